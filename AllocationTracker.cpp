@@ -0,0 +1,291 @@
+#include "AllocationTracker.h"
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+
+#if defined(TRACK_ALLOCATIONS) && defined(_MSC_VER) && defined(_DEBUG)
+#include <crtdbg.h>
+#endif
+
+// everything here is reachable from inside malloc, so it may only use atomics and trivially
+// constructed thread locals: no containers, no locks, nothing that could allocate
+namespace
+{
+    std::atomic<uint64_t> totalAllocations{ 0 };
+    std::atomic<uint64_t> totalBytes{ 0 };
+    std::atomic<uint64_t> frameStartAllocations{ 0 };
+    std::atomic<uint64_t> frameStartBytes{ 0 };
+
+    thread_local uint64_t threadAllocations = 0;
+    thread_local uint64_t threadBytes = 0;
+    // > 0 inside an AllocationIgnoreScope, and while operator new is inside malloc so the
+    // malloc hook doesn't count the same allocation twice
+    thread_local int ignoreDepth = 0;
+
+    const unsigned int MAX_SCOPES = 64;
+
+    struct ScopeSlot
+    {
+        std::atomic<const char*> name{ nullptr };
+        std::atomic<uint64_t> allocations{ 0 };
+        std::atomic<uint64_t> bytes{ 0 };
+        std::atomic<uint64_t> lastFrameAllocations{ 0 };
+        std::atomic<uint64_t> lastFrameBytes{ 0 };
+    };
+    ScopeSlot scopeSlots[MAX_SCOPES];
+
+    // finds the slot for name, claiming a free one the first time a name is seen. Returns
+    // MAX_SCOPES when the table is full; those scopes are simply not reported
+    unsigned int findScope(const char* name)
+    {
+        for (unsigned int i = 0; i < MAX_SCOPES; i++)
+        {
+            const char* slotName = scopeSlots[i].name.load(std::memory_order_acquire);
+            if (slotName == nullptr)
+            {
+                if (scopeSlots[i].name.compare_exchange_strong(slotName, name, std::memory_order_acq_rel))
+                    return i;
+                // another thread claimed it first; slotName now holds its name
+            }
+            if (slotName == name || strcmp(slotName, name) == 0)
+                return i;
+        }
+        return MAX_SCOPES;
+    }
+}
+
+bool AllocationTracker::isEnabled()
+{
+#ifdef TRACK_ALLOCATIONS
+    return true;
+#else
+    return false;
+#endif
+}
+
+AllocationCounts AllocationTracker::total()
+{
+    return { totalAllocations.load(std::memory_order_relaxed), totalBytes.load(std::memory_order_relaxed) };
+}
+
+AllocationCounts AllocationTracker::thread()
+{
+    return { threadAllocations, threadBytes };
+}
+
+AllocationCounts AllocationTracker::beginFrame()
+{
+    AllocationCounts lastFrame = frame();
+    frameStartAllocations.store(totalAllocations.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    frameStartBytes.store(totalBytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    for (ScopeSlot& slot : scopeSlots)
+    {
+        if (slot.name.load(std::memory_order_relaxed) == nullptr)
+            break;
+        slot.lastFrameAllocations.store(slot.allocations.exchange(0, std::memory_order_relaxed), std::memory_order_relaxed);
+        slot.lastFrameBytes.store(slot.bytes.exchange(0, std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+    return lastFrame;
+}
+
+AllocationCounts AllocationTracker::frame()
+{
+    return {
+        totalAllocations.load(std::memory_order_relaxed) - frameStartAllocations.load(std::memory_order_relaxed),
+        totalBytes.load(std::memory_order_relaxed) - frameStartBytes.load(std::memory_order_relaxed)
+    };
+}
+
+void AllocationTracker::printLastFrameScopes()
+{
+    for (ScopeSlot& slot : scopeSlots)
+    {
+        const char* name = slot.name.load(std::memory_order_acquire);
+        if (name == nullptr)
+            break;
+        uint64_t allocations = slot.lastFrameAllocations.load(std::memory_order_relaxed);
+        if (allocations > 0)
+            std::cout << "    " << name << ": " << allocations << " allocations, " << slot.lastFrameBytes.load(std::memory_order_relaxed) << " bytes" << std::endl;
+    }
+}
+
+void AllocationTracker::recordAllocation(size_t bytes)
+{
+    if (ignoreDepth > 0)
+        return;
+    totalAllocations.fetch_add(1, std::memory_order_relaxed);
+    totalBytes.fetch_add(bytes, std::memory_order_relaxed);
+    threadAllocations++;
+    threadBytes += bytes;
+}
+
+AllocationScope::AllocationScope(const char* name) : slot(findScope(name)), start(AllocationTracker::thread())
+{
+}
+
+AllocationScope::~AllocationScope()
+{
+    if (slot == MAX_SCOPES)
+        return;
+    AllocationCounts end = AllocationTracker::thread();
+    if (end.allocations == start.allocations)
+        return;
+    scopeSlots[slot].allocations.fetch_add(end.allocations - start.allocations, std::memory_order_relaxed);
+    scopeSlots[slot].bytes.fetch_add(end.bytes - start.bytes, std::memory_order_relaxed);
+}
+
+AllocationIgnoreScope::AllocationIgnoreScope()
+{
+    ignoreDepth++;
+}
+
+AllocationIgnoreScope::~AllocationIgnoreScope()
+{
+    ignoreDepth--;
+}
+
+#ifdef TRACK_ALLOCATIONS
+
+// malloc: glibc lets the executable interpose it and still reach the real allocator, and the
+// MSVC debug runtime calls a hook before every allocation. Release MSVC runtimes have no
+// hook, so there only operator new is counted.
+#if defined(__GLIBC__)
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* pointer, size_t size);
+
+extern "C" void* malloc(size_t size) noexcept
+{
+    AllocationTracker::recordAllocation(size);
+    return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size) noexcept
+{
+    AllocationTracker::recordAllocation(count * size);
+    return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void* pointer, size_t size) noexcept
+{
+    AllocationTracker::recordAllocation(size);
+    return __libc_realloc(pointer, size);
+}
+#elif defined(_MSC_VER) && defined(_DEBUG)
+static int crtAllocationHook(int allocationType, void*, size_t size, int, long, const unsigned char*, int)
+{
+    if (allocationType == _HOOK_ALLOC || allocationType == _HOOK_REALLOC)
+        AllocationTracker::recordAllocation(size);
+    return 1;
+}
+
+static const bool crtAllocationHookInstalled = (_CrtSetAllocHook(crtAllocationHook), true);
+#endif
+
+// operator new counts the request itself and keeps the malloc hook quiet underneath it
+static void* trackedAllocate(size_t size)
+{
+    AllocationTracker::recordAllocation(size);
+    ignoreDepth++;
+    void* pointer = malloc(size == 0 ? 1 : size);
+    ignoreDepth--;
+    return pointer;
+}
+
+#ifdef __cpp_aligned_new
+static void* trackedAllocateAligned(size_t size, size_t alignment)
+{
+    AllocationTracker::recordAllocation(size);
+    ignoreDepth++;
+    if (size == 0)
+        size = 1;
+#ifdef _MSC_VER
+    void* pointer = _aligned_malloc(size, alignment);
+#else
+    void* pointer = nullptr;
+    if (posix_memalign(&pointer, alignment < sizeof(void*) ? sizeof(void*) : alignment, size) != 0)
+        pointer = nullptr;
+#endif
+    ignoreDepth--;
+    return pointer;
+}
+
+static void freeAligned(void* pointer)
+{
+#ifdef _MSC_VER
+    _aligned_free(pointer);
+#else
+    free(pointer);
+#endif
+}
+
+#endif
+
+void* operator new(size_t size)
+{
+    if (void* pointer = trackedAllocate(size))
+        return pointer;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size)
+{
+    if (void* pointer = trackedAllocate(size))
+        return pointer;
+    throw std::bad_alloc();
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    return trackedAllocate(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+    return trackedAllocate(size);
+}
+
+void operator delete(void* pointer) noexcept { free(pointer); }
+void operator delete[](void* pointer) noexcept { free(pointer); }
+void operator delete(void* pointer, size_t) noexcept { free(pointer); }
+void operator delete[](void* pointer, size_t) noexcept { free(pointer); }
+void operator delete(void* pointer, const std::nothrow_t&) noexcept { free(pointer); }
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept { free(pointer); }
+
+// the aligned forms exist from C++17 on
+#ifdef __cpp_aligned_new
+void* operator new(size_t size, std::align_val_t alignment)
+{
+    if (void* pointer = trackedAllocateAligned(size, static_cast<size_t>(alignment)))
+        return pointer;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+    if (void* pointer = trackedAllocateAligned(size, static_cast<size_t>(alignment)))
+        return pointer;
+    throw std::bad_alloc();
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    return trackedAllocateAligned(size, static_cast<size_t>(alignment));
+}
+
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    return trackedAllocateAligned(size, static_cast<size_t>(alignment));
+}
+
+void operator delete(void* pointer, std::align_val_t) noexcept { freeAligned(pointer); }
+void operator delete[](void* pointer, std::align_val_t) noexcept { freeAligned(pointer); }
+void operator delete(void* pointer, size_t, std::align_val_t) noexcept { freeAligned(pointer); }
+void operator delete[](void* pointer, size_t, std::align_val_t) noexcept { freeAligned(pointer); }
+void operator delete(void* pointer, std::align_val_t, const std::nothrow_t&) noexcept { freeAligned(pointer); }
+void operator delete[](void* pointer, std::align_val_t, const std::nothrow_t&) noexcept { freeAligned(pointer); }
+#endif
+
+#endif
@@ -0,0 +1,64 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Counts every heap allocation the program makes. Builds with TRACK_ALLOCATIONS defined (the
+// Debug configurations, or any build used for benchmarking) replace the global operator new
+// and hook malloc where the C runtime allows it; other builds compile the same calls to
+// counters that never move.
+struct AllocationCounts
+{
+    uint64_t allocations;
+    uint64_t bytes;
+};
+
+class AllocationTracker
+{
+public:
+    static bool isEnabled();
+
+    // all threads since startup
+    static AllocationCounts total();
+    // the calling thread since it started
+    static AllocationCounts thread();
+
+    // starts a new frame and returns what the one before it allocated; frame() is everything
+    // allocated by any thread since then, and every scope's counts move to "last frame"
+    static AllocationCounts beginFrame();
+    static AllocationCounts frame();
+
+    // prints last frame's allocations per scope, skipping the scopes that allocated nothing
+    static void printLastFrameScopes();
+
+    // called by the hooks
+    static void recordAllocation(size_t bytes);
+};
+
+// Attributes the allocations made on this thread during its lifetime to a named scope (the
+// same names the frame is split into for profiling). Scopes nest; an allocation counts in
+// every open scope. The name must outlive the program, in practice a string literal.
+class AllocationScope
+{
+public:
+    explicit AllocationScope(const char* name);
+    ~AllocationScope();
+
+    AllocationScope(const AllocationScope&) = delete;
+    AllocationScope& operator=(const AllocationScope&) = delete;
+
+private:
+    unsigned int slot;
+    AllocationCounts start;
+};
+
+// Allocations made on this thread while one of these is alive are not counted. Meant for
+// calls into code we don't own that allocate by design (window system, driver present).
+class AllocationIgnoreScope
+{
+public:
+    AllocationIgnoreScope();
+    ~AllocationIgnoreScope();
+
+    AllocationIgnoreScope(const AllocationIgnoreScope&) = delete;
+    AllocationIgnoreScope& operator=(const AllocationIgnoreScope&) = delete;
+};
@@ -0,0 +1,258 @@
+#include "BatchTransform.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+
+glm::mat4 AffineTransform::toMat4() const
+{
+    // glm is column major, so row r of the transform is element [c][r]
+    glm::mat4 result(1.0f);
+    for (int r = 0; r < 3; r++)
+        for (int c = 0; c < 4; c++)
+            result[c][r] = rows[r][c];
+    return result;
+}
+
+void TransformSoA::resize(size_t count)
+{
+    positionX.resize(count, 0.0f);
+    positionY.resize(count, 0.0f);
+    positionZ.resize(count, 0.0f);
+    rotationX.resize(count, 0.0f);
+    rotationY.resize(count, 0.0f);
+    rotationZ.resize(count, 0.0f);
+    rotationW.resize(count, 1.0f);
+    scaleX.resize(count, 1.0f);
+    scaleY.resize(count, 1.0f);
+    scaleZ.resize(count, 1.0f);
+}
+
+void TransformSoA::set(size_t index, const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale)
+{
+    positionX[index] = position.x;
+    positionY[index] = position.y;
+    positionZ[index] = position.z;
+    rotationX[index] = rotation.x;
+    rotationY[index] = rotation.y;
+    rotationZ[index] = rotation.z;
+    rotationW[index] = rotation.w;
+    scaleX[index] = scale.x;
+    scaleY[index] = scale.y;
+    scaleZ[index] = scale.z;
+}
+
+static void composeOne(const TransformSoA& t, size_t i, AffineTransform& out)
+{
+    float x = t.rotationX[i], y = t.rotationY[i], z = t.rotationZ[i], w = t.rotationW[i];
+    float xx = x * x, yy = y * y, zz = z * z;
+    float xy = x * y, xz = x * z, yz = y * z;
+    float wx = w * x, wy = w * y, wz = w * z;
+    float sx = t.scaleX[i], sy = t.scaleY[i], sz = t.scaleZ[i];
+
+    out.rows[0][0] = (1.0f - 2.0f * (yy + zz)) * sx;
+    out.rows[0][1] = 2.0f * (xy - wz) * sy;
+    out.rows[0][2] = 2.0f * (xz + wy) * sz;
+    out.rows[0][3] = t.positionX[i];
+    out.rows[1][0] = 2.0f * (xy + wz) * sx;
+    out.rows[1][1] = (1.0f - 2.0f * (xx + zz)) * sy;
+    out.rows[1][2] = 2.0f * (yz - wx) * sz;
+    out.rows[1][3] = t.positionY[i];
+    out.rows[2][0] = 2.0f * (xz - wy) * sx;
+    out.rows[2][1] = 2.0f * (yz + wx) * sy;
+    out.rows[2][2] = (1.0f - 2.0f * (xx + yy)) * sz;
+    out.rows[2][3] = t.positionZ[i];
+}
+
+void composeTransformsScalar(const TransformSoA& transforms, size_t first, size_t count, AffineTransform* out)
+{
+    for (size_t i = 0; i < count; i++)
+        composeOne(transforms, first + i, out[i]);
+}
+
+#if GLM_ARCH & GLM_ARCH_AVX2_BIT
+
+// 8 objects per iteration; the 12 matrix elements are computed as SoA registers and
+// transposed 4x4 within each 128-bit lane on the way out
+void composeTransforms(const TransformSoA& t, size_t first, size_t count, AffineTransform* out)
+{
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 two = _mm256_set1_ps(2.0f);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        size_t s = first + i;
+        __m256 x = _mm256_loadu_ps(&t.rotationX[s]);
+        __m256 y = _mm256_loadu_ps(&t.rotationY[s]);
+        __m256 z = _mm256_loadu_ps(&t.rotationZ[s]);
+        __m256 w = _mm256_loadu_ps(&t.rotationW[s]);
+        __m256 sx = _mm256_loadu_ps(&t.scaleX[s]);
+        __m256 sy = _mm256_loadu_ps(&t.scaleY[s]);
+        __m256 sz = _mm256_loadu_ps(&t.scaleZ[s]);
+
+        // pre-doubled products save the multiply by two on every term
+        __m256 x2 = _mm256_mul_ps(x, two), y2 = _mm256_mul_ps(y, two), z2 = _mm256_mul_ps(z, two);
+        __m256 xx = _mm256_mul_ps(x, x2), yy = _mm256_mul_ps(y, y2), zz = _mm256_mul_ps(z, z2);
+        __m256 xy = _mm256_mul_ps(x, y2), xz = _mm256_mul_ps(x, z2), yz = _mm256_mul_ps(y, z2);
+        __m256 wx = _mm256_mul_ps(w, x2), wy = _mm256_mul_ps(w, y2), wz = _mm256_mul_ps(w, z2);
+
+        __m256 m[3][4];
+        m[0][0] = _mm256_mul_ps(_mm256_sub_ps(one, _mm256_add_ps(yy, zz)), sx);
+        m[0][1] = _mm256_mul_ps(_mm256_sub_ps(xy, wz), sy);
+        m[0][2] = _mm256_mul_ps(_mm256_add_ps(xz, wy), sz);
+        m[0][3] = _mm256_loadu_ps(&t.positionX[s]);
+        m[1][0] = _mm256_mul_ps(_mm256_add_ps(xy, wz), sx);
+        m[1][1] = _mm256_mul_ps(_mm256_sub_ps(one, _mm256_add_ps(xx, zz)), sy);
+        m[1][2] = _mm256_mul_ps(_mm256_sub_ps(yz, wx), sz);
+        m[1][3] = _mm256_loadu_ps(&t.positionY[s]);
+        m[2][0] = _mm256_mul_ps(_mm256_sub_ps(xz, wy), sx);
+        m[2][1] = _mm256_mul_ps(_mm256_add_ps(yz, wx), sy);
+        m[2][2] = _mm256_mul_ps(_mm256_sub_ps(one, _mm256_add_ps(xx, yy)), sz);
+        m[2][3] = _mm256_loadu_ps(&t.positionZ[s]);
+
+        for (int r = 0; r < 3; r++)
+        {
+            __m256 t0 = _mm256_unpacklo_ps(m[r][0], m[r][1]);
+            __m256 t1 = _mm256_unpackhi_ps(m[r][0], m[r][1]);
+            __m256 t2 = _mm256_unpacklo_ps(m[r][2], m[r][3]);
+            __m256 t3 = _mm256_unpackhi_ps(m[r][2], m[r][3]);
+            // each register now holds row r of object k in its low lane and of object k + 4 in its high lane
+            __m256 o0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+            __m256 o1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+            __m256 o2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+            __m256 o3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+            _mm_storeu_ps(out[i + 0].rows[r], _mm256_castps256_ps128(o0));
+            _mm_storeu_ps(out[i + 1].rows[r], _mm256_castps256_ps128(o1));
+            _mm_storeu_ps(out[i + 2].rows[r], _mm256_castps256_ps128(o2));
+            _mm_storeu_ps(out[i + 3].rows[r], _mm256_castps256_ps128(o3));
+            _mm_storeu_ps(out[i + 4].rows[r], _mm256_extractf128_ps(o0, 1));
+            _mm_storeu_ps(out[i + 5].rows[r], _mm256_extractf128_ps(o1, 1));
+            _mm_storeu_ps(out[i + 6].rows[r], _mm256_extractf128_ps(o2, 1));
+            _mm_storeu_ps(out[i + 7].rows[r], _mm256_extractf128_ps(o3, 1));
+        }
+    }
+    composeTransformsScalar(t, first + i, count - i, out + i);
+}
+
+#elif GLM_ARCH & GLM_ARCH_SSE2_BIT
+
+// 4 objects per iteration, same scheme as the AVX2 path
+void composeTransforms(const TransformSoA& t, size_t first, size_t count, AffineTransform* out)
+{
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 two = _mm_set1_ps(2.0f);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        size_t s = first + i;
+        __m128 x = _mm_loadu_ps(&t.rotationX[s]);
+        __m128 y = _mm_loadu_ps(&t.rotationY[s]);
+        __m128 z = _mm_loadu_ps(&t.rotationZ[s]);
+        __m128 w = _mm_loadu_ps(&t.rotationW[s]);
+        __m128 sx = _mm_loadu_ps(&t.scaleX[s]);
+        __m128 sy = _mm_loadu_ps(&t.scaleY[s]);
+        __m128 sz = _mm_loadu_ps(&t.scaleZ[s]);
+
+        __m128 x2 = _mm_mul_ps(x, two), y2 = _mm_mul_ps(y, two), z2 = _mm_mul_ps(z, two);
+        __m128 xx = _mm_mul_ps(x, x2), yy = _mm_mul_ps(y, y2), zz = _mm_mul_ps(z, z2);
+        __m128 xy = _mm_mul_ps(x, y2), xz = _mm_mul_ps(x, z2), yz = _mm_mul_ps(y, z2);
+        __m128 wx = _mm_mul_ps(w, x2), wy = _mm_mul_ps(w, y2), wz = _mm_mul_ps(w, z2);
+
+        __m128 m[3][4];
+        m[0][0] = _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(yy, zz)), sx);
+        m[0][1] = _mm_mul_ps(_mm_sub_ps(xy, wz), sy);
+        m[0][2] = _mm_mul_ps(_mm_add_ps(xz, wy), sz);
+        m[0][3] = _mm_loadu_ps(&t.positionX[s]);
+        m[1][0] = _mm_mul_ps(_mm_add_ps(xy, wz), sx);
+        m[1][1] = _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(xx, zz)), sy);
+        m[1][2] = _mm_mul_ps(_mm_sub_ps(yz, wx), sz);
+        m[1][3] = _mm_loadu_ps(&t.positionY[s]);
+        m[2][0] = _mm_mul_ps(_mm_sub_ps(xz, wy), sx);
+        m[2][1] = _mm_mul_ps(_mm_add_ps(yz, wx), sy);
+        m[2][2] = _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(xx, yy)), sz);
+        m[2][3] = _mm_loadu_ps(&t.positionZ[s]);
+
+        for (int r = 0; r < 3; r++)
+        {
+            __m128 r0 = m[r][0], r1 = m[r][1], r2 = m[r][2], r3 = m[r][3];
+            _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+            _mm_storeu_ps(out[i + 0].rows[r], r0);
+            _mm_storeu_ps(out[i + 1].rows[r], r1);
+            _mm_storeu_ps(out[i + 2].rows[r], r2);
+            _mm_storeu_ps(out[i + 3].rows[r], r3);
+        }
+    }
+    composeTransformsScalar(t, first + i, count - i, out + i);
+}
+
+#else
+
+void composeTransforms(const TransformSoA& transforms, size_t first, size_t count, AffineTransform* out)
+{
+    composeTransformsScalar(transforms, first, count, out);
+}
+
+#endif
+
+void runTransformBenchmark()
+{
+#if GLM_ARCH & GLM_ARCH_AVX2_BIT
+    const char* path = "AVX2";
+#elif GLM_ARCH & GLM_ARCH_SSE2_BIT
+    const char* path = "SSE2";
+#else
+    const char* path = "scalar";
+#endif
+    // every size composes about the same number of transforms so the timings are comparable
+    const size_t TRANSFORMS_PER_SIZE = 10000000;
+    std::cout << "transform composition: " << path << ", one thread" << std::endl;
+    for (size_t count : { (size_t)1000, (size_t)10000, (size_t)100000, (size_t)1000000 })
+    {
+        std::mt19937 random(1);
+        std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+        TransformSoA transforms;
+        transforms.resize(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            glm::vec3 axis = glm::normalize(glm::vec3(unit(random), unit(random), unit(random)) + glm::vec3(0.0f, 0.0f, 2.0f));
+            transforms.set(i, 100.0f * glm::vec3(unit(random), unit(random), unit(random)), glm::angleAxis(3.14159265f * unit(random), axis),
+                glm::vec3(1.5f) + glm::vec3(unit(random), unit(random), unit(random)));
+        }
+        std::vector<AffineTransform> simd(count), scalar(count);
+        std::vector<glm::mat4> models(count);
+        const size_t iterations = TRANSFORMS_PER_SIZE / count;
+
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < iterations; i++)
+            composeTransforms(transforms, 0, count, simd.data());
+        double simdSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < iterations; i++)
+            composeTransformsScalar(transforms, 0, count, scalar.data());
+        double scalarSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < iterations; i++)
+            for (size_t j = 0; j < count; j++)
+            {
+                glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(transforms.positionX[j], transforms.positionY[j], transforms.positionZ[j]));
+                model = model * glm::mat4_cast(glm::quat(transforms.rotationW[j], transforms.rotationX[j], transforms.rotationY[j], transforms.rotationZ[j]));
+                models[j] = glm::scale(model, glm::vec3(transforms.scaleX[j], transforms.scaleY[j], transforms.scaleZ[j]));
+            }
+        double glmSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        // largest difference from glm, relative to the size of the element
+        float error = 0.0f;
+        for (size_t i = 0; i < count; i++)
+        {
+            glm::mat4 model = simd[i].toMat4();
+            for (int c = 0; c < 4; c++)
+                for (int r = 0; r < 4; r++)
+                    error = std::max(error, std::fabs(model[c][r] - models[i][c][r]) / (1.0f + std::fabs(models[i][c][r])));
+        }
+        const double millions = (double)count * iterations / 1e6;
+        std::cout << count << " transforms: " << millions / simdSeconds << "M/s (scalar " << millions / scalarSeconds
+            << "M/s, glm " << millions / glmSeconds << "M/s), largest relative difference from glm " << error << std::endl;
+    }
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <vector>
+#include <cstddef>
+
+// Affine object-to-world transform stored as the top three rows of a 4x4 matrix, row major.
+// Each row is (rotation * scale | translation), so it uploads as three vec4 instance attributes.
+struct AffineTransform
+{
+    float rows[3][4];
+
+    glm::mat4 toMat4() const;
+};
+
+// Translation, rotation and scale for many objects, one array per component so
+// they can be loaded straight into SIMD registers.
+struct TransformSoA
+{
+    std::vector<float> positionX, positionY, positionZ;
+    std::vector<float> rotationX, rotationY, rotationZ, rotationW; // unit quaternions
+    std::vector<float> scaleX, scaleY, scaleZ;
+
+    size_t size() const { return positionX.size(); }
+    void resize(size_t count);
+    void set(size_t index, const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale);
+};
+
+// Writes T * R * S for objects [first, first + count) to out[0 .. count). Uses AVX2 or SSE2
+// depending on what glm detected for the build (GLM_ARCH), falling back to scalar code.
+void composeTransforms(const TransformSoA& transforms, size_t first, size_t count, AffineTransform* out);
+// scalar reference version of composeTransforms
+void composeTransformsScalar(const TransformSoA& transforms, size_t first, size_t count, AffineTransform* out);
+
+// Times composeTransforms, composeTransformsScalar and the per-object glm translate/rotate/scale
+// they replace over 1K to 1M transforms and prints the results; "--transform-benchmark" runs it
+// without opening a window
+void runTransformBenchmark();
@@ -0,0 +1,669 @@
+#include "Bvh.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <limits>
+#include <cmath>
+
+static const int BIN_COUNT = 16;
+// ranges this small go to a worker whole rather than being split any further here
+static const uint32_t PARALLEL_THRESHOLD = 4096;
+// cost of visiting a node relative to testing one object, for the SAH
+static const float TRAVERSAL_COST = 1.0f;
+
+static float surfaceArea(const glm::vec3& min, const glm::vec3& max)
+{
+    glm::vec3 extent = glm::max(max - min, glm::vec3(0.0f));
+    return 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+}
+
+// objects are partitioned by value while building so each level streams through contiguous memory
+struct BvhBuildPrimitive
+{
+    glm::vec3 min;
+    uint32_t object;
+    glm::vec3 max;
+    float padding;
+
+    glm::vec3 centroid() const { return (min + max) * 0.5f; }
+};
+
+// a subtree still to be built: its root node and the range of primitives under it
+struct BvhBuildTask
+{
+    uint32_t node;
+    uint32_t first;
+    uint32_t count;
+};
+
+void Bvh::build(const AabbSoA& boxes)
+{
+    buildTree(boxes, nullptr);
+}
+
+void Bvh::build(const AabbSoA& boxes, JobSystem& jobs)
+{
+    buildTree(boxes, &jobs);
+}
+
+void Bvh::buildTree(const AabbSoA& boxes, JobSystem* jobs)
+{
+    uint32_t count = (uint32_t)boxes.size();
+    std::vector<BvhBuildPrimitive> primitives(count);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        primitives[i].min = glm::vec3(boxes.minX[i], boxes.minY[i], boxes.minZ[i]);
+        primitives[i].max = glm::vec3(boxes.maxX[i], boxes.maxY[i], boxes.maxZ[i]);
+        primitives[i].object = i;
+    }
+
+    nodes.clear();
+    nodes4.clear();
+    wideDepth = 0;
+    objects.resize(count);
+    bounds.resize(count);
+    if (count == 0)
+        return;
+
+    // a binary tree over n objects never needs more than 2n - 1 nodes
+    nodes.resize(2 * (size_t)count);
+    std::atomic<uint32_t> nodeCount(1);
+
+    // the top of the tree is split here, largest range first, until there are a few subtrees
+    // for every worker to take
+    std::vector<BvhBuildTask> subtrees(1, BvhBuildTask{ 0, 0, count });
+    size_t targetSubtrees = jobs && jobs->threadCount() > 1 ? (size_t)jobs->threadCount() * 4 : 1;
+    while (subtrees.size() < targetSubtrees)
+    {
+        size_t largest = 0;
+        for (size_t i = 1; i < subtrees.size(); i++)
+            if (subtrees[i].count > subtrees[largest].count)
+                largest = i;
+        BvhBuildTask task = subtrees[largest];
+        if (task.count <= PARALLEL_THRESHOLD)
+            break;
+        uint32_t leftCount = splitNode(task.node, task.first, task.count, primitives.data(), nodeCount);
+        uint32_t left = nodes[task.node].leftFirst;
+        subtrees[largest] = BvhBuildTask{ left, task.first, leftCount };
+        subtrees.push_back(BvhBuildTask{ left + 1, task.first + leftCount, task.count - leftCount });
+    }
+
+    if (subtrees.size() > 1)
+    {
+        jobs->parallelFor(subtrees.size(), [&](size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; i++)
+                buildSubtree(subtrees[i], primitives.data(), nodeCount);
+        });
+    }
+    else
+    {
+        buildSubtree(subtrees[0], primitives.data(), nodeCount);
+    }
+    nodes.resize(nodeCount.load());
+
+    // the primitives are now in leaf order
+    for (uint32_t i = 0; i < count; i++)
+    {
+        objects[i] = primitives[i].object;
+        bounds[i].min = primitives[i].min;
+        bounds[i].max = primitives[i].max;
+    }
+
+    collapse();
+}
+
+// An explicit stack rather than recursion: skewed inputs (centroids at geometrically growing
+// distances, say) peel a few objects off per split, so the tree can be about as deep as it is long
+void Bvh::buildSubtree(const BvhBuildTask& root, BvhBuildPrimitive* primitives, std::atomic<uint32_t>& nodeCount)
+{
+    std::vector<BvhBuildTask> stack(1, root);
+    while (!stack.empty())
+    {
+        BvhBuildTask task = stack.back();
+        stack.pop_back();
+        uint32_t leftCount = splitNode(task.node, task.first, task.count, primitives, nodeCount);
+        if (leftCount == 0)
+            continue;
+        uint32_t left = nodes[task.node].leftFirst;
+        stack.push_back(BvhBuildTask{ left + 1, task.first + leftCount, task.count - leftCount });
+        stack.push_back(BvhBuildTask{ left, task.first, leftCount });
+    }
+}
+
+// Fits the node to its range and either leaves it a leaf (returns 0) or partitions the range
+// and allocates the two children at node.leftFirst, returning how many objects went left
+uint32_t Bvh::splitNode(uint32_t nodeIndex, uint32_t first, uint32_t count, BvhBuildPrimitive* primitives, std::atomic<uint32_t>& nodeCount)
+{
+    BvhNode& node = nodes[nodeIndex];
+    glm::vec3 centroidMin(std::numeric_limits<float>::max()), centroidMax(-std::numeric_limits<float>::max());
+    node.min = glm::vec3(std::numeric_limits<float>::max());
+    node.max = glm::vec3(-std::numeric_limits<float>::max());
+    for (uint32_t i = first; i < first + count; i++)
+    {
+        node.min = glm::min(node.min, primitives[i].min);
+        node.max = glm::max(node.max, primitives[i].max);
+        glm::vec3 centroid = primitives[i].centroid();
+        centroidMin = glm::min(centroidMin, centroid);
+        centroidMax = glm::max(centroidMax, centroid);
+    }
+    node.leftFirst = first;
+    node.count = count;
+    if (count == 1)
+        return 0;
+
+    // binned SAH: drop centroids into bins along all three axes in one pass, then sweep each
+    // axis for the cheapest split plane
+    struct Bin
+    {
+        glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+        glm::vec3 max = glm::vec3(-std::numeric_limits<float>::max());
+        uint32_t count = 0;
+    } bins[3][BIN_COUNT];
+    glm::vec3 extent = centroidMax - centroidMin;
+    glm::vec3 scale;
+    for (int axis = 0; axis < 3; axis++)
+        scale[axis] = extent[axis] > 0.0f ? BIN_COUNT / extent[axis] : 0.0f;
+    for (uint32_t i = first; i < first + count; i++)
+    {
+        const BvhBuildPrimitive& primitive = primitives[i];
+        glm::vec3 position = (primitive.centroid() - centroidMin) * scale;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            Bin& bin = bins[axis][std::min(BIN_COUNT - 1, (int)position[axis])];
+            bin.count++;
+            bin.min = glm::min(bin.min, primitive.min);
+            bin.max = glm::max(bin.max, primitive.max);
+        }
+    }
+
+    int bestAxis = -1, bestSplit = 0;
+    float bestCost = std::numeric_limits<float>::max();
+    for (int axis = 0; axis < 3; axis++)
+    {
+        if (extent[axis] <= 0.0f)
+            continue;
+        float leftArea[BIN_COUNT - 1];
+        uint32_t leftCount[BIN_COUNT - 1];
+        glm::vec3 sweepMin(std::numeric_limits<float>::max()), sweepMax(-std::numeric_limits<float>::max());
+        uint32_t sweepCount = 0;
+        for (int i = 0; i < BIN_COUNT - 1; i++)
+        {
+            sweepCount += bins[axis][i].count;
+            sweepMin = glm::min(sweepMin, bins[axis][i].min);
+            sweepMax = glm::max(sweepMax, bins[axis][i].max);
+            leftCount[i] = sweepCount;
+            leftArea[i] = sweepCount ? surfaceArea(sweepMin, sweepMax) : 0.0f;
+        }
+        sweepMin = glm::vec3(std::numeric_limits<float>::max());
+        sweepMax = glm::vec3(-std::numeric_limits<float>::max());
+        sweepCount = 0;
+        for (int i = BIN_COUNT - 1; i > 0; i--)
+        {
+            sweepCount += bins[axis][i].count;
+            sweepMin = glm::min(sweepMin, bins[axis][i].min);
+            sweepMax = glm::max(sweepMax, bins[axis][i].max);
+            if (leftCount[i - 1] == 0 || sweepCount == 0)
+                continue;
+            float cost = leftCount[i - 1] * leftArea[i - 1] + sweepCount * surfaceArea(sweepMin, sweepMax);
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = i;
+            }
+        }
+    }
+
+    // stay a leaf when splitting doesn't pay for the extra traversal step
+    float nodeArea = surfaceArea(node.min, node.max);
+    if (count <= MAX_LEAF_SIZE && (bestAxis < 0 || bestCost + TRAVERSAL_COST * nodeArea >= count * nodeArea))
+        return 0;
+
+    BvhBuildPrimitive* begin = primitives + first;
+    BvhBuildPrimitive* middle;
+    if (bestAxis >= 0)
+    {
+        middle = std::partition(begin, begin + count, [&](const BvhBuildPrimitive& primitive)
+        {
+            int bin = std::min(BIN_COUNT - 1, (int)((primitive.centroid()[bestAxis] - centroidMin[bestAxis]) * scale[bestAxis]));
+            return bin < bestSplit;
+        });
+    }
+    else
+    {
+        // every centroid is in the same place, so just halve the range
+        middle = begin + count / 2;
+    }
+    uint32_t leftCount = (uint32_t)(middle - begin);
+
+    uint32_t left = nodeCount.fetch_add(2);
+    node.leftFirst = left;
+    node.count = 0;
+    return leftCount;
+}
+
+void Bvh::refit(const AabbSoA& boxes)
+{
+    for (size_t i = 0; i < objects.size(); i++)
+    {
+        uint32_t object = objects[i];
+        bounds[i].min = glm::vec3(boxes.minX[object], boxes.minY[object], boxes.minZ[object]);
+        bounds[i].max = glm::vec3(boxes.maxX[object], boxes.maxY[object], boxes.maxZ[object]);
+    }
+
+    // children are always allocated after their parent, so a reverse sweep visits them first
+    for (size_t n = nodes.size(); n-- > 0;)
+    {
+        BvhNode& node = nodes[n];
+        if (node.isLeaf())
+        {
+            node.min = bounds[node.leftFirst].min;
+            node.max = bounds[node.leftFirst].max;
+            for (uint32_t i = node.leftFirst + 1; i < node.leftFirst + node.count; i++)
+            {
+                node.min = glm::min(node.min, bounds[i].min);
+                node.max = glm::max(node.max, bounds[i].max);
+            }
+        }
+        else
+        {
+            const BvhNode& left = nodes[node.leftFirst];
+            const BvhNode& right = nodes[node.leftFirst + 1];
+            node.min = glm::min(left.min, right.min);
+            node.max = glm::max(left.max, right.max);
+        }
+    }
+    collapse();
+}
+
+void Bvh::collapse()
+{
+    nodes4.clear();
+    wideDepth = 0;
+    if (nodes.empty())
+        return;
+    nodes4.reserve(nodes.size() / 2 + 1);
+
+    // Pulls grandchildren up into four-wide nodes, always opening the largest interior child
+    // first. Iterative like the build, since the binary tree can be very deep
+    struct Pending
+    {
+        uint32_t binary;
+        uint32_t parent; // wide node whose child slot links to this one, EMPTY for the root
+        int slot;
+        uint32_t depth;
+    };
+    std::vector<Pending> pending(1, Pending{ 0, Bvh4Node::EMPTY, 0, 1 });
+    while (!pending.empty())
+    {
+        Pending current = pending.back();
+        pending.pop_back();
+        wideDepth = std::max(wideDepth, current.depth);
+
+        uint32_t children[4];
+        int childCount = 0;
+        const BvhNode& root = nodes[current.binary];
+        if (root.isLeaf())
+        {
+            children[childCount++] = current.binary;
+        }
+        else
+        {
+            children[childCount++] = root.leftFirst;
+            children[childCount++] = root.leftFirst + 1;
+        }
+        while (childCount < 4)
+        {
+            int largest = -1;
+            float largestArea = -1.0f;
+            for (int i = 0; i < childCount; i++)
+            {
+                const BvhNode& child = nodes[children[i]];
+                float area = surfaceArea(child.min, child.max);
+                if (!child.isLeaf() && area > largestArea)
+                {
+                    largest = i;
+                    largestArea = area;
+                }
+            }
+            if (largest < 0)
+                break;
+            uint32_t opened = children[largest];
+            children[largest] = nodes[opened].leftFirst;
+            children[childCount++] = nodes[opened].leftFirst + 1;
+        }
+
+        uint32_t wideIndex = (uint32_t)nodes4.size();
+        if (current.parent != Bvh4Node::EMPTY)
+            nodes4[current.parent].child[current.slot] = wideIndex;
+        nodes4.emplace_back();
+        Bvh4Node& wide = nodes4[wideIndex];
+        // children are pushed last to first so the first is collapsed next, keeping the order depth first
+        for (int i = 3; i >= 0; i--)
+        {
+            if (i >= childCount)
+            {
+                // an inverted box fails every test
+                wide.minX[i] = wide.minY[i] = wide.minZ[i] = std::numeric_limits<float>::max();
+                wide.maxX[i] = wide.maxY[i] = wide.maxZ[i] = -std::numeric_limits<float>::max();
+                wide.child[i] = Bvh4Node::EMPTY;
+                wide.count[i] = 0;
+                continue;
+            }
+            const BvhNode& child = nodes[children[i]];
+            wide.minX[i] = child.min.x;
+            wide.minY[i] = child.min.y;
+            wide.minZ[i] = child.min.z;
+            wide.maxX[i] = child.max.x;
+            wide.maxY[i] = child.max.y;
+            wide.maxZ[i] = child.max.z;
+            wide.count[i] = child.count;
+            if (child.isLeaf())
+            {
+                wide.child[i] = child.leftFirst;
+            }
+            else
+            {
+                wide.child[i] = Bvh4Node::EMPTY;
+                pending.push_back(Pending{ children[i], wideIndex, i, current.depth + 1 });
+            }
+        }
+    }
+}
+
+// Tests the four children of a node against the frustum. Returns a bit per child that is at
+// least partly inside, and sets a bit in fullyInside for children entirely inside.
+static unsigned int frustumMask(const Bvh4Node& node, const Frustum& frustum, unsigned int& fullyInside)
+{
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+    __m128 minX = _mm_load_ps(node.minX), minY = _mm_load_ps(node.minY), minZ = _mm_load_ps(node.minZ);
+    __m128 maxX = _mm_load_ps(node.maxX), maxY = _mm_load_ps(node.maxY), maxZ = _mm_load_ps(node.maxZ);
+    __m128 intersects = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    __m128 contained = intersects;
+    for (const glm::vec4& plane : frustum.planes)
+    {
+        __m128 a = _mm_set1_ps(plane.x), b = _mm_set1_ps(plane.y), c = _mm_set1_ps(plane.z), d = _mm_set1_ps(plane.w);
+        // furthest corner along the normal decides intersection, nearest decides containment
+        __m128 farDistance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, plane.x > 0.0f ? maxX : minX), _mm_mul_ps(b, plane.y > 0.0f ? maxY : minY)),
+            _mm_add_ps(_mm_mul_ps(c, plane.z > 0.0f ? maxZ : minZ), d));
+        __m128 nearDistance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, plane.x > 0.0f ? minX : maxX), _mm_mul_ps(b, plane.y > 0.0f ? minY : maxY)),
+            _mm_add_ps(_mm_mul_ps(c, plane.z > 0.0f ? minZ : maxZ), d));
+        intersects = _mm_and_ps(intersects, _mm_cmpge_ps(farDistance, _mm_setzero_ps()));
+        contained = _mm_and_ps(contained, _mm_cmpge_ps(nearDistance, _mm_setzero_ps()));
+    }
+    unsigned int mask = (unsigned int)_mm_movemask_ps(intersects);
+    fullyInside = mask & (unsigned int)_mm_movemask_ps(contained);
+    return mask;
+#else
+    unsigned int mask = 0;
+    fullyInside = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        glm::vec3 min(node.minX[i], node.minY[i], node.minZ[i]), max(node.maxX[i], node.maxY[i], node.maxZ[i]);
+        bool intersects = true, contained = true;
+        for (const glm::vec4& plane : frustum.planes)
+        {
+            glm::vec3 normal(plane);
+            glm::vec3 farCorner(plane.x > 0.0f ? max.x : min.x, plane.y > 0.0f ? max.y : min.y, plane.z > 0.0f ? max.z : min.z);
+            glm::vec3 nearCorner(plane.x > 0.0f ? min.x : max.x, plane.y > 0.0f ? min.y : max.y, plane.z > 0.0f ? min.z : max.z);
+            intersects = intersects && glm::dot(normal, farCorner) + plane.w >= 0.0f;
+            contained = contained && glm::dot(normal, nearCorner) + plane.w >= 0.0f;
+        }
+        if (intersects)
+            mask |= 1u << i;
+        if (intersects && contained)
+            fullyInside |= 1u << i;
+    }
+    return mask;
+#endif
+}
+
+size_t Bvh::queryFrustum(const Frustum& frustum, uint32_t* visible) const
+{
+    if (nodes4.empty())
+        return 0;
+
+    uint32_t localStack[LOCAL_STACK_SIZE];
+    std::vector<uint32_t> heapStack;
+    uint32_t* stack = localStack;
+    if (traversalStackSize() > LOCAL_STACK_SIZE)
+    {
+        heapStack.resize(traversalStackSize());
+        stack = heapStack.data();
+    }
+
+    // nothing below a fully contained node needs testing; such nodes carry this bit on the stack
+    const uint32_t CONTAINED = 0x80000000u;
+    uint32_t* out = visible;
+    size_t stackSize = 0;
+    stack[stackSize++] = 0;
+    while (stackSize > 0)
+    {
+        uint32_t entry = stack[--stackSize];
+        const Bvh4Node& node = nodes4[entry & ~CONTAINED];
+        unsigned int fullyInside = 0xF;
+        unsigned int mask = 0xF;
+        if (!(entry & CONTAINED))
+            mask = frustumMask(node, frustum, fullyInside);
+        for (int i = 0; i < 4; i++)
+        {
+            if (!(mask & (1u << i)))
+                continue;
+            bool contained = (fullyInside & (1u << i)) != 0;
+            if (node.count[i] > 0)
+            {
+                for (uint32_t p = node.child[i]; p < node.child[i] + node.count[i]; p++)
+                    if (contained || frustum.intersectsAabb(bounds[p].min, bounds[p].max))
+                        *out++ = objects[p];
+            }
+            else if (node.child[i] != Bvh4Node::EMPTY)
+            {
+                stack[stackSize++] = node.child[i] | (contained ? CONTAINED : 0u);
+            }
+        }
+    }
+    return out - visible;
+}
+
+// Slab test of the ray against the four children. Returns a bit per child hit closer than
+// maxDistance and writes the entry distances. The near slab is picked from the ray's direction
+// rather than with min/max, so the inverted boxes of empty slots never pass.
+static unsigned int rayMask(const Bvh4Node& node, const glm::vec3& origin, const glm::vec3& inverseDirection, float maxDistance, float entry[4])
+{
+    bool px = inverseDirection.x >= 0.0f, py = inverseDirection.y >= 0.0f, pz = inverseDirection.z >= 0.0f;
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+    __m128 ox = _mm_set1_ps(origin.x), oy = _mm_set1_ps(origin.y), oz = _mm_set1_ps(origin.z);
+    __m128 ix = _mm_set1_ps(inverseDirection.x), iy = _mm_set1_ps(inverseDirection.y), iz = _mm_set1_ps(inverseDirection.z);
+    __m128 nearX = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(px ? node.minX : node.maxX), ox), ix);
+    __m128 farX = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(px ? node.maxX : node.minX), ox), ix);
+    __m128 nearY = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(py ? node.minY : node.maxY), oy), iy);
+    __m128 farY = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(py ? node.maxY : node.minY), oy), iy);
+    __m128 nearZ = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(pz ? node.minZ : node.maxZ), oz), iz);
+    __m128 farZ = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(pz ? node.maxZ : node.minZ), oz), iz);
+    __m128 tNear = _mm_max_ps(_mm_max_ps(nearX, nearY), _mm_max_ps(nearZ, _mm_setzero_ps()));
+    __m128 tFar = _mm_min_ps(_mm_min_ps(farX, farY), _mm_min_ps(farZ, _mm_set1_ps(maxDistance)));
+    _mm_storeu_ps(entry, tNear);
+    return (unsigned int)_mm_movemask_ps(_mm_cmple_ps(tNear, tFar));
+#else
+    unsigned int mask = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        float nearX = ((px ? node.minX[i] : node.maxX[i]) - origin.x) * inverseDirection.x;
+        float farX = ((px ? node.maxX[i] : node.minX[i]) - origin.x) * inverseDirection.x;
+        float nearY = ((py ? node.minY[i] : node.maxY[i]) - origin.y) * inverseDirection.y;
+        float farY = ((py ? node.maxY[i] : node.minY[i]) - origin.y) * inverseDirection.y;
+        float nearZ = ((pz ? node.minZ[i] : node.maxZ[i]) - origin.z) * inverseDirection.z;
+        float farZ = ((pz ? node.maxZ[i] : node.minZ[i]) - origin.z) * inverseDirection.z;
+        float tNear = std::max(std::max(nearX, nearY), std::max(nearZ, 0.0f));
+        float tFar = std::min(std::min(farX, farY), std::min(farZ, maxDistance));
+        entry[i] = tNear;
+        if (tNear <= tFar)
+            mask |= 1u << i;
+    }
+    return mask;
+#endif
+}
+
+bool Bvh::raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, uint32_t& hitObject, float& hitDistance) const
+{
+    if (nodes4.empty())
+        return false;
+
+    // a huge finite reciprocal keeps axis-parallel rays out of inf * 0 = NaN
+    glm::vec3 inverseDirection;
+    for (int axis = 0; axis < 3; axis++)
+        inverseDirection[axis] = std::fabs(direction[axis]) > 1e-20f ? 1.0f / direction[axis] : std::copysign(1e30f, direction[axis]);
+
+    bool hit = false;
+    float closest = maxDistance;
+    uint32_t localStack[LOCAL_STACK_SIZE];
+    float localStackDistance[LOCAL_STACK_SIZE];
+    std::vector<uint32_t> heapStack;
+    std::vector<float> heapStackDistance;
+    uint32_t* stack = localStack;
+    float* stackDistance = localStackDistance;
+    if (traversalStackSize() > LOCAL_STACK_SIZE)
+    {
+        heapStack.resize(traversalStackSize());
+        heapStackDistance.resize(traversalStackSize());
+        stack = heapStack.data();
+        stackDistance = heapStackDistance.data();
+    }
+    size_t stackSize = 0;
+    stack[stackSize] = 0;
+    stackDistance[stackSize++] = 0.0f;
+    while (stackSize > 0)
+    {
+        --stackSize;
+        if (stackDistance[stackSize] > closest)
+            continue;
+        const Bvh4Node& node = nodes4[stack[stackSize]];
+        float entry[4];
+        unsigned int mask = rayMask(node, origin, inverseDirection, closest, entry);
+
+        // push far children first so the nearest is popped next; an insertion sort of at most four
+        int order[4], orderCount = 0;
+        for (int i = 0; i < 4; i++)
+        {
+            if (!(mask & (1u << i)))
+                continue;
+            int k = orderCount++;
+            while (k > 0 && entry[order[k - 1]] < entry[i])
+            {
+                order[k] = order[k - 1];
+                k--;
+            }
+            order[k] = i;
+        }
+        for (int k = 0; k < orderCount; k++)
+        {
+            int i = order[k];
+            if (node.count[i] > 0)
+            {
+                for (uint32_t p = node.child[i]; p < node.child[i] + node.count[i]; p++)
+                {
+                    glm::vec3 t0 = (bounds[p].min - origin) * inverseDirection;
+                    glm::vec3 t1 = (bounds[p].max - origin) * inverseDirection;
+                    glm::vec3 low = glm::min(t0, t1), high = glm::max(t0, t1);
+                    float tNear = std::max(std::max(low.x, low.y), std::max(low.z, 0.0f));
+                    float tFar = std::min(std::min(high.x, high.y), std::min(high.z, closest));
+                    if (tNear <= tFar && (!hit || tNear < closest))
+                    {
+                        hit = true;
+                        closest = tNear;
+                        hitObject = objects[p];
+                    }
+                }
+            }
+            else
+            {
+                stack[stackSize] = node.child[i];
+                stackDistance[stackSize++] = entry[i];
+            }
+        }
+    }
+    hitDistance = closest;
+    return hit;
+}
+
+void runBvhBenchmark(JobSystem& jobs)
+{
+    const glm::mat4 viewProjection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 100.0f) *
+        glm::lookAt(glm::vec3(0.0f, 0.0f, 3.0f), glm::vec3(0.0f, 0.0f, 2.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    const Frustum frustum = Frustum::fromMatrix(viewProjection);
+    const int BUILD_ITERATIONS = 3;
+    const int ITERATIONS = 10;
+    const int RAYS = 100000;
+    std::cout << "bvh: " << jobs.threadCount() << " threads" << std::endl;
+    for (size_t count : { (size_t)10000, (size_t)100000, (size_t)1000000 })
+    {
+        // boxes scattered through a cube around the camera, about as dense at every size
+        const float extent = 100.0f * std::cbrt((float)count / 1000000.0f);
+        std::mt19937 random(1);
+        std::uniform_real_distribution<float> coordinate(-extent, extent);
+        std::uniform_real_distribution<float> size(0.1f, 1.0f);
+        AabbSoA boxes;
+        boxes.resize(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            glm::vec3 center(coordinate(random), coordinate(random), coordinate(random));
+            glm::vec3 halfSize(size(random), size(random), size(random));
+            boxes.set(i, center - halfSize, center + halfSize);
+        }
+
+        Bvh bvh;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < BUILD_ITERATIONS; i++)
+            bvh.build(boxes);
+        double serialBuild = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / BUILD_ITERATIONS;
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < BUILD_ITERATIONS; i++)
+            bvh.build(boxes, jobs);
+        double parallelBuild = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / BUILD_ITERATIONS;
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < ITERATIONS; i++)
+            bvh.refit(boxes);
+        double refit = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / ITERATIONS;
+
+        std::vector<uint32_t> visible(count), expected(count);
+        size_t visibleCount = 0;
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < ITERATIONS; i++)
+            visibleCount = bvh.queryFrustum(frustum, visible.data());
+        double query = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / ITERATIONS;
+        size_t expectedCount = 0;
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < ITERATIONS; i++)
+            expectedCount = cullAabbs(frustum, boxes, 0, count, expected.data());
+        double linear = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / ITERATIONS;
+        // the query returns leaf order, the linear cull index order
+        std::sort(visible.begin(), visible.begin() + visibleCount);
+        bool match = visibleCount == expectedCount && std::equal(visible.begin(), visible.begin() + visibleCount, expected.begin());
+
+        // rays between two random points in the cube, so most of them hit something
+        std::vector<glm::vec3> origins(RAYS), directions(RAYS);
+        for (int i = 0; i < RAYS; i++)
+        {
+            origins[i] = glm::vec3(coordinate(random), coordinate(random), coordinate(random));
+            directions[i] = glm::vec3(coordinate(random), coordinate(random), coordinate(random)) - origins[i];
+        }
+        int hits = 0;
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < RAYS; i++)
+        {
+            uint32_t hitObject;
+            float hitDistance;
+            if (bvh.raycast(origins[i], directions[i], 1.0f, hitObject, hitDistance))
+                hits++;
+        }
+        double raySeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::cout << count << " boxes: build " << serialBuild << " ms (" << parallelBuild << " ms on the jobs), refit " << refit
+            << " ms, depth " << bvh.depth() << std::endl;
+        std::cout << "    frustum query " << query << " ms against " << linear << " ms linear, " << visibleCount << " visible"
+            << (match ? "" : ", MISMATCH") << "; " << RAYS / raySeconds / 1e6 << "M rays/s, " << hits << " of " << RAYS << " hit" << std::endl;
+    }
+}
@@ -0,0 +1,94 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <vector>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include "FrustumCulling.h"
+#include "JobSystem.h"
+
+struct BvhBuildPrimitive;
+struct BvhBuildTask;
+
+// Binary node, 32 bytes so two share a cache line. Interior nodes keep their children
+// next to each other at leftFirst and leftFirst + 1; leaves own count primitives from leftFirst.
+struct alignas(32) BvhNode
+{
+    glm::vec3 min;
+    uint32_t leftFirst;
+    glm::vec3 max;
+    uint32_t count;
+
+    bool isLeaf() const { return count > 0; }
+};
+
+// Four-wide node with its children's bounds in SoA form, so one SIMD pass tests all four.
+// A child with count > 0 is a leaf owning count primitives from child; otherwise child is
+// another wide node, or EMPTY for unused slots. 128 bytes, two cache lines.
+struct alignas(64) Bvh4Node
+{
+    static const uint32_t EMPTY = 0xFFFFFFFFu;
+
+    float minX[4], minY[4], minZ[4];
+    float maxX[4], maxY[4], maxZ[4];
+    uint32_t child[4];
+    uint32_t count[4];
+};
+
+// Bounding volume hierarchy over object AABBs for large, mostly static scenes. Built with a
+// binned SAH, with subtrees built in parallel, and collapsed into a BVH4 for traversal.
+class Bvh
+{
+public:
+    // leaves hold at most this many objects
+    static const uint32_t MAX_LEAF_SIZE = 4;
+
+    // builds over all boxes on the calling thread
+    void build(const AabbSoA& boxes);
+    // same, with the subtrees below the top few levels built on the job system's workers
+    void build(const AabbSoA& boxes, JobSystem& jobs);
+    // Updates the bounds for objects that moved without changing the tree. boxes must hold the
+    // same objects the tree was built from. Quality drops as objects drift, so rebuild now and then.
+    void refit(const AabbSoA& boxes);
+
+    // writes the indices of the objects at least partly inside the frustum; visible needs room
+    // for objectCount() indices. Returns how many were written, in no particular order.
+    size_t queryFrustum(const Frustum& frustum, uint32_t* visible) const;
+    // nearest object whose box the ray hits within maxDistance; direction needn't be normalized,
+    // distances are in multiples of it
+    bool raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, uint32_t& hitObject, float& hitDistance) const;
+
+    size_t objectCount() const { return objects.size(); }
+    const std::vector<BvhNode>& binaryNodes() const { return nodes; }
+    const std::vector<Bvh4Node>& wideNodes() const { return nodes4; }
+    // levels of wide nodes, 1 for a lone root
+    uint32_t depth() const { return wideDepth; }
+
+private:
+    // traversal stacks up to this size live on the stack, deeper trees get one from the heap
+    static const size_t LOCAL_STACK_SIZE = 256;
+
+    struct Box
+    {
+        glm::vec3 min, max;
+    };
+
+    std::vector<BvhNode> nodes;
+    std::vector<Bvh4Node> nodes4;
+    std::vector<uint32_t> objects; // object index for each primitive slot, in leaf order
+    std::vector<Box> bounds;       // object bounds in the same order as objects
+    uint32_t wideDepth = 0;
+
+    void buildTree(const AabbSoA& boxes, JobSystem* jobs);
+    void buildSubtree(const BvhBuildTask& root, BvhBuildPrimitive* primitives, std::atomic<uint32_t>& nodeCount);
+    uint32_t splitNode(uint32_t nodeIndex, uint32_t first, uint32_t count, BvhBuildPrimitive* primitives, std::atomic<uint32_t>& nodeCount);
+    void collapse();
+    // a depth first traversal holds at most the three siblings left at each level above, plus
+    // the four children just pushed
+    size_t traversalStackSize() const { return 3 * (size_t)wideDepth + 1; }
+};
+
+// Times serial and parallel builds, refits, frustum queries against a linear cullAabbs and
+// raycasts over 10K, 100K and 1M boxes and prints the results; "--bvh-benchmark" runs it
+// without opening a window
+void runBvhBenchmark(JobSystem& jobs);
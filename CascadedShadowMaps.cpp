@@ -0,0 +1,176 @@
+#include "CascadedShadowMaps.h"
+#include "Camera.h"
+#include "Shader.h"
+#include "GlStateCache.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+// how much bigger than the view needs a cached cascade's footprint is, so walking around
+// doesn't re-render it every few texels
+const float CascadedShadowMaps::CACHE_MARGIN = 1.25f;
+
+CascadedShadowMaps::CascadedShadowMaps(int resolution)
+    : resolution(resolution)
+{
+    glGenTextures(1, &depthTexture);
+    glState().bindTexture(TEXTURE_UNIT, GL_TEXTURE_2D_ARRAY, depthTexture);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT32F, resolution, resolution, LAYER_COUNT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+    // linear filtering of a comparison gives 2x2 percentage closer filtering for free
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+
+    // depth only: one framebuffer to render into a layer, one to read a cache layer from
+    glGenFramebuffers(1, &framebuffer);
+    glGenFramebuffers(1, &copyFramebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthTexture, 0, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cout << "ERROR::SHADOWS::FRAMEBUFFER_INCOMPLETE" << std::endl;
+    glBindFramebuffer(GL_FRAMEBUFFER, copyFramebuffer);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+CascadedShadowMaps::~CascadedShadowMaps()
+{
+    glState().forgetTexture(depthTexture);
+    glDeleteTextures(1, &depthTexture);
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteFramebuffers(1, &copyFramebuffer);
+}
+
+void CascadedShadowMaps::update(const Camera& camera, float aspect, float zNear, const glm::vec3& direction,
+    const glm::vec3& casterMin, const glm::vec3& casterMax)
+{
+    // a turning light invalidates every cached cascade, as do changed static casters
+    glm::vec3 newDirection = glm::normalize(direction);
+    if (glm::dot(newDirection, lightDirection) < 0.99999f || staticCastersChanged)
+    {
+        for (uint32_t c = 0; c < CASCADE_COUNT; c++)
+            cacheValid[c] = false;
+        staticCastersChanged = false;
+    }
+    lightDirection = newDirection;
+    // the light's view only rotates, so a point's depth along the light is dot(direction, point)
+    glm::vec3 up = std::fabs(lightDirection.y) > 0.99f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+    lightView = glm::lookAt(glm::vec3(0.0f), lightDirection, up);
+    float casterDepth = 0.0f;
+    for (int axis = 0; axis < 3; axis++)
+        casterDepth += lightDirection[axis] * (lightDirection[axis] > 0.0f ? casterMin[axis] : casterMax[axis]);
+
+    // a frustum slice's corners at depth d are d * diagonal away from the view axis
+    float tanHalfY = std::tan(glm::radians(camera.Zoom) * 0.5f);
+    float diagonalSquared = tanHalfY * tanHalfY * (1.0f + aspect * aspect);
+    float sliceStart = zNear;
+    passesThisFrame = 0;
+    for (uint32_t c = 0; c < CASCADE_COUNT; c++)
+    {
+        float t = (float)(c + 1) / (float)CASCADE_COUNT;
+        float uniformSplit = zNear + (shadowDistance - zNear) * t;
+        float logSplit = zNear * std::pow(shadowDistance / zNear, t);
+        float sliceEnd = uniformSplit + (logSplit - uniformSplit) * splitBlend;
+        splitDepths[c] = sliceEnd;
+
+        // the smallest sphere around the slice is centred on the view axis, where it is as far
+        // from the near corners as from the far ones (or at the far end, for deep slices). It is
+        // rounded up so float noise can't change the projection's size
+        float centerDepth = std::min((sliceStart + sliceEnd) * (1.0f + diagonalSquared) * 0.5f, sliceEnd);
+        float radius = std::sqrt(std::max((centerDepth - sliceStart) * (centerDepth - sliceStart) + sliceStart * sliceStart * diagonalSquared,
+            (sliceEnd - centerDepth) * (sliceEnd - centerDepth) + sliceEnd * sliceEnd * diagonalSquared));
+        radius = std::ceil(radius * 16.0f) / 16.0f;
+        sliceStart = sliceEnd;
+
+        glm::vec3 center = camera.Position + camera.Front * centerDepth;
+        glm::vec2 lightCenter = glm::vec2(lightView * glm::vec4(center, 1.0f));
+        float depth = glm::dot(lightDirection, center);
+        float minDepth = std::min(casterDepth, depth - radius);
+        float maxDepth = depth + radius;
+
+        bool cached = c >= FIRST_CACHED_CASCADE;
+        Footprint& footprint = footprints[c];
+        glm::vec2 offset = glm::abs(lightCenter - footprint.center);
+        bool fits = footprint.valid && std::max(offset.x, offset.y) + radius <= footprint.radius &&
+            footprint.minDepth <= minDepth && footprint.maxDepth >= maxDepth;
+        if (!cached || !fits)
+        {
+            float margin = cached ? CACHE_MARGIN : 1.0f;
+            footprint.radius = radius * margin;
+            float texel = 2.0f * footprint.radius / (float)resolution;
+            footprint.center = glm::floor(lightCenter / texel + 0.5f) * texel;
+            footprint.minDepth = minDepth - (margin - 1.0f) * radius;
+            footprint.maxDepth = maxDepth + (margin - 1.0f) * radius;
+            footprint.valid = true;
+            cacheValid[c] = false;
+        }
+        texelSizes[c] = 2.0f * footprint.radius / (float)resolution;
+        viewProjections[c] = glm::ortho(footprint.center.x - footprint.radius, footprint.center.x + footprint.radius,
+            footprint.center.y - footprint.radius, footprint.center.y + footprint.radius, footprint.minDepth, footprint.maxDepth) * lightView;
+
+        if (!cached)
+        {
+            passes[passesThisFrame++] = { c, c, viewProjections[c], true, true, -1 };
+            continue;
+        }
+        uint32_t cacheLayer = CASCADE_COUNT + c - FIRST_CACHED_CASCADE;
+        if (!cacheValid[c])
+        {
+            passes[passesThisFrame++] = { c, cacheLayer, viewProjections[c], true, false, -1 };
+            cacheValid[c] = true;
+            refreshes++;
+        }
+        passes[passesThisFrame++] = { c, c, viewProjections[c], false, true, (int)cacheLayer };
+    }
+}
+
+void CascadedShadowMaps::beginPass(size_t index)
+{
+    const Pass& pass = passes[index];
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthTexture, 0, pass.layer);
+    glViewport(0, 0, resolution, resolution);
+    glState().depthMask(true);
+    if (pass.copyFromLayer >= 0)
+    {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, copyFramebuffer);
+        glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthTexture, 0, pass.copyFromLayer);
+        glBlitFramebuffer(0, 0, resolution, resolution, 0, 0, resolution, resolution, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+    }
+    else
+    {
+        glClear(GL_DEPTH_BUFFER_BIT);
+    }
+    // pushes the casters back a little so lit surfaces don't shadow themselves
+    glState().enable(GL_POLYGON_OFFSET_FILL);
+    glPolygonOffset(1.5f, 2.0f);
+}
+
+void CascadedShadowMaps::endPasses(int viewportWidth, int viewportHeight)
+{
+    glState().disable(GL_POLYGON_OFFSET_FILL);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, viewportWidth, viewportHeight);
+}
+
+void CascadedShadowMaps::bind(const Shader& shader) const
+{
+    static const char* const matrixNames[CASCADE_COUNT] = {
+        "shadowMatrices[0]", "shadowMatrices[1]", "shadowMatrices[2]", "shadowMatrices[3]"
+    };
+    glState().bindTexture(TEXTURE_UNIT, GL_TEXTURE_2D_ARRAY, depthTexture);
+    shader.setInt("shadowMap", TEXTURE_UNIT);
+    for (uint32_t c = 0; c < CASCADE_COUNT; c++)
+        shader.setMat4(matrixNames[c], viewProjections[c]);
+    shader.setVec4("cascadeSplits", glm::vec4(splitDepths[0], splitDepths[1], splitDepths[2], splitDepths[3]));
+    shader.setVec4("cascadeTexelSizes", glm::vec4(texelSizes[0], texelSizes[1], texelSizes[2], texelSizes[3]));
+    shader.setVec3("sunDirection", lightDirection);
+}
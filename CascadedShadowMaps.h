@@ -0,0 +1,109 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+
+class Camera;
+class Shader;
+
+// Cascaded shadow maps for one directional light. The camera's view, from its near plane out to
+// shadowDistance, is split into CASCADE_COUNT slices (a blend of uniform and logarithmic
+// spacing), and each slice gets an orthographic light projection around the bounding sphere of
+// its part of the frustum. The sphere only depends on the field of view and the split depths,
+// so the projection keeps its size as the camera turns, and its centre is snapped to whole
+// shadow map texels, so moving the camera doesn't make shadow edges shimmer.
+//
+// All cascades are layers of one depth texture array, sampled with hardware comparison. The
+// far cascades cover a lot of the scene but change little from frame to frame, so their static
+// casters are rendered into cache layers of their own, over a footprint padded by CACHE_MARGIN,
+// and only rendered again when the light turns, the static casters change
+// (invalidateStaticCasters) or the view leaves the footprint. Every frame the cache is copied
+// into the cascade's layer and only the dynamic casters are drawn on top.
+//
+// The class renders nothing itself: update() lists the passes a frame needs, and the caller
+// draws the casters of each pass with its own culling and instanced paths.
+class CascadedShadowMaps
+{
+public:
+    static const uint32_t CASCADE_COUNT = 4;
+    // cascades from this one on keep their static casters in a cache layer
+    static const uint32_t FIRST_CACHED_CASCADE = 2;
+    static const uint32_t LAYER_COUNT = CASCADE_COUNT + (CASCADE_COUNT - FIRST_CACHED_CASCADE);
+    // the shadow map is sampled from a unit of its own so the materials' stay bound
+    static const int TEXTURE_UNIT = 11;
+
+    // one render into one layer of the array
+    struct Pass
+    {
+        uint32_t cascade;
+        uint32_t layer;
+        glm::mat4 viewProjection;
+        bool staticCasters;
+        bool dynamicCasters;
+        // layer copied in before the casters are drawn, -1 to start from a cleared layer
+        int copyFromLayer;
+    };
+
+    explicit CascadedShadowMaps(int resolution = 2048);
+    ~CascadedShadowMaps();
+    CascadedShadowMaps(const CascadedShadowMaps&) = delete;
+    CascadedShadowMaps& operator=(const CascadedShadowMaps&) = delete;
+
+    // fits the cascades to the camera (its projection has this aspect and near plane) for a
+    // light shining along lightDirection, and lists this frame's passes. casterMin and
+    // casterMax bound every caster in world space, so casters between the light and a cascade
+    // are caught however far away they are.
+    void update(const Camera& camera, float aspect, float zNear, const glm::vec3& lightDirection,
+        const glm::vec3& casterMin, const glm::vec3& casterMax);
+    // the static casters moved or changed; the cached cascades are rendered again next update
+    void invalidateStaticCasters() { staticCastersChanged = true; }
+
+    size_t passCount() const { return passesThisFrame; }
+    const Pass& pass(size_t index) const { return passes[index]; }
+    // sets up the framebuffer for a pass: the layer, the viewport, and a clear or the copy
+    void beginPass(size_t index);
+    // back to the default framebuffer and the window's viewport
+    void endPasses(int viewportWidth, int viewportHeight);
+
+    // points the shader (which must be in use) at the shadow map, the cascade matrices and
+    // split depths, and the light direction
+    void bind(const Shader& shader) const;
+
+    // cached cascades rendered again since construction, to see how well the cache holds up
+    uint32_t cacheRefreshes() const { return refreshes; }
+
+    float shadowDistance = 60.0f;
+    // 0 spaces the splits uniformly, 1 logarithmically
+    float splitBlend = 0.75f;
+
+private:
+    static const float CACHE_MARGIN;
+
+    // light space rectangle and depth range a cascade's projection covers
+    struct Footprint
+    {
+        glm::vec2 center = glm::vec2(0.0f);
+        float radius = 0.0f;
+        float minDepth = 0.0f;
+        float maxDepth = 0.0f;
+        bool valid = false;
+    };
+
+    int resolution;
+    GLuint depthTexture = 0;
+    GLuint framebuffer = 0;
+    GLuint copyFramebuffer = 0;
+
+    glm::vec3 lightDirection = glm::vec3(0.0f);
+    glm::mat4 lightView = glm::mat4(1.0f);
+    Footprint footprints[CASCADE_COUNT];
+    bool cacheValid[CASCADE_COUNT] = {};
+    bool staticCastersChanged = true;
+    glm::mat4 viewProjections[CASCADE_COUNT];
+    float splitDepths[CASCADE_COUNT] = {};
+    float texelSizes[CASCADE_COUNT] = {};
+    Pass passes[LAYER_COUNT];
+    size_t passesThisFrame = 0;
+    uint32_t refreshes = 0;
+};
@@ -0,0 +1,548 @@
+#include "ClusteredLighting.h"
+#include "Shader.h"
+#include "GlStateCache.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// a tile boundary plane through the eye: x (or y) = slope * depth in view space, as the unit
+// normal's two components so that the signed distance is x * across - depth * along
+struct TilePlane
+{
+    float across;
+    float along;
+};
+
+// boundary j of count tiles across a field of view whose half width at depth 1 is tanHalf
+static TilePlane tilePlane(uint32_t j, uint32_t count, float tanHalf)
+{
+    float slope = (-1.0f + 2.0f * (float)j / (float)count) * tanHalf;
+    float scale = 1.0f / std::sqrt(1.0f + slope * slope);
+    return { scale, slope * scale };
+}
+
+static inline unsigned int lowestBit(unsigned int mask)
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return index;
+#else
+    return (unsigned int)__builtin_ctz(mask);
+#endif
+}
+
+ClusteredLighting::ClusteredLighting()
+    : clusterCounts(CLUSTER_COUNT), clusterCursors(CLUSTER_COUNT), clusterRanges(2 * CLUSTER_COUNT)
+{
+    setProjection(45.0f, 4.0f / 3.0f, zNear, zFar);
+}
+
+ClusteredLighting::~ClusteredLighting()
+{
+    for (int i = 0; i < 3; i++)
+    {
+        glState().forgetBuffer(buffers[i]);
+        glState().forgetTexture(textures[i]);
+        if (buffers[i])
+            glDeleteBuffers(1, &buffers[i]);
+        if (textures[i])
+            glDeleteTextures(1, &textures[i]);
+    }
+}
+
+void ClusteredLighting::setProjection(float fovYDegrees, float aspect, float nearDepth, float farDepth)
+{
+    tanHalfY = std::tan(glm::radians(fovYDegrees) * 0.5f);
+    tanHalfX = tanHalfY * aspect;
+    zNear = nearDepth;
+    zFar = farDepth;
+    float logRange = std::log(zFar / zNear);
+    sliceScale = (float)SLICES / logRange;
+    sliceBias = -(float)SLICES * std::log(zNear) / logRange;
+    for (uint32_t i = 0; i <= SLICES; i++)
+        sliceDepths[i] = zNear * std::pow(zFar / zNear, (float)i / (float)SLICES);
+}
+
+uint32_t ClusteredLighting::sliceOf(float depth) const
+{
+    float slice = std::floor(std::log(std::max(depth, zNear)) * sliceScale + sliceBias);
+    return (uint32_t)std::min(std::max(slice, 0.0f), (float)(SLICES - 1));
+}
+
+// first and last tile of count tiles the sphere reaches, from its signed distances to the
+// boundaries (which shrink from left to right); false when it misses them all
+static bool tileRange(const float* distances, uint32_t count, float radius, uint32_t& first, uint32_t& last)
+{
+    if (distances[0] < -radius || distances[count] > radius)
+        return false;
+    first = 0;
+    last = count - 1;
+    for (uint32_t j = 1; j < count; j++)
+    {
+        first += distances[j] > radius;
+        last -= distances[j] < -radius;
+    }
+    return true;
+}
+
+#if GLM_ARCH & GLM_ARCH_AVX2_BIT
+
+// number of lanes, per lane, where a > b (the compare's all ones mask is -1)
+static inline __m256i countGreater(__m256i count, __m256 a, __m256 b)
+{
+    return _mm256_sub_epi32(count, _mm256_castps_si256(_mm256_cmp_ps(a, b, _CMP_GT_OQ)));
+}
+
+#elif GLM_ARCH & GLM_ARCH_SSE2_BIT
+
+static inline __m128i countGreater(__m128i count, __m128 a, __m128 b)
+{
+    return _mm_sub_epi32(count, _mm_castps_si128(_mm_cmpgt_ps(a, b)));
+}
+
+#endif
+
+// stores one light's froxel box from the SIMD counts: slices first..last, tiles firstX to
+// TILES_X - 1 - pastX and firstY to TILES_Y - 1 - pastY
+void ClusteredLighting::storeRange(size_t i, bool inside, bool straddling, int32_t first, int32_t last,
+                                   uint32_t firstX, uint32_t pastX, uint32_t firstY, uint32_t pastY)
+{
+    if (!inside)
+    {
+        zFirst[i] = SLICES;
+        zLast[i] = -1;
+        return;
+    }
+    zFirst[i] = first;
+    zLast[i] = last;
+    uint32_t x0 = firstX, x1 = TILES_X - 1 - pastX;
+    uint32_t y0 = firstY, y1 = TILES_Y - 1 - pastY;
+    // a sphere reaching behind the eye isn't bounded by the tile planes; it gets every tile
+    if (straddling)
+        x0 = 0, x1 = TILES_X - 1, y0 = 0, y1 = TILES_Y - 1;
+    tileRanges[i] = x0 | x1 << 8 | y0 << 16 | y1 << 24;
+}
+
+void ClusteredLighting::computeRanges(const SphereSoA& lights, const glm::mat4& view, size_t begin, size_t end)
+{
+    TilePlane planesX[TILES_X + 1], planesY[TILES_Y + 1];
+    for (uint32_t j = 0; j <= TILES_X; j++)
+        planesX[j] = tilePlane(j, TILES_X, tanHalfX);
+    for (uint32_t j = 0; j <= TILES_Y; j++)
+        planesY[j] = tilePlane(j, TILES_Y, tanHalfY);
+    // depth is minus view space z
+    const glm::vec4 rowX(view[0][0], view[1][0], view[2][0], view[3][0]);
+    const glm::vec4 rowY(view[0][1], view[1][1], view[2][1], view[3][1]);
+    const glm::vec4 rowDepth(-view[0][2], -view[1][2], -view[2][2], -view[3][2]);
+
+    size_t i = begin;
+#if GLM_ARCH & GLM_ARCH_AVX2_BIT
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 nearDepth = _mm256_set1_ps(zNear), farDepth = _mm256_set1_ps(zFar);
+    for (; i + 8 <= end; i += 8)
+    {
+        __m256 x = _mm256_loadu_ps(&lights.centerX[i]);
+        __m256 y = _mm256_loadu_ps(&lights.centerY[i]);
+        __m256 z = _mm256_loadu_ps(&lights.centerZ[i]);
+        __m256 radius = _mm256_loadu_ps(&lights.radius[i]);
+        __m256 negRadius = _mm256_sub_ps(zero, radius);
+        // multiplies and adds rather than FMA, so -mavx2 alone builds it like the other modules
+        auto transform = [&](const glm::vec4& row)
+        {
+            return _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(row.x), x), _mm256_mul_ps(_mm256_set1_ps(row.y), y)),
+                _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(row.z), z), _mm256_set1_ps(row.w)));
+        };
+        __m256 viewX = transform(rowX), viewY = transform(rowY), depth = transform(rowDepth);
+        __m256 nearest = _mm256_sub_ps(depth, radius), farthest = _mm256_add_ps(depth, radius);
+
+        // slices: how many inner boundaries lie at or before each end of the sphere
+        __m256i sliceFirst = _mm256_setzero_si256(), sliceLast = _mm256_setzero_si256();
+        for (uint32_t j = 1; j < SLICES; j++)
+        {
+            __m256 boundary = _mm256_set1_ps(sliceDepths[j]);
+            sliceFirst = _mm256_sub_epi32(sliceFirst, _mm256_castps_si256(_mm256_cmp_ps(nearest, boundary, _CMP_GE_OQ)));
+            sliceLast = _mm256_sub_epi32(sliceLast, _mm256_castps_si256(_mm256_cmp_ps(farthest, boundary, _CMP_GE_OQ)));
+        }
+
+        // tiles, counted the same way from the signed distances to the boundary planes
+        __m256i firstX = _mm256_setzero_si256(), pastX = _mm256_setzero_si256();
+        __m256i firstY = _mm256_setzero_si256(), pastY = _mm256_setzero_si256();
+        __m256 inside = _mm256_and_ps(_mm256_cmp_ps(farthest, nearDepth, _CMP_GE_OQ), _mm256_cmp_ps(nearest, farDepth, _CMP_LE_OQ));
+        for (uint32_t j = 0; j <= TILES_X; j++)
+        {
+            __m256 distance = _mm256_sub_ps(_mm256_mul_ps(viewX, _mm256_set1_ps(planesX[j].across)), _mm256_mul_ps(depth, _mm256_set1_ps(planesX[j].along)));
+            if (j == 0)
+                inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, negRadius, _CMP_GE_OQ));
+            else if (j == TILES_X)
+                inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, radius, _CMP_LE_OQ));
+            else
+            {
+                firstX = countGreater(firstX, distance, radius);
+                pastX = countGreater(pastX, negRadius, distance);
+            }
+        }
+        for (uint32_t j = 0; j <= TILES_Y; j++)
+        {
+            __m256 distance = _mm256_sub_ps(_mm256_mul_ps(viewY, _mm256_set1_ps(planesY[j].across)), _mm256_mul_ps(depth, _mm256_set1_ps(planesY[j].along)));
+            if (j == 0)
+                inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, negRadius, _CMP_GE_OQ));
+            else if (j == TILES_Y)
+                inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, radius, _CMP_LE_OQ));
+            else
+            {
+                firstY = countGreater(firstY, distance, radius);
+                pastY = countGreater(pastY, negRadius, distance);
+            }
+        }
+
+        alignas(32) int32_t first[8], last[8], tilesX0[8], tilesX1[8], tilesY0[8], tilesY1[8];
+        _mm256_store_si256((__m256i*)first, sliceFirst);
+        _mm256_store_si256((__m256i*)last, sliceLast);
+        _mm256_store_si256((__m256i*)tilesX0, firstX);
+        _mm256_store_si256((__m256i*)tilesX1, pastX);
+        _mm256_store_si256((__m256i*)tilesY0, firstY);
+        _mm256_store_si256((__m256i*)tilesY1, pastY);
+        unsigned int insideMask = (unsigned int)_mm256_movemask_ps(inside);
+        unsigned int straddlingMask = (unsigned int)_mm256_movemask_ps(_mm256_cmp_ps(nearest, zero, _CMP_LE_OQ));
+        for (int lane = 0; lane < 8; lane++)
+            storeRange(i + lane, (insideMask >> lane) & 1, (straddlingMask >> lane) & 1, first[lane], last[lane],
+                tilesX0[lane], tilesX1[lane], tilesY0[lane], tilesY1[lane]);
+    }
+#elif GLM_ARCH & GLM_ARCH_SSE2_BIT
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 nearDepth = _mm_set1_ps(zNear), farDepth = _mm_set1_ps(zFar);
+    for (; i + 4 <= end; i += 4)
+    {
+        __m128 x = _mm_loadu_ps(&lights.centerX[i]);
+        __m128 y = _mm_loadu_ps(&lights.centerY[i]);
+        __m128 z = _mm_loadu_ps(&lights.centerZ[i]);
+        __m128 radius = _mm_loadu_ps(&lights.radius[i]);
+        __m128 negRadius = _mm_sub_ps(zero, radius);
+        auto transform = [&](const glm::vec4& row)
+        {
+            return _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(row.x), x), _mm_mul_ps(_mm_set1_ps(row.y), y)),
+                _mm_add_ps(_mm_mul_ps(_mm_set1_ps(row.z), z), _mm_set1_ps(row.w)));
+        };
+        __m128 viewX = transform(rowX), viewY = transform(rowY), depth = transform(rowDepth);
+        __m128 nearest = _mm_sub_ps(depth, radius), farthest = _mm_add_ps(depth, radius);
+
+        __m128i sliceFirst = _mm_setzero_si128(), sliceLast = _mm_setzero_si128();
+        for (uint32_t j = 1; j < SLICES; j++)
+        {
+            __m128 boundary = _mm_set1_ps(sliceDepths[j]);
+            sliceFirst = _mm_sub_epi32(sliceFirst, _mm_castps_si128(_mm_cmpge_ps(nearest, boundary)));
+            sliceLast = _mm_sub_epi32(sliceLast, _mm_castps_si128(_mm_cmpge_ps(farthest, boundary)));
+        }
+
+        __m128i firstX = _mm_setzero_si128(), pastX = _mm_setzero_si128();
+        __m128i firstY = _mm_setzero_si128(), pastY = _mm_setzero_si128();
+        __m128 inside = _mm_and_ps(_mm_cmpge_ps(farthest, nearDepth), _mm_cmple_ps(nearest, farDepth));
+        for (uint32_t j = 0; j <= TILES_X; j++)
+        {
+            __m128 distance = _mm_sub_ps(_mm_mul_ps(viewX, _mm_set1_ps(planesX[j].across)), _mm_mul_ps(depth, _mm_set1_ps(planesX[j].along)));
+            if (j == 0)
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negRadius));
+            else if (j == TILES_X)
+                inside = _mm_and_ps(inside, _mm_cmple_ps(distance, radius));
+            else
+            {
+                firstX = countGreater(firstX, distance, radius);
+                pastX = countGreater(pastX, negRadius, distance);
+            }
+        }
+        for (uint32_t j = 0; j <= TILES_Y; j++)
+        {
+            __m128 distance = _mm_sub_ps(_mm_mul_ps(viewY, _mm_set1_ps(planesY[j].across)), _mm_mul_ps(depth, _mm_set1_ps(planesY[j].along)));
+            if (j == 0)
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negRadius));
+            else if (j == TILES_Y)
+                inside = _mm_and_ps(inside, _mm_cmple_ps(distance, radius));
+            else
+            {
+                firstY = countGreater(firstY, distance, radius);
+                pastY = countGreater(pastY, negRadius, distance);
+            }
+        }
+
+        alignas(16) int32_t first[4], last[4], tilesX0[4], tilesX1[4], tilesY0[4], tilesY1[4];
+        _mm_store_si128((__m128i*)first, sliceFirst);
+        _mm_store_si128((__m128i*)last, sliceLast);
+        _mm_store_si128((__m128i*)tilesX0, firstX);
+        _mm_store_si128((__m128i*)tilesX1, pastX);
+        _mm_store_si128((__m128i*)tilesY0, firstY);
+        _mm_store_si128((__m128i*)tilesY1, pastY);
+        unsigned int insideMask = (unsigned int)_mm_movemask_ps(inside);
+        unsigned int straddlingMask = (unsigned int)_mm_movemask_ps(_mm_cmple_ps(nearest, zero));
+        for (int lane = 0; lane < 4; lane++)
+            storeRange(i + lane, (insideMask >> lane) & 1, (straddlingMask >> lane) & 1, first[lane], last[lane],
+                tilesX0[lane], tilesX1[lane], tilesY0[lane], tilesY1[lane]);
+    }
+#endif
+    for (; i < end; i++)
+    {
+        glm::vec4 center(lights.centerX[i], lights.centerY[i], lights.centerZ[i], 1.0f);
+        float radius = lights.radius[i];
+        float viewX = glm::dot(rowX, center), viewY = glm::dot(rowY, center), depth = glm::dot(rowDepth, center);
+        float nearest = depth - radius, farthest = depth + radius;
+        float distancesX[TILES_X + 1], distancesY[TILES_Y + 1];
+        for (uint32_t j = 0; j <= TILES_X; j++)
+            distancesX[j] = viewX * planesX[j].across - depth * planesX[j].along;
+        for (uint32_t j = 0; j <= TILES_Y; j++)
+            distancesY[j] = viewY * planesY[j].across - depth * planesY[j].along;
+        uint32_t x0, x1, y0, y1;
+        if (farthest < zNear || nearest > zFar || !tileRange(distancesX, TILES_X, radius, x0, x1) ||
+            !tileRange(distancesY, TILES_Y, radius, y0, y1))
+        {
+            zFirst[i] = SLICES;
+            zLast[i] = -1;
+            continue;
+        }
+        int32_t first = 0, last = 0;
+        for (uint32_t j = 1; j < SLICES; j++)
+        {
+            first += nearest >= sliceDepths[j];
+            last += farthest >= sliceDepths[j];
+        }
+        if (nearest <= 0.0f)
+            x0 = 0, x1 = TILES_X - 1, y0 = 0, y1 = TILES_Y - 1;
+        zFirst[i] = first;
+        zLast[i] = last;
+        tileRanges[i] = x0 | x1 << 8 | y0 << 16 | y1 << 24;
+    }
+}
+
+void ClusteredLighting::fillSlice(uint32_t slice, bool write)
+{
+    if (!write)
+    {
+        uint32_t* counts = &clusterCounts[clusterIndex(0, 0, slice)];
+        std::fill(counts, counts + TILES_X * TILES_Y, 0u);
+    }
+    // the first pass counts each froxel's lights, the second writes them at the froxel's cursor
+    auto add = [&](uint32_t v)
+    {
+        uint32_t range = visibleTileRanges[v];
+        uint32_t x0 = range & 0xFF, x1 = (range >> 8) & 0xFF, y0 = (range >> 16) & 0xFF, y1 = range >> 24;
+        for (uint32_t y = y0; y <= y1; y++)
+        {
+            for (uint32_t x = x0; x <= x1; x++)
+            {
+                uint32_t cluster = clusterIndex(x, y, slice);
+                if (write)
+                    lightIndices[clusterCursors[cluster]++] = v;
+                else
+                    clusterCounts[cluster]++;
+            }
+        }
+    };
+
+    const size_t visibleCount = visibleLights.size();
+    size_t v = 0;
+#if GLM_ARCH & GLM_ARCH_AVX2_BIT
+    // eight lights' slice ranges at a time; lights are added in index order either way
+    const __m256i s = _mm256_set1_epi32((int32_t)slice);
+    for (; v + 8 <= visibleCount; v += 8)
+    {
+        __m256i first = _mm256_loadu_si256((const __m256i*)&visibleZFirst[v]);
+        __m256i last = _mm256_loadu_si256((const __m256i*)&visibleZLast[v]);
+        __m256i outside = _mm256_or_si256(_mm256_cmpgt_epi32(first, s), _mm256_cmpgt_epi32(s, last));
+        unsigned int mask = ~(unsigned int)_mm256_movemask_ps(_mm256_castsi256_ps(outside)) & 0xFFu;
+        while (mask)
+        {
+            add((uint32_t)(v + lowestBit(mask)));
+            mask &= mask - 1;
+        }
+    }
+#elif GLM_ARCH & GLM_ARCH_SSE2_BIT
+    const __m128i s = _mm_set1_epi32((int32_t)slice);
+    for (; v + 4 <= visibleCount; v += 4)
+    {
+        __m128i first = _mm_loadu_si128((const __m128i*)&visibleZFirst[v]);
+        __m128i last = _mm_loadu_si128((const __m128i*)&visibleZLast[v]);
+        __m128i outside = _mm_or_si128(_mm_cmpgt_epi32(first, s), _mm_cmpgt_epi32(s, last));
+        unsigned int mask = ~(unsigned int)_mm_movemask_ps(_mm_castsi128_ps(outside)) & 0xFu;
+        while (mask)
+        {
+            add((uint32_t)(v + lowestBit(mask)));
+            mask &= mask - 1;
+        }
+    }
+#endif
+    for (; v < visibleCount; v++)
+        if (visibleZFirst[v] <= (int32_t)slice && (int32_t)slice <= visibleZLast[v])
+            add((uint32_t)v);
+}
+
+void ClusteredLighting::assign(const SphereSoA& lights, const glm::mat4& view, JobSystem& jobs)
+{
+    const size_t count = lights.size();
+    zFirst.resize(count);
+    zLast.resize(count);
+    tileRanges.resize(count);
+    jobs.parallelFor(count, [&](size_t begin, size_t end) { computeRanges(lights, view, begin, end); }, 1024);
+
+    // the lights in view, in index order; room for all of them is kept so frames where more
+    // come into view don't allocate
+    visibleLights.reserve(count);
+    visibleZFirst.reserve(count);
+    visibleZLast.reserve(count);
+    visibleTileRanges.reserve(count);
+    size_t visibleCount = 0;
+    for (size_t i = 0; i < count; i++)
+        visibleCount += zFirst[i] <= zLast[i];
+    visibleLights.resize(visibleCount);
+    visibleZFirst.resize(visibleCount);
+    visibleZLast.resize(visibleCount);
+    visibleTileRanges.resize(visibleCount);
+    for (size_t i = 0, v = 0; i < count; i++)
+    {
+        if (zFirst[i] > zLast[i])
+            continue;
+        visibleLights[v] = (uint32_t)i;
+        visibleZFirst[v] = zFirst[i];
+        visibleZLast[v] = zLast[i];
+        visibleTileRanges[v] = tileRanges[i];
+        v++;
+    }
+
+    auto fillSlices = [&](bool write)
+    {
+        jobs.parallelFor(SLICES, [&](size_t begin, size_t end)
+        {
+            for (size_t slice = begin; slice < end; slice++)
+                fillSlice((uint32_t)slice, write);
+        }, 1);
+    };
+    fillSlices(false);
+
+    // the lists go back to back, each as long as its count
+    lastStats = Stats();
+    lastStats.visibleLights = visibleCount;
+    uint32_t offset = 0;
+    for (uint32_t cluster = 0; cluster < CLUSTER_COUNT; cluster++)
+    {
+        clusterRanges[2 * cluster] = offset;
+        clusterRanges[2 * cluster + 1] = clusterCounts[cluster];
+        clusterCursors[cluster] = offset;
+        offset += clusterCounts[cluster];
+        lastStats.busiestCluster = std::max(lastStats.busiestCluster, clusterCounts[cluster]);
+    }
+    lightIndices.resize(offset);
+    fillSlices(true);
+    lastStats.assignments = offset;
+}
+
+void ClusteredLighting::uploadBuffer(int which, GLenum format, const void* data, size_t bytes, size_t texelSize)
+{
+    if (!buffers[which])
+    {
+        glGenBuffers(1, &buffers[which]);
+        glGenTextures(1, &textures[which]);
+    }
+    glState().bindBuffer(GL_TEXTURE_BUFFER, buffers[which]);
+    // orphaned every frame so the driver never waits on the frame still reading the old data
+    size_t size = std::max(bytes, texelSize);
+    if (size > bufferSizes[which])
+        bufferSizes[which] = size + size / 2;
+    glBufferData(GL_TEXTURE_BUFFER, bufferSizes[which], NULL, GL_STREAM_DRAW);
+    if (bytes > 0)
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, bytes, data);
+    glState().bindBuffer(GL_TEXTURE_BUFFER, 0);
+    glState().bindTexture(LIGHT_TEXTURE_UNIT + which, GL_TEXTURE_BUFFER, textures[which]);
+    glTexBuffer(GL_TEXTURE_BUFFER, format, buffers[which]);
+}
+
+void ClusteredLighting::upload(const SphereSoA& lights, const glm::vec3* colors)
+{
+    lightTexels.reserve(2 * lights.size());
+    lightTexels.resize(2 * visibleLights.size());
+    for (size_t v = 0; v < visibleLights.size(); v++)
+    {
+        uint32_t i = visibleLights[v];
+        lightTexels[2 * v] = glm::vec4(lights.centerX[i], lights.centerY[i], lights.centerZ[i], lights.radius[i]);
+        lightTexels[2 * v + 1] = glm::vec4(colors[i], 0.0f);
+    }
+
+    // texture buffers only have to hold 64K texels; past the limit the lights are switched off
+    GLint maxTexels = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+    bool fits = lightTexels.size() <= (size_t)maxTexels && lightIndices.size() <= (size_t)maxTexels;
+    if (!fits && !tooManyReported)
+    {
+        std::cout << "ERROR::LIGHTING::TOO_MANY_LIGHTS " << visibleLights.size() << " visible lights and " << lightIndices.size()
+            << " froxel references don't fit " << maxTexels << " texel texture buffers" << std::endl;
+        tooManyReported = true;
+    }
+    uploadBuffer(0, GL_RGBA32F, lightTexels.data(), fits ? lightTexels.size() * sizeof(glm::vec4) : 0, sizeof(glm::vec4));
+    if (fits)
+        uploadBuffer(1, GL_RG32UI, clusterRanges.data(), clusterRanges.size() * sizeof(uint32_t), 2 * sizeof(uint32_t));
+    else
+        uploadBuffer(1, GL_RG32UI, NULL, 0, 2 * sizeof(uint32_t));
+    uploadBuffer(2, GL_R32UI, lightIndices.data(), fits ? lightIndices.size() * sizeof(uint32_t) : 0, sizeof(uint32_t));
+}
+
+void ClusteredLighting::bind(const Shader& shader, int viewportWidth, int viewportHeight) const
+{
+    for (int i = 0; i < 3; i++)
+        glState().bindTexture(LIGHT_TEXTURE_UNIT + i, GL_TEXTURE_BUFFER, textures[i]);
+    shader.setInt("lightData", LIGHT_TEXTURE_UNIT);
+    shader.setInt("clusterRanges", RANGE_TEXTURE_UNIT);
+    shader.setInt("clusterLights", INDEX_TEXTURE_UNIT);
+    shader.setVec2("clusterTileScale", glm::vec2((float)TILES_X / std::max(viewportWidth, 1), (float)TILES_Y / std::max(viewportHeight, 1)));
+    shader.setVec2("clusterSlicing", glm::vec2(sliceScale, sliceBias));
+}
+
+void scatterLights(size_t count, const glm::vec3& boundsMin, const glm::vec3& boundsMax, SphereSoA& lights, std::vector<glm::vec3>& colors)
+{
+    // about REACH_PER_POINT lights reach any point whatever the count
+    const float REACH_PER_POINT = 8.0f;
+    glm::vec3 extent = boundsMax - boundsMin;
+    float radius = std::cbrt(REACH_PER_POINT * extent.x * extent.y * extent.z / ((float)std::max<size_t>(count, 1) * 4.18879f));
+
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    lights.resize(count);
+    colors.resize(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        glm::vec3 position = boundsMin + extent * glm::vec3(unit(random), unit(random), unit(random));
+        lights.set(i, position, radius * (0.75f + 0.5f * unit(random)));
+        // a saturated hue, dimmed so the overlapping lights don't burn out
+        float hue = 6.0f * unit(random);
+        glm::vec3 color = glm::clamp(glm::vec3(std::fabs(hue - 3.0f) - 1.0f, 2.0f - std::fabs(hue - 2.0f), 2.0f - std::fabs(hue - 4.0f)), 0.0f, 1.0f);
+        colors[i] = color * (1.5f / REACH_PER_POINT);
+    }
+}
+
+void runLightingBenchmark(JobSystem& jobs)
+{
+    // the demo's view: the camera at z = 3 looking down -z over the cubes
+    const glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 3.0f), glm::vec3(0.0f, 0.0f, 2.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    const int ITERATIONS = 20;
+    ClusteredLighting lighting;
+    lighting.setProjection(45.0f, 800.0f / 600.0f, 0.1f, 100.0f);
+    std::cout << "clustered light assignment: " << ClusteredLighting::TILES_X << "x" << ClusteredLighting::TILES_Y << "x"
+        << ClusteredLighting::SLICES << " froxels, " << jobs.threadCount() << " threads" << std::endl;
+    for (size_t count : { (size_t)1000, (size_t)10000, (size_t)100000 })
+    {
+        SphereSoA lights;
+        std::vector<glm::vec3> colors;
+        scatterLights(count, glm::vec3(-8.0f, -5.0f, -20.0f), glm::vec3(8.0f, 7.0f, 2.0f), lights, colors);
+        lighting.assign(lights, view, jobs);
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < ITERATIONS; i++)
+            lighting.assign(lights, view, jobs);
+        double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / ITERATIONS;
+        const ClusteredLighting::Stats& stats = lighting.stats();
+        std::cout << count << " lights: " << milliseconds << " ms, " << stats.visibleLights << " visible, " << stats.assignments
+            << " froxel references (busiest froxel " << stats.busiestCluster << ")" << std::endl;
+    }
+}
@@ -0,0 +1,109 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include "FrustumCulling.h"
+#include "JobSystem.h"
+
+class Shader;
+
+// Clustered forward lighting. The view frustum is cut into froxels: TILES_X x TILES_Y screen
+// tiles, each split into SLICES depth slices spaced exponentially between the near and far
+// planes, so froxels stay about as deep as they are wide. Every frame the point lights
+// (bounding spheres in world space, one colour each) are assigned to the froxels they reach
+// on the CPU: the light's tile and slice ranges are found 8 lights at a time with AVX2, 4
+// with SSE2 (scalar otherwise), then the slices are filled in parallel, one job per slice, so
+// no two jobs write the same list. The slices are walked twice, once to count each froxel's
+// lights and once to write them into lists sized from those counts, so no light is dropped.
+//
+// The visible lights, the per-froxel (offset, count) ranges and the light index lists go to
+// the fragment shader as texture buffers, so the path needs nothing past GL 3.3.
+class ClusteredLighting
+{
+public:
+    static const uint32_t TILES_X = 16;
+    static const uint32_t TILES_Y = 9;
+    static const uint32_t SLICES = 24;
+    static const uint32_t CLUSTER_COUNT = TILES_X * TILES_Y * SLICES;
+    // the texture buffers are bound to units of their own so the materials' stay bound
+    static const int LIGHT_TEXTURE_UNIT = 12;
+    static const int RANGE_TEXTURE_UNIT = 13;
+    static const int INDEX_TEXTURE_UNIT = 14;
+
+    struct Stats
+    {
+        size_t visibleLights = 0;
+        size_t assignments = 0;     // light references over all froxels
+        uint32_t busiestCluster = 0; // most lights in one froxel
+    };
+
+    ClusteredLighting();
+    ~ClusteredLighting();
+    ClusteredLighting(const ClusteredLighting&) = delete;
+    ClusteredLighting& operator=(const ClusteredLighting&) = delete;
+
+    // the camera's symmetric perspective projection (as glm::perspective builds it); the tiles
+    // follow its field of view and the slices run from zNear to zFar
+    void setProjection(float fovYDegrees, float aspect, float zNear, float zFar);
+    // fills the froxels with the lights that reach them, for a camera with this view matrix
+    void assign(const SphereSoA& lights, const glm::mat4& view, JobSystem& jobs);
+
+    // uploads the visible lights and the froxel lists, and points the shader at them (the
+    // shader must be in use); colors holds one linear colour per light passed to assign
+    void upload(const SphereSoA& lights, const glm::vec3* colors);
+    void bind(const Shader& shader, int viewportWidth, int viewportHeight) const;
+
+    const Stats& stats() const { return lastStats; }
+    // froxel index of tile (x, y) in slice z; tile y = 0 is the bottom row of the screen
+    static uint32_t clusterIndex(uint32_t x, uint32_t y, uint32_t z) { return (z * TILES_Y + y) * TILES_X + x; }
+    // the lights (indices into the lights passed to assign) of one froxel
+    size_t clusterLightCount(uint32_t cluster) const { return clusterRanges[2 * cluster + 1]; }
+    uint32_t clusterLight(uint32_t cluster, size_t i) const { return visibleLights[lightIndices[clusterRanges[2 * cluster] + i]]; }
+    // the slice a view space depth (distance in front of the camera) falls in, as the shader
+    // finds it
+    uint32_t sliceOf(float depth) const;
+
+private:
+    // tan of the half field of view, horizontally and vertically
+    float tanHalfX = 1.0f, tanHalfY = 1.0f;
+    float zNear = 0.1f, zFar = 100.0f;
+    // slice = log(depth) * sliceScale + sliceBias
+    float sliceScale = 0.0f, sliceBias = 0.0f;
+    float sliceDepths[SLICES + 1];
+
+    // each light's froxel box, SLICES in zFirst when it's outside the frustum; x and y are
+    // packed as firstX | lastX << 8 | firstY << 16 | lastY << 24
+    std::vector<int32_t> zFirst, zLast;
+    std::vector<uint32_t> tileRanges;
+    std::vector<uint32_t> visibleLights;
+    std::vector<int32_t> visibleZFirst, visibleZLast;
+    std::vector<uint32_t> visibleTileRanges;
+    // lights per froxel, and where the next one goes in lightIndices while they're written
+    std::vector<uint32_t> clusterCounts;
+    std::vector<uint32_t> clusterCursors;
+    std::vector<uint32_t> clusterRanges; // offset, count per froxel
+    std::vector<uint32_t> lightIndices;  // indices into visibleLights
+    std::vector<glm::vec4> lightTexels;  // sphere, colour per visible light
+    Stats lastStats;
+
+    GLuint buffers[3] = { 0, 0, 0 };
+    GLuint textures[3] = { 0, 0, 0 };
+    size_t bufferSizes[3] = { 0, 0, 0 };
+    bool tooManyReported = false;
+
+    void computeRanges(const SphereSoA& lights, const glm::mat4& view, size_t begin, size_t end);
+    void storeRange(size_t i, bool inside, bool straddling, int32_t first, int32_t last, uint32_t firstX, uint32_t pastX,
+                    uint32_t firstY, uint32_t pastY);
+    void fillSlice(uint32_t slice, bool write);
+    void uploadBuffer(int which, GLenum format, const void* data, size_t bytes, size_t texelSize);
+};
+
+// count lights spread at random through the box [boundsMin, boundsMax] with random hues; the
+// radii shrink as the count grows so about as many lights reach any point
+void scatterLights(size_t count, const glm::vec3& boundsMin, const glm::vec3& boundsMax, SphereSoA& lights, std::vector<glm::vec3>& colors);
+
+// Times assign over 1K, 10K and 100K lights scattered through a box in front of the camera
+// and prints the results; "--light-benchmark" runs it without opening a window
+void runLightingBenchmark(JobSystem& jobs);
@@ -0,0 +1,277 @@
+#include "CommandBuffer.h"
+#include "JobSystem.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <random>
+
+static const int RADIX_BITS = 11;
+static const int RADIX_SIZE = 1 << RADIX_BITS;
+// ranges this short are insertion sorted
+static const size_t INSERTION_SORT_RANGE = 32;
+// ranges this short (128 KB of entries) stay in cache, where byte wise LSD passes are cheap
+static const size_t CACHE_RANGE = 8192;
+// below this many commands the parallel sort isn't worth splitting up
+static const size_t PARALLEL_SORT_THRESHOLD = 65536;
+
+// one MSD level per RADIX_BITS of the key, and the byte histogram at the bottom
+static_assert(RADIX_SORT_WORKSPACE >= ((64 + RADIX_BITS - 1) / RADIX_BITS) * RADIX_SIZE + 256, "radix sort workspace too small");
+
+void CommandBuffer::reset()
+{
+    memory.reset();
+    entries.clear();
+}
+
+void CommandQueue::append(const CommandBuffer& buffer)
+{
+    const std::vector<CommandEntry>& commands = buffer.commands();
+    entries.insert(entries.end(), commands.begin(), commands.end());
+}
+
+void CommandQueue::sort()
+{
+    scratch.resize(entries.size());
+    workspaces.resize(RADIX_SORT_WORKSPACE);
+    radixSortCommands(entries.data(), scratch.data(), entries.size(), workspaces.data());
+}
+
+// the bits in which some key of the range differs from the first
+static uint64_t differingBits(const CommandEntry* entries, size_t count)
+{
+    uint64_t first = entries[0].key, differing = 0;
+    for (size_t i = 1; i < count; i++)
+        differing |= entries[i].key ^ first;
+    return differing;
+}
+
+// the shift of the RADIX_BITS wide digit that ends at the highest differing bit
+static int leadingDigitShift(uint64_t differing)
+{
+    int highest = 63;
+    while (!(differing >> highest))
+        highest--;
+    return std::max(0, highest - (RADIX_BITS - 1));
+}
+
+static void insertionSort(CommandEntry* entries, size_t count)
+{
+    for (size_t i = 1; i < count; i++)
+    {
+        CommandEntry entry = entries[i];
+        size_t j = i;
+        while (j > 0 && entries[j - 1].key > entry.key)
+        {
+            entries[j] = entries[j - 1];
+            j--;
+        }
+        entries[j] = entry;
+    }
+}
+
+// LSD passes over the bytes in which the keys differ; only for ranges that stay in cache
+static void byteRadixSort(CommandEntry* entries, CommandEntry* scratch, size_t count, uint64_t differing, size_t* histogram)
+{
+    CommandEntry* source = entries;
+    CommandEntry* target = scratch;
+    for (int shift = 0; shift < 64; shift += 8)
+    {
+        if (((differing >> shift) & 0xFF) == 0)
+            continue;
+        std::fill(histogram, histogram + 256, 0);
+        for (size_t i = 0; i < count; i++)
+            histogram[(source[i].key >> shift) & 0xFF]++;
+        size_t offset = 0;
+        for (int value = 0; value < 256; value++)
+        {
+            size_t bucket = histogram[value];
+            histogram[value] = offset;
+            offset += bucket;
+        }
+        for (size_t i = 0; i < count; i++)
+            target[histogram[(source[i].key >> shift) & 0xFF]++] = source[i];
+        std::swap(source, target);
+    }
+    if (source != entries)
+        std::memcpy(entries, source, count * sizeof(CommandEntry));
+}
+
+// One MSD pass on the leading digit scatters the range into scratch, then every bucket is
+// sorted there on its own (using its part of entries as scratch) and copied back. Buckets
+// soon fit in cache, so unlike LSD passes over the whole queue most of the work stays there.
+void radixSortCommands(CommandEntry* entries, CommandEntry* scratch, size_t count, size_t* workspace)
+{
+    if (count <= INSERTION_SORT_RANGE)
+    {
+        insertionSort(entries, count);
+        return;
+    }
+    uint64_t differing = differingBits(entries, count);
+    if (differing == 0)
+        return;
+    if (count <= CACHE_RANGE)
+    {
+        byteRadixSort(entries, scratch, count, differing, workspace);
+        return;
+    }
+
+    int shift = leadingDigitShift(differing);
+    size_t* offsets = workspace;
+    std::fill(offsets, offsets + RADIX_SIZE, 0);
+    for (size_t i = 0; i < count; i++)
+        offsets[(entries[i].key >> shift) & (RADIX_SIZE - 1)]++;
+    size_t offset = 0;
+    for (int value = 0; value < RADIX_SIZE; value++)
+    {
+        size_t bucket = offsets[value];
+        offsets[value] = offset;
+        offset += bucket;
+    }
+    for (size_t i = 0; i < count; i++)
+        scratch[offsets[(entries[i].key >> shift) & (RADIX_SIZE - 1)]++] = entries[i];
+
+    // each offset has moved on to the end of its bucket
+    size_t start = 0;
+    for (int value = 0; value < RADIX_SIZE; value++)
+    {
+        size_t end = offsets[value];
+        if (end > start)
+        {
+            radixSortCommands(scratch + start, entries + start, end - start, workspace + RADIX_SIZE);
+            std::memcpy(entries + start, scratch + start, (end - start) * sizeof(CommandEntry));
+        }
+        start = end;
+    }
+}
+
+// The leading digit's pass is split over chunks: each chunk counts its keys in parallel, the
+// counts become per-chunk output offsets (chunk order within a bucket keeps the sort stable)
+// and the chunks scatter in parallel. The buckets are then independent and are sorted as
+// parallel jobs, each worker with a workspace of its own.
+void CommandQueue::sort(JobSystem& jobs)
+{
+    size_t count = entries.size();
+    size_t chunkCount = std::min<size_t>(jobs.threadCount() * 2, count / (PARALLEL_SORT_THRESHOLD / 4));
+    if (count < PARALLEL_SORT_THRESHOLD || chunkCount < 2)
+    {
+        sort();
+        return;
+    }
+    uint64_t differing = differingBits(entries.data(), count);
+    if (differing == 0)
+        return;
+    scratch.resize(count);
+    chunkHistograms.resize(chunkCount * RADIX_SIZE);
+    bucketStarts.resize(RADIX_SIZE + 1);
+    workspaces.resize(jobs.threadCount() * RADIX_SORT_WORKSPACE);
+
+    int shift = leadingDigitShift(differing);
+    CommandEntry* source = entries.data();
+    CommandEntry* target = scratch.data();
+    auto chunkBegin = [count, chunkCount](size_t chunk) { return count * chunk / chunkCount; };
+    jobs.parallelFor(chunkCount, [&](size_t begin, size_t end)
+    {
+        for (size_t chunk = begin; chunk < end; chunk++)
+        {
+            size_t* histogram = &chunkHistograms[chunk * RADIX_SIZE];
+            std::fill(histogram, histogram + RADIX_SIZE, 0);
+            for (size_t i = chunkBegin(chunk); i < chunkBegin(chunk + 1); i++)
+                histogram[(source[i].key >> shift) & (RADIX_SIZE - 1)]++;
+        }
+    });
+
+    size_t offset = 0;
+    for (int value = 0; value < RADIX_SIZE; value++)
+    {
+        bucketStarts[value] = offset;
+        for (size_t chunk = 0; chunk < chunkCount; chunk++)
+        {
+            size_t& bucket = chunkHistograms[chunk * RADIX_SIZE + value];
+            size_t size = bucket;
+            bucket = offset;
+            offset += size;
+        }
+    }
+    bucketStarts[RADIX_SIZE] = count;
+
+    jobs.parallelFor(chunkCount, [&](size_t begin, size_t end)
+    {
+        for (size_t chunk = begin; chunk < end; chunk++)
+        {
+            size_t* offsets = &chunkHistograms[chunk * RADIX_SIZE];
+            for (size_t i = chunkBegin(chunk); i < chunkBegin(chunk + 1); i++)
+                target[offsets[(source[i].key >> shift) & (RADIX_SIZE - 1)]++] = source[i];
+        }
+    });
+
+    jobs.parallelFor(RADIX_SIZE, [&](size_t begin, size_t end)
+    {
+        size_t* workspace = &workspaces[jobs.workerIndex() * RADIX_SORT_WORKSPACE];
+        for (size_t value = begin; value < end; value++)
+        {
+            size_t start = bucketStarts[value], size = bucketStarts[value + 1] - start;
+            if (size == 0)
+                continue;
+            radixSortCommands(target + start, source + start, size, workspace);
+            std::memcpy(source + start, target + start, size * sizeof(CommandEntry));
+        }
+    }, 8);
+}
+
+void runCommandSortBenchmark(JobSystem& jobs)
+{
+    const int ITERATIONS = 10;
+    const char* distributions[] = { "random keys", "opaque draws", "mixed passes" };
+    std::cout << "command sort: " << jobs.threadCount() << " threads" << std::endl;
+    for (size_t count : { (size_t)100000, (size_t)1000000 })
+        for (int distribution = 0; distribution < 3; distribution++)
+        {
+            // opaque draws share a few programs and materials and differ mostly in depth; mixed
+            // passes add transparent draws and uploads on a few layers
+            std::mt19937_64 random(1);
+            std::uniform_real_distribution<float> depth(0.0f, 1.0f);
+            CommandBuffer buffer(1 << 20);
+            for (size_t i = 0; i < count; i++)
+            {
+                uint64_t key = random();
+                if (distribution == 1)
+                    key = RenderKey::opaque(random() % 8, random() % 64, random() % 256, depth(random));
+                else if (distribution == 2)
+                {
+                    uint32_t layer = random() % 3;
+                    uint64_t kind = random() % 16;
+                    key = kind == 0 ? RenderKey::upload(layer)
+                        : kind < 4 ? RenderKey::transparent(random() % 4, random() % 16, random() % 256, depth(random), layer)
+                        : RenderKey::opaque(random() % 8, random() % 64, random() % 256, depth(random), layer);
+                }
+                buffer.add<DrawCommand>(key);
+            }
+            std::vector<CommandEntry> expected = buffer.commands();
+            auto start = std::chrono::steady_clock::now();
+            std::stable_sort(expected.begin(), expected.end(), [](const CommandEntry& a, const CommandEntry& b) { return a.key < b.key; });
+            double reference = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+            // the queue is refilled in recording order before every sort, outside the timing
+            CommandQueue queue;
+            double serial = 0.0, parallel = 0.0;
+            bool match = true;
+            for (int i = 0; i < 2 * ITERATIONS; i++)
+            {
+                queue.clear();
+                queue.append(buffer);
+                start = std::chrono::steady_clock::now();
+                if (i < ITERATIONS)
+                    queue.sort();
+                else
+                    queue.sort(jobs);
+                double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                (i < ITERATIONS ? serial : parallel) += milliseconds;
+                const std::vector<CommandEntry>& sorted = queue.commands();
+                for (size_t k = 0; k < count && match; k++)
+                    match = sorted[k].key == expected[k].key && sorted[k].command == expected[k].command;
+            }
+            std::cout << count << " " << distributions[distribution] << ": " << serial / ITERATIONS << " ms, " << parallel / ITERATIONS
+                << " ms on the jobs, std::stable_sort " << reference << " ms" << (match ? "" : ", MISMATCH") << std::endl;
+        }
+}
@@ -0,0 +1,98 @@
+#include "DeferredShading.h"
+#include "GlStateCache.h"
+#include <iostream>
+
+DeferredShading::DeferredShading()
+    : geometry("vertexShader.glsl", "gBufferFragmentShader.glsl"),
+      lighting("deferredLightingVertexShader.glsl", "deferredLightingFragmentShader.glsl")
+{
+    glGenFramebuffers(1, &framebuffer);
+    glGenVertexArrays(1, &emptyVertexArray);
+}
+
+DeferredShading::~DeferredShading()
+{
+    releaseTargets();
+    glDeleteFramebuffers(1, &framebuffer);
+    glState().forgetVertexArray(emptyVertexArray);
+    glDeleteVertexArrays(1, &emptyVertexArray);
+}
+
+void DeferredShading::releaseTargets()
+{
+    GLuint* textures[4] = { &normalTexture, &albedoTexture, &materialTexture, &depthTexture };
+    for (GLuint* texture : textures)
+    {
+        if (*texture == 0)
+            continue;
+        glState().forgetTexture(*texture);
+        glDeleteTextures(1, texture);
+        *texture = 0;
+    }
+}
+
+void DeferredShading::resize(int newWidth, int newHeight)
+{
+    releaseTargets();
+    width = newWidth;
+    height = newHeight;
+
+    // every target is read one texel per pixel with texelFetch, so none needs filtering
+    auto createTarget = [this](GLuint& texture, int unit, GLenum internalFormat, GLenum format, GLenum type)
+    {
+        glGenTextures(1, &texture);
+        glState().bindTexture(unit, GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    };
+    createTarget(normalTexture, NORMAL_TEXTURE_UNIT, GL_RG16, GL_RG, GL_UNSIGNED_SHORT);
+    createTarget(albedoTexture, ALBEDO_TEXTURE_UNIT, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE);
+    createTarget(materialTexture, MATERIAL_TEXTURE_UNIT, GL_RG8, GL_RG, GL_UNSIGNED_BYTE);
+    createTarget(depthTexture, DEPTH_TEXTURE_UNIT, GL_DEPTH_COMPONENT32F, GL_DEPTH_COMPONENT, GL_FLOAT);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, normalTexture, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, albedoTexture, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, materialTexture, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+    const GLenum drawBuffers[3] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
+    glDrawBuffers(3, drawBuffers);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cout << "ERROR::DEFERRED::FRAMEBUFFER_INCOMPLETE " << width << "x" << height << std::endl;
+}
+
+void DeferredShading::beginGeometryPass(int newWidth, int newHeight)
+{
+    if (newWidth != width || newHeight != height)
+        resize(newWidth, newHeight);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glState().depthMask(true);
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+void DeferredShading::light(const glm::mat4& view, const glm::mat4& projection)
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    glState().bindTexture(NORMAL_TEXTURE_UNIT, GL_TEXTURE_2D, normalTexture);
+    glState().bindTexture(ALBEDO_TEXTURE_UNIT, GL_TEXTURE_2D, albedoTexture);
+    glState().bindTexture(MATERIAL_TEXTURE_UNIT, GL_TEXTURE_2D, materialTexture);
+    glState().bindTexture(DEPTH_TEXTURE_UNIT, GL_TEXTURE_2D, depthTexture);
+    lighting.setInt("gNormal", NORMAL_TEXTURE_UNIT);
+    lighting.setInt("gAlbedo", ALBEDO_TEXTURE_UNIT);
+    lighting.setInt("gMaterial", MATERIAL_TEXTURE_UNIT);
+    lighting.setInt("gDepth", DEPTH_TEXTURE_UNIT);
+    lighting.setMat4("inverseProjection", glm::inverse(projection));
+    lighting.setMat4("inverseView", glm::inverse(view));
+    lighting.setVec2("viewportSize", glm::vec2(width, height));
+
+    // the triangle covers every pixel; each one takes the depth it carries in the G-buffer
+    glState().depthFunc(GL_ALWAYS);
+    glState().bindVertexArray(emptyVertexArray);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glState().depthFunc(GL_LESS);
+}
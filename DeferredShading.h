@@ -0,0 +1,58 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include "Shader.h"
+
+// Deferred shading, the alternative to shading in the forward pass (fragmentShader.glsl). The
+// geometry pass draws the scene with gBufferFragmentShader.glsl into a small G-buffer:
+//
+//   normal     RG16     octahedral encoding, 4 bytes
+//   albedo     RGBA8    colour and ambient occlusion, 4 bytes
+//   material   RG8      roughness and metalness, 2 bytes
+//   depth      32F      the position is reconstructed from it, so there is no position target
+//
+// The lighting pass is one full screen triangle that shades every covered pixel once with the
+// clustered lights (ClusteredLighting) and the shadow cascades, so the cost of the lights no
+// longer grows with overdraw. It writes the depth back, leaving the default framebuffer as a
+// forward pass would. Needs GL 3.3.
+class DeferredShading
+{
+public:
+    // the G-buffer is read from units of its own, below the shadow map and the light buffers
+    static const int NORMAL_TEXTURE_UNIT = 7;
+    static const int ALBEDO_TEXTURE_UNIT = 8;
+    static const int MATERIAL_TEXTURE_UNIT = 9;
+    static const int DEPTH_TEXTURE_UNIT = 10;
+
+    DeferredShading();
+    ~DeferredShading();
+    DeferredShading(const DeferredShading&) = delete;
+    DeferredShading& operator=(const DeferredShading&) = delete;
+
+    // draws the scene into the G-buffer with this program; it takes the same uniforms and vertex
+    // inputs as the forward one
+    Shader& geometryShader() { return geometry; }
+    // shades the G-buffer with this program; bind the lights and shadows to it before light()
+    Shader& lightingShader() { return lighting; }
+
+    // binds the G-buffer, sized to the framebuffer (reallocated when that changes), and clears it
+    void beginGeometryPass(int width, int height);
+    // back to the default framebuffer, where the lighting pass shades the G-buffer into; the
+    // lighting program must be in use
+    void light(const glm::mat4& view, const glm::mat4& projection);
+
+private:
+    Shader geometry;
+    Shader lighting;
+    GLuint framebuffer = 0;
+    GLuint normalTexture = 0;
+    GLuint albedoTexture = 0;
+    GLuint materialTexture = 0;
+    GLuint depthTexture = 0;
+    // the full screen triangle has no vertex buffers, but the core profile needs a vertex array
+    GLuint emptyVertexArray = 0;
+    int width = 0, height = 0;
+
+    void resize(int newWidth, int newHeight);
+    void releaseTargets();
+};
@@ -0,0 +1,335 @@
+#include "FrustumCulling.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+Frustum Frustum::fromMatrix(const glm::mat4& m)
+{
+    // Gribb/Hartmann: each plane is the fourth row of the matrix plus or minus one of the others.
+    // glm is column major, so row r is (m[0][r], m[1][r], m[2][r], m[3][r])
+    glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+    glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+    glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+    glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+    Frustum frustum;
+    frustum.planes[LEFT] = row3 + row0;
+    frustum.planes[RIGHT] = row3 - row0;
+    frustum.planes[BOTTOM] = row3 + row1;
+    frustum.planes[TOP] = row3 - row1;
+    frustum.planes[NEAR_PLANE] = row3 + row2;
+    frustum.planes[FAR_PLANE] = row3 - row2;
+    for (glm::vec4& plane : frustum.planes)
+        plane /= glm::length(glm::vec3(plane));
+    return frustum;
+}
+
+bool Frustum::intersectsSphere(const glm::vec3& center, float radius) const
+{
+    for (const glm::vec4& plane : planes)
+        if (glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+            return false;
+    return true;
+}
+
+bool Frustum::intersectsAabb(const glm::vec3& min, const glm::vec3& max) const
+{
+    for (const glm::vec4& plane : planes)
+    {
+        // the corner furthest along the plane normal
+        glm::vec3 corner(plane.x > 0.0f ? max.x : min.x, plane.y > 0.0f ? max.y : min.y, plane.z > 0.0f ? max.z : min.z);
+        if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f)
+            return false;
+    }
+    return true;
+}
+
+void SphereSoA::resize(size_t count)
+{
+    centerX.resize(count);
+    centerY.resize(count);
+    centerZ.resize(count);
+    radius.resize(count);
+}
+
+void SphereSoA::set(size_t index, const glm::vec3& center, float r)
+{
+    centerX[index] = center.x;
+    centerY[index] = center.y;
+    centerZ[index] = center.z;
+    radius[index] = r;
+}
+
+void AabbSoA::resize(size_t count)
+{
+    minX.resize(count);
+    minY.resize(count);
+    minZ.resize(count);
+    maxX.resize(count);
+    maxY.resize(count);
+    maxZ.resize(count);
+}
+
+void AabbSoA::set(size_t index, const glm::vec3& min, const glm::vec3& max)
+{
+    minX[index] = min.x;
+    minY[index] = min.y;
+    minZ[index] = min.z;
+    maxX[index] = max.x;
+    maxY[index] = max.y;
+    maxZ[index] = max.z;
+}
+
+static inline unsigned int lowestBit(unsigned int mask)
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return index;
+#else
+    return (unsigned int)__builtin_ctz(mask);
+#endif
+}
+
+// appends base + i for every set bit i of mask
+static inline uint32_t* writeVisible(uint32_t* out, unsigned int mask, uint32_t base)
+{
+    while (mask)
+    {
+        *out++ = base + lowestBit(mask);
+        mask &= mask - 1;
+    }
+    return out;
+}
+
+static size_t cullSpheresScalar(const Frustum& frustum, const SphereSoA& s, size_t first, size_t count, uint32_t* visible)
+{
+    uint32_t* out = visible;
+    for (size_t i = first; i < first + count; i++)
+        if (frustum.intersectsSphere(glm::vec3(s.centerX[i], s.centerY[i], s.centerZ[i]), s.radius[i]))
+            *out++ = (uint32_t)i;
+    return out - visible;
+}
+
+static size_t cullAabbsScalar(const Frustum& frustum, const AabbSoA& b, size_t first, size_t count, uint32_t* visible)
+{
+    uint32_t* out = visible;
+    for (size_t i = first; i < first + count; i++)
+        if (frustum.intersectsAabb(glm::vec3(b.minX[i], b.minY[i], b.minZ[i]), glm::vec3(b.maxX[i], b.maxY[i], b.maxZ[i])))
+            *out++ = (uint32_t)i;
+    return out - visible;
+}
+
+#if GLM_ARCH & GLM_ARCH_AVX2_BIT
+
+size_t cullSpheres(const Frustum& frustum, const SphereSoA& s, size_t first, size_t count, uint32_t* visible)
+{
+    __m256 planeX[6], planeY[6], planeZ[6], planeW[6];
+    for (int p = 0; p < 6; p++)
+    {
+        planeX[p] = _mm256_set1_ps(frustum.planes[p].x);
+        planeY[p] = _mm256_set1_ps(frustum.planes[p].y);
+        planeZ[p] = _mm256_set1_ps(frustum.planes[p].z);
+        planeW[p] = _mm256_set1_ps(frustum.planes[p].w);
+    }
+
+    uint32_t* out = visible;
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        size_t at = first + i;
+        __m256 x = _mm256_loadu_ps(&s.centerX[at]);
+        __m256 y = _mm256_loadu_ps(&s.centerY[at]);
+        __m256 z = _mm256_loadu_ps(&s.centerZ[at]);
+        __m256 negRadius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(&s.radius[at]));
+
+        // a sphere is outside once it is fully behind any plane
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (int p = 0; p < 6; p++)
+        {
+            // summed in the order glm::dot(plane, center) + w is, so both paths round alike
+            __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(planeX[p], x), _mm256_mul_ps(planeY[p], y)),
+                _mm256_mul_ps(planeZ[p], z)), planeW[p]);
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, negRadius, _CMP_GE_OQ));
+        }
+        out = writeVisible(out, (unsigned int)_mm256_movemask_ps(inside), (uint32_t)at);
+    }
+    return (out - visible) + cullSpheresScalar(frustum, s, first + i, count - i, out);
+}
+
+size_t cullAabbs(const Frustum& frustum, const AabbSoA& b, size_t first, size_t count, uint32_t* visible)
+{
+    uint32_t* out = visible;
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        size_t at = first + i;
+        __m256 minX = _mm256_loadu_ps(&b.minX[at]), maxX = _mm256_loadu_ps(&b.maxX[at]);
+        __m256 minY = _mm256_loadu_ps(&b.minY[at]), maxY = _mm256_loadu_ps(&b.maxY[at]);
+        __m256 minZ = _mm256_loadu_ps(&b.minZ[at]), maxZ = _mm256_loadu_ps(&b.maxZ[at]);
+
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (const glm::vec4& plane : frustum.planes)
+        {
+            // the plane is the same for every lane, so the furthest corner is picked per plane, not per box
+            __m256 x = plane.x > 0.0f ? maxX : minX;
+            __m256 y = plane.y > 0.0f ? maxY : minY;
+            __m256 z = plane.z > 0.0f ? maxZ : minZ;
+            __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane.x), x), _mm256_mul_ps(_mm256_set1_ps(plane.y), y)),
+                _mm256_mul_ps(_mm256_set1_ps(plane.z), z)), _mm256_set1_ps(plane.w));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, _mm256_setzero_ps(), _CMP_GE_OQ));
+        }
+        out = writeVisible(out, (unsigned int)_mm256_movemask_ps(inside), (uint32_t)at);
+    }
+    return (out - visible) + cullAabbsScalar(frustum, b, first + i, count - i, out);
+}
+
+#elif GLM_ARCH & GLM_ARCH_SSE2_BIT
+
+size_t cullSpheres(const Frustum& frustum, const SphereSoA& s, size_t first, size_t count, uint32_t* visible)
+{
+    __m128 planeX[6], planeY[6], planeZ[6], planeW[6];
+    for (int p = 0; p < 6; p++)
+    {
+        planeX[p] = _mm_set1_ps(frustum.planes[p].x);
+        planeY[p] = _mm_set1_ps(frustum.planes[p].y);
+        planeZ[p] = _mm_set1_ps(frustum.planes[p].z);
+        planeW[p] = _mm_set1_ps(frustum.planes[p].w);
+    }
+
+    uint32_t* out = visible;
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        size_t at = first + i;
+        __m128 x = _mm_loadu_ps(&s.centerX[at]);
+        __m128 y = _mm_loadu_ps(&s.centerY[at]);
+        __m128 z = _mm_loadu_ps(&s.centerZ[at]);
+        __m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&s.radius[at]));
+
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (int p = 0; p < 6; p++)
+        {
+            // summed in the order glm::dot(plane, center) + w is, so both paths round alike
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(planeX[p], x), _mm_mul_ps(planeY[p], y)),
+                _mm_mul_ps(planeZ[p], z)), planeW[p]);
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negRadius));
+        }
+        out = writeVisible(out, (unsigned int)_mm_movemask_ps(inside), (uint32_t)at);
+    }
+    return (out - visible) + cullSpheresScalar(frustum, s, first + i, count - i, out);
+}
+
+size_t cullAabbs(const Frustum& frustum, const AabbSoA& b, size_t first, size_t count, uint32_t* visible)
+{
+    uint32_t* out = visible;
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        size_t at = first + i;
+        __m128 minX = _mm_loadu_ps(&b.minX[at]), maxX = _mm_loadu_ps(&b.maxX[at]);
+        __m128 minY = _mm_loadu_ps(&b.minY[at]), maxY = _mm_loadu_ps(&b.maxY[at]);
+        __m128 minZ = _mm_loadu_ps(&b.minZ[at]), maxZ = _mm_loadu_ps(&b.maxZ[at]);
+
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (const glm::vec4& plane : frustum.planes)
+        {
+            __m128 x = plane.x > 0.0f ? maxX : minX;
+            __m128 y = plane.y > 0.0f ? maxY : minY;
+            __m128 z = plane.z > 0.0f ? maxZ : minZ;
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.x), x), _mm_mul_ps(_mm_set1_ps(plane.y), y)),
+                _mm_mul_ps(_mm_set1_ps(plane.z), z)), _mm_set1_ps(plane.w));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, _mm_setzero_ps()));
+        }
+        out = writeVisible(out, (unsigned int)_mm_movemask_ps(inside), (uint32_t)at);
+    }
+    return (out - visible) + cullAabbsScalar(frustum, b, first + i, count - i, out);
+}
+
+#else
+
+size_t cullSpheres(const Frustum& frustum, const SphereSoA& spheres, size_t first, size_t count, uint32_t* visible)
+{
+    return cullSpheresScalar(frustum, spheres, first, count, visible);
+}
+
+size_t cullAabbs(const Frustum& frustum, const AabbSoA& boxes, size_t first, size_t count, uint32_t* visible)
+{
+    return cullAabbsScalar(frustum, boxes, first, count, visible);
+}
+
+#endif
+
+void runCullingBenchmark()
+{
+#if GLM_ARCH & GLM_ARCH_AVX2_BIT
+    const char* path = "AVX2";
+#elif GLM_ARCH & GLM_ARCH_SSE2_BIT
+    const char* path = "SSE2";
+#else
+    const char* path = "scalar";
+#endif
+    // the demo's view and projection, with the volumes scattered through a box around the camera
+    // so that a few percent of them survive
+    const glm::mat4 viewProjection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 100.0f) *
+        glm::lookAt(glm::vec3(0.0f, 0.0f, 3.0f), glm::vec3(0.0f, 0.0f, 2.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    const Frustum frustum = Frustum::fromMatrix(viewProjection);
+    // every size does about the same number of tests so the timings are comparable
+    const size_t TESTS_PER_SIZE = 100000000;
+    std::cout << "frustum culling: " << path << ", one thread" << std::endl;
+    for (size_t count : { (size_t)10000, (size_t)100000, (size_t)1000000 })
+    {
+        std::mt19937 random(1);
+        std::uniform_real_distribution<float> coordinate(-100.0f, 100.0f);
+        std::uniform_real_distribution<float> size(0.1f, 2.0f);
+        SphereSoA spheres;
+        AabbSoA boxes;
+        spheres.resize(count);
+        boxes.resize(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            glm::vec3 center(coordinate(random), coordinate(random), coordinate(random));
+            float radius = size(random);
+            spheres.set(i, center, radius);
+            boxes.set(i, center - radius, center + radius);
+        }
+        std::vector<uint32_t> visible(count), expected(count);
+        const size_t iterations = TESTS_PER_SIZE / count;
+
+        size_t visibleSpheres = cullSpheres(frustum, spheres, 0, count, visible.data());
+        bool spheresMatch = visibleSpheres == cullSpheresScalar(frustum, spheres, 0, count, expected.data()) &&
+            std::equal(visible.begin(), visible.begin() + visibleSpheres, expected.begin());
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < iterations; i++)
+            cullSpheres(frustum, spheres, 0, count, visible.data());
+        double sphereSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < iterations; i++)
+            cullSpheresScalar(frustum, spheres, 0, count, expected.data());
+        double scalarSphereSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        size_t visibleBoxes = cullAabbs(frustum, boxes, 0, count, visible.data());
+        bool boxesMatch = visibleBoxes == cullAabbsScalar(frustum, boxes, 0, count, expected.data()) &&
+            std::equal(visible.begin(), visible.begin() + visibleBoxes, expected.begin());
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < iterations; i++)
+            cullAabbs(frustum, boxes, 0, count, visible.data());
+        double boxSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < iterations; i++)
+            cullAabbsScalar(frustum, boxes, 0, count, expected.data());
+        double scalarBoxSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        const double tests = (double)count * iterations / 1e6;
+        std::cout << count << " spheres: " << tests / sphereSeconds << "M tests/s (scalar " << tests / scalarSphereSeconds
+            << "M), " << visibleSpheres << " visible" << (spheresMatch ? "" : ", MISMATCH") << std::endl;
+        std::cout << count << " boxes: " << tests / boxSeconds << "M tests/s (scalar " << tests / scalarBoxSeconds
+            << "M), " << visibleBoxes << " visible" << (boxesMatch ? "" : ", MISMATCH") << std::endl;
+    }
+}
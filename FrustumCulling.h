@@ -0,0 +1,50 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// The six clip planes of a view frustum, pointing inwards and normalized so that
+// dot(plane.xyz, p) + plane.w is the signed distance of p from the plane.
+struct Frustum
+{
+    enum Plane { LEFT, RIGHT, BOTTOM, TOP, NEAR_PLANE, FAR_PLANE };
+    glm::vec4 planes[6];
+
+    // extracts the planes from a projection * view (or projection * view * model) matrix
+    static Frustum fromMatrix(const glm::mat4& viewProjection);
+
+    bool intersectsSphere(const glm::vec3& center, float radius) const;
+    bool intersectsAabb(const glm::vec3& min, const glm::vec3& max) const;
+};
+
+// bounding spheres, one array per component
+struct SphereSoA
+{
+    std::vector<float> centerX, centerY, centerZ, radius;
+
+    size_t size() const { return centerX.size(); }
+    void resize(size_t count);
+    void set(size_t index, const glm::vec3& center, float radius);
+};
+
+// axis aligned boxes, one array per component
+struct AabbSoA
+{
+    std::vector<float> minX, minY, minZ, maxX, maxY, maxZ;
+
+    size_t size() const { return minX.size(); }
+    void resize(size_t count);
+    void set(size_t index, const glm::vec3& min, const glm::vec3& max);
+};
+
+// Test volumes [first, first + count) against the frustum and write the indices of the ones
+// that are at least partly inside to visible, in order. visible needs room for count indices.
+// Returns how many were written. Runs 8 at a time with AVX2, 4 with SSE2, scalar otherwise.
+size_t cullSpheres(const Frustum& frustum, const SphereSoA& spheres, size_t first, size_t count, uint32_t* visible);
+size_t cullAabbs(const Frustum& frustum, const AabbSoA& boxes, size_t first, size_t count, uint32_t* visible);
+
+// Times cullSpheres and cullAabbs over 10K, 100K and 1M volumes scattered around the demo's
+// view on one thread, checks them against the scalar tests and prints tests per second;
+// "--cull-benchmark" runs it without opening a window
+void runCullingBenchmark();
@@ -0,0 +1,65 @@
+#include "GlCommandBackend.h"
+#include "GlStateCache.h"
+#include <iostream>
+
+uint32_t GlCommandBackend::addMaterial(const Material& material)
+{
+    materials.push_back(material);
+    return (uint32_t)materials.size() - 1;
+}
+
+void GlCommandBackend::execute(const CommandQueue& queue)
+{
+    // the state cache skips the program, vertex array and texture binds that consecutive
+    // draws share, which the key order makes the common case
+    GlStateCache& state = glState();
+    for (const CommandEntry& entry : queue.commands())
+    {
+        switch (*static_cast<const CommandType*>(entry.command))
+        {
+        case CommandType::UPLOAD:
+        {
+            const UploadCommand& upload = *static_cast<const UploadCommand*>(entry.command);
+            state.bindBuffer(GL_ARRAY_BUFFER, upload.buffer);
+            glBufferSubData(GL_ARRAY_BUFFER, upload.offset, upload.size, upload.data);
+            break;
+        }
+        case CommandType::DRAW:
+        {
+            const DrawCommand& draw = *static_cast<const DrawCommand*>(entry.command);
+            state.useProgram(draw.program);
+            state.bindVertexArray(draw.vertexArray);
+            if (draw.material < materials.size())
+            {
+                const Material& material = materials[draw.material];
+                for (int i = 0; i < material.textureCount; i++)
+                    state.bindTexture(material.units[i], GL_TEXTURE_2D, material.textures[i]);
+            }
+
+            // a non-zero first instance needs GL 4.2
+            if (draw.firstInstance != 0 && !GLAD_GL_VERSION_4_2)
+            {
+                std::cout << "ERROR::COMMANDS::BASE_INSTANCE_UNSUPPORTED" << std::endl;
+                break;
+            }
+            if (draw.indexed)
+            {
+                GLenum indexType = draw.indexSize == 1 ? GL_UNSIGNED_BYTE : (draw.indexSize == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT);
+                const void* offset = (const void*)(uintptr_t)(draw.first * draw.indexSize);
+                if (draw.firstInstance != 0)
+                    glDrawElementsInstancedBaseInstance(GL_TRIANGLES, draw.count, indexType, offset, draw.instanceCount, draw.firstInstance);
+                else
+                    glDrawElementsInstanced(GL_TRIANGLES, draw.count, indexType, offset, draw.instanceCount);
+            }
+            else
+            {
+                if (draw.firstInstance != 0)
+                    glDrawArraysInstancedBaseInstance(GL_TRIANGLES, draw.first, draw.count, draw.instanceCount, draw.firstInstance);
+                else
+                    glDrawArraysInstanced(GL_TRIANGLES, draw.first, draw.count, draw.instanceCount);
+            }
+            break;
+        }
+        }
+    }
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include <glad/glad.h>
+#include <vector>
+#include <cstdint>
+#include "CommandBuffer.h"
+
+// textures bound together for a draw, each on its own unit
+struct Material
+{
+    static const int MAX_TEXTURES = 4;
+
+    int textureCount = 0;
+    GLuint textures[MAX_TEXTURES] = {};
+    GLint units[MAX_TEXTURES] = {};
+};
+
+// Executes sorted command queues with GL; call only from the thread that owns the context.
+// Binds go through the GL state cache, so draws sharing state don't rebind it.
+class GlCommandBackend
+{
+public:
+    uint32_t addMaterial(const Material& material);
+    Material& material(uint32_t index) { return materials[index]; }
+
+    void execute(const CommandQueue& queue);
+
+private:
+    std::vector<Material> materials;
+};
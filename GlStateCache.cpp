@@ -0,0 +1,195 @@
+#include "GlStateCache.h"
+
+const GLuint GlStateCache::UNKNOWN;
+
+GlStateCache& glState()
+{
+    static GlStateCache cache;
+    return cache;
+}
+
+GlStateCache::GlStateCache()
+{
+    invalidate();
+}
+
+void GlStateCache::invalidate()
+{
+    program = UNKNOWN;
+    vertexArray = UNKNOWN;
+    activeUnit = UNKNOWN;
+    for (Binding& binding : buffers)
+        binding = { 0, UNKNOWN };
+    for (auto& unit : textures)
+        for (Binding& binding : unit)
+            binding = { 0, UNKNOWN };
+    for (Binding& binding : capabilities)
+        binding = { 0, UNKNOWN };
+    blendSource = blendDestination = UNKNOWN;
+    depthFunction = UNKNOWN;
+    depthWrite = UNKNOWN;
+    cullFaceMode = UNKNOWN;
+}
+
+bool GlStateCache::change(GLuint& cached, GLuint value)
+{
+    if (cached == value)
+    {
+        frame.elided++;
+        return false;
+    }
+    cached = value;
+    frame.issued++;
+    return true;
+}
+
+// the cached value for target; a full table falls back to a slot that never matches
+GLuint& GlStateCache::slot(Binding* bindings, int count, GLenum target)
+{
+    for (int i = 0; i < count; i++)
+        if (bindings[i].target == target)
+            return bindings[i].object;
+    for (int i = 0; i < count; i++)
+    {
+        if (bindings[i].target == 0)
+        {
+            bindings[i].target = target;
+            return bindings[i].object;
+        }
+    }
+    static GLuint untracked;
+    untracked = UNKNOWN;
+    return untracked;
+}
+
+void GlStateCache::useProgram(GLuint value)
+{
+    if (change(program, value))
+        glUseProgram(value);
+}
+
+void GlStateCache::bindVertexArray(GLuint value)
+{
+    if (change(vertexArray, value))
+        glBindVertexArray(value);
+}
+
+void GlStateCache::bindBuffer(GLenum target, GLuint buffer)
+{
+    if (target == GL_ELEMENT_ARRAY_BUFFER)
+    {
+        frame.issued++;
+        glBindBuffer(target, buffer);
+        return;
+    }
+    if (change(slot(buffers, MAX_BUFFER_TARGETS, target), buffer))
+        glBindBuffer(target, buffer);
+}
+
+void GlStateCache::bindBufferBase(GLenum target, GLuint index, GLuint buffer)
+{
+    frame.issued++;
+    glBindBufferBase(target, index, buffer);
+    slot(buffers, MAX_BUFFER_TARGETS, target) = buffer;
+}
+
+void GlStateCache::activeTexture(GLuint unit)
+{
+    if (change(activeUnit, unit))
+        glActiveTexture(GL_TEXTURE0 + unit);
+}
+
+void GlStateCache::bindTexture(GLuint unit, GLenum target, GLuint texture)
+{
+    if (unit >= (GLuint)MAX_TEXTURE_UNITS)
+    {
+        activeTexture(unit);
+        frame.issued++;
+        glBindTexture(target, texture);
+        return;
+    }
+    GLuint& cached = slot(textures[unit], MAX_TEXTURE_TARGETS, target);
+    if (cached == texture)
+    {
+        frame.elided++;
+        return;
+    }
+    activeTexture(unit);
+    change(cached, texture);
+    glBindTexture(target, texture);
+}
+
+void GlStateCache::setEnabled(GLenum capability, bool enabled)
+{
+    if (change(slot(capabilities, MAX_CAPABILITIES, capability), enabled ? 1 : 0))
+    {
+        if (enabled)
+            glEnable(capability);
+        else
+            glDisable(capability);
+    }
+}
+
+void GlStateCache::blendFunc(GLenum source, GLenum destination)
+{
+    if (blendSource == source && blendDestination == destination)
+    {
+        frame.elided++;
+        return;
+    }
+    blendSource = source;
+    blendDestination = destination;
+    frame.issued++;
+    glBlendFunc(source, destination);
+}
+
+void GlStateCache::depthFunc(GLenum function)
+{
+    if (change(depthFunction, function))
+        glDepthFunc(function);
+}
+
+void GlStateCache::depthMask(bool write)
+{
+    if (change(depthWrite, write ? 1 : 0))
+        glDepthMask(write ? GL_TRUE : GL_FALSE);
+}
+
+void GlStateCache::cullFace(GLenum face)
+{
+    if (change(cullFaceMode, face))
+        glCullFace(face);
+}
+
+void GlStateCache::forgetProgram(GLuint value)
+{
+    if (program == value)
+        program = UNKNOWN;
+}
+
+void GlStateCache::forgetVertexArray(GLuint value)
+{
+    if (vertexArray == value)
+        vertexArray = UNKNOWN;
+}
+
+void GlStateCache::forgetBuffer(GLuint buffer)
+{
+    for (Binding& binding : buffers)
+        if (binding.object == buffer)
+            binding.object = UNKNOWN;
+}
+
+void GlStateCache::forgetTexture(GLuint texture)
+{
+    for (auto& unit : textures)
+        for (Binding& binding : unit)
+            if (binding.object == texture)
+                binding.object = UNKNOWN;
+}
+
+void GlStateCache::beginFrame()
+{
+    lastFrame = frame;
+    frame = Counters();
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <glad/glad.h>
+#include <cstdint>
+
+// Shadows the GL binding and fixed function state the renderer changes most and skips calls
+// that wouldn't change anything. Every change to tracked state has to go through the cache
+// (or be followed by invalidate()), otherwise the shadow copy goes stale. Deleting a GL
+// object unbinds it, so forget it here as well before its name can be reused.
+class GlStateCache
+{
+public:
+    static const int MAX_TEXTURE_UNITS = 32;
+    static const int MAX_BUFFER_TARGETS = 8;
+    static const int MAX_TEXTURE_TARGETS = 4;
+    static const int MAX_CAPABILITIES = 8;
+
+    struct Counters
+    {
+        uint32_t issued = 0;
+        uint32_t elided = 0;
+    };
+
+    GlStateCache();
+
+    void useProgram(GLuint program);
+    void bindVertexArray(GLuint vertexArray);
+    // the element array binding belongs to the bound vertex array, so it is passed straight through
+    void bindBuffer(GLenum target, GLuint buffer);
+    // always issued; the indexed binding also replaces the generic one
+    void bindBufferBase(GLenum target, GLuint index, GLuint buffer);
+    void activeTexture(GLuint unit);
+    // binds texture on unit, switching the active unit only if the binding changes
+    void bindTexture(GLuint unit, GLenum target, GLuint texture);
+    void enable(GLenum capability) { setEnabled(capability, true); }
+    void disable(GLenum capability) { setEnabled(capability, false); }
+    void setEnabled(GLenum capability, bool enabled);
+    void blendFunc(GLenum source, GLenum destination);
+    void depthFunc(GLenum function);
+    void depthMask(bool write);
+    void cullFace(GLenum face);
+
+    void forgetProgram(GLuint program);
+    void forgetVertexArray(GLuint vertexArray);
+    void forgetBuffer(GLuint buffer);
+    void forgetTexture(GLuint texture);
+    // forgets everything, e.g. after code that changes state behind the cache's back
+    void invalidate();
+
+    // starts counting a new frame; the previous frame's counts stay readable
+    void beginFrame();
+    const Counters& frameCounters() const { return frame; }
+    const Counters& lastFrameCounters() const { return lastFrame; }
+
+private:
+    static const GLuint UNKNOWN = 0xFFFFFFFF;
+
+    struct Binding
+    {
+        GLenum target;
+        GLuint object;
+    };
+
+    GLuint program;
+    GLuint vertexArray;
+    GLuint activeUnit;
+    Binding buffers[MAX_BUFFER_TARGETS];
+    Binding textures[MAX_TEXTURE_UNITS][MAX_TEXTURE_TARGETS];
+    Binding capabilities[MAX_CAPABILITIES]; // object holds 0/1
+    GLenum blendSource, blendDestination;
+    GLenum depthFunction;
+    GLuint depthWrite;
+    GLenum cullFaceMode;
+    Counters frame, lastFrame;
+
+    // true if the call has to be made; counts it either way
+    bool change(GLuint& cached, GLuint value);
+    GLuint& slot(Binding* bindings, int count, GLenum target);
+};
+
+// the cache for the (single) GL context of this application
+GlStateCache& glState();
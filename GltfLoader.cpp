@@ -0,0 +1,707 @@
+#include "GltfLoader.h"
+#include "GlStateCache.h"
+#include "MappedFile.h"
+#include "Json.h"
+#include "Mesh.h"
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+static const uint32_t GLB_MAGIC = 0x46546C67;      // "glTF"
+static const uint32_t GLB_CHUNK_JSON = 0x4E4F534A; // "JSON"
+static const uint32_t GLB_CHUNK_BIN = 0x004E4942;  // "BIN\0"
+static const uint32_t NONE = 0xFFFFFFFF;
+static const int64_t MODE_TRIANGLES = 4;
+
+// glTF names its component types by their GL enums
+static uint32_t componentSize(GLenum componentType)
+{
+    switch (componentType)
+    {
+    case GL_BYTE: case GL_UNSIGNED_BYTE: return 1;
+    case GL_SHORT: case GL_UNSIGNED_SHORT: return 2;
+    case GL_UNSIGNED_INT: case GL_FLOAT: return 4;
+    default: return 0;
+    }
+}
+
+static int componentCount(const JsonValue& type)
+{
+    if (type.equals("SCALAR")) return 1;
+    if (type.equals("VEC2")) return 2;
+    if (type.equals("VEC3")) return 3;
+    if (type.equals("VEC4")) return 4;
+    return 0;
+}
+
+struct BufferView
+{
+    uint32_t offset;   // in the binary chunk
+    uint32_t length;
+    uint32_t stride;   // 0 when tightly packed
+    GLuint buffer;     // uploaded on first use
+};
+
+struct Accessor
+{
+    uint32_t view;     // NONE for all zeros (or sparse only)
+    uint32_t offset;   // within the view
+    GLenum componentType;
+    int components;
+    bool normalized;
+    bool sparse;
+    uint32_t count;
+    bool hasBounds;
+    glm::vec3 min, max;
+
+    uint32_t elementSize() const { return componentSize(componentType) * components; }
+};
+
+// everything load needs while it works through the meshes
+struct GltfFile
+{
+    const unsigned char* binary = nullptr;
+    size_t binaryLength = 0;
+    std::vector<BufferView> views;
+    std::vector<Accessor> accessors;
+
+    uint32_t stride(const Accessor& accessor) const
+    {
+        uint32_t viewStride = views[accessor.view].stride;
+        return viewStride != 0 ? viewStride : accessor.elementSize();
+    }
+};
+
+static float readComponent(const unsigned char* data, GLenum componentType, bool normalized)
+{
+    switch (componentType)
+    {
+    case GL_FLOAT: { float value; memcpy(&value, data, 4); return value; }
+    case GL_UNSIGNED_BYTE: return normalized ? data[0] / 255.0f : data[0];
+    case GL_BYTE: { int8_t value = (int8_t)data[0]; return normalized ? std::max(value / 127.0f, -1.0f) : value; }
+    case GL_UNSIGNED_SHORT: { uint16_t value; memcpy(&value, data, 2); return normalized ? value / 65535.0f : value; }
+    case GL_SHORT: { int16_t value; memcpy(&value, data, 2); return normalized ? std::max(value / 32767.0f, -1.0f) : value; }
+    case GL_UNSIGNED_INT: { uint32_t value; memcpy(&value, data, 4); return (float)value; }
+    default: return 0.0f;
+    }
+}
+
+// reads up to four components of element; accessors without a view read as zeros
+static glm::vec4 readElement(const GltfFile& file, const Accessor& accessor, uint32_t element)
+{
+    glm::vec4 value(0.0f);
+    if (accessor.view == NONE)
+        return value;
+    const unsigned char* data = file.binary + file.views[accessor.view].offset + accessor.offset + (size_t)element * file.stride(accessor);
+    uint32_t size = componentSize(accessor.componentType);
+    for (int i = 0; i < accessor.components && i < 4; i++)
+        value[i] = readComponent(data + i * size, accessor.componentType, accessor.normalized);
+    return value;
+}
+
+static uint32_t readIndex(const GltfFile& file, const Accessor& accessor, uint32_t element)
+{
+    if (accessor.view == NONE)
+        return 0;
+    const unsigned char* data = file.binary + file.views[accessor.view].offset + accessor.offset + (size_t)element * file.stride(accessor);
+    switch (accessor.componentType)
+    {
+    case GL_UNSIGNED_BYTE: return data[0];
+    case GL_UNSIGNED_SHORT: { uint16_t value; memcpy(&value, data, 2); return value; }
+    default: { uint32_t value; memcpy(&value, data, 4); return value; }
+    }
+}
+
+// true when every element of the accessor lies inside its view
+static bool accessorInBounds(const GltfFile& file, const Accessor& accessor)
+{
+    if (accessor.view == NONE)
+        return true;
+    if (accessor.view >= file.views.size() || accessor.elementSize() == 0)
+        return false;
+    if (accessor.count == 0)
+        return true;
+    uint64_t last = (uint64_t)accessor.offset + (uint64_t)(accessor.count - 1) * file.stride(accessor) + accessor.elementSize();
+    return last <= file.views[accessor.view].length;
+}
+
+// maps path and parses the GLB container, its JSON, buffer views and accessors; mapping has
+// to stay open as long as document and file are used
+static bool readGlb(const char* path, MappedFile& mapping, JsonDocument& document, GltfFile& file)
+{
+    if (!mapping.open(path))
+    {
+        std::cout << "ERROR::GLTF::FILE_NOT_SUCCESSFULLY_READ " << path << std::endl;
+        return false;
+    }
+
+    // header, then the JSON chunk and an optional binary chunk, each 4 byte aligned
+    const unsigned char* bytes = (const unsigned char*)mapping.data();
+    uint32_t header[3];
+    if (mapping.size() < 20)
+    {
+        std::cout << "ERROR::GLTF::NOT_A_GLB " << path << std::endl;
+        return false;
+    }
+    memcpy(header, bytes, 12);
+    if (header[0] != GLB_MAGIC || header[1] != 2 || header[2] > mapping.size())
+    {
+        std::cout << "ERROR::GLTF::NOT_A_GLB " << path << std::endl;
+        return false;
+    }
+    const char* json = nullptr;
+    size_t jsonLength = 0;
+    for (size_t offset = 12; offset + 8 <= header[2];)
+    {
+        uint32_t chunk[2];
+        memcpy(chunk, bytes + offset, 8);
+        if (offset + 8 + chunk[0] > header[2])
+            break;
+        if (chunk[1] == GLB_CHUNK_JSON && json == nullptr)
+        {
+            json = (const char*)bytes + offset + 8;
+            jsonLength = chunk[0];
+        }
+        else if (chunk[1] == GLB_CHUNK_BIN && file.binary == nullptr)
+        {
+            file.binary = bytes + offset + 8;
+            file.binaryLength = chunk[0];
+        }
+        offset += 8 + ((chunk[0] + 3) & ~3u);
+    }
+    if (json == nullptr || !document.parse(json, jsonLength))
+    {
+        std::cout << "ERROR::GLTF::INVALID_JSON " << path << std::endl;
+        return false;
+    }
+    JsonValue root = document.root();
+
+    // anything we would have to understand to draw the file correctly
+    JsonValue required = root["extensionsRequired"];
+    JsonValue extension = required.first();
+    for (size_t i = 0; i < required.size(); i++, extension = extension.next())
+    {
+        if (!extension.equals("KHR_mesh_quantization"))
+        {
+            std::cout << "ERROR::GLTF::UNSUPPORTED_EXTENSION " << extension.string() << " " << path << std::endl;
+            return false;
+        }
+    }
+
+    // only the GLB's own buffer is supported; external .bin files and data URIs are not
+    JsonValue jsonBuffers = root["buffers"];
+    if (jsonBuffers.size() > 1 || (jsonBuffers.size() == 1 && (jsonBuffers[(size_t)0]["uri"].isValid() || file.binary == nullptr)))
+    {
+        std::cout << "ERROR::GLTF::EXTERNAL_BUFFERS_UNSUPPORTED " << path << std::endl;
+        return false;
+    }
+
+    JsonValue jsonViews = root["bufferViews"];
+    JsonValue jsonView = jsonViews.first();
+    for (size_t i = 0; i < jsonViews.size(); i++, jsonView = jsonView.next())
+    {
+        BufferView view;
+        view.offset = (uint32_t)jsonView["byteOffset"].integer(0);
+        view.length = (uint32_t)jsonView["byteLength"].integer(0);
+        view.stride = (uint32_t)jsonView["byteStride"].integer(0);
+        view.buffer = 0;
+        if (jsonView["buffer"].integer(-1) != 0 || (uint64_t)view.offset + view.length > file.binaryLength)
+        {
+            std::cout << "ERROR::GLTF::INVALID_BUFFER_VIEW " << i << " " << path << std::endl;
+            return false;
+        }
+        file.views.push_back(view);
+    }
+
+    JsonValue jsonAccessors = root["accessors"];
+    JsonValue jsonAccessor = jsonAccessors.first();
+    for (size_t i = 0; i < jsonAccessors.size(); i++, jsonAccessor = jsonAccessor.next())
+    {
+        Accessor accessor;
+        accessor.view = (uint32_t)jsonAccessor["bufferView"].integer(NONE);
+        accessor.offset = (uint32_t)jsonAccessor["byteOffset"].integer(0);
+        accessor.componentType = (GLenum)jsonAccessor["componentType"].integer(0);
+        accessor.components = componentCount(jsonAccessor["type"]);
+        accessor.normalized = jsonAccessor["normalized"].boolean(false);
+        accessor.sparse = jsonAccessor["sparse"].isValid();
+        accessor.count = (uint32_t)jsonAccessor["count"].integer(0);
+        JsonValue min = jsonAccessor["min"];
+        JsonValue max = jsonAccessor["max"];
+        accessor.hasBounds = min.size() >= 3 && max.size() >= 3;
+        for (int k = 0; k < 3 && accessor.hasBounds; k++)
+        {
+            accessor.min[k] = (float)min[(size_t)k].number();
+            accessor.max[k] = (float)max[(size_t)k].number();
+        }
+        if (!accessorInBounds(file, accessor))
+        {
+            std::cout << "ERROR::GLTF::INVALID_ACCESSOR " << i << " " << path << std::endl;
+            return false;
+        }
+        file.accessors.push_back(accessor);
+    }
+    return true;
+}
+
+struct PrimitiveAccessors
+{
+    const Accessor* positions;
+    const Accessor* texCoords;  // null when the primitive has none
+    const Accessor* normals;
+    const Accessor* indices;
+};
+
+// looks up a primitive's accessors; prints the reason and returns false for one that can't
+// be drawn as triangles, which callers skip
+static bool primitiveAccessors(const GltfFile& file, const JsonValue& jsonPrimitive, size_t m, size_t p, const char* path, PrimitiveAccessors& accessors)
+{
+    if (jsonPrimitive["mode"].integer(MODE_TRIANGLES) != MODE_TRIANGLES)
+    {
+        std::cout << "ERROR::GLTF::UNSUPPORTED_PRIMITIVE_MODE mesh " << m << " primitive " << p << " " << path << std::endl;
+        return false;
+    }
+    auto accessorAt = [&file](const JsonValue& index) -> const Accessor*
+    {
+        int64_t i = index.integer(-1);
+        return i >= 0 && i < (int64_t)file.accessors.size() ? &file.accessors[(size_t)i] : nullptr;
+    };
+    JsonValue attributes = jsonPrimitive["attributes"];
+    accessors.positions = accessorAt(attributes["POSITION"]);
+    accessors.texCoords = accessorAt(attributes["TEXCOORD_0"]);
+    accessors.normals = accessorAt(attributes["NORMAL"]);
+    accessors.indices = accessorAt(jsonPrimitive["indices"]);
+    const Accessor* indices = accessors.indices;
+    if (accessors.positions == nullptr || accessors.positions->components != 3 ||
+        (accessors.texCoords && accessors.texCoords->components != 2) || (accessors.normals && accessors.normals->components != 3) ||
+        (indices && (indices->components != 1 || indices->componentType == GL_FLOAT || indices->componentType == GL_BYTE || indices->componentType == GL_SHORT)))
+    {
+        std::cout << "ERROR::GLTF::INVALID_PRIMITIVE mesh " << m << " primitive " << p << " " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// converts a primitive to MeshVertex and 32 bit indices, filling in what's missing
+static void readPrimitive(const GltfFile& file, const PrimitiveAccessors& accessors, Mesh& converted)
+{
+    const Accessor* positions = accessors.positions;
+    const Accessor* texCoords = accessors.texCoords;
+    const Accessor* normals = accessors.normals;
+    converted.vertices.resize(positions->count);
+    for (uint32_t v = 0; v < positions->count; v++)
+    {
+        MeshVertex& vertex = converted.vertices[v];
+        vertex.position = glm::vec3(readElement(file, *positions, v));
+        vertex.texCoord = texCoords && v < texCoords->count ? glm::vec2(readElement(file, *texCoords, v)) : glm::vec2(0.0f);
+        vertex.normal = normals && v < normals->count ? glm::vec3(readElement(file, *normals, v)) : glm::vec3(0.0f);
+    }
+    if (accessors.indices)
+    {
+        converted.indices.resize(accessors.indices->count);
+        for (uint32_t i = 0; i < accessors.indices->count; i++)
+            converted.indices[i] = std::min(readIndex(file, *accessors.indices, i), positions->count - 1);
+    }
+    else
+    {
+        converted.indices.resize(positions->count);
+        for (uint32_t i = 0; i < positions->count; i++)
+            converted.indices[i] = i;
+    }
+    // a partial last triangle is dropped, as a draw would
+    converted.indices.resize(converted.indices.size() - converted.indices.size() % 3);
+    if (normals == nullptr)
+        converted.computeNormals();
+}
+
+GltfModel::~GltfModel()
+{
+    release();
+}
+
+void GltfModel::release()
+{
+    for (GLuint buffer : buffers)
+        glState().forgetBuffer(buffer);
+    if (!buffers.empty())
+        glDeleteBuffers((GLsizei)buffers.size(), buffers.data());
+    buffers.clear();
+    primitiveList.clear();
+    meshList.clear();
+    nodes.clear();
+    rootNodes.clear();
+    bytesUploaded = 0;
+}
+
+GLuint GltfModel::upload(const void* data, size_t size)
+{
+    GLuint buffer;
+    glGenBuffers(1, &buffer);
+    glState().bindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    if (GLAD_GL_VERSION_4_4)
+        glBufferStorage(GL_COPY_WRITE_BUFFER, size, data, 0);
+    else
+        glBufferData(GL_COPY_WRITE_BUFFER, size, data, GL_STATIC_DRAW);
+    buffers.push_back(buffer);
+    bytesUploaded += size;
+    return buffer;
+}
+
+bool GltfModel::load(const char* path)
+{
+    release();
+
+    MappedFile mapping;
+    JsonDocument document;
+    GltfFile file;
+    if (!readGlb(path, mapping, document, file))
+        return false;
+    JsonValue root = document.root();
+    auto viewBuffer = [this, &file](uint32_t view)
+    {
+        BufferView& bufferView = file.views[view];
+        if (bufferView.buffer == 0)
+            bufferView.buffer = upload(file.binary + bufferView.offset, bufferView.length);
+        return bufferView.buffer;
+    };
+
+    JsonValue jsonMeshes = root["meshes"];
+    JsonValue jsonMesh = jsonMeshes.first();
+    for (size_t m = 0; m < jsonMeshes.size(); m++, jsonMesh = jsonMesh.next())
+    {
+        GltfMesh mesh;
+        mesh.firstPrimitive = (uint32_t)primitiveList.size();
+        glm::vec3 meshMin(FLT_MAX), meshMax(-FLT_MAX);
+
+        JsonValue jsonPrimitives = jsonMesh["primitives"];
+        JsonValue jsonPrimitive = jsonPrimitives.first();
+        for (size_t p = 0; p < jsonPrimitives.size(); p++, jsonPrimitive = jsonPrimitive.next())
+        {
+            PrimitiveAccessors accessors;
+            if (!primitiveAccessors(file, jsonPrimitive, m, p, path, accessors))
+                continue;
+            const Accessor* positions = accessors.positions;
+            const Accessor* indices = accessors.indices;
+
+            GltfPrimitive primitive;
+            const Accessor* streams[3] = { positions, accessors.texCoords, accessors.normals };
+            static const char* const streamNames[3] = { "aPos", "aTexCoord", "aNormal" };
+            bool direct = true;
+            for (const Accessor* accessor : streams)
+                direct = direct && accessor != nullptr && !accessor->sparse && accessor->view != NONE;
+
+            if (direct)
+            {
+                // attribute offsets are relative to the start of the view's buffer
+                for (int s = 0; s < 3; s++)
+                {
+                    const Accessor& accessor = *streams[s];
+                    VertexFormat format;
+                    format.attributes.push_back({ streamNames[s], accessor.components, accessor.componentType,
+                        accessor.normalized ? (GLboolean)GL_TRUE : (GLboolean)GL_FALSE, (GLsizei)accessor.offset });
+                    format.stride = (GLsizei)file.stride(accessor);
+                    primitive.formats.push_back(format);
+                    primitive.streamBuffers.push_back(viewBuffer(accessor.view));
+                }
+            }
+            else
+            {
+                Mesh converted;
+                readPrimitive(file, accessors, converted);
+                primitive.formats.push_back(Mesh::vertexFormat());
+                primitive.streamBuffers.push_back(upload(converted.vertices.data(), converted.vertices.size() * sizeof(MeshVertex)));
+                primitive.repacked = true;
+                std::cout << "WARNING::GLTF::PRIMITIVE_REPACKED mesh " << m << " primitive " << p << std::endl;
+            }
+
+            if (indices && indices->view != NONE && !indices->sparse && file.views[indices->view].stride == 0)
+            {
+                primitive.indexBuffer = viewBuffer(indices->view);
+                primitive.indexSize = componentSize(indices->componentType);
+                primitive.firstIndex = indices->offset / primitive.indexSize;
+                primitive.count = indices->count;
+            }
+            else if (indices)
+            {
+                // the buffers already uploaded for it stay with the model and go at release
+                std::cout << "ERROR::GLTF::UNSUPPORTED_INDICES mesh " << m << " primitive " << p << " " << path << std::endl;
+                continue;
+            }
+            else
+            {
+                primitive.count = positions->count;
+            }
+
+            // the spec requires position bounds; files that leave them out get them computed
+            glm::vec3 low = positions->min, high = positions->max;
+            if (!positions->hasBounds)
+            {
+                low = glm::vec3(FLT_MAX);
+                high = glm::vec3(-FLT_MAX);
+                for (uint32_t v = 0; v < positions->count; v++)
+                {
+                    glm::vec3 position = glm::vec3(readElement(file, *positions, v));
+                    low = glm::min(low, position);
+                    high = glm::max(high, position);
+                }
+            }
+            meshMin = glm::min(meshMin, low);
+            meshMax = glm::max(meshMax, high);
+            primitiveList.push_back(primitive);
+        }
+
+        mesh.primitiveCount = (uint32_t)primitiveList.size() - mesh.firstPrimitive;
+        if (mesh.primitiveCount == 0)
+            meshMin = meshMax = glm::vec3(0.0f);
+        mesh.boundsCenter = 0.5f * (meshMin + meshMax);
+        mesh.boundingRadius = 0.5f * glm::length(meshMax - meshMin);
+        meshList.push_back(mesh);
+    }
+
+    readNodes(root, meshList.size(), nodes, rootNodes);
+    return true;
+}
+
+void GltfModel::readNodes(const JsonValue& root, size_t meshCount, std::vector<Node>& nodes, std::vector<uint32_t>& rootNodes)
+{
+    JsonValue jsonNodes = root["nodes"];
+    JsonValue jsonNode = jsonNodes.first();
+    std::vector<uint8_t> hasParent(jsonNodes.size(), 0);
+    for (size_t n = 0; n < jsonNodes.size(); n++, jsonNode = jsonNode.next())
+    {
+        Node node;
+        node.mesh = (uint32_t)jsonNode["mesh"].integer(NONE);
+        if (node.mesh != NONE && node.mesh >= meshCount)
+            node.mesh = NONE;
+        JsonValue matrix = jsonNode["matrix"];
+        if (matrix.size() == 16)
+        {
+            // column major, like glm
+            JsonValue element = matrix.first();
+            for (int i = 0; i < 16; i++, element = element.next())
+                node.local[i / 4][i % 4] = (float)element.number();
+        }
+        else
+        {
+            JsonValue t = jsonNode["translation"], r = jsonNode["rotation"], s = jsonNode["scale"];
+            glm::vec3 translation((float)t[(size_t)0].number(0.0), (float)t[1].number(0.0), (float)t[2].number(0.0));
+            // glTF stores quaternions as x, y, z, w
+            glm::quat rotation((float)r[3].number(1.0), (float)r[(size_t)0].number(0.0), (float)r[1].number(0.0), (float)r[2].number(0.0));
+            glm::vec3 scale((float)s[(size_t)0].number(1.0), (float)s[1].number(1.0), (float)s[2].number(1.0));
+            node.local = glm::translate(glm::mat4(1.0f), translation) * glm::mat4_cast(rotation) * glm::scale(glm::mat4(1.0f), scale);
+        }
+        JsonValue children = jsonNode["children"];
+        JsonValue child = children.first();
+        for (size_t c = 0; c < children.size(); c++, child = child.next())
+        {
+            int64_t index = child.integer(-1);
+            if (index >= 0 && index < (int64_t)jsonNodes.size())
+            {
+                node.children.push_back((uint32_t)index);
+                hasParent[(size_t)index] = 1;
+            }
+        }
+        nodes.push_back(node);
+    }
+
+    // the default scene's roots; without scenes, every node that isn't someone's child
+    JsonValue scenes = root["scenes"];
+    JsonValue scene = scenes[(size_t)root["scene"].integer(0)];
+    if (scene.isValid())
+    {
+        JsonValue sceneNodes = scene["nodes"];
+        JsonValue sceneNode = sceneNodes.first();
+        for (size_t i = 0; i < sceneNodes.size(); i++, sceneNode = sceneNode.next())
+        {
+            int64_t index = sceneNode.integer(-1);
+            if (index >= 0 && index < (int64_t)nodes.size())
+                rootNodes.push_back((uint32_t)index);
+        }
+    }
+    else
+    {
+        for (uint32_t n = 0; n < nodes.size(); n++)
+            if (!hasParent[n])
+                rootNodes.push_back(n);
+    }
+}
+
+GLuint GltfModel::createVertexArray(size_t primitive, const ProgramReflection& program, const std::vector<VertexStream>& extraStreams) const
+{
+    const GltfPrimitive& source = primitiveList[primitive];
+    std::vector<VertexStream> streams;
+    for (size_t i = 0; i < source.formats.size(); i++)
+        streams.push_back({ source.streamBuffers[i], &source.formats[i] });
+    streams.insert(streams.end(), extraStreams.begin(), extraStreams.end());
+
+    GLuint vertexArray;
+    glGenVertexArrays(1, &vertexArray);
+    glState().bindVertexArray(vertexArray);
+    bindVertexStreams(program, streams);
+    if (source.indexBuffer != 0)
+        glState().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, source.indexBuffer);
+    glState().bindVertexArray(0);
+    return vertexArray;
+}
+
+// splits an affine matrix into translation, rotation and scale; shear is lost
+static void decompose(const glm::mat4& matrix, glm::vec3& translation, glm::quat& rotation, glm::vec3& scale)
+{
+    translation = glm::vec3(matrix[3]);
+    glm::mat3 basis(matrix);
+    scale = glm::vec3(glm::length(basis[0]), glm::length(basis[1]), glm::length(basis[2]));
+    // a mirrored basis keeps its rotation proper by flipping one axis into the scale
+    if (glm::determinant(basis) < 0.0f)
+        scale.x = -scale.x;
+    for (int i = 0; i < 3; i++)
+        basis[i] = scale[i] != 0.0f ? basis[i] / scale[i] : glm::vec3(0.0f);
+    rotation = glm::normalize(glm::quat_cast(basis));
+}
+
+void GltfModel::placeMeshes(const std::vector<Node>& nodes, const std::vector<uint32_t>& rootNodes, std::vector<Placement>& placements)
+{
+    struct Pending
+    {
+        uint32_t node;
+        glm::mat4 parentWorld;
+    };
+    std::vector<Pending> stack;
+    for (auto it = rootNodes.rbegin(); it != rootNodes.rend(); ++it)
+        stack.push_back({ *it, glm::mat4(1.0f) });
+
+    // a malformed file may link nodes into a cycle; no valid tree visits a node twice
+    size_t visitsLeft = nodes.size() * 2 + rootNodes.size();
+    while (!stack.empty() && visitsLeft-- > 0)
+    {
+        Pending pending = stack.back();
+        stack.pop_back();
+        const Node& node = nodes[pending.node];
+        glm::mat4 world = pending.parentWorld * node.local;
+        if (node.mesh != NONE)
+            placements.push_back({ node.mesh, world });
+        for (auto it = node.children.rbegin(); it != node.children.rend(); ++it)
+            stack.push_back({ *it, world });
+    }
+}
+
+void GltfModel::instantiate(TransformHierarchy& hierarchy, Scene& scene, std::vector<GltfInstance>& instances) const
+{
+    struct Pending
+    {
+        uint32_t node;
+        uint32_t parent; // hierarchy id of the parent
+        glm::mat4 parentWorld;
+    };
+    std::vector<Pending> stack;
+    for (auto it = rootNodes.rbegin(); it != rootNodes.rend(); ++it)
+        stack.push_back({ *it, TransformHierarchy::NONE, glm::mat4(1.0f) });
+
+    // depth first, like placeMeshes, so the hierarchy is created already sorted
+    size_t visitsLeft = nodes.size() * 2 + rootNodes.size();
+    while (!stack.empty() && visitsLeft-- > 0)
+    {
+        Pending pending = stack.back();
+        stack.pop_back();
+        const Node& node = nodes[pending.node];
+        glm::vec3 translation, scale;
+        glm::quat rotation;
+        // glTF requires node matrices to be decomposable, so the local transform is exact
+        decompose(node.local, translation, rotation, scale);
+        uint32_t id = hierarchy.create(pending.parent, translation, rotation, scale);
+        glm::mat4 world = pending.parentWorld * node.local;
+        for (auto it = node.children.rbegin(); it != node.children.rend(); ++it)
+            stack.push_back({ *it, id, world });
+        if (node.mesh == NONE || meshList[node.mesh].primitiveCount == 0)
+            continue;
+
+        // a sheared world isn't T * R * S; the object's sphere is then grown to cover the mesh
+        // under the real transform (the Frobenius norm bounds how far the basis stretches)
+        const GltfMesh& mesh = meshList[node.mesh];
+        decompose(world, translation, rotation, scale);
+        glm::mat4 placed = glm::translate(glm::mat4(1.0f), translation) * glm::mat4_cast(rotation) * glm::scale(glm::mat4(1.0f), scale);
+        float largestScale = std::max(std::fabs(scale.x), std::max(std::fabs(scale.y), std::fabs(scale.z)));
+        float radius = mesh.boundingRadius;
+        glm::mat3 basis(world), placedBasis(placed);
+        float basisError = std::max(glm::length(basis[0] - placedBasis[0]), std::max(glm::length(basis[1] - placedBasis[1]), glm::length(basis[2] - placedBasis[2])));
+        if (largestScale > 0.0f && basisError > 1e-4f * largestScale)
+        {
+            float stretch = std::sqrt(glm::dot(basis[0], basis[0]) + glm::dot(basis[1], basis[1]) + glm::dot(basis[2], basis[2]));
+            float offset = glm::length(glm::vec3(world * glm::vec4(mesh.boundsCenter, 1.0f)) - glm::vec3(placed * glm::vec4(mesh.boundsCenter, 1.0f)));
+            radius = (offset + mesh.boundingRadius * stretch) / largestScale;
+        }
+        instances.push_back({ scene.create(translation, rotation, scale, radius, mesh.boundsCenter), node.mesh, id });
+    }
+}
+
+bool GltfModel::loadMesh(const char* path, Mesh& mesh)
+{
+    MappedFile mapping;
+    JsonDocument document;
+    GltfFile file;
+    if (!readGlb(path, mapping, document, file))
+        return false;
+    JsonValue root = document.root();
+
+    // every glTF mesh converted once, however many nodes place it
+    JsonValue jsonMeshes = root["meshes"];
+    std::vector<Mesh> parts(jsonMeshes.size());
+    JsonValue jsonMesh = jsonMeshes.first();
+    for (size_t m = 0; m < jsonMeshes.size(); m++, jsonMesh = jsonMesh.next())
+    {
+        JsonValue jsonPrimitives = jsonMesh["primitives"];
+        JsonValue jsonPrimitive = jsonPrimitives.first();
+        for (size_t p = 0; p < jsonPrimitives.size(); p++, jsonPrimitive = jsonPrimitive.next())
+        {
+            PrimitiveAccessors accessors;
+            if (!primitiveAccessors(file, jsonPrimitive, m, p, path, accessors))
+                continue;
+            Mesh primitive;
+            readPrimitive(file, accessors, primitive);
+            uint32_t base = (uint32_t)parts[m].vertices.size();
+            parts[m].vertices.insert(parts[m].vertices.end(), primitive.vertices.begin(), primitive.vertices.end());
+            for (uint32_t index : primitive.indices)
+                parts[m].indices.push_back(base + index);
+        }
+    }
+
+    std::vector<Node> nodes;
+    std::vector<uint32_t> rootNodes;
+    readNodes(root, parts.size(), nodes, rootNodes);
+    std::vector<Placement> placements;
+    placeMeshes(nodes, rootNodes, placements);
+
+    // the hierarchy is baked into the vertices; normals go through the inverse transpose and
+    // mirrored placements get their triangles flipped to keep them front facing
+    mesh = Mesh();
+    for (const Placement& placement : placements)
+    {
+        const Mesh& part = parts[placement.mesh];
+        glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(placement.world)));
+        bool mirrored = glm::determinant(glm::mat3(placement.world)) < 0.0f;
+        uint32_t base = (uint32_t)mesh.vertices.size();
+        for (const MeshVertex& source : part.vertices)
+        {
+            MeshVertex vertex = source;
+            vertex.position = glm::vec3(placement.world * glm::vec4(source.position, 1.0f));
+            glm::vec3 normal = normalMatrix * source.normal;
+            vertex.normal = glm::length(normal) > 0.0f ? glm::normalize(normal) : normal;
+            mesh.vertices.push_back(vertex);
+        }
+        for (size_t i = 0; i < part.indices.size(); i += 3)
+        {
+            mesh.indices.push_back(base + part.indices[i]);
+            mesh.indices.push_back(base + part.indices[mirrored ? i + 2 : i + 1]);
+            mesh.indices.push_back(base + part.indices[mirrored ? i + 1 : i + 2]);
+        }
+    }
+    if (mesh.indices.empty())
+    {
+        std::cout << "ERROR::GLTF::NO_TRIANGLES " << path << std::endl;
+        return false;
+    }
+    mesh.computeBounds();
+    return true;
+}
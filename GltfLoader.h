@@ -0,0 +1,109 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include "VertexFormat.h"
+#include "ShaderReflection.h"
+#include "Scene.h"
+#include "TransformHierarchy.h"
+#include "Mesh.h"
+
+class JsonValue;
+
+// One drawable part of a glTF mesh. Its vertices stay in the layout the file stores them in:
+// one stream per attribute (aPos, aTexCoord, aNormal, in the shaders' location order) sourced
+// straight from the uploaded buffer views. Primitives missing an attribute the shaders need,
+// or using sparse accessors, are converted to MeshVertex instead and have a single stream.
+struct GltfPrimitive
+{
+    std::vector<VertexFormat> formats;
+    std::vector<GLuint> streamBuffers;  // buffer of each format
+    GLuint indexBuffer = 0;             // 0 draws count vertices without indices
+    uint32_t indexSize = 4;             // bytes per index
+    uint32_t firstIndex = 0;            // in indices from the start of indexBuffer
+    uint32_t count = 0;
+    bool repacked = false;
+};
+
+struct GltfMesh
+{
+    uint32_t firstPrimitive;
+    uint32_t primitiveCount;
+    // sphere around the primitives' position bounds
+    glm::vec3 boundsCenter;
+    float boundingRadius;
+};
+
+// scene object created for a node that has a mesh
+struct GltfInstance
+{
+    SceneHandle object;
+    uint32_t mesh;
+    uint32_t node; // the node's id in the TransformHierarchy
+};
+
+// glTF 2.0 binary (.glb) model. The file is mapped, its JSON chunk parsed in place by
+// JsonDocument and every buffer view that holds vertices or indices uploaded from the mapping
+// as is: glBufferStorage on GL 4.4 (immutable, so the driver may place it where it likes),
+// glBufferData before that. Materials, textures, animation and skins are not read.
+class GltfModel
+{
+public:
+    GltfModel() = default;
+    ~GltfModel();
+    GltfModel(const GltfModel&) = delete;
+    GltfModel& operator=(const GltfModel&) = delete;
+
+    // prints ERROR::GLTF:: and returns false when the file can't be used; primitives that
+    // can't be drawn (points, lines) are skipped with a message and the rest still load
+    bool load(const char* path);
+    // deletes the GL buffers
+    void release();
+
+    // reads the file's default scene into one CPU side mesh instead, with every node's world
+    // transform baked into its vertices; this is what the mesh cooker uses
+    static bool loadMesh(const char* path, Mesh& mesh);
+
+    // vertex array sourcing program's inputs from the primitive's streams followed by
+    // extraStreams (per-instance data), with the index buffer attached
+    GLuint createVertexArray(size_t primitive, const ProgramReflection& program, const std::vector<VertexStream>& extraStreams) const;
+
+    // Adds the default scene's nodes to hierarchy under their glTF parents, and an object to
+    // scene for every node with a mesh, placed at the node's world transform for culling. That
+    // placement is T * R * S, which can't hold the shear a non-uniformly scaled parent puts on a
+    // rotated child, so draw with hierarchy.world(instance.node) once hierarchy is updated.
+    void instantiate(TransformHierarchy& hierarchy, Scene& scene, std::vector<GltfInstance>& instances) const;
+
+    const std::vector<GltfPrimitive>& primitives() const { return primitiveList; }
+    const std::vector<GltfMesh>& meshes() const { return meshList; }
+    size_t uploadedBytes() const { return bytesUploaded; }
+
+private:
+    struct Node
+    {
+        glm::mat4 local;
+        uint32_t mesh;
+        std::vector<uint32_t> children;
+    };
+
+    // a node's mesh and where the node hierarchy puts it
+    struct Placement
+    {
+        uint32_t mesh;
+        glm::mat4 world;
+    };
+
+    std::vector<GLuint> buffers;
+    std::vector<GltfPrimitive> primitiveList;
+    std::vector<GltfMesh> meshList;
+    std::vector<Node> nodes;
+    std::vector<uint32_t> rootNodes;
+    size_t bytesUploaded = 0;
+
+    GLuint upload(const void* data, size_t size);
+    static void readNodes(const JsonValue& root, size_t meshCount, std::vector<Node>& nodes, std::vector<uint32_t>& rootNodes);
+    // every node with a mesh reachable from rootNodes, in depth first order
+    static void placeMeshes(const std::vector<Node>& nodes, const std::vector<uint32_t>& rootNodes, std::vector<Placement>& placements);
+};
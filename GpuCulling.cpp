@@ -0,0 +1,301 @@
+#include "GpuCulling.h"
+#include "GlStateCache.h"
+#include <vector>
+#include <algorithm>
+
+bool GpuCulling::isSupported()
+{
+    return GLAD_GL_VERSION_4_3 != 0;
+}
+
+GpuCulling::GpuCulling(unsigned int maxObjects)
+    : cullShader("cullComputeShader.glsl"), meshletShader("meshletCullComputeShader.glsl"), hiZShader("hiZComputeShader.glsl"),
+      capacity(maxObjects), commandCapacity(maxObjects)
+{
+    glGenBuffers(1, &boundsBuffer);
+    glState().bindBuffer(GL_SHADER_STORAGE_BUFFER, boundsBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, capacity * sizeof(glm::vec4), NULL, GL_STATIC_DRAW);
+
+    glGenBuffers(1, &commandBuffer);
+    glState().bindBuffer(GL_SHADER_STORAGE_BUFFER, commandBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, capacity * sizeof(DrawElementsIndirectCommand), NULL, GL_DYNAMIC_DRAW);
+    glState().bindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    glGenBuffers(1, &counterBuffer);
+    glState().bindBuffer(GL_ATOMIC_COUNTER_BUFFER, counterBuffer);
+    glBufferData(GL_ATOMIC_COUNTER_BUFFER, sizeof(GLuint), NULL, GL_DYNAMIC_DRAW);
+    glState().bindBuffer(GL_ATOMIC_COUNTER_BUFFER, 0);
+
+    // every object starts at the full mesh
+    const GLuint zero = 0;
+    glGenBuffers(1, &objectLodBuffer);
+    glState().bindBuffer(GL_SHADER_STORAGE_BUFFER, objectLodBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, capacity * sizeof(GLuint), NULL, GL_DYNAMIC_COPY);
+    glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+    glGenBuffers(1, &lodBuffer);
+    glGenBuffers(1, &meshletBuffer);
+    glGenBuffers(1, &visibleBuffer);
+    glState().bindBuffer(GL_SHADER_STORAGE_BUFFER, visibleBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, (3 + capacity) * sizeof(GLuint), NULL, GL_DYNAMIC_COPY);
+    glState().bindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+GpuCulling::~GpuCulling()
+{
+    GlStateCache& state = glState();
+    state.forgetBuffer(boundsBuffer);
+    state.forgetBuffer(commandBuffer);
+    state.forgetBuffer(counterBuffer);
+    state.forgetBuffer(lodBuffer);
+    state.forgetBuffer(objectLodBuffer);
+    state.forgetBuffer(meshletBuffer);
+    state.forgetBuffer(visibleBuffer);
+    state.forgetTexture(depthTexture);
+    state.forgetTexture(hiZTexture);
+    state.forgetProgram(cullShader.ID);
+    state.forgetProgram(meshletShader.ID);
+    state.forgetProgram(hiZShader.ID);
+    glDeleteBuffers(1, &boundsBuffer);
+    glDeleteBuffers(1, &commandBuffer);
+    glDeleteBuffers(1, &counterBuffer);
+    glDeleteBuffers(1, &lodBuffer);
+    glDeleteBuffers(1, &objectLodBuffer);
+    glDeleteBuffers(1, &meshletBuffer);
+    glDeleteBuffers(1, &visibleBuffer);
+    glDeleteTextures(1, &depthTexture);
+    glDeleteTextures(1, &hiZTexture);
+    glDeleteProgram(cullShader.ID);
+    glDeleteProgram(meshletShader.ID);
+    glDeleteProgram(hiZShader.ID);
+}
+
+void GpuCulling::setBounds(const SphereSoA& spheres)
+{
+    size_t count = std::min(spheres.size(), (size_t)capacity);
+    std::vector<glm::vec4> packed(count);
+    for (size_t i = 0; i < count; i++)
+        packed[i] = glm::vec4(spheres.centerX[i], spheres.centerY[i], spheres.centerZ[i], spheres.radius[i]);
+    glState().bindBuffer(GL_SHADER_STORAGE_BUFFER, boundsBuffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, count * sizeof(glm::vec4), packed.data());
+    glState().bindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void GpuCulling::setLods(const MeshLod* lods, size_t count)
+{
+    // std430 layout of the shaders' Lod: the index and meshlet ranges, error, padding
+    struct PackedLod
+    {
+        GLuint firstIndex;
+        GLuint indexCount;
+        GLuint firstMeshlet;
+        GLuint meshletCount;
+        float error;
+        float padding;
+    };
+    std::vector<PackedLod> packed(count);
+    maxLodMeshlets = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        packed[i] = { lods[i].firstIndex, lods[i].indexCount, lods[i].firstMeshlet, lods[i].meshletCount, lods[i].error, 0.0f };
+        maxLodMeshlets = std::max(maxLodMeshlets, lods[i].meshletCount);
+    }
+    lodCount = (unsigned int)count;
+    glState().bindBuffer(GL_SHADER_STORAGE_BUFFER, lodBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, std::max<size_t>(count, 1) * sizeof(PackedLod), packed.data(), GL_STATIC_DRAW);
+
+    // drawn by meshlets, every object may draw every meshlet of the largest level
+    if (capacity * maxLodMeshlets > commandCapacity)
+    {
+        commandCapacity = capacity * maxLodMeshlets;
+        glState().bindBuffer(GL_SHADER_STORAGE_BUFFER, commandBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, commandCapacity * sizeof(DrawElementsIndirectCommand), NULL, GL_DYNAMIC_DRAW);
+    }
+    glState().bindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void GpuCulling::setMeshlets(const Meshlet* meshlets, size_t count)
+{
+    // std430 layout of the shader's Meshlet: sphere, cone, triangle range, padding
+    struct PackedMeshlet
+    {
+        glm::vec4 sphere;
+        glm::vec4 cone;
+        GLuint firstTriangle;
+        GLuint triangleCount;
+        GLuint padding[2];
+    };
+    std::vector<PackedMeshlet> packed(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        packed[i] = { glm::vec4(meshlets[i].center, meshlets[i].radius), glm::vec4(meshlets[i].coneAxis, meshlets[i].coneCutoff),
+            meshlets[i].firstTriangle, meshlets[i].triangleCount, { 0, 0 } };
+    }
+    meshletCount = (unsigned int)count;
+    glState().bindBuffer(GL_SHADER_STORAGE_BUFFER, meshletBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, std::max<size_t>(count, 1) * sizeof(PackedMeshlet), packed.data(), GL_STATIC_DRAW);
+    glState().bindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void GpuCulling::setCullUniforms(Shader& shader, const glm::mat4& viewProjection)
+{
+    shader.setMat4("viewProjection", viewProjection);
+    Frustum frustum = Frustum::fromMatrix(viewProjection);
+    static const char* const planeNames[6] = {
+        "frustumPlanes[0]", "frustumPlanes[1]", "frustumPlanes[2]", "frustumPlanes[3]", "frustumPlanes[4]", "frustumPlanes[5]"
+    };
+    for (int i = 0; i < 6; i++)
+        shader.setVec4(planeNames[i], frustum.planes[i]);
+
+    bool useHiZ = occlusionEnabled && hiZValid;
+    shader.setBool("useHiZ", useHiZ);
+    if (useHiZ)
+    {
+        shader.setVec2("hiZSize", glm::vec2(hiZWidth, hiZHeight));
+        shader.setInt("hiZLevels", hiZLevels);
+        shader.setInt("hiZ", TEXTURE_UNIT);
+        glState().bindTexture(TEXTURE_UNIT, GL_TEXTURE_2D, hiZTexture);
+    }
+}
+
+void GpuCulling::cull(GLuint transforms, unsigned int count, const glm::mat4& viewProjection, const glm::vec3& cameraPosition, float projectionScale)
+{
+    objectCount = std::min(count, capacity);
+    bool meshletPass = cullMeshlets && meshletCount > 0;
+    drawSlots = meshletPass ? objectCount * maxLodMeshlets : objectCount;
+
+    // without the count parameter every command is drawn, so the unused ones must draw nothing
+    const GLuint zero = 0;
+    glState().bindBuffer(GL_ATOMIC_COUNTER_BUFFER, counterBuffer);
+    glBufferSubData(GL_ATOMIC_COUNTER_BUFFER, 0, sizeof(GLuint), &zero);
+    glState().bindBuffer(GL_ATOMIC_COUNTER_BUFFER, 0);
+    if (!GLAD_GL_VERSION_4_6 && drawSlots > 0)
+    {
+        glState().bindBuffer(GL_SHADER_STORAGE_BUFFER, commandBuffer);
+        glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, 0, drawSlots * sizeof(DrawElementsIndirectCommand),
+            GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+        glState().bindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+    if (meshletPass)
+    {
+        // no workgroups until the object pass lists some
+        const GLuint emptyDispatch[3] = { 0, 1, 1 };
+        glState().bindBuffer(GL_SHADER_STORAGE_BUFFER, visibleBuffer);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(emptyDispatch), emptyDispatch);
+        glState().bindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+
+    cullShader.use();
+    cullShader.setUInt("objectCount", objectCount);
+    cullShader.setUInt("lodCount", lodCount);
+    cullShader.setVec4("cameraPosition", glm::vec4(cameraPosition, 1.0f));
+    cullShader.setFloat("lodProjectionScale", projectionScale);
+    cullShader.setFloat("lodThreshold", lodSettings.pixelThreshold);
+    cullShader.setFloat("lodHysteresis", lodSettings.hysteresis);
+    cullShader.setBool("listObjects", meshletPass);
+    setCullUniforms(cullShader, viewProjection);
+
+    glState().bindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, transforms);
+    glState().bindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, boundsBuffer);
+    glState().bindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, commandBuffer);
+    glState().bindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, lodBuffer);
+    glState().bindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, objectLodBuffer);
+    glState().bindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, visibleBuffer);
+    glState().bindBufferBase(GL_ATOMIC_COUNTER_BUFFER, 0, counterBuffer);
+    glDispatchCompute((objectCount + 63) / 64, 1, 1);
+
+    if (meshletPass)
+    {
+        // the list, its workgroup count and the chosen levels come from the pass above
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+        meshletShader.use();
+        meshletShader.setVec4("cameraPosition", glm::vec4(cameraPosition, 1.0f));
+        setCullUniforms(meshletShader, viewProjection);
+        glState().bindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, meshletBuffer);
+        glState().bindBuffer(GL_DISPATCH_INDIRECT_BUFFER, visibleBuffer);
+        glDispatchComputeIndirect(0);
+        glState().bindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+    }
+    // the commands and the count are read by the draw that follows
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT | GL_ATOMIC_COUNTER_BARRIER_BIT);
+}
+
+void GpuCulling::draw() const
+{
+    glState().bindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+    if (GLAD_GL_VERSION_4_6)
+    {
+        glState().bindBuffer(GL_PARAMETER_BUFFER, counterBuffer);
+        glMultiDrawElementsIndirectCount(GL_TRIANGLES, GL_UNSIGNED_INT, 0, 0, (GLsizei)drawSlots, 0);
+        glState().bindBuffer(GL_PARAMETER_BUFFER, 0);
+    }
+    else
+    {
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, 0, (GLsizei)drawSlots, 0);
+    }
+    glState().bindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+void GpuCulling::resizeHiZ(int width, int height)
+{
+    glState().forgetTexture(depthTexture);
+    glState().forgetTexture(hiZTexture);
+    glDeleteTextures(1, &depthTexture);
+    glDeleteTextures(1, &hiZTexture);
+    hiZWidth = width;
+    hiZHeight = height;
+    hiZLevels = 1;
+    while ((std::max(width, height) >> hiZLevels) > 0)
+        hiZLevels++;
+
+    glGenTextures(1, &depthTexture);
+    glState().bindTexture(TEXTURE_UNIT, GL_TEXTURE_2D, depthTexture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT32F, width, height);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    glGenTextures(1, &hiZTexture);
+    glState().bindTexture(TEXTURE_UNIT, GL_TEXTURE_2D, hiZTexture);
+    glTexStorage2D(GL_TEXTURE_2D, hiZLevels, GL_R32F, width, height);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glState().bindTexture(TEXTURE_UNIT, GL_TEXTURE_2D, 0);
+    hiZValid = false;
+}
+
+void GpuCulling::updateHiZ(int width, int height)
+{
+    if (!occlusionEnabled || width <= 0 || height <= 0)
+    {
+        hiZValid = false;
+        return;
+    }
+    if (width != hiZWidth || height != hiZHeight)
+        resizeHiZ(width, height);
+
+    glState().bindTexture(TEXTURE_UNIT, GL_TEXTURE_2D, depthTexture);
+    glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, width, height);
+
+    hiZShader.use();
+    hiZShader.setInt("source", TEXTURE_UNIT);
+    int levelWidth = width, levelHeight = height;
+    for (int level = 0; level < hiZLevels; level++)
+    {
+        // level 0 reads the depth copy, every other level the one above it
+        hiZShader.setInt("sourceLevel", level - 1);
+        hiZShader.setVec2("sourceSize", glm::vec2(levelWidth, levelHeight));
+        if (level == 1)
+            glState().bindTexture(TEXTURE_UNIT, GL_TEXTURE_2D, hiZTexture);
+        if (level > 0)
+        {
+            levelWidth = std::max(1, levelWidth / 2);
+            levelHeight = std::max(1, levelHeight / 2);
+        }
+        glBindImageTexture(0, hiZTexture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+        glDispatchCompute((levelWidth + 7) / 8, (levelHeight + 7) / 8, 1);
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    }
+    glState().bindTexture(TEXTURE_UNIT, GL_TEXTURE_2D, 0);
+    hiZValid = true;
+}
@@ -0,0 +1,99 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include "Shader.h"
+#include "FrustumCulling.h"
+#include "LodSelection.h"
+
+// GPU driven culling. Object bounds live in a shader storage buffer next to the per-object
+// transforms; a compute pass tests every object against the frustum and the previous frame's
+// Hi-Z pyramid and appends a DrawElementsIndirectCommand for each survivor, counting them
+// with an atomic counter. Each survivor's command draws the level of detail selectLod would
+// pick, with every object's level kept on the GPU for the hysteresis. The draw is then issued
+// with a single multi-draw-indirect call, so the CPU never reads the visibility back. Needs
+// GL 4.3; the draw count is read by the GPU only when GL 4.6 (indirect count) is available,
+// otherwise unused commands are left with zero instances, which keeps the path usable on
+// software drivers like llvmpipe.
+//
+// With meshlets, the visible objects are listed instead and a second pass, dispatched
+// indirectly with one workgroup per listed object, tests each meshlet of the chosen level
+// against the frustum, its normal cone and the Hi-Z pyramid, and writes a command per
+// surviving meshlet. The cone test drops meshlets that only show their backs, so it assumes
+// closed meshes or face culling.
+class GpuCulling
+{
+public:
+    // layout of one indirect command, as GL reads it
+    struct DrawElementsIndirectCommand
+    {
+        GLuint count;
+        GLuint instanceCount;
+        GLuint firstIndex;
+        GLint baseVertex;
+        GLuint baseInstance; // the object, so instanced attributes fetch its transform
+    };
+
+    // true if the context has compute shaders and indirect multi-draws
+    static bool isSupported();
+
+    explicit GpuCulling(unsigned int maxObjects);
+    ~GpuCulling();
+    GpuCulling(const GpuCulling&) = delete;
+    GpuCulling& operator=(const GpuCulling&) = delete;
+
+    // object space bounding spheres, uploaded once (or whenever they change)
+    void setBounds(const SphereSoA& spheres);
+    // the single mesh every object draws: its levels of detail, as ranges of the currently
+    // bound element buffer (a mesh without levels passes one covering all of its indices)
+    void setLods(const MeshLod* lods, size_t count);
+    // the mesh's meshlets, whose triangles are ranges of the same element buffer (see
+    // buildMeshlets); the levels passed to setLods say which meshlets each level has
+    void setMeshlets(const Meshlet* meshlets, size_t count);
+
+    // culls the first objectCount objects; transforms holds three vec4 model matrix rows per
+    // object (the instance buffer). Occlusion uses the pyramid built by the last updateHiZ.
+    // projectionScale is lodProjectionScale for the view.
+    void cull(GLuint transforms, unsigned int objectCount, const glm::mat4& viewProjection, const glm::vec3& cameraPosition, float projectionScale);
+    // draws the survivors with the VAO and program currently bound
+    void draw() const;
+    // copies the default framebuffer's depth (after the scene is drawn) and rebuilds the Hi-Z
+    // pyramid for the next frame's cull. Reallocates when the framebuffer size changes.
+    void updateHiZ(int width, int height);
+
+    bool occlusionEnabled = true;
+    // draw meshlet by meshlet; ignored until setMeshlets has been given some
+    bool cullMeshlets = false;
+    LodSettings lodSettings;
+
+private:
+    // the pyramid is sampled from a unit of its own so the scene's textures stay bound
+    static const int TEXTURE_UNIT = 15;
+
+    Shader cullShader;
+    Shader meshletShader;
+    Shader hiZShader;
+    unsigned int capacity;
+    unsigned int commandCapacity;
+    unsigned int lodCount = 0;
+    unsigned int maxLodMeshlets = 0;
+    unsigned int meshletCount = 0;
+    unsigned int objectCount = 0;
+    // commands the last cull may have written, which the draw walks
+    unsigned int drawSlots = 0;
+    GLuint boundsBuffer = 0;
+    GLuint commandBuffer = 0;
+    GLuint counterBuffer = 0;
+    GLuint lodBuffer = 0;
+    GLuint objectLodBuffer = 0;
+    GLuint meshletBuffer = 0;
+    // dispatch arguments for the meshlet pass followed by the visible objects
+    GLuint visibleBuffer = 0;
+    GLuint depthTexture = 0;
+    GLuint hiZTexture = 0;
+    int hiZWidth = 0, hiZHeight = 0, hiZLevels = 0;
+    bool hiZValid = false;
+
+    void resizeHiZ(int width, int height);
+    // frustum planes, matrix and occlusion inputs shared by both culling passes
+    void setCullUniforms(Shader& shader, const glm::mat4& viewProjection);
+};
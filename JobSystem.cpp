@@ -0,0 +1,307 @@
+#include "JobSystem.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+const int64_t JobDeque::CAPACITY;
+const size_t JobSystem::MAX_JOBS_PER_THREAD;
+
+// which system and worker the current thread belongs to, and the job it is running
+static thread_local const JobSystem* currentSystem = nullptr;
+static thread_local unsigned int currentWorker = 0;
+static thread_local Job* runningJob = nullptr;
+
+JobDeque::JobDeque() : top(0), bottom(0), buffer(CAPACITY)
+{
+}
+
+bool JobDeque::push(Job* job)
+{
+    int64_t b = bottom.load(std::memory_order_relaxed);
+    int64_t t = top.load(std::memory_order_acquire);
+    if (b - t >= CAPACITY)
+        return false;
+    buffer[b & (CAPACITY - 1)].store(job, std::memory_order_relaxed);
+    // publishes the job's contents to thieves that acquire bottom
+    bottom.store(b + 1, std::memory_order_release);
+    return true;
+}
+
+Job* JobDeque::pop()
+{
+    int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+    bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = top.load(std::memory_order_relaxed);
+    if (t > b)
+    {
+        // empty
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    Job* job = buffer[b & (CAPACITY - 1)].load(std::memory_order_relaxed);
+    if (t == b)
+    {
+        // last one left, race the thieves for it
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            job = nullptr;
+        bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    return job;
+}
+
+Job* JobDeque::steal()
+{
+    int64_t t = top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t b = bottom.load(std::memory_order_acquire);
+    if (t >= b)
+        return nullptr;
+    Job* job = buffer[t & (CAPACITY - 1)].load(std::memory_order_relaxed);
+    if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        return nullptr;
+    return job;
+}
+
+int64_t JobDeque::size() const
+{
+    int64_t b = bottom.load(std::memory_order_relaxed);
+    int64_t t = top.load(std::memory_order_relaxed);
+    return std::max<int64_t>(b - t, 0);
+}
+
+JobSystem::JobSystem(unsigned int threadCount)
+    : deques(threadCount == 0 ? std::max(1u, std::thread::hardware_concurrency()) : threadCount),
+      jobPools(deques.size()), jobPoolNext(deques.size(), 0), running(true), queuedJobs(0)
+{
+    for (std::vector<Job>& pool : jobPools)
+        pool = std::vector<Job>(MAX_JOBS_PER_THREAD);
+
+    currentSystem = this;
+    currentWorker = 0;
+    for (unsigned int worker = 1; worker < deques.size(); worker++)
+        workers.emplace_back(&JobSystem::workerLoop, this, worker);
+}
+
+JobSystem::~JobSystem()
+{
+    running.store(false);
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        wakeUp.notify_all();
+    }
+    for (std::thread& worker : workers)
+        worker.join();
+    if (currentSystem == this)
+        currentSystem = nullptr;
+}
+
+unsigned int JobSystem::workerIndex() const
+{
+    if (currentSystem != this)
+    {
+        std::cout << "ERROR::JOBSYSTEM::NOT_A_WORKER_THREAD" << std::endl;
+        return 0;
+    }
+    return currentWorker;
+}
+
+Job* JobSystem::currentJob() const
+{
+    return currentSystem == this ? runningJob : nullptr;
+}
+
+Job* JobSystem::allocate()
+{
+    unsigned int worker = workerIndex();
+    size_t slot = jobPoolNext[worker]++ & (MAX_JOBS_PER_THREAD - 1);
+    return &jobPools[worker][slot];
+}
+
+void JobSystem::addContinuation(Job* job, Job* continuation)
+{
+    int32_t index = job->continuationCount.fetch_add(1, std::memory_order_relaxed);
+    if (index >= Job::MAX_CONTINUATIONS)
+    {
+        std::cout << "ERROR::JOBSYSTEM::TOO_MANY_CONTINUATIONS" << std::endl;
+        job->continuationCount.fetch_sub(1, std::memory_order_relaxed);
+        return;
+    }
+    job->continuations[index] = continuation;
+}
+
+void JobSystem::run(Job* job)
+{
+    if (!deques[workerIndex()].push(job))
+    {
+        // deque full: no point queueing, just do it now
+        execute(job);
+        return;
+    }
+    queuedJobs.fetch_add(1, std::memory_order_release);
+    wakeUp.notify_one();
+}
+
+void JobSystem::execute(Job* job)
+{
+    Job* outer = runningJob;
+    runningJob = job;
+    job->invoke(job);
+    runningJob = outer;
+    finish(job);
+}
+
+void JobSystem::finish(Job* job)
+{
+    // continuations are read before the count drops, after which a waiter may reuse the job
+    int32_t continuationCount = job->continuationCount.load(std::memory_order_relaxed);
+    Job* continuations[Job::MAX_CONTINUATIONS];
+    std::copy(job->continuations, job->continuations + continuationCount, continuations);
+    Job* parent = job->parent;
+
+    if (job->unfinished.fetch_sub(1, std::memory_order_acq_rel) != 1)
+        return;
+    for (int32_t i = 0; i < continuationCount; i++)
+        run(continuations[i]);
+    if (parent)
+        finish(parent);
+}
+
+Job* JobSystem::findJob(unsigned int worker)
+{
+    Job* job = deques[worker].pop();
+    if (job == nullptr)
+    {
+        // steal, starting from the next worker so thieves spread out
+        unsigned int count = threadCount();
+        for (unsigned int i = 1; i < count && job == nullptr; i++)
+            job = deques[(worker + i) % count].steal();
+    }
+    if (job)
+        queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+    return job;
+}
+
+void JobSystem::wait(const Job* job)
+{
+    unsigned int worker = workerIndex();
+    while (!isFinished(job))
+    {
+        if (Job* other = findJob(worker))
+            execute(other);
+        else if (worker == 0)
+            executeMainThreadJobs();
+        else
+            std::this_thread::yield();
+    }
+}
+
+void JobSystem::workerLoop(unsigned int worker)
+{
+    currentSystem = this;
+    currentWorker = worker;
+    while (running.load(std::memory_order_relaxed))
+    {
+        if (Job* job = findJob(worker))
+        {
+            execute(job);
+            continue;
+        }
+        // sleep until something is queued; the timeout covers a wake up that raced the check
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wakeUp.wait_for(lock, std::chrono::milliseconds(1), [this]()
+        {
+            return queuedJobs.load(std::memory_order_acquire) > 0 || !running.load(std::memory_order_relaxed);
+        });
+    }
+}
+
+void JobSystem::runOnMainThread(std::function<void()> function)
+{
+    std::lock_guard<std::mutex> lock(mainThreadMutex);
+    mainThreadJobs.push_back(std::move(function));
+}
+
+void JobSystem::executeMainThreadJobs()
+{
+    if (workerIndex() != 0)
+        return;
+    // this runs whenever the main thread waits with nothing to steal, so the common empty
+    // case must not construct a deque (which allocates its map up front)
+    std::unique_lock<std::mutex> lock(mainThreadMutex);
+    if (mainThreadJobs.empty())
+        return;
+    std::deque<std::function<void()>> jobs;
+    jobs.swap(mainThreadJobs);
+    lock.unlock();
+    for (std::function<void()>& function : jobs)
+        function();
+}
+
+void runJobSystemBenchmark()
+{
+    const size_t ELEMENTS = (size_t)1 << 22;
+    const int ITERATIONS = 10;
+    const int BATCHES = 100;
+    const int JOBS_PER_BATCH = 1000;
+    unsigned int hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<unsigned int> threadCounts;
+    for (unsigned int threads = 1; threads < hardwareThreads; threads *= 2)
+        threadCounts.push_back(threads);
+    threadCounts.push_back(hardwareThreads);
+
+    std::vector<float> source(ELEMENTS), destination(ELEMENTS);
+    for (size_t i = 0; i < ELEMENTS; i++)
+        source[i] = (float)i;
+    auto milliseconds = [](std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    };
+    double baseCompute = 0.0, baseMemory = 0.0;
+    std::cout << "job system: " << ELEMENTS << " element parallelFor, " << JOBS_PER_BATCH << " empty jobs per batch, "
+        << hardwareThreads << " hardware threads" << std::endl;
+    for (unsigned int threads : threadCounts)
+    {
+        JobSystem jobs(threads);
+
+        // a few dozen flops per element, so the workers never wait on memory
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < ITERATIONS; i++)
+            jobs.parallelFor(ELEMENTS, [&](size_t begin, size_t end)
+            {
+                for (size_t k = begin; k < end; k++)
+                    destination[k] = std::sqrt(source[k]) * std::sin(source[k]);
+            }, 1024);
+        double compute = milliseconds(start) / ITERATIONS;
+
+        // one multiply per element, so this scales only as far as memory bandwidth does
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < ITERATIONS; i++)
+            jobs.parallelFor(ELEMENTS, [&](size_t begin, size_t end)
+            {
+                for (size_t k = begin; k < end; k++)
+                    destination[k] = source[k] * 0.5f;
+            }, 1024);
+        double memory = milliseconds(start) / ITERATIONS;
+
+        // scheduling cost: a parent with many empty children
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < BATCHES; i++)
+        {
+            Job* root = jobs.create([]() {});
+            for (int k = 0; k < JOBS_PER_BATCH; k++)
+                jobs.run(jobs.create([]() {}, root));
+            jobs.run(root);
+            jobs.wait(root);
+        }
+        double perJob = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / (BATCHES * JOBS_PER_BATCH);
+
+        if (threads == 1)
+        {
+            baseCompute = compute;
+            baseMemory = memory;
+        }
+        std::cout << threads << " threads: compute " << compute << " ms (" << baseCompute / compute << "x), memory " << memory
+            << " ms (" << baseMemory / memory << "x), " << perJob << " us per empty job" << std::endl;
+    }
+}
@@ -0,0 +1,174 @@
+#pragma once
+#include <atomic>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+
+// A unit of work: a small callable stored inline, a count of itself plus unfinished children,
+// and jobs to start once it (and all its children) have finished.
+struct Job
+{
+    static const int MAX_CONTINUATIONS = 4;
+    static const size_t STORAGE_SIZE = 64;
+
+    void (*invoke)(Job*);
+    Job* parent;
+    std::atomic<int32_t> unfinished;
+    std::atomic<int32_t> continuationCount;
+    Job* continuations[MAX_CONTINUATIONS];
+    alignas(16) unsigned char storage[STORAGE_SIZE];
+};
+
+// Chase-Lev work-stealing deque with a fixed capacity. The owning worker pushes and pops at
+// the bottom without locks; other workers steal from the top.
+class JobDeque
+{
+public:
+    static const int64_t CAPACITY = 4096;
+
+    JobDeque();
+    // false when full; the caller then runs the job itself
+    bool push(Job* job);
+    Job* pop();
+    Job* steal();
+    // approximate, for deciding whether splitting work is worthwhile
+    int64_t size() const;
+
+private:
+    std::atomic<int64_t> top;
+    std::atomic<int64_t> bottom;
+    std::vector<std::atomic<Job*>> buffer;
+};
+
+// Work-stealing job scheduler. The thread that creates it is worker 0 and takes part whenever
+// it waits; the others are background threads, each with its own deque, stealing from one
+// another when they run dry. Dependencies are expressed without fibers: a job can have child
+// jobs that it waits on implicitly (it only counts as finished after them) and continuations
+// that are started once it has finished.
+//
+// Jobs are created and run from worker threads (the creating thread or inside other jobs).
+// They live in a per-thread ring of MAX_JOBS_PER_THREAD slots, so a job must be finished
+// before that many more are created on the same thread, which a frame's work easily is.
+class JobSystem
+{
+public:
+    static const size_t MAX_JOBS_PER_THREAD = 4096;
+
+    // threadCount includes the calling thread; 0 uses every hardware thread
+    explicit JobSystem(unsigned int threadCount = 0);
+    ~JobSystem();
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    unsigned int threadCount() const { return (unsigned int)deques.size(); }
+    // index of the calling worker, 0 for the thread that created the system; handy for
+    // per-worker data such as command buffers
+    unsigned int workerIndex() const;
+
+    // Wraps a callable (at most Job::STORAGE_SIZE bytes, capture big state by reference).
+    // With a parent, the parent doesn't finish until this job has.
+    template <typename F>
+    Job* create(F&& function, Job* parent = nullptr);
+    // starts continuation after job and its children have finished; add before running job
+    void addContinuation(Job* job, Job* continuation);
+    void run(Job* job);
+    // runs other jobs (and, on worker 0, main thread jobs) until job has finished
+    void wait(const Job* job);
+    bool isFinished(const Job* job) const { return job->unfinished.load(std::memory_order_acquire) == 0; }
+    // the job being executed on this thread, e.g. to parent jobs created inside it
+    Job* currentJob() const;
+
+    // Calls function(begin, end) over [0, count) in parallel and returns when all are done.
+    // Ranges are split in halves only while this worker's deque is nearly empty, so the
+    // grain adapts to how much stealing is happening; minGrain bounds the smallest range.
+    template <typename F>
+    void parallelFor(size_t count, const F& function, size_t minGrain = 1);
+
+    // queues a job for worker 0 (the GL thread); callable from any thread
+    void runOnMainThread(std::function<void()> function);
+    // runs the queued main thread jobs; call from worker 0, e.g. once per frame
+    void executeMainThreadJobs();
+
+private:
+    std::vector<JobDeque> deques;
+    std::vector<std::vector<Job>> jobPools;
+    std::vector<size_t> jobPoolNext;
+    std::vector<std::thread> workers;
+    std::atomic<bool> running;
+    std::atomic<int> queuedJobs;
+    std::mutex sleepMutex;
+    std::condition_variable wakeUp;
+    std::mutex mainThreadMutex;
+    std::deque<std::function<void()>> mainThreadJobs;
+
+    Job* allocate();
+    void execute(Job* job);
+    void finish(Job* job);
+    Job* findJob(unsigned int worker);
+    void workerLoop(unsigned int worker);
+
+    template <typename F>
+    void splitRange(const F* function, size_t begin, size_t end, size_t minGrain);
+};
+
+// Times a compute bound parallelFor, a memory bound one and batches of empty jobs with 1, 2, 4,
+// ... up to every hardware thread and prints the speedups; "--job-benchmark" runs it without
+// opening a window
+void runJobSystemBenchmark();
+
+template <typename F>
+Job* JobSystem::create(F&& function, Job* parent)
+{
+    typedef typename std::decay<F>::type Function;
+    static_assert(sizeof(Function) <= Job::STORAGE_SIZE, "job captures too much state, capture it by reference");
+    static_assert(alignof(Function) <= 16, "job callable is over-aligned");
+
+    Job* job = allocate();
+    job->invoke = [](Job* self)
+    {
+        Function* stored = reinterpret_cast<Function*>(self->storage);
+        (*stored)();
+        stored->~Function();
+    };
+    job->parent = parent;
+    job->unfinished.store(1, std::memory_order_relaxed);
+    job->continuationCount.store(0, std::memory_order_relaxed);
+    new (job->storage) Function(std::forward<F>(function));
+    if (parent)
+        parent->unfinished.fetch_add(1, std::memory_order_relaxed);
+    return job;
+}
+
+template <typename F>
+void JobSystem::splitRange(const F* function, size_t begin, size_t end, size_t minGrain)
+{
+    // hand out the upper half while nobody has anything queued here to steal
+    const JobDeque& deque = deques[workerIndex()];
+    while (end - begin > minGrain && deque.size() < 2)
+    {
+        size_t middle = begin + (end - begin) / 2;
+        run(create([this, function, middle, end, minGrain]() { splitRange(function, middle, end, minGrain); }, currentJob()));
+        end = middle;
+    }
+    (*function)(begin, end);
+}
+
+template <typename F>
+void JobSystem::parallelFor(size_t count, const F& function, size_t minGrain)
+{
+    if (count == 0)
+        return;
+    if (minGrain == 0)
+        minGrain = 1;
+    Job* root = create([this, &function, count, minGrain]() { splitRange(&function, 0, count, minGrain); });
+    run(root);
+    wait(root);
+}
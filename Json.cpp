@@ -0,0 +1,352 @@
+#include "Json.h"
+#include "TextParsing.h"
+#include <cstring>
+#include <iostream>
+
+JsonType JsonValue::type() const
+{
+    return document ? document->tokens[token].type : JsonType::INVALID;
+}
+
+size_t JsonValue::size() const
+{
+    return document ? document->tokens[token].size : 0;
+}
+
+JsonValue JsonValue::operator[](const char* key) const
+{
+    if (!isObject())
+        return JsonValue();
+    const std::vector<JsonToken>& tokens = document->tokens;
+    uint32_t member = token + 1;
+    for (uint32_t i = 0; i < tokens[token].size; i++)
+    {
+        if (JsonValue(document, member).equals(key))
+            return JsonValue(document, member + 1);
+        member = tokens[member + 1].next;
+    }
+    return JsonValue();
+}
+
+JsonValue JsonValue::operator[](size_t index) const
+{
+    if (!isArray() || index >= size())
+        return JsonValue();
+    uint32_t element = token + 1;
+    for (size_t i = 0; i < index; i++)
+        element = document->tokens[element].next;
+    return JsonValue(document, element);
+}
+
+JsonValue JsonValue::first() const
+{
+    if (size() == 0)
+        return JsonValue();
+    if (isArray())
+        return JsonValue(document, token + 1);
+    if (isObject())
+        return JsonValue(document, token + 2);
+    return JsonValue();
+}
+
+JsonValue JsonValue::next() const
+{
+    // the caller knows the array's size; past the last element this is whatever follows it
+    if (!document || document->tokens[token].next >= document->tokens.size())
+        return JsonValue();
+    return JsonValue(document, document->tokens[token].next);
+}
+
+double JsonValue::number(double fallback) const
+{
+    if (type() != JsonType::NUMBER)
+        return fallback;
+    const JsonToken& number = document->tokens[token];
+    const char* cursor = document->source + number.start;
+    double value;
+    return parseDouble(cursor, document->source + number.end, value) ? value : fallback;
+}
+
+int64_t JsonValue::integer(int64_t fallback) const
+{
+    return type() == JsonType::NUMBER ? (int64_t)number() : fallback;
+}
+
+bool JsonValue::boolean(bool fallback) const
+{
+    return type() == JsonType::BOOLEAN ? document->source[document->tokens[token].start] == 't' : fallback;
+}
+
+// appends code point as UTF-8
+static void appendUtf8(std::string& out, uint32_t codePoint)
+{
+    if (codePoint < 0x80)
+    {
+        out += (char)codePoint;
+    }
+    else if (codePoint < 0x800)
+    {
+        out += (char)(0xC0 | (codePoint >> 6));
+        out += (char)(0x80 | (codePoint & 0x3F));
+    }
+    else if (codePoint < 0x10000)
+    {
+        out += (char)(0xE0 | (codePoint >> 12));
+        out += (char)(0x80 | ((codePoint >> 6) & 0x3F));
+        out += (char)(0x80 | (codePoint & 0x3F));
+    }
+    else
+    {
+        out += (char)(0xF0 | (codePoint >> 18));
+        out += (char)(0x80 | ((codePoint >> 12) & 0x3F));
+        out += (char)(0x80 | ((codePoint >> 6) & 0x3F));
+        out += (char)(0x80 | (codePoint & 0x3F));
+    }
+}
+
+static bool parseHex4(const char* text, uint32_t& value)
+{
+    value = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        char c = text[i];
+        value <<= 4;
+        if (c >= '0' && c <= '9')
+            value |= c - '0';
+        else if (c >= 'a' && c <= 'f')
+            value |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F')
+            value |= c - 'A' + 10;
+        else
+            return false;
+    }
+    return true;
+}
+
+std::string JsonValue::string(const std::string& fallback) const
+{
+    if (type() != JsonType::STRING)
+        return fallback;
+    const JsonToken& string = document->tokens[token];
+    const char* begin = document->source + string.start;
+    const char* end = document->source + string.end;
+    if (!string.escaped)
+        return std::string(begin, end);
+
+    std::string out;
+    out.reserve(end - begin);
+    for (const char* p = begin; p < end; p++)
+    {
+        if (*p != '\\')
+        {
+            out += *p;
+            continue;
+        }
+        p++;
+        switch (*p)
+        {
+        case 'b': out += '\b'; break;
+        case 'f': out += '\f'; break;
+        case 'n': out += '\n'; break;
+        case 'r': out += '\r'; break;
+        case 't': out += '\t'; break;
+        case 'u':
+        {
+            // the parser checked that four hex digits follow
+            uint32_t codePoint;
+            parseHex4(p + 1, codePoint);
+            p += 4;
+            uint32_t low;
+            if (codePoint >= 0xD800 && codePoint < 0xDC00 && end - p > 6 && p[1] == '\\' && p[2] == 'u' &&
+                parseHex4(p + 3, low) && low >= 0xDC00 && low < 0xE000)
+            {
+                codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+                p += 6;
+            }
+            appendUtf8(out, codePoint);
+            break;
+        }
+        default: out += *p; break; // \" \\ \/
+        }
+    }
+    return out;
+}
+
+bool JsonValue::equals(const char* text) const
+{
+    if (type() != JsonType::STRING)
+        return false;
+    const JsonToken& string = document->tokens[token];
+    if (string.escaped)
+        return this->string() == text;
+    size_t length = string.end - string.start;
+    return strlen(text) == length && memcmp(document->source + string.start, text, length) == 0;
+}
+
+static void skipWhitespace(const char* text, size_t size, size_t& pos)
+{
+    while (pos < size && (text[pos] == ' ' || text[pos] == '\t' || text[pos] == '\n' || text[pos] == '\r'))
+        pos++;
+}
+
+// pos is on the opening quote; leaves pos after the closing one
+static bool scanString(const char* text, size_t size, size_t& pos, JsonToken& token)
+{
+    token.type = JsonType::STRING;
+    token.escaped = false;
+    token.start = (uint32_t)++pos;
+    while (pos < size)
+    {
+        char c = text[pos];
+        if (c == '"')
+        {
+            token.end = (uint32_t)pos++;
+            return true;
+        }
+        if ((unsigned char)c < 0x20)
+            return false;
+        if (c == '\\')
+        {
+            token.escaped = true;
+            if (++pos >= size)
+                return false;
+            if (text[pos] == 'u')
+            {
+                uint32_t codePoint;
+                if (pos + 4 >= size || !parseHex4(text + pos + 1, codePoint))
+                    return false;
+                pos += 4;
+            }
+            else if (!strchr("\"\\/bfnrt", text[pos]))
+            {
+                return false;
+            }
+        }
+        pos++;
+    }
+    return false;
+}
+
+bool JsonDocument::parse(const char* text, size_t size)
+{
+    source = text;
+    tokens.clear();
+    // containers whose closing bracket hasn't been reached yet
+    std::vector<uint32_t> open;
+    size_t pos = 0;
+
+    auto fail = [&](const char* error)
+    {
+        std::cout << "ERROR::JSON::" << error << " at byte " << pos << std::endl;
+        tokens.clear();
+        return false;
+    };
+    if (size >= 0xFFFFFFFF)
+        return fail("TOO_LARGE");
+
+    for (;;)
+    {
+        skipWhitespace(text, size, pos);
+        if (!open.empty() && tokens[open.back()].type == JsonType::OBJECT)
+        {
+            JsonToken key = {};
+            if (pos >= size || text[pos] != '"')
+                return fail("EXPECTED_KEY");
+            if (!scanString(text, size, pos, key))
+                return fail("INVALID_STRING");
+            key.next = (uint32_t)tokens.size() + 1;
+            tokens.push_back(key);
+            skipWhitespace(text, size, pos);
+            if (pos >= size || text[pos] != ':')
+                return fail("EXPECTED_COLON");
+            pos++;
+            skipWhitespace(text, size, pos);
+        }
+        if (pos >= size)
+            return fail("UNEXPECTED_END");
+
+        JsonToken value = {};
+        value.start = (uint32_t)pos;
+        char c = text[pos];
+        if (c == '{' || c == '[')
+        {
+            value.type = c == '{' ? JsonType::OBJECT : JsonType::ARRAY;
+            open.push_back((uint32_t)tokens.size());
+            tokens.push_back(value);
+            pos++;
+            skipWhitespace(text, size, pos);
+            // anything but an immediate close starts the first member
+            if (pos >= size || text[pos] != (c == '{' ? '}' : ']'))
+                continue;
+            pos++;
+            tokens.back().end = (uint32_t)pos;
+            tokens.back().next = (uint32_t)tokens.size();
+            open.pop_back();
+        }
+        else
+        {
+            if (c == '"')
+            {
+                if (!scanString(text, size, pos, value))
+                    return fail("INVALID_STRING");
+            }
+            else if (c == '-' || isDigit(c))
+            {
+                const char* cursor = text + pos;
+                double number;
+                if (!parseDouble(cursor, text + size, number))
+                    return fail("INVALID_NUMBER");
+                value.type = JsonType::NUMBER;
+                pos = cursor - text;
+                value.end = (uint32_t)pos;
+            }
+            else if (size - pos >= 4 && (memcmp(text + pos, "true", 4) == 0 || memcmp(text + pos, "null", 4) == 0))
+            {
+                value.type = text[pos] == 't' ? JsonType::BOOLEAN : JsonType::NULL_VALUE;
+                pos += 4;
+                value.end = (uint32_t)pos;
+            }
+            else if (size - pos >= 5 && memcmp(text + pos, "false", 5) == 0)
+            {
+                value.type = JsonType::BOOLEAN;
+                pos += 5;
+                value.end = (uint32_t)pos;
+            }
+            else
+            {
+                return fail("UNEXPECTED_CHARACTER");
+            }
+            value.next = (uint32_t)tokens.size() + 1;
+            tokens.push_back(value);
+        }
+
+        // a value is complete: count it in its container, then either move on to the next
+        // member or close the container, which completes a value of the one around it
+        for (;;)
+        {
+            skipWhitespace(text, size, pos);
+            if (open.empty())
+            {
+                if (pos != size)
+                    return fail("TRAILING_CHARACTERS");
+                return true;
+            }
+            JsonToken& container = tokens[open.back()];
+            container.size++;
+            if (pos < size && text[pos] == ',')
+            {
+                pos++;
+                break;
+            }
+            if (pos < size && text[pos] == (container.type == JsonType::OBJECT ? '}' : ']'))
+            {
+                pos++;
+                container.end = (uint32_t)pos;
+                container.next = (uint32_t)tokens.size();
+                open.pop_back();
+                continue;
+            }
+            return fail("EXPECTED_COMMA");
+        }
+    }
+}
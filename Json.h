@@ -0,0 +1,73 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+enum class JsonType : uint8_t { INVALID, OBJECT, ARRAY, STRING, NUMBER, BOOLEAN, NULL_VALUE };
+
+// One value of a parsed document. Tokens are stored in document order, so a value's children
+// follow it directly and next skips its whole subtree.
+struct JsonToken
+{
+    JsonType type;
+    bool escaped;       // strings: contains backslash escapes
+    uint32_t start;     // source range; strings without their quotes
+    uint32_t end;
+    uint32_t size;      // objects: members, arrays: elements
+    uint32_t next;      // index of the token after this value and its children
+};
+
+class JsonDocument;
+
+// Lightweight reference to a token. Looking up a missing member or element gives an invalid
+// value, whose accessors return their fallbacks, so optional fields need no checks.
+class JsonValue
+{
+public:
+    JsonValue() : document(nullptr), token(0) {}
+    JsonValue(const JsonDocument* document, uint32_t token) : document(document), token(token) {}
+
+    bool isValid() const { return document != nullptr; }
+    JsonType type() const;
+    bool isObject() const { return type() == JsonType::OBJECT; }
+    bool isArray() const { return type() == JsonType::ARRAY; }
+    size_t size() const;
+
+    // object member by key, in O(members)
+    JsonValue operator[](const char* key) const;
+    // array element, in O(index); iterate with first()/next() to visit every element
+    JsonValue operator[](size_t index) const;
+    // first element of an array, or first value of an object
+    JsonValue first() const;
+    // the sibling after this value within the same array
+    JsonValue next() const;
+
+    double number(double fallback = 0.0) const;
+    int64_t integer(int64_t fallback = 0) const;
+    bool boolean(bool fallback = false) const;
+    // decoded string, escapes included
+    std::string string(const std::string& fallback = std::string()) const;
+    // compares an unescaped string value without decoding it
+    bool equals(const char* text) const;
+
+private:
+    const JsonDocument* document;
+    uint32_t token;
+};
+
+// Parses JSON into a flat token array in one pass, without recursion and without copying
+// strings or numbers out of the source, which has to outlive the document.
+class JsonDocument
+{
+public:
+    // prints ERROR::JSON:: with the byte offset and returns false on malformed input
+    bool parse(const char* text, size_t size);
+
+    JsonValue root() const { return tokens.empty() ? JsonValue() : JsonValue(this, 0); }
+
+private:
+    friend class JsonValue;
+    const char* source = nullptr;
+    std::vector<JsonToken> tokens;
+};
@@ -0,0 +1,52 @@
+#include "LinearAllocator.h"
+#include "Memory.h"
+#include <algorithm>
+#include <cstdint>
+
+LinearAllocator::LinearAllocator(size_t blockSize) : blockSize(blockSize)
+{
+}
+
+void* LinearAllocator::allocate(size_t size, size_t alignment)
+{
+    while (currentBlock < blocks.size())
+    {
+        Block& block = blocks[currentBlock];
+        uintptr_t base = reinterpret_cast<uintptr_t>(block.memory.get());
+        size_t aligned = ((base + offset + alignment - 1) & ~(uintptr_t)(alignment - 1)) - base;
+        if (aligned + size <= block.size)
+        {
+            offset = aligned + size;
+            used += size;
+            return block.memory.get() + aligned;
+        }
+        // move on to the next block, which reset() may have left behind
+        currentBlock++;
+        offset = 0;
+    }
+
+    // oversized requests get a block of their own
+    Block block;
+    block.size = std::max(blockSize, size + alignment);
+    block.memory.reset(new char[block.size]);
+    memoryStats().countHeapAllocation(block.size);
+    blocks.push_back(std::move(block));
+    currentBlock = blocks.size() - 1;
+    offset = 0;
+    return allocate(size, alignment);
+}
+
+void LinearAllocator::reset()
+{
+    currentBlock = 0;
+    offset = 0;
+    used = 0;
+}
+
+size_t LinearAllocator::bytesReserved() const
+{
+    size_t total = 0;
+    for (const Block& block : blocks)
+        total += block.size;
+    return total;
+}
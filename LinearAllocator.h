@@ -0,0 +1,50 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <cstddef>
+#include <new>
+#include <utility>
+
+// Bump allocator over a list of fixed size blocks. Allocating is a pointer increment, nothing
+// is freed individually and reset() rewinds to the start while keeping the blocks, so after
+// the first few frames it stops touching the heap. Not thread safe: give each thread its own.
+class LinearAllocator
+{
+public:
+    explicit LinearAllocator(size_t blockSize = 64 * 1024);
+    LinearAllocator(const LinearAllocator&) = delete;
+    LinearAllocator& operator=(const LinearAllocator&) = delete;
+    LinearAllocator(LinearAllocator&&) = default;
+    LinearAllocator& operator=(LinearAllocator&&) = default;
+
+    void* allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+    // constructs a T in place; its destructor is never run, so T should be trivially destructible
+    template <typename T, typename... Args>
+    T* create(Args&&... args)
+    {
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+    template <typename T>
+    T* allocateArray(size_t count)
+    {
+        return static_cast<T*>(allocate(sizeof(T) * count, alignof(T)));
+    }
+
+    // forgets every allocation; the memory is reused by the next ones
+    void reset();
+    size_t bytesAllocated() const { return used; }
+    size_t bytesReserved() const;
+
+private:
+    struct Block
+    {
+        std::unique_ptr<char[]> memory;
+        size_t size;
+    };
+
+    size_t blockSize;
+    std::vector<Block> blocks;
+    size_t currentBlock = 0;
+    size_t offset = 0;
+    size_t used = 0;
+};
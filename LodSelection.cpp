@@ -0,0 +1,32 @@
+#include "LodSelection.h"
+#include <algorithm>
+#include <cmath>
+
+float lodProjectionScale(float fovYDegrees, float viewportHeight)
+{
+    return viewportHeight / (2.0f * std::tan(glm::radians(fovYDegrees) * 0.5f));
+}
+
+// the coarsest level whose error stays within limit pixels; errors only grow down the chain
+static uint32_t coarsestWithin(const MeshLod* lods, uint32_t lodCount, float pixelsPerUnit, float limit)
+{
+    uint32_t level = 0;
+    while (level + 1 < lodCount && lods[level + 1].error * pixelsPerUnit <= limit)
+        level++;
+    return level;
+}
+
+uint32_t selectLod(const MeshLod* lods, uint32_t lodCount, float objectScale, float distance, float projectionScale,
+    uint32_t current, const LodSettings& settings)
+{
+    if (lodCount <= 1)
+        return 0;
+    // with the camera inside the bounds this is huge and the full mesh is drawn
+    float pixelsPerUnit = objectScale * projectionScale / std::max(distance, 1e-4f);
+    current = std::min(current, lodCount - 1);
+    uint32_t finest = coarsestWithin(lods, lodCount, pixelsPerUnit, settings.pixelThreshold);
+    // the current level shows too much error: refine straight away
+    if (finest < current)
+        return finest;
+    return std::max(current, coarsestWithin(lods, lodCount, pixelsPerUnit, settings.pixelThreshold * (1.0f - settings.hysteresis)));
+}
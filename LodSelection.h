@@ -0,0 +1,23 @@
+#pragma once
+#include <cstdint>
+#include "Mesh.h"
+
+// Screen space error level of detail selection. A level's error (MeshLod::error, object space)
+// covers error * objectScale * projectionScale / distance pixels on screen, and the coarsest
+// level under the threshold is drawn. Moving to a coarser level waits until that level is under
+// threshold * (1 - hysteresis), so objects near a boundary don't flip between two levels.
+// cullComputeShader.glsl makes the same choice on the GPU.
+struct LodSettings
+{
+    float pixelThreshold = 1.0f;
+    float hysteresis = 0.25f;
+};
+
+// pixels covered by one unit at distance one, for a vertical field of view in degrees (like
+// Camera::Zoom) and a viewport height in pixels
+float lodProjectionScale(float fovYDegrees, float viewportHeight);
+
+// level to draw for an object whose mesh is scaled by up to objectScale and whose bounding
+// sphere's surface is distance away from the camera; current is the level drawn last frame
+uint32_t selectLod(const MeshLod* lods, uint32_t lodCount, float objectScale, float distance, float projectionScale,
+    uint32_t current, const LodSettings& settings = LodSettings());
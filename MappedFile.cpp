@@ -0,0 +1,168 @@
+#include "MappedFile.h"
+#include <utility>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// empty files can't be mapped, so they (and closed mappings) point here instead
+static const char emptyFile[1] = { 0 };
+
+#ifdef _WIN32
+MappedFile::MappedFile() : bytes(emptyFile), length(0), opened(false), fileHandle(nullptr), mappingHandle(nullptr)
+{
+}
+#else
+MappedFile::MappedFile() : bytes(emptyFile), length(0), opened(false), fileDescriptor(-1)
+{
+}
+#endif
+
+MappedFile::MappedFile(const char* path) : MappedFile()
+{
+    open(path);
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept : MappedFile()
+{
+    *this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+    if (this != &other)
+    {
+        close();
+        std::swap(bytes, other.bytes);
+        std::swap(length, other.length);
+        std::swap(opened, other.opened);
+#ifdef _WIN32
+        std::swap(fileHandle, other.fileHandle);
+        std::swap(mappingHandle, other.mappingHandle);
+#else
+        std::swap(fileDescriptor, other.fileDescriptor);
+#endif
+    }
+    return *this;
+}
+
+#ifdef _WIN32
+bool MappedFile::open(const char* path)
+{
+    close();
+
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize))
+    {
+        CloseHandle(file);
+        return false;
+    }
+
+    fileHandle = file;
+    opened = true;
+    if (fileSize.QuadPart == 0)
+    {
+        bytes = emptyFile;
+        return true;
+    }
+
+    mappingHandle = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mappingHandle == NULL)
+    {
+        close();
+        return false;
+    }
+    const void* view = MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+    if (view == NULL)
+    {
+        close();
+        return false;
+    }
+    bytes = static_cast<const char*>(view);
+    length = static_cast<size_t>(fileSize.QuadPart);
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (bytes != emptyFile)
+        UnmapViewOfFile(bytes);
+    if (mappingHandle != nullptr)
+        CloseHandle(mappingHandle);
+    if (fileHandle != nullptr)
+        CloseHandle(fileHandle);
+    bytes = emptyFile;
+    length = 0;
+    opened = false;
+    fileHandle = nullptr;
+    mappingHandle = nullptr;
+}
+#else
+bool MappedFile::open(const char* path)
+{
+    close();
+
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    fileDescriptor = fd;
+    opened = true;
+    if (info.st_size == 0)
+    {
+        bytes = emptyFile;
+        return true;
+    }
+
+    void* mapping = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED)
+    {
+        close();
+        return false;
+    }
+    // loaders read front to back, so let the kernel read ahead
+    madvise(mapping, static_cast<size_t>(info.st_size), MADV_SEQUENTIAL);
+    bytes = static_cast<const char*>(mapping);
+    length = static_cast<size_t>(info.st_size);
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (bytes != emptyFile)
+        munmap(const_cast<char*>(bytes), length);
+    if (fileDescriptor >= 0)
+        ::close(fileDescriptor);
+    bytes = emptyFile;
+    length = 0;
+    opened = false;
+    fileDescriptor = -1;
+}
+#endif
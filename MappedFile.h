@@ -0,0 +1,38 @@
+#pragma once
+#include <cstddef>
+
+// Read-only view of a whole file mapped into memory. Shader sources, textures and meshes are
+// read straight out of the mapping, so no intermediate stream or string copies are made.
+class MappedFile
+{
+public:
+    MappedFile();
+    explicit MappedFile(const char* path);
+    ~MappedFile();
+
+    // the mapping owns OS handles, so it can be moved but not copied
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // maps the file at path, closing any previous mapping. Returns false if the file could not be mapped
+    bool open(const char* path);
+    void close();
+
+    bool isOpen() const { return opened; }
+    // never null; a closed or empty file is a zero length view
+    const char* data() const { return bytes; }
+    size_t size() const { return length; }
+
+private:
+    const char* bytes;
+    size_t length;
+    bool opened;
+#ifdef _WIN32
+    void* fileHandle;
+    void* mappingHandle;
+#else
+    int fileDescriptor;
+#endif
+};
@@ -0,0 +1,7 @@
+#include "Memory.h"
+
+MemoryStats& memoryStats()
+{
+    static MemoryStats stats;
+    return stats;
+}
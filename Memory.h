@@ -0,0 +1,65 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include "LinearAllocator.h"
+
+// Counts the heap allocations made by the linear allocators (arena blocks). Once every arena
+// has grown to its steady state size a frame should add nothing, which
+// beginFrame/frameAllocations make easy to check.
+class MemoryStats
+{
+public:
+    void countHeapAllocation(size_t bytes)
+    {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+        allocatedBytes.fetch_add(bytes, std::memory_order_relaxed);
+    }
+
+    void beginFrame()
+    {
+        frameStartAllocations = allocations.load(std::memory_order_relaxed);
+        frameStartBytes = allocatedBytes.load(std::memory_order_relaxed);
+    }
+    uint64_t frameAllocations() const { return allocations.load(std::memory_order_relaxed) - frameStartAllocations; }
+    uint64_t frameBytes() const { return allocatedBytes.load(std::memory_order_relaxed) - frameStartBytes; }
+    uint64_t totalAllocations() const { return allocations.load(std::memory_order_relaxed); }
+    uint64_t totalBytes() const { return allocatedBytes.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> allocations{ 0 };
+    std::atomic<uint64_t> allocatedBytes{ 0 };
+    uint64_t frameStartAllocations = 0;
+    uint64_t frameStartBytes = 0;
+};
+
+MemoryStats& memoryStats();
+
+// Two linear arenas used on alternate frames. Memory allocated during a frame stays valid
+// through the next one (long enough for data the GL thread consumes a frame late) and is
+// reclaimed all at once when its arena comes around again.
+class FrameArena
+{
+public:
+    explicit FrameArena(size_t blockSize = 256 * 1024) : arenas{ LinearAllocator(blockSize), LinearAllocator(blockSize) } {}
+
+    // switches to the other arena and resets it; call once at the start of every frame
+    void beginFrame()
+    {
+        current ^= 1;
+        arenas[current].reset();
+    }
+
+    void* allocate(size_t size, size_t alignment = alignof(std::max_align_t)) { return arenas[current].allocate(size, alignment); }
+    template <typename T>
+    T* allocateArray(size_t count) { return arenas[current].allocateArray<T>(count); }
+    template <typename T, typename... Args>
+    T* create(Args&&... args) { return arenas[current].create<T>(std::forward<Args>(args)...); }
+
+    LinearAllocator& allocator() { return arenas[current]; }
+
+private:
+    LinearAllocator arenas[2];
+    int current = 0;
+};
@@ -0,0 +1,67 @@
+#include "Mesh.h"
+#include <cstddef>
+
+void Mesh::computeBounds()
+{
+    if (vertices.empty())
+    {
+        boundsMin = boundsMax = boundsCenter = glm::vec3(0.0f);
+        boundingRadius = 0.0f;
+        return;
+    }
+    glm::vec3 low = vertices[0].position;
+    glm::vec3 high = low;
+    for (const MeshVertex& vertex : vertices)
+    {
+        low = glm::min(low, vertex.position);
+        high = glm::max(high, vertex.position);
+    }
+    boundsMin = low;
+    boundsMax = high;
+    boundsCenter = 0.5f * (low + high);
+    // the box's half diagonal is loose for round meshes, so take the farthest vertex instead
+    float radiusSquared = 0.0f;
+    for (const MeshVertex& vertex : vertices)
+    {
+        glm::vec3 offset = vertex.position - boundsCenter;
+        radiusSquared = glm::max(radiusSquared, glm::dot(offset, offset));
+    }
+    boundingRadius = glm::sqrt(radiusSquared);
+}
+
+void Mesh::computeNormals()
+{
+    for (MeshVertex& vertex : vertices)
+        vertex.normal = glm::vec3(0.0f);
+    for (size_t i = 0; i + 2 < indices.size(); i += 3)
+    {
+        MeshVertex& a = vertices[indices[i]];
+        MeshVertex& b = vertices[indices[i + 1]];
+        MeshVertex& c = vertices[indices[i + 2]];
+        // the cross product's length is twice the triangle's area, which is the weight we want
+        glm::vec3 faceNormal = glm::cross(b.position - a.position, c.position - a.position);
+        a.normal += faceNormal;
+        b.normal += faceNormal;
+        c.normal += faceNormal;
+    }
+    for (MeshVertex& vertex : vertices)
+    {
+        float length = glm::length(vertex.normal);
+        vertex.normal = length > 0.0f ? vertex.normal / length : glm::vec3(0.0f, 1.0f, 0.0f);
+    }
+}
+
+const VertexFormat& Mesh::vertexFormat()
+{
+    // listed in the order of the vertex shaders' input locations, which is how the SPIR-V
+    // programs (no input names) are matched
+    static const VertexFormat format = {
+        {
+            { "aPos",      3, GL_FLOAT, GL_FALSE, (GLsizei)offsetof(MeshVertex, position) },
+            { "aTexCoord", 2, GL_FLOAT, GL_FALSE, (GLsizei)offsetof(MeshVertex, texCoord) },
+            { "aNormal",   3, GL_FLOAT, GL_FALSE, (GLsizei)offsetof(MeshVertex, normal) }
+        },
+        sizeof(MeshVertex)
+    };
+    return format;
+}
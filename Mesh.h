@@ -0,0 +1,69 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstdint>
+#include "VertexFormat.h"
+
+// the vertex layout every loader produces
+struct MeshVertex
+{
+    glm::vec3 position;
+    glm::vec3 normal;
+    glm::vec2 texCoord;
+};
+
+// One level of detail: a range of the index buffer, the meshlets built from it and the
+// object space error the simplifier stopped at (0 for the full mesh)
+struct MeshLod
+{
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    uint32_t firstMeshlet;
+    uint32_t meshletCount;
+    float error;
+};
+
+// A small cluster of triangles with its own bounds and normal cone. Its vertices are
+// meshletVertices[firstVertex, +vertexCount) (indices into the mesh's vertices) and its
+// triangles are the triangleCount byte triples starting at meshletTriangles[3 * firstTriangle],
+// indexing those local vertices. buildMeshlets orders the index buffer the same way, so the
+// same triangles are also indices[3 * firstTriangle, +3 * triangleCount).
+// Every triangle faces away from a camera at c when
+//   dot(center - c, coneAxis) > coneCutoff * length(center - c) + radius
+struct Meshlet
+{
+    uint32_t firstVertex;
+    uint32_t firstTriangle;
+    uint32_t vertexCount;
+    uint32_t triangleCount;
+    glm::vec3 center;
+    float radius;
+    glm::vec3 coneAxis;
+    float coneCutoff; // sin of the cone's half angle; 1 when the normals spread too far to cull
+};
+
+// Indexed triangle list in system memory, as it comes out of a loader and before it is
+// uploaded. Bounds are in the mesh's own space. lods and meshlets are optional; a mesh
+// without lods is a single level covering every index.
+struct Mesh
+{
+    std::vector<MeshVertex> vertices;
+    std::vector<uint32_t> indices;
+    std::vector<MeshLod> lods;
+    std::vector<Meshlet> meshlets;
+    std::vector<uint32_t> meshletVertices;
+    std::vector<uint8_t> meshletTriangles;
+    glm::vec3 boundsMin = glm::vec3(0.0f);
+    glm::vec3 boundsMax = glm::vec3(0.0f);
+    // sphere around the box; what the scene and the culling passes use
+    glm::vec3 boundsCenter = glm::vec3(0.0f);
+    float boundingRadius = 0.0f;
+
+    void computeBounds();
+    // area weighted vertex normals from the triangles; vertices split at texture seams get
+    // their normals from their own side of the seam only
+    void computeNormals();
+
+    // aPos, aTexCoord and aNormal, interleaved as MeshVertex
+    static const VertexFormat& vertexFormat();
+};
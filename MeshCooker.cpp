@@ -0,0 +1,64 @@
+#include "MeshCooker.h"
+#include "MeshFile.h"
+#include "ObjLoader.h"
+#include "GltfLoader.h"
+#include "MeshSimplifier.h"
+#include "MeshletBuilder.h"
+#include <cctype>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+// lower case extension of path without the dot, empty if it has none
+static std::string extensionOf(const char* path)
+{
+    const char* dot = strrchr(path, '.');
+    const char* separator = strpbrk(dot ? dot : path, "/\\");
+    std::string extension;
+    if (dot == nullptr || separator != nullptr)
+        return extension;
+    for (const char* c = dot + 1; *c; c++)
+        extension += (char)tolower((unsigned char)*c);
+    return extension;
+}
+
+bool cookMesh(const char* source, const char* destination, JobSystem& jobs)
+{
+    uint64_t sourceSize;
+    int64_t sourceModified;
+    if (!fileStamp(source, sourceSize, sourceModified))
+    {
+        std::cout << "ERROR::COOK::FILE_NOT_FOUND " << source << std::endl;
+        return false;
+    }
+
+    Mesh mesh;
+    std::string extension = extensionOf(source);
+    bool loaded;
+    if (extension == "obj")
+    {
+        loaded = loadObj(source, mesh, jobs, false);
+    }
+    else if (extension == "glb")
+    {
+        loaded = GltfModel::loadMesh(source, mesh);
+    }
+    else
+    {
+        std::cout << "ERROR::COOK::UNKNOWN_SOURCE_FORMAT " << source << std::endl;
+        return false;
+    }
+    if (!loaded)
+    {
+        std::cout << "ERROR::COOK::SOURCE_NOT_LOADED " << source << std::endl;
+        return false;
+    }
+    size_t triangles = mesh.indices.size() / 3;
+    buildLods(mesh);
+    buildMeshlets(mesh);
+    if (!writeMeshFile(destination, mesh, sourceSize, sourceModified))
+        return false;
+    std::cout << "cooked " << source << " -> " << destination << ": " << mesh.vertices.size() << " vertices, "
+        << triangles << " triangles, " << mesh.lods.size() << " levels of detail, " << mesh.meshlets.size() << " meshlets" << std::endl;
+    return true;
+}
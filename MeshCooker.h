@@ -0,0 +1,9 @@
+#pragma once
+#include "JobSystem.h"
+
+// Offline conversion of a source model into a .mesh file (MeshFile.h). The source format is
+// picked by extension: .obj through loadObj, .glb through GltfModel::loadMesh, which flattens
+// the node hierarchy into the one mesh. Levels of detail are built (buildLods) and stored with
+// it, along with the source's size and modification time so a stale cooked file can be
+// spotted. Prints ERROR::COOK:: and returns false on failure.
+bool cookMesh(const char* source, const char* destination, JobSystem& jobs);
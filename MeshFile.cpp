@@ -0,0 +1,209 @@
+#include "MeshFile.h"
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+static const char MESH_FILE_MAGIC[4] = { 'M', 'E', 'S', 'H' };
+
+bool fileStamp(const char* path, uint64_t& size, int64_t& modified)
+{
+#ifdef _WIN32
+    struct _stat64 info;
+    if (_stat64(path, &info) != 0)
+        return false;
+#else
+    struct stat info;
+    if (stat(path, &info) != 0)
+        return false;
+#endif
+    size = (uint64_t)info.st_size;
+    modified = (int64_t)info.st_mtime;
+    return true;
+}
+
+static uint64_t alignSection(uint64_t offset)
+{
+    const uint64_t alignment = MeshFileHeader::SECTION_ALIGNMENT;
+    return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+// places a section of count elements after offset and moves offset past it
+static MeshFileSection placeSection(uint64_t& offset, size_t count, size_t elementSize)
+{
+    MeshFileSection section;
+    section.offset = alignSection(offset);
+    section.count = count;
+    offset = section.offset + (uint64_t)count * elementSize;
+    return section;
+}
+
+static bool writeSection(FILE* file, uint64_t& written, const MeshFileSection& section, const void* data, size_t elementSize)
+{
+    static const char padding[MeshFileHeader::SECTION_ALIGNMENT] = {};
+    size_t paddingBytes = (size_t)(section.offset - written);
+    size_t bytes = (size_t)section.count * elementSize;
+    if (fwrite(padding, 1, paddingBytes, file) != paddingBytes || (bytes && fwrite(data, 1, bytes, file) != bytes))
+        return false;
+    written = section.offset + bytes;
+    return true;
+}
+
+bool writeMeshFile(const char* path, const Mesh& mesh, uint64_t sourceSize, int64_t sourceModified)
+{
+    MeshLod wholeMesh = { 0, (uint32_t)mesh.indices.size(), 0, (uint32_t)mesh.meshlets.size(), 0.0f };
+    const MeshLod* lods = mesh.lods.empty() ? &wholeMesh : mesh.lods.data();
+    size_t lodCount = mesh.lods.empty() ? 1 : mesh.lods.size();
+
+    MeshFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MESH_FILE_MAGIC, 4);
+    header.version = MeshFileHeader::VERSION;
+    header.sourceSize = sourceSize;
+    header.sourceModified = sourceModified;
+    for (int i = 0; i < 3; i++)
+    {
+        header.boundsMin[i] = mesh.boundsMin[i];
+        header.boundsMax[i] = mesh.boundsMax[i];
+        header.boundsCenter[i] = mesh.boundsCenter[i];
+    }
+    header.boundingRadius = mesh.boundingRadius;
+    header.vertexStride = sizeof(MeshVertex);
+
+    uint64_t offset = sizeof(MeshFileHeader);
+    header.vertices = placeSection(offset, mesh.vertices.size(), sizeof(MeshVertex));
+    header.indices = placeSection(offset, mesh.indices.size(), sizeof(uint32_t));
+    header.lods = placeSection(offset, lodCount, sizeof(MeshLod));
+    header.meshlets = placeSection(offset, mesh.meshlets.size(), sizeof(Meshlet));
+    header.meshletVertices = placeSection(offset, mesh.meshletVertices.size(), sizeof(uint32_t));
+    header.meshletTriangles = placeSection(offset, mesh.meshletTriangles.size(), sizeof(uint8_t));
+    header.fileSize = offset;
+
+    FILE* file = fopen(path, "wb");
+    if (!file)
+    {
+        std::cout << "ERROR::MESH_FILE::COULD_NOT_CREATE " << path << std::endl;
+        return false;
+    }
+    uint64_t written = 0;
+    bool succeeded = fwrite(&header, sizeof(header), 1, file) == 1;
+    written = sizeof(header);
+    succeeded = succeeded &&
+        writeSection(file, written, header.vertices, mesh.vertices.data(), sizeof(MeshVertex)) &&
+        writeSection(file, written, header.indices, mesh.indices.data(), sizeof(uint32_t)) &&
+        writeSection(file, written, header.lods, lods, sizeof(MeshLod)) &&
+        writeSection(file, written, header.meshlets, mesh.meshlets.data(), sizeof(Meshlet)) &&
+        writeSection(file, written, header.meshletVertices, mesh.meshletVertices.data(), sizeof(uint32_t)) &&
+        writeSection(file, written, header.meshletTriangles, mesh.meshletTriangles.data(), sizeof(uint8_t));
+    succeeded = fclose(file) == 0 && succeeded;
+    if (!succeeded)
+    {
+        std::cout << "ERROR::MESH_FILE::WRITE_FAILED " << path << std::endl;
+        remove(path);
+    }
+    return succeeded;
+}
+
+// section lies within the file and starts aligned
+static bool sectionValid(const MeshFileSection& section, size_t elementSize, uint64_t fileSize)
+{
+    return section.offset % MeshFileHeader::SECTION_ALIGNMENT == 0 && section.offset <= fileSize &&
+        section.count <= (fileSize - section.offset) / elementSize;
+}
+
+bool MeshFile::open(const char* path)
+{
+    close();
+    if (!mapping.open(path))
+    {
+        std::cout << "ERROR::MESH_FILE::FILE_NOT_SUCCESSFULLY_READ " << path << std::endl;
+        return false;
+    }
+    auto fail = [&](const char* error)
+    {
+        std::cout << "ERROR::MESH_FILE::" << error << " " << path << std::endl;
+        mapping.close();
+        return false;
+    };
+
+    // the mapping is page aligned, so the header and every section are aligned in memory too
+    const char* base = mapping.data();
+    uint64_t size = mapping.size();
+    if (size < sizeof(MeshFileHeader))
+        return fail("TRUNCATED");
+    const MeshFileHeader* candidate = reinterpret_cast<const MeshFileHeader*>(base);
+    if (memcmp(candidate->magic, MESH_FILE_MAGIC, 4) != 0)
+        return fail("NOT_A_MESH_FILE");
+    if (candidate->version != MeshFileHeader::VERSION || candidate->vertexStride != sizeof(MeshVertex))
+        return fail("UNSUPPORTED_VERSION");
+    if (candidate->fileSize != size)
+        return fail("TRUNCATED");
+    if (!sectionValid(candidate->vertices, sizeof(MeshVertex), size) ||
+        !sectionValid(candidate->indices, sizeof(uint32_t), size) ||
+        !sectionValid(candidate->lods, sizeof(MeshLod), size) ||
+        !sectionValid(candidate->meshlets, sizeof(Meshlet), size) ||
+        !sectionValid(candidate->meshletVertices, sizeof(uint32_t), size) ||
+        !sectionValid(candidate->meshletTriangles, sizeof(uint8_t), size) ||
+        candidate->vertices.count > 0xFFFFFFFFu || candidate->indices.count % 3 != 0)
+        return fail("INVALID_SECTION");
+
+    // the tables that index into other sections are small, so they are checked here once
+    // rather than by everything that walks them; the index buffer itself is trusted, as going
+    // through it would cost as much as the rest of the load
+    const MeshLod* lods = reinterpret_cast<const MeshLod*>(base + candidate->lods.offset);
+    // the cooker always writes the full mesh as LOD 0, and every reader relies on it
+    if (candidate->lods.count == 0)
+        return fail("INVALID_LOD");
+    for (uint64_t i = 0; i < candidate->lods.count; i++)
+    {
+        if ((uint64_t)lods[i].firstIndex + lods[i].indexCount > candidate->indices.count ||
+            (uint64_t)lods[i].firstMeshlet + lods[i].meshletCount > candidate->meshlets.count)
+            return fail("INVALID_LOD");
+    }
+    // meshlet triangles double as ranges of the index buffer, so the two line up one to one
+    if (candidate->meshlets.count > 0 && candidate->meshletTriangles.count != candidate->indices.count)
+        return fail("INVALID_MESHLET");
+    const Meshlet* meshlets = reinterpret_cast<const Meshlet*>(base + candidate->meshlets.offset);
+    for (uint64_t i = 0; i < candidate->meshlets.count; i++)
+    {
+        if ((uint64_t)meshlets[i].firstVertex + meshlets[i].vertexCount > candidate->meshletVertices.count ||
+            ((uint64_t)meshlets[i].firstTriangle + meshlets[i].triangleCount) * 3 > candidate->meshletTriangles.count)
+            return fail("INVALID_MESHLET");
+    }
+
+    header = candidate;
+    vertexData = reinterpret_cast<const MeshVertex*>(base + header->vertices.offset);
+    indexData = reinterpret_cast<const uint32_t*>(base + header->indices.offset);
+    lodData = lods;
+    meshletData = meshlets;
+    meshletVertexData = reinterpret_cast<const uint32_t*>(base + header->meshletVertices.offset);
+    meshletTriangleData = reinterpret_cast<const uint8_t*>(base + header->meshletTriangles.offset);
+    return true;
+}
+
+void MeshFile::close()
+{
+    mapping.close();
+    header = nullptr;
+    vertexData = nullptr;
+    indexData = nullptr;
+    lodData = nullptr;
+    meshletData = nullptr;
+    meshletVertexData = nullptr;
+    meshletTriangleData = nullptr;
+}
+
+void MeshFile::copyTo(Mesh& mesh) const
+{
+    mesh.vertices.assign(vertexData, vertexData + vertexCount());
+    mesh.indices.assign(indexData, indexData + indexCount());
+    mesh.lods.assign(lodData, lodData + lodCount());
+    mesh.meshlets.assign(meshletData, meshletData + meshletCount());
+    mesh.meshletVertices.assign(meshletVertexData, meshletVertexData + header->meshletVertices.count);
+    mesh.meshletTriangles.assign(meshletTriangleData, meshletTriangleData + header->meshletTriangles.count);
+    mesh.boundsMin = glm::vec3(header->boundsMin[0], header->boundsMin[1], header->boundsMin[2]);
+    mesh.boundsMax = glm::vec3(header->boundsMax[0], header->boundsMax[1], header->boundsMax[2]);
+    mesh.boundsCenter = glm::vec3(header->boundsCenter[0], header->boundsCenter[1], header->boundsCenter[2]);
+    mesh.boundingRadius = header->boundingRadius;
+}
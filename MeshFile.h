@@ -0,0 +1,92 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include "Mesh.h"
+#include "MappedFile.h"
+
+// Runtime mesh container (.mesh). Everything a renderer needs is stored exactly as it is used
+// in memory, so loading is a mapping plus turning section offsets into pointers:
+//
+//   MeshFileHeader
+//   vertices           MeshVertex[]
+//   indices            uint32_t[]
+//   lods               MeshLod[]
+//   meshlets           Meshlet[]
+//   meshletVertices    uint32_t[]
+//   meshletTriangles   uint8_t[3 * triangles]
+//
+// Sections start on SECTION_ALIGNMENT boundaries. The file is little endian and tied to the
+// struct layouts above; the version changes with any of them.
+struct MeshFileSection
+{
+    uint64_t offset;
+    uint64_t count;
+};
+
+struct MeshFileHeader
+{
+    static const uint32_t VERSION = 1;
+    static const size_t SECTION_ALIGNMENT = 64;
+
+    char magic[4];              // "MESH"
+    uint32_t version;
+    uint64_t fileSize;
+    // of the file the mesh was cooked from, so stale cooked files and caches can be noticed;
+    // zero when unknown
+    uint64_t sourceSize;
+    int64_t sourceModified;
+    float boundsMin[3];
+    float boundsMax[3];
+    float boundsCenter[3];
+    float boundingRadius;
+    uint32_t vertexStride;
+    uint32_t reserved;
+    MeshFileSection vertices;
+    MeshFileSection indices;
+    MeshFileSection lods;
+    MeshFileSection meshlets;
+    MeshFileSection meshletVertices;
+    MeshFileSection meshletTriangles;
+};
+
+// size and modification time of a file; false if it doesn't exist
+bool fileStamp(const char* path, uint64_t& size, int64_t& modified);
+
+// writes mesh as a .mesh file; a mesh without lods gets one covering all of its indices
+bool writeMeshFile(const char* path, const Mesh& mesh, uint64_t sourceSize = 0, int64_t sourceModified = 0);
+
+// A mapped .mesh file. The sections are read (or uploaded) straight out of the mapping.
+class MeshFile
+{
+public:
+    // maps and validates the file; prints ERROR::MESH_FILE:: and returns false if it is
+    // malformed, truncated or from another version
+    bool open(const char* path);
+    void close();
+    bool isOpen() const { return header != nullptr; }
+
+    const MeshFileHeader& info() const { return *header; }
+    const MeshVertex* vertices() const { return vertexData; }
+    size_t vertexCount() const { return (size_t)header->vertices.count; }
+    const uint32_t* indices() const { return indexData; }
+    size_t indexCount() const { return (size_t)header->indices.count; }
+    const MeshLod* lods() const { return lodData; }
+    size_t lodCount() const { return (size_t)header->lods.count; }
+    const Meshlet* meshlets() const { return meshletData; }
+    size_t meshletCount() const { return (size_t)header->meshlets.count; }
+    const uint32_t* meshletVertices() const { return meshletVertexData; }
+    const uint8_t* meshletTriangles() const { return meshletTriangleData; }
+
+    // copies everything into mesh, for code that wants to modify it
+    void copyTo(Mesh& mesh) const;
+
+private:
+    MappedFile mapping;
+    const MeshFileHeader* header = nullptr;
+    const MeshVertex* vertexData = nullptr;
+    const uint32_t* indexData = nullptr;
+    const MeshLod* lodData = nullptr;
+    const Meshlet* meshletData = nullptr;
+    const uint32_t* meshletVertexData = nullptr;
+    const uint8_t* meshletTriangleData = nullptr;
+};
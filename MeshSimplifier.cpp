@@ -0,0 +1,369 @@
+#include "MeshSimplifier.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+// position, normal and texture coordinate
+static const int QUADRIC_SIZE = 8;
+static const int QUADRIC_TERMS = QUADRIC_SIZE * (QUADRIC_SIZE + 1) / 2;
+// positions are scaled into a unit box; a unit difference in normal or texture coordinate
+// counts like this much of the box
+static const float NORMAL_WEIGHT = 0.5f;
+static const float TEXCOORD_WEIGHT = 0.5f;
+// a level below this many triangles isn't worth simplifying further
+static const size_t MIN_LOD_TRIANGLES = 32;
+// a level keeping more than this share of the one before ends the chain
+static const float MIN_LOD_REDUCTION = 0.85f;
+
+// Sum of squared distances to the triangles' planes in attribute space, weighted by area:
+// error(v) = v'Av + 2b'v + c
+struct Quadric
+{
+    float a[QUADRIC_TERMS]; // upper triangle of A, row by row
+    float b[QUADRIC_SIZE];
+    float c;
+    float weight;           // total area, to turn the sum into a mean
+};
+
+struct Collapse
+{
+    uint32_t from;
+    uint32_t to;
+    float error;
+};
+
+static void addQuadric(Quadric& quadric, const Quadric& other)
+{
+    for (int i = 0; i < QUADRIC_TERMS; i++)
+        quadric.a[i] += other.a[i];
+    for (int i = 0; i < QUADRIC_SIZE; i++)
+        quadric.b[i] += other.b[i];
+    quadric.c += other.c;
+    quadric.weight += other.weight;
+}
+
+static float evaluate(const Quadric& quadric, const float* v)
+{
+    float result = quadric.c;
+    int term = 0;
+    for (int i = 0; i < QUADRIC_SIZE; i++)
+    {
+        float row = quadric.a[term++] * v[i];
+        for (int j = i + 1; j < QUADRIC_SIZE; j++)
+            row += 2.0f * quadric.a[term++] * v[j];
+        result += v[i] * (row + 2.0f * quadric.b[i]);
+    }
+    return result;
+}
+
+static float dot(const float* a, const float* b)
+{
+    float result = 0.0f;
+    for (int i = 0; i < QUADRIC_SIZE; i++)
+        result += a[i] * b[i];
+    return result;
+}
+
+// the quadric of the plane through p, q and r (Garland & Heckbert 1998: A = I - e1e1' - e2e2'
+// for an orthonormal basis e1, e2 of the plane), scaled by weight; false if degenerate
+static bool triangleQuadric(const float* p, const float* q, const float* r, float weight, Quadric& quadric)
+{
+    float e1[QUADRIC_SIZE], e2[QUADRIC_SIZE];
+    for (int i = 0; i < QUADRIC_SIZE; i++)
+    {
+        e1[i] = q[i] - p[i];
+        e2[i] = r[i] - p[i];
+    }
+    float length1 = std::sqrt(dot(e1, e1));
+    if (length1 <= 0.0f)
+        return false;
+    for (int i = 0; i < QUADRIC_SIZE; i++)
+        e1[i] /= length1;
+    float along = dot(e2, e1);
+    for (int i = 0; i < QUADRIC_SIZE; i++)
+        e2[i] -= along * e1[i];
+    float length2 = std::sqrt(dot(e2, e2));
+    if (length2 <= 0.0f)
+        return false;
+    for (int i = 0; i < QUADRIC_SIZE; i++)
+        e2[i] /= length2;
+
+    float p1 = dot(p, e1), p2 = dot(p, e2);
+    int term = 0;
+    for (int i = 0; i < QUADRIC_SIZE; i++)
+    {
+        for (int j = i; j < QUADRIC_SIZE; j++)
+            quadric.a[term++] = weight * ((i == j ? 1.0f : 0.0f) - e1[i] * e1[j] - e2[i] * e2[j]);
+        quadric.b[i] = weight * (p1 * e1[i] + p2 * e2[i] - p[i]);
+    }
+    quadric.c = weight * (dot(p, p) - p1 * p1 - p2 * p2);
+    quadric.weight = weight;
+    return true;
+}
+
+// the vertex as a point in attribute space
+static void attributeVector(const MeshVertex& vertex, const glm::vec3& center, float scale, float* v)
+{
+    glm::vec3 position = (vertex.position - center) * scale;
+    v[0] = position.x;
+    v[1] = position.y;
+    v[2] = position.z;
+    v[3] = vertex.normal.x * NORMAL_WEIGHT;
+    v[4] = vertex.normal.y * NORMAL_WEIGHT;
+    v[5] = vertex.normal.z * NORMAL_WEIGHT;
+    v[6] = vertex.texCoord.x * TEXCOORD_WEIGHT;
+    v[7] = vertex.texCoord.y * TEXCOORD_WEIGHT;
+}
+
+// the first vertex with the same position as each vertex; true in seam for positions shared
+// by several vertices (split normals or texture coordinates)
+static void positionGroups(const Mesh& mesh, std::vector<uint32_t>& canonical, std::vector<uint8_t>& seam)
+{
+    size_t vertexCount = mesh.vertices.size();
+    std::vector<uint32_t> order(vertexCount);
+    for (uint32_t v = 0; v < vertexCount; v++)
+        order[v] = v;
+    auto less = [&mesh](uint32_t a, uint32_t b)
+    {
+        const glm::vec3& p = mesh.vertices[a].position;
+        const glm::vec3& q = mesh.vertices[b].position;
+        if (p.x != q.x) return p.x < q.x;
+        if (p.y != q.y) return p.y < q.y;
+        if (p.z != q.z) return p.z < q.z;
+        return a < b;
+    };
+    std::sort(order.begin(), order.end(), less);
+
+    canonical.resize(vertexCount);
+    seam.assign(vertexCount, 0);
+    for (size_t begin = 0; begin < vertexCount;)
+    {
+        size_t end = begin + 1;
+        while (end < vertexCount && mesh.vertices[order[end]].position == mesh.vertices[order[begin]].position)
+            end++;
+        // sorted by index within the group, so order[begin] is the first
+        for (size_t i = begin; i < end; i++)
+            canonical[order[i]] = order[begin];
+        if (end - begin > 1)
+            seam[order[begin]] = 1;
+        begin = end;
+    }
+}
+
+// locks (by canonical vertex) the ends of every edge that isn't shared by exactly two
+// triangles with opposite windings: open borders and non-manifold edges
+static void lockBorders(const std::vector<uint32_t>& indices, const std::vector<uint32_t>& canonical, std::vector<uint8_t>& locked)
+{
+    std::vector<uint64_t> edges;
+    edges.reserve(indices.size());
+    for (size_t t = 0; t < indices.size(); t += 3)
+    {
+        for (int e = 0; e < 3; e++)
+        {
+            uint64_t a = canonical[indices[t + e]], b = canonical[indices[t + (e + 1) % 3]];
+            if (a != b)
+                edges.push_back(a << 32 | b);
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+    for (size_t i = 0; i < edges.size();)
+    {
+        size_t count = 1;
+        while (i + count < edges.size() && edges[i + count] == edges[i])
+            count++;
+        uint32_t a = (uint32_t)(edges[i] >> 32), b = (uint32_t)edges[i];
+        uint64_t twin = (uint64_t)b << 32 | a;
+        auto range = std::equal_range(edges.begin(), edges.end(), twin);
+        if (count != 1 || range.second - range.first != 1)
+            locked[a] = locked[b] = 1;
+        i += count;
+    }
+}
+
+float simplifyMesh(const Mesh& mesh, const uint32_t* indices, size_t indexCount, size_t targetIndexCount, float maxError, std::vector<uint32_t>& result)
+{
+    result.assign(indices, indices + (indexCount - indexCount % 3));
+    size_t vertexCount = mesh.vertices.size();
+    glm::vec3 size = mesh.boundsMax - mesh.boundsMin;
+    float extent = std::max(std::max(size.x, size.y), size.z);
+    if (result.size() <= targetIndexCount || vertexCount == 0 || extent <= 0.0f)
+        return 0.0f;
+
+    // everything is measured in a unit box around the mesh
+    const float scale = 1.0f / extent;
+    std::vector<float> attributes(vertexCount * QUADRIC_SIZE);
+    for (size_t v = 0; v < vertexCount; v++)
+        attributeVector(mesh.vertices[v], mesh.boundsCenter, scale, &attributes[v * QUADRIC_SIZE]);
+
+    std::vector<uint32_t> canonical;
+    std::vector<uint8_t> seam;
+    positionGroups(mesh, canonical, seam);
+
+    std::vector<Quadric> quadrics(vertexCount);
+    memset(quadrics.data(), 0, quadrics.size() * sizeof(Quadric));
+    for (size_t t = 0; t < result.size(); t += 3)
+    {
+        const uint32_t* corner = &result[t];
+        glm::vec3 p = mesh.vertices[corner[0]].position * scale;
+        glm::vec3 q = mesh.vertices[corner[1]].position * scale;
+        glm::vec3 r = mesh.vertices[corner[2]].position * scale;
+        float area = 0.5f * glm::length(glm::cross(q - p, r - p));
+        Quadric quadric;
+        if (area <= 0.0f || !triangleQuadric(&attributes[corner[0] * QUADRIC_SIZE], &attributes[corner[1] * QUADRIC_SIZE], &attributes[corner[2] * QUADRIC_SIZE], area, quadric))
+            continue;
+        for (int i = 0; i < 3; i++)
+            addQuadric(quadrics[corner[i]], quadric);
+    }
+
+    const float errorLimit = maxError < FLT_MAX ? (maxError * scale) * (maxError * scale) : FLT_MAX;
+    float largestError = 0.0f;
+    size_t triangleCount = result.size() / 3;
+    const size_t targetTriangles = targetIndexCount / 3;
+    std::vector<uint8_t> locked;
+    std::vector<uint8_t> touched(vertexCount);
+    std::vector<uint32_t> remap(vertexCount);
+    std::vector<uint32_t> triangleOffsets(vertexCount + 1);
+    std::vector<uint32_t> vertexTriangles;
+    std::vector<Collapse> collapses;
+
+    // each pass picks the cheapest collapses whose neighbourhoods don't overlap, so they can
+    // all be applied without updating anything in between
+    while (triangleCount > targetTriangles)
+    {
+        locked = seam;
+        lockBorders(result, canonical, locked);
+
+        // triangles around each vertex
+        std::fill(triangleOffsets.begin(), triangleOffsets.end(), 0);
+        for (uint32_t index : result)
+            triangleOffsets[index + 1]++;
+        for (size_t v = 0; v < vertexCount; v++)
+            triangleOffsets[v + 1] += triangleOffsets[v];
+        vertexTriangles.resize(result.size());
+        // remap isn't needed until the collapses are picked, so it doubles as the fill cursor
+        std::vector<uint32_t>& cursor = remap;
+        std::copy(triangleOffsets.begin(), triangleOffsets.end() - 1, cursor.begin());
+        for (size_t i = 0; i < result.size(); i++)
+            vertexTriangles[cursor[result[i]]++] = (uint32_t)(i / 3);
+
+        // every edge once (its other triangle sees it the other way round), in its cheaper
+        // direction; locked vertices only ever receive collapses
+        collapses.clear();
+        for (size_t t = 0; t < result.size(); t += 3)
+        {
+            for (int e = 0; e < 3; e++)
+            {
+                uint32_t a = result[t + e], b = result[t + (e + 1) % 3];
+                if (canonical[a] >= canonical[b])
+                    continue;
+                Collapse best = { a, a, FLT_MAX };
+                for (int direction = 0; direction < 2; direction++)
+                {
+                    uint32_t from = direction ? b : a, to = direction ? a : b;
+                    float weight = quadrics[from].weight + quadrics[to].weight;
+                    if (locked[canonical[from]] || weight <= 0.0f)
+                        continue;
+                    const float* target = &attributes[to * QUADRIC_SIZE];
+                    float error = std::max((evaluate(quadrics[from], target) + evaluate(quadrics[to], target)) / weight, 0.0f);
+                    if (error <= best.error)
+                        best = { from, to, error };
+                }
+                if (best.from != best.to && best.error <= errorLimit)
+                    collapses.push_back(best);
+            }
+        }
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.error < b.error; });
+
+        for (size_t v = 0; v < vertexCount; v++)
+            remap[v] = (uint32_t)v;
+        std::fill(touched.begin(), touched.end(), 0);
+        size_t collapsed = 0;
+        for (const Collapse& collapse : collapses)
+        {
+            if (triangleCount <= targetTriangles)
+                break;
+            uint32_t from = collapse.from, to = collapse.to;
+            if (touched[canonical[from]] || touched[canonical[to]])
+                continue;
+
+            // moving from onto to must not turn any of from's remaining triangles over
+            const glm::vec3& target = mesh.vertices[to].position;
+            bool flips = false;
+            size_t removed = 0;
+            for (uint32_t i = triangleOffsets[from]; i < triangleOffsets[from + 1] && !flips; i++)
+            {
+                const uint32_t* corner = &result[vertexTriangles[i] * 3];
+                if (canonical[corner[0]] == canonical[to] || canonical[corner[1]] == canonical[to] || canonical[corner[2]] == canonical[to])
+                {
+                    removed++;
+                    continue;
+                }
+                glm::vec3 p[3], moved[3];
+                for (int k = 0; k < 3; k++)
+                {
+                    p[k] = mesh.vertices[corner[k]].position;
+                    moved[k] = corner[k] == from ? target : p[k];
+                }
+                glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+                glm::vec3 after = glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+                // a pure sign test lets a sliver turn over in several steps of just under 90
+                // degrees, so anything past about 75 counts
+                flips = glm::dot(before, after) <= 0.25f * glm::length(before) * glm::length(after);
+            }
+            if (flips)
+                continue;
+
+            remap[from] = to;
+            addQuadric(quadrics[to], quadrics[from]);
+            for (uint32_t i = triangleOffsets[from]; i < triangleOffsets[from + 1]; i++)
+            {
+                const uint32_t* corner = &result[vertexTriangles[i] * 3];
+                for (int k = 0; k < 3; k++)
+                    touched[canonical[corner[k]]] = 1;
+            }
+            triangleCount -= removed;
+            largestError = std::max(largestError, collapse.error);
+            collapsed++;
+        }
+        if (collapsed == 0)
+            break;
+
+        // apply the pass and drop the triangles that collapsed to an edge
+        size_t kept = 0;
+        for (size_t t = 0; t < result.size(); t += 3)
+        {
+            uint32_t a = remap[result[t]], b = remap[result[t + 1]], c = remap[result[t + 2]];
+            if (canonical[a] == canonical[b] || canonical[b] == canonical[c] || canonical[c] == canonical[a])
+                continue;
+            result[kept++] = a;
+            result[kept++] = b;
+            result[kept++] = c;
+        }
+        result.resize(kept);
+        triangleCount = kept / 3;
+    }
+    return std::sqrt(largestError) * extent;
+}
+
+void buildLods(Mesh& mesh, size_t maxLods)
+{
+    mesh.lods.clear();
+    MeshLod full = { 0, (uint32_t)mesh.indices.size(), 0, (uint32_t)mesh.meshlets.size(), 0.0f };
+    mesh.lods.push_back(full);
+
+    std::vector<uint32_t> previous(mesh.indices), simplified;
+    float error = 0.0f;
+    while (mesh.lods.size() < maxLods && previous.size() / 3 > MIN_LOD_TRIANGLES)
+    {
+        size_t target = previous.size() / 6 * 3;
+        float levelError = simplifyMesh(mesh, previous.data(), previous.size(), target, FLT_MAX, simplified);
+        if (simplified.size() > previous.size() * MIN_LOD_REDUCTION)
+            break;
+        error += levelError;
+        MeshLod lod = { (uint32_t)mesh.indices.size(), (uint32_t)simplified.size(), 0, 0, error };
+        mesh.indices.insert(mesh.indices.end(), simplified.begin(), simplified.end());
+        mesh.lods.push_back(lod);
+        previous.swap(simplified);
+    }
+}
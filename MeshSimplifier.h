@@ -0,0 +1,24 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "Mesh.h"
+
+// Quadric error metric simplification (Garland & Heckbert) by half-edge collapses: a vertex is
+// merged into one of its neighbours, so the result indexes the mesh's own vertices and every
+// level of detail shares one vertex buffer. The quadrics measure position, normal and texture
+// coordinate together, so collapses that would smear shading or stretch the texture cost more
+// than ones that only move flat geometry. Vertices on open borders, on attribute seams (one
+// position, several vertices) and on non-manifold edges are locked and never move.
+//
+// Simplifies the triangles indices[0, indexCount) until no more than targetIndexCount indices
+// are left or the next collapse would cost more than maxError. Errors are object space
+// distances, with attribute differences counted as if they were distances. Returns the error
+// of the most expensive collapse made.
+float simplifyMesh(const Mesh& mesh, const uint32_t* indices, size_t indexCount, size_t targetIndexCount, float maxError, std::vector<uint32_t>& result);
+
+// Replaces mesh.lods with a chain: the full mesh, then levels with about half the triangles of
+// the one before, each appended to mesh.indices. The chain ends at maxLods levels, when a level
+// gets small enough, or when the locked vertices keep a level from shrinking much. A level's
+// error includes the errors of those before it, since each is simplified from the last.
+void buildLods(Mesh& mesh, size_t maxLods = 6);
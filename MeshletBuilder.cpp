@@ -0,0 +1,203 @@
+#include "MeshletBuilder.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+static const uint32_t NO_TRIANGLE = 0xFFFFFFFFu;
+
+// sphere around the meshlet's vertices and the cone around its triangles' normals
+static void computeMeshletBounds(const Mesh& mesh, const uint32_t* indices, Meshlet& meshlet)
+{
+    glm::vec3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+    for (uint32_t i = 0; i < meshlet.vertexCount; i++)
+    {
+        const glm::vec3& position = mesh.vertices[mesh.meshletVertices[meshlet.firstVertex + i]].position;
+        boundsMin = glm::min(boundsMin, position);
+        boundsMax = glm::max(boundsMax, position);
+    }
+    meshlet.center = (boundsMin + boundsMax) * 0.5f;
+    float radiusSquared = 0.0f;
+    for (uint32_t i = 0; i < meshlet.vertexCount; i++)
+    {
+        glm::vec3 offset = mesh.vertices[mesh.meshletVertices[meshlet.firstVertex + i]].position - meshlet.center;
+        radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+    }
+    meshlet.radius = std::sqrt(radiusSquared);
+
+    // the axis is the mean of the triangles' unit normals (degenerate triangles face nowhere and
+    // are left out); the cone has to reach the normal furthest from it
+    glm::vec3 normals[MAX_MESHLET_TRIANGLES];
+    uint32_t normalCount = 0;
+    glm::vec3 axis(0.0f);
+    for (uint32_t t = 0; t < meshlet.triangleCount; t++)
+    {
+        const uint32_t* triangle = indices + 3 * t;
+        const glm::vec3& a = mesh.vertices[triangle[0]].position;
+        glm::vec3 normal = glm::cross(mesh.vertices[triangle[1]].position - a, mesh.vertices[triangle[2]].position - a);
+        float length = glm::length(normal);
+        if (length <= 0.0f)
+            continue;
+        normals[normalCount] = normal / length;
+        axis += normals[normalCount++];
+    }
+    float axisLength = glm::length(axis);
+    meshlet.coneAxis = axisLength > 0.0f ? axis / axisLength : glm::vec3(0.0f, 0.0f, 1.0f);
+    float minimumDot = axisLength > 0.0f ? 1.0f : -1.0f;
+    for (uint32_t i = 0; i < normalCount; i++)
+        minimumDot = std::min(minimumDot, glm::dot(normals[i], meshlet.coneAxis));
+    // a view direction within 90 degrees minus the cone's half angle of the axis sees only backs
+    meshlet.coneCutoff = minimumDot <= 0.0f ? 1.0f : std::sqrt(1.0f - minimumDot * minimumDot);
+}
+
+void buildMeshlets(Mesh& mesh)
+{
+    if (mesh.lods.empty())
+        mesh.lods.push_back({ 0, (uint32_t)mesh.indices.size(), 0, 0, 0.0f });
+    mesh.meshlets.clear();
+    mesh.meshletVertices.clear();
+    mesh.meshletTriangles.clear();
+
+    size_t totalIndices = 0;
+    for (const MeshLod& lod : mesh.lods)
+        totalIndices += lod.indexCount;
+    std::vector<uint32_t> ordered;
+    ordered.reserve(totalIndices);
+    mesh.meshletTriangles.reserve(totalIndices);
+
+    // position of each vertex in the meshlet being built, -1 when it isn't in it
+    std::vector<int32_t> localIndex(mesh.vertices.size(), -1);
+    std::vector<uint32_t> firstAdjacent(mesh.vertices.size() + 1);
+    std::vector<uint32_t> adjacent;
+    std::vector<uint8_t> emitted;
+    // unplaced triangles around each vertex
+    std::vector<uint32_t> liveTriangles(mesh.vertices.size());
+    std::vector<glm::vec3> centroids;
+    std::vector<uint32_t> candidates;
+
+    for (MeshLod& lod : mesh.lods)
+    {
+        const uint32_t* source = mesh.indices.data() + lod.firstIndex;
+        const uint32_t triangleCount = lod.indexCount / 3;
+
+        // the triangles around each vertex, as ranges of adjacent
+        std::fill(firstAdjacent.begin(), firstAdjacent.end(), 0u);
+        for (uint32_t i = 0; i < triangleCount * 3; i++)
+            firstAdjacent[source[i] + 1]++;
+        for (size_t v = 0; v < mesh.vertices.size(); v++)
+            firstAdjacent[v + 1] += firstAdjacent[v];
+        adjacent.resize(triangleCount * 3);
+        std::vector<uint32_t> fill(firstAdjacent.begin(), firstAdjacent.end() - 1);
+        for (uint32_t i = 0; i < triangleCount * 3; i++)
+            adjacent[fill[source[i]]++] = i / 3;
+
+        emitted.assign(triangleCount, 0);
+        for (size_t v = 0; v < mesh.vertices.size(); v++)
+            liveTriangles[v] = firstAdjacent[v + 1] - firstAdjacent[v];
+        centroids.resize(triangleCount);
+        for (uint32_t t = 0; t < triangleCount; t++)
+        {
+            const uint32_t* triangle = source + 3 * t;
+            centroids[t] = (mesh.vertices[triangle[0]].position + mesh.vertices[triangle[1]].position +
+                mesh.vertices[triangle[2]].position) * (1.0f / 3.0f);
+        }
+
+        lod.firstIndex = (uint32_t)ordered.size();
+        lod.firstMeshlet = (uint32_t)mesh.meshlets.size();
+        uint32_t nextUnvisited = 0;
+        candidates.clear();
+        for (;;)
+        {
+            // seed next to the meshlet just finished if anything there is left, at the triangle
+            // with the fewest unplaced neighbours so corners get used up instead of left behind
+            // as scraps; otherwise take the first triangle not yet placed
+            uint32_t seed = NO_TRIANGLE;
+            uint32_t seedLive = 0xFFFFFFFFu;
+            for (uint32_t candidate : candidates)
+            {
+                const uint32_t* corners = source + 3 * candidate;
+                uint32_t live = liveTriangles[corners[0]] + liveTriangles[corners[1]] + liveTriangles[corners[2]];
+                if (!emitted[candidate] && live < seedLive)
+                {
+                    seed = candidate;
+                    seedLive = live;
+                }
+            }
+            candidates.clear();
+            while (seed == NO_TRIANGLE && nextUnvisited < triangleCount)
+            {
+                if (!emitted[nextUnvisited])
+                    seed = nextUnvisited;
+                nextUnvisited++;
+            }
+            if (seed == NO_TRIANGLE)
+                break;
+
+            Meshlet meshlet = {};
+            meshlet.firstVertex = (uint32_t)mesh.meshletVertices.size();
+            meshlet.firstTriangle = (uint32_t)(ordered.size() / 3);
+            glm::vec3 centroidSum(0.0f);
+            uint32_t triangle = seed;
+            while (triangle != NO_TRIANGLE)
+            {
+                emitted[triangle] = 1;
+                for (int corner = 0; corner < 3; corner++)
+                    liveTriangles[source[3 * triangle + corner]]--;
+                centroidSum += centroids[triangle];
+                for (int corner = 0; corner < 3; corner++)
+                {
+                    uint32_t vertex = source[3 * triangle + corner];
+                    ordered.push_back(vertex);
+                    if (localIndex[vertex] < 0)
+                    {
+                        localIndex[vertex] = (int32_t)meshlet.vertexCount++;
+                        mesh.meshletVertices.push_back(vertex);
+                        for (uint32_t a = firstAdjacent[vertex]; a < firstAdjacent[vertex + 1]; a++)
+                            if (!emitted[adjacent[a]])
+                                candidates.push_back(adjacent[a]);
+                    }
+                    mesh.meshletTriangles.push_back((uint8_t)localIndex[vertex]);
+                }
+                meshlet.triangleCount++;
+                if (meshlet.triangleCount == MAX_MESHLET_TRIANGLES)
+                    break;
+
+                // the neighbour adding the fewest vertices, then the one with the fewest unplaced
+                // neighbours, then the one closest to the meshlet; placed triangles are dropped
+                // from the candidates on the way
+                glm::vec3 meshletCentroid = centroidSum / (float)meshlet.triangleCount;
+                triangle = NO_TRIANGLE;
+                uint32_t bestNewVertices = 4, bestLive = 0;
+                float bestDistance = FLT_MAX;
+                size_t kept = 0;
+                for (uint32_t candidate : candidates)
+                {
+                    if (emitted[candidate])
+                        continue;
+                    candidates[kept++] = candidate;
+                    const uint32_t* corners = source + 3 * candidate;
+                    uint32_t newVertices = (localIndex[corners[0]] < 0) + (localIndex[corners[1]] < 0) + (localIndex[corners[2]] < 0);
+                    if (meshlet.vertexCount + newVertices > MAX_MESHLET_VERTICES || newVertices > bestNewVertices)
+                        continue;
+                    uint32_t live = liveTriangles[corners[0]] + liveTriangles[corners[1]] + liveTriangles[corners[2]];
+                    glm::vec3 offset = centroids[candidate] - meshletCentroid;
+                    float distance = glm::dot(offset, offset);
+                    if (newVertices < bestNewVertices || live < bestLive || (live == bestLive && distance < bestDistance))
+                    {
+                        triangle = candidate;
+                        bestNewVertices = newVertices;
+                        bestLive = live;
+                        bestDistance = distance;
+                    }
+                }
+                candidates.resize(kept);
+            }
+
+            for (uint32_t i = 0; i < meshlet.vertexCount; i++)
+                localIndex[mesh.meshletVertices[meshlet.firstVertex + i]] = -1;
+            computeMeshletBounds(mesh, ordered.data() + 3 * meshlet.firstTriangle, meshlet);
+            mesh.meshlets.push_back(meshlet);
+        }
+        lod.meshletCount = (uint32_t)mesh.meshlets.size() - lod.firstMeshlet;
+    }
+    mesh.indices.swap(ordered);
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include <cstddef>
+#include "Mesh.h"
+
+// limits of one meshlet, the sizes mesh shader hardware is usually fed (124 triangles keep a
+// meshlet's byte triples a multiple of four bytes)
+static const size_t MAX_MESHLET_VERTICES = 64;
+static const size_t MAX_MESHLET_TRIANGLES = 124;
+
+// Splits every level of detail into meshlets and fills mesh.meshlets, meshletVertices and
+// meshletTriangles (a mesh without lods gets one covering all of its indices first). Meshlets
+// grow greedily from a seed triangle, always adding the neighbouring triangle that brings in
+// the fewest new vertices; ties go to the triangle with the fewest unplaced neighbours, which
+// keeps the surface from being left in scraps, and then to the one closest to the meshlet, so
+// meshlets stay compact and their spheres and normal cones stay tight.
+//
+// The index buffer is rewritten in meshlet order, each level after the one before, so a
+// meshlet's triangles are also indices[3 * firstTriangle, +3 * triangleCount) and can be drawn
+// straight from the element buffer.
+void buildMeshlets(Mesh& mesh);
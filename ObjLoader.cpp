@@ -0,0 +1,427 @@
+#include "ObjLoader.h"
+#include "MappedFile.h"
+#include "MeshFile.h"
+#include "TextParsing.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// below this much text a chunk isn't worth a job of its own
+static const size_t MIN_CHUNK_SIZE = 256 * 1024;
+// nor is welding fewer corners than this per shard
+static const size_t MIN_SHARD_CORNERS = 256 * 1024;
+static const uint32_t MISSING = 0xFFFFFFFF;
+
+// One face corner as written in the file. Positive indices are absolute; negative ones count
+// back from the end of the attributes read so far, which in a chunk is only known relative
+// to the chunk's start until every chunk has been counted.
+struct ObjCorner
+{
+    int32_t index[3];     // position, texcoord, normal
+    uint8_t present;      // bit per index
+    uint8_t relative;     // bit per index
+};
+
+struct ObjChunk
+{
+    const char* begin;
+    const char* end;
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec2> texCoords;
+    std::vector<glm::vec3> normals;
+    std::vector<ObjCorner> corners; // three per triangle
+    size_t lines = 0;
+    size_t errorLine = 0; // 1-based within the chunk, 0 when the chunk parsed cleanly
+};
+
+// position, texcoord and normal index of a welded vertex
+struct VertexKey
+{
+    uint32_t index[3];
+
+    bool operator==(const VertexKey& other) const
+    {
+        return index[0] == other.index[0] && index[1] == other.index[1] && index[2] == other.index[2];
+    }
+};
+
+static uint64_t hashKey(const VertexKey& key)
+{
+    uint64_t hash = (uint64_t)key.index[0] * 0x9E3779B97F4A7C15ull;
+    hash ^= ((uint64_t)key.index[1] + 0x632BE59BD9B4E019ull) * 0xC2B2AE3D27D4EB4Full;
+    hash ^= ((uint64_t)key.index[2] + 0x165667B19E3779F9ull) * 0x85EBCA77C2B2AE63ull;
+    return hash ^ (hash >> 29);
+}
+
+static bool parseVector(const char*& cursor, const char* end, float* values, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        skipBlanks(cursor, end);
+        if (!parseFloat(cursor, end, values[i]))
+            return false;
+    }
+    return true;
+}
+
+// reads "v", "v/t", "v//n" or "v/t/n"
+static bool parseCorner(const char*& cursor, const char* end, const ObjChunk& chunk, ObjCorner& corner)
+{
+    const size_t counts[3] = { chunk.positions.size(), chunk.texCoords.size(), chunk.normals.size() };
+    corner.present = 0;
+    corner.relative = 0;
+    for (int i = 0; i < 3; i++)
+    {
+        if (i > 0)
+        {
+            if (cursor == end || *cursor != '/')
+                break;
+            cursor++;
+        }
+        int64_t value;
+        if (!parseInt(cursor, end, value))
+        {
+            // only the texcoord may be left out ("v//n")
+            if (i == 1)
+                continue;
+            return false;
+        }
+        if (value == 0 || value > INT32_MAX || value < INT32_MIN)
+            return false;
+        corner.present |= 1 << i;
+        if (value > 0)
+        {
+            corner.index[i] = (int32_t)(value - 1);
+        }
+        else
+        {
+            corner.index[i] = (int32_t)((int64_t)counts[i] + value);
+            corner.relative |= 1 << i;
+        }
+    }
+    return (corner.present & 1) != 0;
+}
+
+static void parseChunk(ObjChunk& chunk)
+{
+    const char* cursor = chunk.begin;
+    const char* end = chunk.end;
+    while (cursor < end)
+    {
+        chunk.lines++;
+        skipBlanks(cursor, end);
+        bool valid = true;
+        if (cursor + 1 < end && cursor[0] == 'v' && (cursor[1] == ' ' || cursor[1] == '\t'))
+        {
+            cursor += 1;
+            glm::vec3 position;
+            valid = parseVector(cursor, end, &position.x, 3);
+            chunk.positions.push_back(position);
+        }
+        else if (cursor + 2 < end && cursor[0] == 'v' && cursor[1] == 't' && (cursor[2] == ' ' || cursor[2] == '\t'))
+        {
+            cursor += 2;
+            glm::vec2 texCoord;
+            valid = parseVector(cursor, end, &texCoord.x, 2);
+            chunk.texCoords.push_back(texCoord);
+        }
+        else if (cursor + 2 < end && cursor[0] == 'v' && cursor[1] == 'n' && (cursor[2] == ' ' || cursor[2] == '\t'))
+        {
+            cursor += 2;
+            glm::vec3 normal;
+            valid = parseVector(cursor, end, &normal.x, 3);
+            chunk.normals.push_back(normal);
+        }
+        else if (cursor + 1 < end && cursor[0] == 'f' && (cursor[1] == ' ' || cursor[1] == '\t'))
+        {
+            cursor += 1;
+            // polygons become fans around their first corner
+            ObjCorner first, previous, current;
+            int cornerCount = 0;
+            for (;;)
+            {
+                skipBlanks(cursor, end);
+                if (cursor == end || *cursor == '\r' || *cursor == '\n' || *cursor == '#')
+                    break;
+                if (!parseCorner(cursor, end, chunk, current))
+                {
+                    valid = false;
+                    break;
+                }
+                if (cornerCount == 0)
+                {
+                    first = current;
+                }
+                else if (cornerCount >= 2)
+                {
+                    chunk.corners.push_back(first);
+                    chunk.corners.push_back(previous);
+                    chunk.corners.push_back(current);
+                }
+                previous = current;
+                cornerCount++;
+            }
+            if (cornerCount < 3)
+                valid = false;
+        }
+        // anything else (comments, o, g, s, usemtl, mtllib, l, p) is skipped
+        if (!valid && chunk.errorLine == 0)
+            chunk.errorLine = chunk.lines;
+        skipLine(cursor, end);
+    }
+}
+
+// Welds the corners into unique vertices. The key space is split into one shard per job;
+// each job scans every corner but only hashes the ones in its shard, so the tables are
+// built without locks. vertexOfCorner gets a shard local id, which the shard base turns global.
+struct WeldShard
+{
+    std::vector<VertexKey> keys;      // by shard local id
+    std::vector<uint32_t> table;      // local id + 1, 0 when empty
+    uint32_t base = 0;
+};
+
+static void weldShard(const std::vector<VertexKey>& corners, uint32_t shard, int shardBits, WeldShard& result, std::vector<uint32_t>& vertexOfCorner)
+{
+    size_t capacity = 1024;
+    while (capacity < (corners.size() >> shardBits) / 2)
+        capacity *= 2;
+    result.table.assign(capacity, 0);
+    size_t mask = capacity - 1;
+
+    for (size_t c = 0; c < corners.size(); c++)
+    {
+        uint64_t hash = hashKey(corners[c]);
+        if (shardBits > 0 && (uint32_t)(hash >> (64 - shardBits)) != shard)
+            continue;
+
+        // keep the load factor under a half
+        if (result.keys.size() * 2 >= capacity)
+        {
+            capacity *= 2;
+            mask = capacity - 1;
+            result.table.assign(capacity, 0);
+            for (uint32_t id = 0; id < result.keys.size(); id++)
+            {
+                size_t slot = hashKey(result.keys[id]) & mask;
+                while (result.table[slot] != 0)
+                    slot = (slot + 1) & mask;
+                result.table[slot] = id + 1;
+            }
+        }
+
+        size_t slot = hash & mask;
+        for (;;)
+        {
+            uint32_t entry = result.table[slot];
+            if (entry == 0)
+            {
+                result.keys.push_back(corners[c]);
+                result.table[slot] = (uint32_t)result.keys.size();
+                vertexOfCorner[c] = (uint32_t)result.keys.size() - 1;
+                break;
+            }
+            if (result.keys[entry - 1] == corners[c])
+            {
+                vertexOfCorner[c] = entry - 1;
+                break;
+            }
+            slot = (slot + 1) & mask;
+        }
+    }
+    std::vector<uint32_t>().swap(result.table);
+}
+
+bool parseObj(const char* text, size_t size, Mesh& mesh, JobSystem& jobs, const char* name)
+{
+    mesh.vertices.clear();
+    mesh.indices.clear();
+
+    // cut the text into chunks that end at line breaks
+    size_t chunkSize = std::max(MIN_CHUNK_SIZE, size / (jobs.threadCount() * 4) + 1);
+    std::vector<ObjChunk> chunks;
+    const char* textEnd = text + size;
+    for (const char* begin = text; begin < textEnd;)
+    {
+        const char* chunkEnd = begin + std::min(chunkSize, (size_t)(textEnd - begin));
+        while (chunkEnd < textEnd && chunkEnd[-1] != '\n')
+            chunkEnd++;
+        chunks.emplace_back();
+        chunks.back().begin = begin;
+        chunks.back().end = chunkEnd;
+        begin = chunkEnd;
+    }
+
+    jobs.parallelFor(chunks.size(), [&chunks](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; i++)
+            parseChunk(chunks[i]);
+    });
+
+    // offsets of every chunk's attributes and corners in the merged arrays
+    std::vector<size_t> positionBase(chunks.size()), texCoordBase(chunks.size()), normalBase(chunks.size()), cornerBase(chunks.size());
+    size_t positionCount = 0, texCoordCount = 0, normalCount = 0, cornerCount = 0, lines = 0;
+    for (size_t i = 0; i < chunks.size(); i++)
+    {
+        const ObjChunk& chunk = chunks[i];
+        if (chunk.errorLine != 0)
+        {
+            std::cout << "ERROR::OBJ::PARSE_FAILED " << name << " line " << lines + chunk.errorLine << std::endl;
+            return false;
+        }
+        positionBase[i] = positionCount;
+        texCoordBase[i] = texCoordCount;
+        normalBase[i] = normalCount;
+        cornerBase[i] = cornerCount;
+        positionCount += chunk.positions.size();
+        texCoordCount += chunk.texCoords.size();
+        normalCount += chunk.normals.size();
+        cornerCount += chunk.corners.size();
+        lines += chunk.lines;
+    }
+    if (cornerCount == 0)
+    {
+        std::cout << "ERROR::OBJ::NO_FACES " << name << std::endl;
+        return false;
+    }
+    if (cornerCount > 0xFFFFFFFFull || positionCount >= MISSING || texCoordCount >= MISSING || normalCount >= MISSING)
+    {
+        std::cout << "ERROR::OBJ::TOO_LARGE " << name << std::endl;
+        return false;
+    }
+
+    // merge, resolving relative indices now that every chunk's base is known
+    std::vector<glm::vec3> positions(positionCount), normals(normalCount);
+    std::vector<glm::vec2> texCoords(texCoordCount);
+    std::vector<VertexKey> corners(cornerCount);
+    std::vector<char> chunkValid(chunks.size(), 1);
+    jobs.parallelFor(chunks.size(), [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; i++)
+        {
+            ObjChunk& chunk = chunks[i];
+            std::copy(chunk.positions.begin(), chunk.positions.end(), positions.begin() + positionBase[i]);
+            std::copy(chunk.texCoords.begin(), chunk.texCoords.end(), texCoords.begin() + texCoordBase[i]);
+            std::copy(chunk.normals.begin(), chunk.normals.end(), normals.begin() + normalBase[i]);
+
+            const size_t bases[3] = { positionBase[i], texCoordBase[i], normalBase[i] };
+            const size_t counts[3] = { positionCount, texCoordCount, normalCount };
+            for (size_t c = 0; c < chunk.corners.size(); c++)
+            {
+                const ObjCorner& corner = chunk.corners[c];
+                VertexKey& key = corners[cornerBase[i] + c];
+                for (int k = 0; k < 3; k++)
+                {
+                    if (!(corner.present & (1 << k)))
+                    {
+                        key.index[k] = MISSING;
+                        continue;
+                    }
+                    int64_t index = (int64_t)corner.index[k] + ((corner.relative & (1 << k)) ? (int64_t)bases[k] : 0);
+                    if (index < 0 || index >= (int64_t)counts[k])
+                    {
+                        chunkValid[i] = 0;
+                        index = 0;
+                    }
+                    key.index[k] = (uint32_t)index;
+                }
+            }
+            // the chunk's own arrays aren't needed anymore
+            std::vector<glm::vec3>().swap(chunk.positions);
+            std::vector<glm::vec2>().swap(chunk.texCoords);
+            std::vector<glm::vec3>().swap(chunk.normals);
+            std::vector<ObjCorner>().swap(chunk.corners);
+        }
+    });
+    if (std::find(chunkValid.begin(), chunkValid.end(), 0) != chunkValid.end())
+    {
+        std::cout << "ERROR::OBJ::INDEX_OUT_OF_RANGE " << name << std::endl;
+        return false;
+    }
+
+    // weld in parallel shards
+    int shardBits = 0;
+    while ((1u << shardBits) < jobs.threadCount() && cornerCount > (MIN_SHARD_CORNERS << shardBits))
+        shardBits++;
+    std::vector<WeldShard> shards((size_t)1 << shardBits);
+    std::vector<uint32_t> vertexOfCorner(cornerCount);
+    jobs.parallelFor(shards.size(), [&](size_t begin, size_t end)
+    {
+        for (size_t s = begin; s < end; s++)
+            weldShard(corners, (uint32_t)s, shardBits, shards[s], vertexOfCorner);
+    });
+    uint32_t uniqueCount = 0;
+    for (WeldShard& shard : shards)
+    {
+        shard.base = uniqueCount;
+        uniqueCount += (uint32_t)shard.keys.size();
+    }
+
+    // Number the vertices in the order the triangles first use them, which is also the order
+    // the GPU fetches them in. This pass is sequential but only does array lookups.
+    std::vector<uint32_t> finalIndex(uniqueCount, MISSING);
+    mesh.vertices.reserve(uniqueCount);
+    mesh.indices.resize(cornerCount);
+    for (size_t c = 0; c < cornerCount; c++)
+    {
+        const VertexKey& key = corners[c];
+        uint32_t shard = shardBits > 0 ? (uint32_t)(hashKey(key) >> (64 - shardBits)) : 0;
+        uint32_t welded = shards[shard].base + vertexOfCorner[c];
+        if (finalIndex[welded] == MISSING)
+        {
+            finalIndex[welded] = (uint32_t)mesh.vertices.size();
+            MeshVertex vertex;
+            vertex.position = positions[key.index[0]];
+            vertex.texCoord = key.index[1] != MISSING ? texCoords[key.index[1]] : glm::vec2(0.0f);
+            vertex.normal = key.index[2] != MISSING ? normals[key.index[2]] : glm::vec3(0.0f);
+            mesh.vertices.push_back(vertex);
+        }
+        mesh.indices[c] = finalIndex[welded];
+    }
+
+    if (normalCount == 0)
+        mesh.computeNormals();
+    mesh.computeBounds();
+    return true;
+}
+
+bool loadObj(const char* path, Mesh& mesh, JobSystem& jobs, bool useCache)
+{
+    uint64_t sourceSize = 0;
+    int64_t sourceModified = 0;
+    if (!fileStamp(path, sourceSize, sourceModified))
+    {
+        std::cout << "ERROR::OBJ::FILE_NOT_FOUND " << path << std::endl;
+        return false;
+    }
+    std::string cachePath = std::string(path) + ".meshcache";
+    uint64_t cacheSize;
+    int64_t cacheModified;
+    if (useCache && fileStamp(cachePath.c_str(), cacheSize, cacheModified))
+    {
+        MeshFile cache;
+        if (cache.open(cachePath.c_str()) && cache.info().sourceSize == sourceSize &&
+            cache.info().sourceModified == sourceModified)
+        {
+            cache.copyTo(mesh);
+            return true;
+        }
+    }
+
+    MappedFile file(path);
+    if (!file.isOpen())
+    {
+        std::cout << "ERROR::OBJ::FILE_NOT_SUCCESSFULLY_READ " << path << std::endl;
+        return false;
+    }
+    if (!parseObj(file.data(), file.size(), mesh, jobs, path))
+        return false;
+    // a cache that can't be written (read-only asset folder) is reported but the load still succeeds
+    if (useCache)
+        writeMeshFile(cachePath.c_str(), mesh, sourceSize, sourceModified);
+    return true;
+}
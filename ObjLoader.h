@@ -0,0 +1,18 @@
+#pragma once
+#include <cstddef>
+#include "Mesh.h"
+#include "JobSystem.h"
+
+// Wavefront OBJ loading. Positions, texture coordinates, normals and faces (triangulated as
+// fans, negative indices allowed) are read; objects, groups and materials are not, so a file
+// becomes one mesh. The file is mapped and cut at line boundaries into chunks that the jobs
+// parse in parallel, then corners with the same position/texcoord/normal indices are welded
+// into one vertex. Files without normals get smooth ones generated.
+//
+// A successful load writes the mesh as a .mesh file (MeshFile.h) next to the source (path +
+// ".meshcache"), which later loads read instead as long as the source's size and modification
+// time still match.
+bool loadObj(const char* path, Mesh& mesh, JobSystem& jobs, bool useCache = true);
+
+// parses OBJ text that is already in memory; name is only used in error messages
+bool parseObj(const char* text, size_t size, Mesh& mesh, JobSystem& jobs, const char* name = "<memory>");
@@ -0,0 +1,354 @@
+#include "OcclusionCulling.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+
+OcclusionBuffer::OcclusionBuffer(int width, int height)
+{
+    tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+    tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+    bufferWidth = tilesX * TILE_SIZE;
+    bufferHeight = tilesY * TILE_SIZE;
+    tileBins.resize(tilesX * tilesY);
+
+    // halve down to a single texel
+    int levelWidth = bufferWidth, levelHeight = bufferHeight;
+    while (true)
+    {
+        levels.emplace_back((size_t)levelWidth * levelHeight, 1.0f);
+        if (levelWidth == 1 && levelHeight == 1)
+            break;
+        levelWidth = std::max(1, levelWidth / 2);
+        levelHeight = std::max(1, levelHeight / 2);
+    }
+}
+
+glm::ivec2 OcclusionBuffer::levelSize(int level) const
+{
+    return glm::ivec2(std::max(1, bufferWidth >> level), std::max(1, bufferHeight >> level));
+}
+
+void OcclusionBuffer::beginFrame(const glm::mat4& matrix)
+{
+    viewProjection = matrix;
+    triangles.clear();
+    for (std::vector<uint32_t>& bin : tileBins)
+        bin.clear();
+    std::fill(levels[0].begin(), levels[0].end(), 1.0f);
+}
+
+void OcclusionBuffer::addOccluder(const glm::mat4& model, const float* positions, size_t vertexCount, size_t stride, const uint32_t* indices, size_t indexCount)
+{
+    glm::mat4 toClip = viewProjection * model;
+    // kept between occluders and frames, so adding them stops allocating once it has grown
+    clipSpace.resize(vertexCount);
+    for (size_t i = 0; i < vertexCount; i++)
+    {
+        const float* p = positions + i * stride;
+        clipSpace[i] = toClip * glm::vec4(p[0], p[1], p[2], 1.0f);
+    }
+
+    for (size_t i = 0; i + 2 < indexCount; i += 3)
+    {
+        Triangle triangle;
+        bool inFront = true;
+        for (int k = 0; k < 3; k++)
+        {
+            const glm::vec4& c = clipSpace[indices[i + k]];
+            if (c.w <= 1e-5f || c.z < -c.w)
+            {
+                inFront = false;
+                break;
+            }
+            glm::vec3 ndc = glm::vec3(c) / c.w;
+            triangle.v[k] = glm::vec3((ndc.x * 0.5f + 0.5f) * bufferWidth, (ndc.y * 0.5f + 0.5f) * bufferHeight, ndc.z * 0.5f + 0.5f);
+        }
+        if (!inFront)
+            continue;
+
+        // occluders are drawn two sided, so wind everything the same way
+        glm::vec3* v = triangle.v;
+        float area = (v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[2].x - v[0].x) * (v[1].y - v[0].y);
+        if (std::fabs(area) < 1e-8f)
+            continue;
+        if (area < 0.0f)
+            std::swap(v[1], v[2]);
+
+        float minX = std::min(std::min(v[0].x, v[1].x), v[2].x), maxX = std::max(std::max(v[0].x, v[1].x), v[2].x);
+        float minY = std::min(std::min(v[0].y, v[1].y), v[2].y), maxY = std::max(std::max(v[0].y, v[1].y), v[2].y);
+        int tileX0 = std::max(0, (int)std::floor(minX) / TILE_SIZE), tileX1 = std::min(tilesX - 1, (int)std::floor(maxX) / TILE_SIZE);
+        int tileY0 = std::max(0, (int)std::floor(minY) / TILE_SIZE), tileY1 = std::min(tilesY - 1, (int)std::floor(maxY) / TILE_SIZE);
+        if (maxX < 0.0f || maxY < 0.0f || tileX0 > tileX1 || tileY0 > tileY1)
+            continue;
+
+        uint32_t index = (uint32_t)triangles.size();
+        triangles.push_back(triangle);
+        for (int ty = tileY0; ty <= tileY1; ty++)
+            for (int tx = tileX0; tx <= tileX1; tx++)
+                tileBins[ty * tilesX + tx].push_back(index);
+    }
+}
+
+void OcclusionBuffer::rasterize()
+{
+    for (int tile = 0; tile < tilesX * tilesY; tile++)
+        rasterizeTile(tile);
+    buildHiZ();
+}
+
+void OcclusionBuffer::rasterize(JobSystem& jobs)
+{
+    // tiles own disjoint pixels, so they need no synchronization
+    jobs.parallelFor((size_t)(tilesX * tilesY), [this](size_t begin, size_t end)
+    {
+        for (size_t tile = begin; tile < end; tile++)
+            rasterizeTile((int)tile);
+    });
+    buildHiZ();
+}
+
+// Edge functions are evaluated at pixel centres, four pixels at a time; depth comes from the
+// triangle's screen space plane, since z/w is linear in screen space
+void OcclusionBuffer::rasterizeTile(int tile)
+{
+    int tileX = (tile % tilesX) * TILE_SIZE, tileY = (tile / tilesX) * TILE_SIZE;
+    float* depth = levels[0].data();
+
+    for (uint32_t index : tileBins[tile])
+    {
+        const glm::vec3* v = triangles[index].v;
+        float area = (v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[2].x - v[0].x) * (v[1].y - v[0].y);
+
+        // edge i is opposite vertex i: E(x, y) = a x + b y + c, positive inside
+        float a[3], b[3], c[3];
+        for (int e = 0; e < 3; e++)
+        {
+            const glm::vec3& p = v[(e + 1) % 3];
+            const glm::vec3& q = v[(e + 2) % 3];
+            a[e] = p.y - q.y;
+            b[e] = q.x - p.x;
+            c[e] = p.x * q.y - p.y * q.x;
+        }
+        // z = z0 * e0 + z1 * e1 + z2 * e2 with barycentrics e / area, folded into one plane
+        float inverseArea = 1.0f / area;
+        float za = (a[0] * v[0].z + a[1] * v[1].z + a[2] * v[2].z) * inverseArea;
+        float zb = (b[0] * v[0].z + b[1] * v[1].z + b[2] * v[2].z) * inverseArea;
+        float zc = (c[0] * v[0].z + c[1] * v[1].z + c[2] * v[2].z) * inverseArea;
+        // store the plane's farthest depth over the pixel rather than at its centre, so nothing
+        // in front of the occluder anywhere in the pixel is hidden by it
+        zc += 0.5f * (std::fabs(za) + std::fabs(zb));
+
+        int x0 = std::max(tileX, (int)std::floor(std::min(std::min(v[0].x, v[1].x), v[2].x)));
+        int x1 = std::min(tileX + TILE_SIZE - 1, (int)std::ceil(std::max(std::max(v[0].x, v[1].x), v[2].x)));
+        int y0 = std::max(tileY, (int)std::floor(std::min(std::min(v[0].y, v[1].y), v[2].y)));
+        int y1 = std::min(tileY + TILE_SIZE - 1, (int)std::ceil(std::max(std::max(v[0].y, v[1].y), v[2].y)));
+        if (x0 > x1 || y0 > y1)
+            continue;
+        // blocks of four start on aligned columns so rows can be loaded and stored whole
+        x0 &= ~3;
+
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+        const __m128 offsets = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+        __m128 a0 = _mm_set1_ps(a[0]), a1 = _mm_set1_ps(a[1]), a2 = _mm_set1_ps(a[2]), zA = _mm_set1_ps(za);
+        for (int y = y0; y <= y1; y++)
+        {
+            float py = y + 0.5f;
+            __m128 row0 = _mm_set1_ps(b[0] * py + c[0]), row1 = _mm_set1_ps(b[1] * py + c[1]), row2 = _mm_set1_ps(b[2] * py + c[2]);
+            __m128 rowZ = _mm_set1_ps(zb * py + zc);
+            float* line = depth + (size_t)y * bufferWidth;
+            for (int x = x0; x <= x1; x += 4)
+            {
+                __m128 px = _mm_add_ps(_mm_set1_ps((float)x), offsets);
+                __m128 e0 = _mm_add_ps(_mm_mul_ps(a0, px), row0);
+                __m128 e1 = _mm_add_ps(_mm_mul_ps(a1, px), row1);
+                __m128 e2 = _mm_add_ps(_mm_mul_ps(a2, px), row2);
+                __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, _mm_setzero_ps()), _mm_cmpge_ps(e1, _mm_setzero_ps())), _mm_cmpge_ps(e2, _mm_setzero_ps()));
+                if (_mm_movemask_ps(inside) == 0)
+                    continue;
+                __m128 z = _mm_add_ps(_mm_mul_ps(zA, px), rowZ);
+                __m128 old = _mm_loadu_ps(line + x);
+                __m128 nearer = _mm_min_ps(old, z);
+                _mm_storeu_ps(line + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, old)));
+            }
+        }
+#else
+        for (int y = y0; y <= y1; y++)
+        {
+            float py = y + 0.5f;
+            float* line = depth + (size_t)y * bufferWidth;
+            for (int x = x0; x <= x1; x++)
+            {
+                float px = x + 0.5f;
+                if (a[0] * px + b[0] * py + c[0] < 0.0f || a[1] * px + b[1] * py + c[1] < 0.0f || a[2] * px + b[2] * py + c[2] < 0.0f)
+                    continue;
+                line[x] = std::min(line[x], za * px + zb * py + zc);
+            }
+        }
+#endif
+    }
+}
+
+// each texel keeps the farthest depth below it, so a box nearer than a texel is never hidden by it
+void OcclusionBuffer::buildHiZ()
+{
+    for (int level = 1; level < (int)levels.size(); level++)
+    {
+        glm::ivec2 source = levelSize(level - 1), target = levelSize(level);
+        const std::vector<float>& from = levels[level - 1];
+        std::vector<float>& to = levels[level];
+        for (int y = 0; y < target.y; y++)
+            for (int x = 0; x < target.x; x++)
+            {
+                int sx = std::min(2 * x, source.x - 1), sx1 = std::min(2 * x + 1, source.x - 1);
+                int sy = std::min(2 * y, source.y - 1), sy1 = std::min(2 * y + 1, source.y - 1);
+                to[(size_t)y * target.x + x] = std::max(std::max(from[(size_t)sy * source.x + sx], from[(size_t)sy * source.x + sx1]),
+                    std::max(from[(size_t)sy1 * source.x + sx], from[(size_t)sy1 * source.x + sx1]));
+            }
+    }
+}
+
+bool OcclusionBuffer::isVisible(const glm::vec3& min, const glm::vec3& max) const
+{
+    glm::vec2 screenMin(1e30f), screenMax(-1e30f);
+    float nearest = 1.0f;
+    for (int corner = 0; corner < 8; corner++)
+    {
+        glm::vec4 p = viewProjection * glm::vec4(corner & 1 ? max.x : min.x, corner & 2 ? max.y : min.y, corner & 4 ? max.z : min.z, 1.0f);
+        // boxes reaching behind the camera can't be bounded on screen, so keep them
+        if (p.w <= 1e-5f)
+            return true;
+        glm::vec3 ndc = glm::vec3(p) / p.w;
+        glm::vec2 screen((ndc.x * 0.5f + 0.5f) * bufferWidth, (ndc.y * 0.5f + 0.5f) * bufferHeight);
+        screenMin = glm::min(screenMin, screen);
+        screenMax = glm::max(screenMax, screen);
+        nearest = std::min(nearest, ndc.z * 0.5f + 0.5f);
+    }
+    if (screenMax.x < 0.0f || screenMax.y < 0.0f || screenMin.x >= bufferWidth || screenMin.y >= bufferHeight)
+        return false;
+
+    // occluders cover the pixels whose centres they cover, so a pixel can be marked while part
+    // of it is outside the occluder; growing the box by a pixel reaches one whose centre is out
+    int x0 = std::max(0, (int)std::floor(screenMin.x) - 1), x1 = std::min(bufferWidth - 1, (int)screenMax.x + 1);
+    int y0 = std::max(0, (int)std::floor(screenMin.y) - 1), y1 = std::min(bufferHeight - 1, (int)screenMax.y + 1);
+    // pick the level where the box covers at most about 2x2 texels
+    int level = 0;
+    while (level + 1 < (int)levels.size() && std::max(x1 - x0, y1 - y0) >> level > 1)
+        level++;
+
+    glm::ivec2 size = levelSize(level);
+    const std::vector<float>& texels = levels[level];
+    for (int y = y0 >> level; y <= std::min(size.y - 1, y1 >> level); y++)
+        for (int x = x0 >> level; x <= std::min(size.x - 1, x1 >> level); x++)
+            if (nearest <= texels[(size_t)y * size.x + x])
+                return true;
+    return false;
+}
+
+size_t OcclusionBuffer::cullAabbs(const AabbSoA& boxes, const uint32_t* candidates, size_t count, uint32_t* visible) const
+{
+    size_t written = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        uint32_t object = candidates[i];
+        if (isVisible(glm::vec3(boxes.minX[object], boxes.minY[object], boxes.minZ[object]), glm::vec3(boxes.maxX[object], boxes.maxY[object], boxes.maxZ[object])))
+            visible[written++] = object;
+    }
+    return written;
+}
+
+void runOcclusionBenchmark(JobSystem& jobs)
+{
+    // the demo's view, looking at a wall 8 units ahead, with boxes scattered around and behind it
+    const glm::vec3 eye(0.0f, 0.0f, 3.0f);
+    const glm::mat4 viewProjection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 100.0f) *
+        glm::lookAt(eye, glm::vec3(0.0f, 0.0f, 2.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    const Frustum frustum = Frustum::fromMatrix(viewProjection);
+    const glm::vec3 wallMin(-3.0f, -2.0f, -6.0f), wallMax(3.0f, 2.0f, -5.0f);
+    float wallPositions[8 * 3];
+    for (int corner = 0; corner < 8; corner++)
+    {
+        wallPositions[3 * corner] = corner & 1 ? wallMax.x : wallMin.x;
+        wallPositions[3 * corner + 1] = corner & 2 ? wallMax.y : wallMin.y;
+        wallPositions[3 * corner + 2] = corner & 4 ? wallMax.z : wallMin.z;
+    }
+    // corner bit 0 is x, bit 1 y, bit 2 z
+    static const uint32_t wallIndices[36] = {
+        0, 2, 6, 0, 6, 4,   1, 5, 7, 1, 7, 3,
+        0, 4, 5, 0, 5, 1,   2, 3, 7, 2, 7, 6,
+        0, 1, 3, 0, 3, 2,   4, 6, 7, 4, 7, 5
+    };
+    // the wall is convex, so a box is hidden exactly when all its corners are behind the wall's
+    // front face and seen through it
+    auto behindWall = [&](const glm::vec3& p)
+    {
+        if (p.z >= wallMax.z)
+            return false;
+        float t = (wallMax.z - eye.z) / (p.z - eye.z);
+        glm::vec3 hit = eye + (p - eye) * t;
+        return hit.x >= wallMin.x && hit.x <= wallMax.x && hit.y >= wallMin.y && hit.y <= wallMax.y;
+    };
+
+    const int ITERATIONS = 50;
+    OcclusionBuffer occlusion;
+    auto rasterizeWall = [&](bool parallel)
+    {
+        occlusion.beginFrame(viewProjection);
+        occlusion.addOccluder(glm::mat4(1.0f), wallPositions, 8, 3, wallIndices, 36);
+        if (parallel)
+            occlusion.rasterize(jobs);
+        else
+            occlusion.rasterize();
+    };
+    auto millisecondsPer = [&](auto&& run)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < ITERATIONS; i++)
+            run();
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / ITERATIONS;
+    };
+    std::cout << "occlusion culling: " << occlusion.width() << "x" << occlusion.height() << " depth buffer, one wall, "
+        << jobs.threadCount() << " threads" << std::endl;
+    double serialMilliseconds = millisecondsPer([&] { rasterizeWall(false); });
+    double parallelMilliseconds = millisecondsPer([&] { rasterizeWall(true); });
+    std::cout << "rasterize and build Hi-Z: " << parallelMilliseconds << " ms (" << serialMilliseconds << " ms on one thread)" << std::endl;
+
+    for (size_t count : { (size_t)10000, (size_t)100000 })
+    {
+        std::mt19937 random(1);
+        std::uniform_real_distribution<float> x(-15.0f, 15.0f), y(-10.0f, 10.0f), z(-40.0f, 0.0f), size(0.05f, 0.3f);
+        AabbSoA boxes;
+        boxes.resize(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            glm::vec3 center(x(random), y(random), z(random));
+            float halfSize = size(random);
+            boxes.set(i, center - halfSize, center + halfSize);
+        }
+        std::vector<uint32_t> inFrustum(count), visible(count);
+        size_t frustumCount = cullAabbs(frustum, boxes, 0, count, inFrustum.data());
+        size_t visibleCount = 0;
+        double testMilliseconds = millisecondsPer([&] { visibleCount = occlusion.cullAabbs(boxes, inFrustum.data(), frustumCount, visible.data()); });
+
+        // every culled box must really be behind the wall; hidden boxes that were kept are what
+        // the coarse depth buffer gives away
+        size_t hidden = 0, wronglyCulled = 0;
+        for (size_t k = 0, v = 0; k < frustumCount; k++)
+        {
+            uint32_t i = inFrustum[k];
+            bool kept = v < visibleCount && visible[v] == i;
+            v += kept;
+            bool isHidden = true;
+            for (int corner = 0; corner < 8 && isHidden; corner++)
+                isHidden = behindWall(glm::vec3(corner & 1 ? boxes.maxX[i] : boxes.minX[i], corner & 2 ? boxes.maxY[i] : boxes.minY[i],
+                    corner & 4 ? boxes.maxZ[i] : boxes.minZ[i]));
+            hidden += isHidden;
+            wronglyCulled += !kept && !isHidden;
+        }
+        std::cout << count << " boxes: " << frustumCount << " in the frustum, " << visibleCount << " drawn after occlusion ("
+            << 100.0 * (frustumCount - visibleCount) / std::max<size_t>(frustumCount, 1) << "% fewer draws, " << hidden
+            << " hidden in fact), tested in " << testMilliseconds << " ms" << (wronglyCulled ? ", VISIBLE BOXES CULLED" : "") << std::endl;
+    }
+}
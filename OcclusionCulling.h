@@ -0,0 +1,68 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include "FrustumCulling.h"
+#include "JobSystem.h"
+
+// CPU software occlusion culling. A few large occluder meshes are rasterized into a small
+// depth buffer, which is reduced into a hierarchical (Hi-Z) pyramid holding the farthest
+// occluder depth per texel. Object AABBs that lie entirely behind it are dropped before
+// anything is submitted to GL. Needs no GPU, so it also runs headless.
+class OcclusionBuffer
+{
+public:
+    // tiles are rasterized independently, one per task
+    static const int TILE_SIZE = 32;
+
+    // width and height are rounded up to whole tiles
+    OcclusionBuffer(int width = 256, int height = 128);
+
+    // clears the depth buffer and sets the camera for the occluders and tests that follow
+    void beginFrame(const glm::mat4& viewProjection);
+    // queues an occluder: xyz positions (stride in floats) and a triangle list. Triangles that
+    // cross the near plane are skipped, which only makes the occluder smaller.
+    void addOccluder(const glm::mat4& model, const float* positions, size_t vertexCount, size_t stride, const uint32_t* indices, size_t indexCount);
+    // rasterizes the queued occluders and builds the Hi-Z pyramid
+    void rasterize();
+    // same, with the tiles spread over the job system's workers
+    void rasterize(JobSystem& jobs);
+
+    // true if any part of the world space box might be in front of the occluders
+    bool isVisible(const glm::vec3& min, const glm::vec3& max) const;
+    // keeps the candidates (e.g. frustum culling output) whose boxes pass isVisible; visible
+    // may alias candidates. Returns how many were written.
+    size_t cullAabbs(const AabbSoA& boxes, const uint32_t* candidates, size_t count, uint32_t* visible) const;
+
+    int width() const { return bufferWidth; }
+    int height() const { return bufferHeight; }
+    // depth in [0, 1], 1 where no occluder was drawn; level 0 is the full resolution buffer
+    const std::vector<float>& depthLevel(int level) const { return levels[level]; }
+    int levelCount() const { return (int)levels.size(); }
+
+private:
+    // screen space triangle: x, y in pixels, z in [0, 1]
+    struct Triangle
+    {
+        glm::vec3 v[3];
+    };
+
+    int bufferWidth, bufferHeight;
+    int tilesX, tilesY;
+    glm::mat4 viewProjection;
+    std::vector<Triangle> triangles;
+    std::vector<std::vector<uint32_t>> tileBins; // triangle indices overlapping each tile
+    std::vector<std::vector<float>> levels;      // Hi-Z pyramid, levels[0] is the depth buffer
+    std::vector<glm::vec4> clipSpace;            // the occluder being added, in clip space
+
+    void rasterizeTile(int tile);
+    void buildHiZ();
+    glm::ivec2 levelSize(int level) const;
+};
+
+// Rasterizes a wall in front of the demo's camera and culls 10K and 100K boxes scattered around
+// it, printing how many frustum survivors the occlusion test removes, the rasterization and
+// test times, and whether any box it culled is actually visible; "--occlusion-benchmark" runs
+// it without opening a window
+void runOcclusionBenchmark(JobSystem& jobs);
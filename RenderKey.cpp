@@ -0,0 +1,12 @@
+#include "RenderKey.h"
+#include <algorithm>
+
+uint64_t RenderKey::make(uint32_t layer, Pass pass, uint32_t program, uint32_t material, uint32_t mesh, float depth)
+{
+    uint64_t depthBits = (uint64_t)(std::min(std::max(depth, 0.0f), 1.0f) * 1048575.0f);
+    uint64_t state = ((uint64_t)(program & 0xFFF) << 24) | ((uint64_t)(material & 0xFFF) << 12) | (uint64_t)(mesh & 0xFFF);
+    uint64_t key = ((uint64_t)(layer & 0xF) << 60) | ((uint64_t)(pass & 0xF) << 56);
+    if (pass == PASS_TRANSPARENT)
+        return key | ((0xFFFFF - depthBits) << 36) | state;
+    return key | (state << 20) | depthBits;
+}
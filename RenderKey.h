@@ -0,0 +1,36 @@
+#pragma once
+#include <cstdint>
+
+// Builds the 64-bit keys render commands are sorted by, most significant field first:
+//
+//   opaque:       layer 4 | pass 4 | program 12 | material 12 | mesh 12 | depth 20
+//   transparent:  layer 4 | pass 4 | ~depth 20  | program 12 | material 12 | mesh 12
+//
+// Opaque draws are grouped by state, then go front to back within a group for early-Z.
+// Transparent draws have to blend back to front, so depth (inverted) comes before state.
+// Handles wider than their field are masked, which only costs sort quality.
+struct RenderKey
+{
+    enum Pass
+    {
+        PASS_UPLOAD = 0, // buffer uploads, ahead of every draw in their layer
+        PASS_OPAQUE = 1,
+        PASS_TRANSPARENT = 2,
+        PASS_OVERLAY = 3
+    };
+
+    // depth is view distance normalized to [0, 1] (e.g. divided by the far plane)
+    static uint64_t make(uint32_t layer, Pass pass, uint32_t program, uint32_t material, uint32_t mesh, float depth);
+    static uint64_t opaque(uint32_t program, uint32_t material, uint32_t mesh, float depth, uint32_t layer = 0)
+    {
+        return make(layer, PASS_OPAQUE, program, material, mesh, depth);
+    }
+    static uint64_t transparent(uint32_t program, uint32_t material, uint32_t mesh, float depth, uint32_t layer = 0)
+    {
+        return make(layer, PASS_TRANSPARENT, program, material, mesh, depth);
+    }
+    static uint64_t upload(uint32_t layer = 0) { return (uint64_t)(layer & 0xF) << 60; }
+
+    static uint32_t layer(uint64_t key) { return (uint32_t)(key >> 60); }
+    static Pass pass(uint64_t key) { return (Pass)((key >> 56) & 0xF); }
+};
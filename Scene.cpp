@@ -0,0 +1,240 @@
+#include "Scene.h"
+#include <algorithm>
+#include <cmath>
+
+SceneHandle Scene::create(const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale, float boundingRadius, const glm::vec3& boundsCenter)
+{
+    SceneHandle handle;
+    if (freeSlot != SceneHandle::INVALID)
+    {
+        handle.index = freeSlot;
+        freeSlot = slots[freeSlot].dense;
+    }
+    else
+    {
+        handle.index = (uint32_t)slots.size();
+        slots.push_back({ 0, 0 });
+    }
+    handle.generation = slots[handle.index].generation;
+
+    size_t index = owners.size();
+    slots[handle.index].dense = (uint32_t)index;
+    owners.push_back(handle.index);
+    locals.resize(index + 1);
+    locals.set(index, position, rotation, scale);
+    worlds.emplace_back();
+    boundsLocal.resize(index + 1);
+    boundsLocal.set(index, boundsCenter, boundingRadius);
+    boundsWorld.resize(index + 1);
+    dirtyFlags.push_back(0);
+    markDirty(index);
+    return handle;
+}
+
+void Scene::destroy(SceneHandle handle)
+{
+    if (!isAlive(handle))
+        return;
+
+    // move the last object into the hole so the arrays stay dense
+    size_t index = slots[handle.index].dense;
+    size_t last = owners.size() - 1;
+    if (index != last)
+    {
+        locals.set(index, glm::vec3(locals.positionX[last], locals.positionY[last], locals.positionZ[last]),
+                   glm::quat(locals.rotationW[last], locals.rotationX[last], locals.rotationY[last], locals.rotationZ[last]),
+                   glm::vec3(locals.scaleX[last], locals.scaleY[last], locals.scaleZ[last]));
+        worlds[index] = worlds[last];
+        boundsLocal.set(index, glm::vec3(boundsLocal.centerX[last], boundsLocal.centerY[last], boundsLocal.centerZ[last]), boundsLocal.radius[last]);
+        boundsWorld.set(index, glm::vec3(boundsWorld.centerX[last], boundsWorld.centerY[last], boundsWorld.centerZ[last]), boundsWorld.radius[last]);
+        owners[index] = owners[last];
+        slots[owners[index]].dense = (uint32_t)index;
+
+        // the moved object keeps its pending update; a stale entry for the removed one is skipped
+        bool wasDirty = dirtyFlags[index] != 0;
+        dirtyFlags[index] = dirtyFlags[last];
+        if (dirtyFlags[index] && !wasDirty)
+            dirty.push_back((uint32_t)index);
+    }
+    locals.resize(last);
+    worlds.pop_back();
+    boundsLocal.resize(last);
+    boundsWorld.resize(last);
+    owners.pop_back();
+    dirtyFlags.pop_back();
+
+    Slot& slot = slots[handle.index];
+    slot.generation++;
+    slot.dense = freeSlot;
+    freeSlot = handle.index;
+}
+
+void Scene::clear()
+{
+    for (uint32_t slot : owners)
+    {
+        slots[slot].generation++;
+        slots[slot].dense = freeSlot;
+        freeSlot = slot;
+    }
+    locals.resize(0);
+    worlds.clear();
+    boundsLocal.resize(0);
+    boundsWorld.resize(0);
+    owners.clear();
+    dirtyFlags.clear();
+    dirty.clear();
+    updated.clear();
+}
+
+bool Scene::isAlive(SceneHandle handle) const
+{
+    if (handle.index >= slots.size())
+        return false;
+    const Slot& slot = slots[handle.index];
+    return slot.generation == handle.generation && slot.dense < owners.size() && owners[slot.dense] == handle.index;
+}
+
+SceneHandle Scene::handleAt(size_t index) const
+{
+    SceneHandle handle;
+    handle.index = owners[index];
+    handle.generation = slots[handle.index].generation;
+    return handle;
+}
+
+void Scene::markDirty(size_t index)
+{
+    if (!dirtyFlags[index])
+    {
+        dirtyFlags[index] = 1;
+        dirty.push_back((uint32_t)index);
+    }
+}
+
+void Scene::setPosition(SceneHandle handle, const glm::vec3& position)
+{
+    size_t i = indexOf(handle);
+    locals.positionX[i] = position.x;
+    locals.positionY[i] = position.y;
+    locals.positionZ[i] = position.z;
+    markDirty(i);
+}
+
+void Scene::setRotation(SceneHandle handle, const glm::quat& rotation)
+{
+    size_t i = indexOf(handle);
+    locals.rotationX[i] = rotation.x;
+    locals.rotationY[i] = rotation.y;
+    locals.rotationZ[i] = rotation.z;
+    locals.rotationW[i] = rotation.w;
+    markDirty(i);
+}
+
+void Scene::setScale(SceneHandle handle, const glm::vec3& scale)
+{
+    size_t i = indexOf(handle);
+    locals.scaleX[i] = scale.x;
+    locals.scaleY[i] = scale.y;
+    locals.scaleZ[i] = scale.z;
+    markDirty(i);
+}
+
+void Scene::setTransform(SceneHandle handle, const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale)
+{
+    size_t i = indexOf(handle);
+    locals.set(i, position, rotation, scale);
+    markDirty(i);
+}
+
+void Scene::setLocalBounds(SceneHandle handle, const glm::vec3& center, float radius)
+{
+    size_t i = indexOf(handle);
+    boundsLocal.set(i, center, radius);
+    markDirty(i);
+}
+
+glm::vec3 Scene::position(SceneHandle handle) const
+{
+    size_t i = indexOf(handle);
+    return glm::vec3(locals.positionX[i], locals.positionY[i], locals.positionZ[i]);
+}
+
+glm::quat Scene::rotation(SceneHandle handle) const
+{
+    size_t i = indexOf(handle);
+    return glm::quat(locals.rotationW[i], locals.rotationX[i], locals.rotationY[i], locals.rotationZ[i]);
+}
+
+glm::vec3 Scene::scale(SceneHandle handle) const
+{
+    size_t i = indexOf(handle);
+    return glm::vec3(locals.scaleX[i], locals.scaleY[i], locals.scaleZ[i]);
+}
+
+// composes the sorted, unique dense indices, batching consecutive runs through the SIMD path
+void Scene::updateRange(const uint32_t* indices, size_t count)
+{
+    size_t start = 0;
+    while (start < count)
+    {
+        size_t end = start + 1;
+        while (end < count && indices[end] == indices[end - 1] + 1)
+            end++;
+        size_t first = indices[start];
+        composeTransforms(locals, first, end - start, &worlds[first]);
+        start = end;
+    }
+
+    // the sphere centre follows the transform; the radius grows with the largest axis scale
+    for (size_t k = 0; k < count; k++)
+    {
+        size_t i = indices[k];
+        const AffineTransform& world = worlds[i];
+        glm::vec4 center(boundsLocal.centerX[i], boundsLocal.centerY[i], boundsLocal.centerZ[i], 1.0f);
+        glm::vec3 worldCenter(glm::dot(glm::vec4(world.rows[0][0], world.rows[0][1], world.rows[0][2], world.rows[0][3]), center),
+                              glm::dot(glm::vec4(world.rows[1][0], world.rows[1][1], world.rows[1][2], world.rows[1][3]), center),
+                              glm::dot(glm::vec4(world.rows[2][0], world.rows[2][1], world.rows[2][2], world.rows[2][3]), center));
+        float scale = std::max(std::max(std::abs(locals.scaleX[i]), std::abs(locals.scaleY[i])), std::abs(locals.scaleZ[i]));
+        boundsWorld.set(i, worldCenter, boundsLocal.radius[i] * scale);
+    }
+}
+
+// drops stale entries left by destroy, then sorts so runs of neighbours compose together
+void Scene::collectDirty()
+{
+    updated.clear();
+    for (uint32_t index : dirty)
+    {
+        if (index < dirtyFlags.size() && dirtyFlags[index])
+        {
+            dirtyFlags[index] = 0;
+            updated.push_back(index);
+        }
+    }
+    dirty.clear();
+    std::sort(updated.begin(), updated.end());
+}
+
+size_t Scene::updateTransforms()
+{
+    collectDirty();
+    updateRange(updated.data(), updated.size());
+    return updated.size();
+}
+
+size_t Scene::updateTransforms(JobSystem& jobs)
+{
+    collectDirty();
+    if (updated.size() < PARALLEL_THRESHOLD)
+    {
+        updateRange(updated.data(), updated.size());
+        return updated.size();
+    }
+    // each range is a contiguous slice of the (sorted) dirty list, so writes never overlap
+    jobs.parallelFor(updated.size(), [this](size_t begin, size_t end)
+    {
+        updateRange(updated.data() + begin, end - begin);
+    }, PARALLEL_THRESHOLD / 8);
+    return updated.size();
+}
@@ -0,0 +1,94 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include "BatchTransform.h"
+#include "FrustumCulling.h"
+#include "JobSystem.h"
+
+// Generational handle to a scene object. The generation changes whenever a slot is reused,
+// so a handle to a destroyed object never silently refers to its replacement.
+struct SceneHandle
+{
+    static const uint32_t INVALID = 0xFFFFFFFF;
+
+    uint32_t index = INVALID;
+    uint32_t generation = 0;
+
+    bool isValid() const { return index != INVALID; }
+    bool operator==(const SceneHandle& other) const { return index == other.index && generation == other.generation; }
+    bool operator!=(const SceneHandle& other) const { return !(*this == other); }
+};
+
+// Objects stored as structure-of-arrays components: local position/rotation/scale, the world
+// transform composed from them and bounding spheres in object and world space. Objects are
+// kept densely packed (destroying one moves the last object into its place), so every
+// component can be iterated contiguously, handed to the SIMD batch routines or split over
+// threads. Setters only mark an object dirty; updateTransforms recomputes the dirty ones.
+class Scene
+{
+public:
+    // below this many dirty objects updateTransforms(JobSystem&) stays on the calling thread
+    static const size_t PARALLEL_THRESHOLD = 8192;
+
+    SceneHandle create(const glm::vec3& position, const glm::quat& rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f),
+                       const glm::vec3& scale = glm::vec3(1.0f), float boundingRadius = 0.0f, const glm::vec3& boundsCenter = glm::vec3(0.0f));
+    void destroy(SceneHandle handle);
+    void clear();
+    bool isAlive(SceneHandle handle) const;
+
+    size_t size() const { return owners.size(); }
+    // dense index of a live object; stays valid until an object is destroyed
+    size_t indexOf(SceneHandle handle) const { return slots[handle.index].dense; }
+    SceneHandle handleAt(size_t index) const;
+
+    void setPosition(SceneHandle handle, const glm::vec3& position);
+    void setRotation(SceneHandle handle, const glm::quat& rotation);
+    void setScale(SceneHandle handle, const glm::vec3& scale);
+    void setTransform(SceneHandle handle, const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale);
+    // bounding sphere in object space
+    void setLocalBounds(SceneHandle handle, const glm::vec3& center, float radius);
+
+    glm::vec3 position(SceneHandle handle) const;
+    glm::quat rotation(SceneHandle handle) const;
+    glm::vec3 scale(SceneHandle handle) const;
+
+    // recomposes the world transforms and world bounds of the dirty objects on the calling
+    // thread. Returns how many were updated.
+    size_t updateTransforms();
+    // same, as a parallelFor on the job system when there are enough of them
+    size_t updateTransforms(JobSystem& jobs);
+    // dense indices updated by the last updateTransforms, in ascending order (e.g. for
+    // SpatialGrid::update or deciding whether a Bvh needs a refit)
+    const std::vector<uint32_t>& updatedObjects() const { return updated; }
+
+    // components, indexed by dense index
+    const TransformSoA& localTransforms() const { return locals; }
+    const std::vector<AffineTransform>& worldTransforms() const { return worlds; }
+    const SphereSoA& localBounds() const { return boundsLocal; }
+    const SphereSoA& worldBounds() const { return boundsWorld; }
+
+private:
+    struct Slot
+    {
+        uint32_t dense;      // index into the component arrays while alive, next free slot otherwise
+        uint32_t generation;
+    };
+
+    TransformSoA locals;
+    std::vector<AffineTransform> worlds;
+    SphereSoA boundsLocal;
+    SphereSoA boundsWorld;
+    std::vector<uint32_t> owners;     // slot of each dense object
+    std::vector<uint8_t> dirtyFlags;  // per dense object
+    std::vector<uint32_t> dirty;      // dense indices marked since the last update, may hold stale entries
+    std::vector<uint32_t> updated;
+    std::vector<Slot> slots;
+    uint32_t freeSlot = SceneHandle::INVALID;
+
+    void markDirty(size_t index);
+    void collectDirty();
+    void updateRange(const uint32_t* indices, size_t count);
+};
@@ -1,71 +1,137 @@
 #include "Shader.h"
+#include "MappedFile.h"
+#include <cstring>
+#include <algorithm>
 
-Shader::Shader(const char* vertexPath, const char* fragmentPath)
+SpecializationConstant SpecializationConstant::fromFloat(unsigned int id, float value)
 {
-	// retrieve filepath
-	std::string vertexCode;
-	std::string fragmentCode;
-	std::ifstream vShaderFile;
-	std::ifstream fShaderFile;
-	// ensure they can throw exceptions
-	vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-	fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+	SpecializationConstant constant;
+	constant.id = id;
+	std::memcpy(&constant.value, &value, sizeof(value));
+	return constant;
+}
 
-	try
-	{
-		//open files
-		vShaderFile.open(vertexPath);
-		fShaderFile.open(fragmentPath);
-		std::stringstream vShaderStream, fShaderStream;
-		// read files' buffer content into streams
-		vShaderStream << vShaderFile.rdbuf();
-		fShaderStream << fShaderFile.rdbuf();
-		//close file handlers
-		vShaderFile.close();
-		fShaderFile.close();
-		// convert stream into string
-		vertexCode = vShaderStream.str();
-		fragmentCode = fShaderStream.str();
-	}
-	catch (std::ifstream::failure e)
+Shader::Shader() : ID(0)
+{
+}
+
+Shader::Shader(const char* vertexPath, const char* fragmentPath)
+{
+	// 1. map the source files; glShaderSource reads straight out of the mapping
+	MappedFile vShaderFile(vertexPath);
+	MappedFile fShaderFile(fragmentPath);
+	if (!vShaderFile.isOpen() || !fShaderFile.isOpen())
 	{
 		std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
 	}
-	const char* vShaderCode = vertexCode.c_str();
-	const char* fShaderCode = fragmentCode.c_str();
+	const char* vShaderCode = vShaderFile.data();
+	const char* fShaderCode = fShaderFile.data();
+	// the mappings aren't null terminated, so pass the lengths explicitly
+	GLint vShaderLength = static_cast<GLint>(vShaderFile.size());
+	GLint fShaderLength = static_cast<GLint>(fShaderFile.size());
 
 	// 2. compile shaders
 	unsigned int vertex, fragment;
-	int success;
-	char infoLog[512];
 
 	// vertex Shader
 	vertex = glCreateShader(GL_VERTEX_SHADER);
-	glShaderSource(vertex, 1, &vShaderCode, NULL);
+	glShaderSource(vertex, 1, &vShaderCode, &vShaderLength);
 	glCompileShader(vertex);
-	// print compile errors if any
-	glGetShaderiv(vertex, GL_COMPILE_STATUS, &success);
-	if (!success)
-	{
-		glGetShaderInfoLog(vertex, 512, NULL, infoLog);
-		std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
-	};
+	checkCompileErrors(vertex, "VERTEX");
 
 	//fragment shader
 	fragment = glCreateShader(GL_FRAGMENT_SHADER);
-	glShaderSource(fragment, 1, &fShaderCode, NULL);
+	glShaderSource(fragment, 1, &fShaderCode, &fShaderLength);
 	glCompileShader(fragment);
-	// print compile errors if any
-	glGetShaderiv(fragment, GL_COMPILE_STATUS, &success);
-	if (!success)
-	{
-		glGetShaderInfoLog(fragment, 512, NULL, infoLog);
-		std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
-	};
+	checkCompileErrors(fragment, "FRAGMENT");
+
 	// shader program
+	linkProgram({ vertex, fragment });
+	reflect(true);
+}
+
+Shader::Shader(const char* computePath)
+{
+	MappedFile cShaderFile(computePath);
+	if (!cShaderFile.isOpen())
+	{
+		std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+	}
+	const char* cShaderCode = cShaderFile.data();
+	GLint cShaderLength = static_cast<GLint>(cShaderFile.size());
+
+	unsigned int compute = glCreateShader(GL_COMPUTE_SHADER);
+	glShaderSource(compute, 1, &cShaderCode, &cShaderLength);
+	glCompileShader(compute);
+	checkCompileErrors(compute, "COMPUTE");
+
+	linkProgram({ compute });
+	reflect(true);
+}
+
+Shader Shader::fromSpirv(const char* vertexPath, const char* fragmentPath,
+	const std::vector<SpecializationConstant>& constants, const std::vector<UniformBinding>& uniforms)
+{
+	Shader shader;
+	if (!GLAD_GL_VERSION_4_6)
+	{
+		std::cout << "ERROR::SHADER::SPIRV_NOT_SUPPORTED" << std::endl;
+		return shader;
+	}
+
+	// 1. map the binaries; they are handed to the driver as is
+	MappedFile vShaderFile(vertexPath);
+	MappedFile fShaderFile(fragmentPath);
+	if (!vShaderFile.isOpen() || !fShaderFile.isOpen())
+	{
+		std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+		return shader;
+	}
+
+	std::vector<GLuint> constantIds, constantValues;
+	for (const SpecializationConstant& constant : constants)
+	{
+		constantIds.push_back(constant.id);
+		constantValues.push_back(constant.value);
+	}
+
+	// 2. specialize shaders
+	unsigned int vertex, fragment;
+
+	vertex = glCreateShader(GL_VERTEX_SHADER);
+	glShaderBinary(1, &vertex, GL_SHADER_BINARY_FORMAT_SPIR_V, vShaderFile.data(), static_cast<GLsizei>(vShaderFile.size()));
+	glSpecializeShader(vertex, "main", static_cast<GLuint>(constantIds.size()), constantIds.data(), constantValues.data());
+	checkCompileErrors(vertex, "VERTEX");
+
+	fragment = glCreateShader(GL_FRAGMENT_SHADER);
+	glShaderBinary(1, &fragment, GL_SHADER_BINARY_FORMAT_SPIR_V, fShaderFile.data(), static_cast<GLsizei>(fShaderFile.size()));
+	glSpecializeShader(fragment, "main", static_cast<GLuint>(constantIds.size()), constantIds.data(), constantValues.data());
+	checkCompileErrors(fragment, "FRAGMENT");
+
+	shader.linkProgram({ vertex, fragment });
+	shader.reflect(false);
+	// name the reflected uniforms from the binding table so lookups by name work
+	for (const UniformBinding& binding : uniforms)
+	{
+		shader.cacheUniformLocation(binding.name, binding.location);
+		for (ShaderUniform& uniform : shader.reflection.uniforms)
+			if (uniform.location == binding.location && uniform.name.empty())
+				uniform.name = binding.name;
+		for (ShaderSampler& sampler : shader.reflection.samplers)
+			if (sampler.location == binding.location && sampler.name.empty())
+				sampler.name = binding.name;
+	}
+	return shader;
+}
+
+void Shader::linkProgram(std::initializer_list<unsigned int> shaders)
+{
+	int success;
+	char infoLog[512];
+
 	ID = glCreateProgram();
-	glAttachShader(ID, vertex);
-	glAttachShader(ID, fragment);
+	for (unsigned int shader : shaders)
+		glAttachShader(ID, shader);
 	glLinkProgram(ID);
 	//print linking errors if any
 	glGetProgramiv(ID, GL_LINK_STATUS, &success);
@@ -76,31 +142,122 @@ Shader::Shader(const char* vertexPath, const char* fragmentPath)
 	}
 
 	//delete shaders as they are linked now
-	glDeleteShader(vertex);
-	glDeleteShader(fragment);
+	for (unsigned int shader : shaders)
+		glDeleteShader(shader);
 }
 
-void Shader::use()
+// print compile errors if any
+bool Shader::checkCompileErrors(unsigned int shader, const char* type)
 {
+	int success;
+	char infoLog[512];
+
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+	if (!success)
+	{
+		glGetShaderInfoLog(shader, 512, NULL, infoLog);
+		std::cout << "ERROR::SHADER::" << type << "::COMPILATION_FAILED\n" << infoLog << std::endl;
+	}
+	return success != 0;
+}
+
+// GLSL programs get their sampler units here, once; SPIR-V programs keep the bindings from their source
+void Shader::reflect(bool assignSamplerUnits)
+{
+	reflection = ProgramReflection(ID);
+	for (const ShaderUniform& uniform : reflection.uniforms)
+		if (uniform.location >= 0 && !uniform.name.empty())
+			cacheUniformLocation(uniform.name, uniform.location);
+
+	if (!assignSamplerUnits || reflection.samplers.empty())
+		return;
+	std::vector<ShaderSampler*> samplers;
+	for (ShaderSampler& sampler : reflection.samplers)
+		samplers.push_back(&sampler);
+	std::sort(samplers.begin(), samplers.end(), [](const ShaderSampler* a, const ShaderSampler* b) { return a->name < b->name; });
+
+	GLint previousProgram = 0;
+	glGetIntegerv(GL_CURRENT_PROGRAM, &previousProgram);
 	glUseProgram(ID);
+	for (size_t unit = 0; unit < samplers.size(); unit++)
+	{
+		samplers[unit]->unit = (GLint)unit;
+		glUniform1i(samplers[unit]->location, (GLint)unit);
+	}
+	glUseProgram(previousProgram);
+}
+
+int Shader::samplerUnit(const std::string& name) const
+{
+	const ShaderSampler* sampler = reflection.findSampler(name);
+	return sampler ? sampler->unit : -1;
+}
+
+// uniforms the reflection didn't list (array elements, inactive uniforms) are looked up once and cached
+int Shader::uniformLocation(const char* name) const
+{
+	for (const std::pair<std::string, int>& entry : uniformLocations)
+		if (entry.first == name)
+			return entry.second;
+	int location = glGetUniformLocation(ID, name);
+	uniformLocations.emplace_back(name, location);
+	return location;
+}
+
+void Shader::cacheUniformLocation(const std::string& name, int location) const
+{
+	for (std::pair<std::string, int>& entry : uniformLocations)
+	{
+		if (entry.first == name)
+		{
+			entry.second = location;
+			return;
+		}
+	}
+	uniformLocations.emplace_back(name, location);
+}
+
+void Shader::use()
+{
+	glState().useProgram(ID);
+}
+
+void Shader::setBool(const char* name, bool value) const
+{
+	glUniform1i(uniformLocation(name), (int)value);
+}
+
+void Shader::setInt(const char* name, int value) const
+{
+	glUniform1i(uniformLocation(name), value);
+}
+
+void Shader::setUInt(const char* name, unsigned int value) const
+{
+	glUniform1ui(uniformLocation(name), value);
+}
+
+void Shader::setFloat(const char* name, float value) const
+{
+	glUniform1f(uniformLocation(name), value);
 }
 
-void Shader::setBool(const std::string& name, bool value) const
+void Shader::setVec2(const char* name, const glm::vec2& value) const
 {
-	glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+	glUniform2fv(uniformLocation(name), 1, glm::value_ptr(value));
 }
 
-void Shader::setInt(const std::string& name, int value) const
+void Shader::setVec3(const char* name, const glm::vec3& value) const
 {
-	glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+	glUniform3fv(uniformLocation(name), 1, glm::value_ptr(value));
 }
 
-void Shader::setFloat(const std::string& name, float value) const
+void Shader::setVec4(const char* name, const glm::vec4& value) const
 {
-	glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+	glUniform4fv(uniformLocation(name), 1, glm::value_ptr(value));
 }
 
-void Shader::setMat4(const std::string& name, glm::mat4 value) const
+void Shader::setMat4(const char* name, glm::mat4 value) const
 {
-	glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()),1, GL_FALSE, glm::value_ptr(value));
+	glUniformMatrix4fv(uniformLocation(name),1, GL_FALSE, glm::value_ptr(value));
 }
@@ -3,25 +3,72 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <string>
-#include <fstream>
-#include <sstream>
+#include <vector>
+#include <utility>
+#include <initializer_list>
 #include <iostream>
+#include "ShaderReflection.h"
+#include "GlStateCache.h"
+
+// value for a SPIR-V specialization constant (layout (constant_id = N) in GLSL)
+struct SpecializationConstant
+{
+	unsigned int id;
+	unsigned int value; // raw bits; use fromFloat for float constants
+
+	static SpecializationConstant fromFloat(unsigned int id, float value);
+};
+
+// SPIR-V programs carry no uniform names, so the name -> explicit location table is passed in
+struct UniformBinding
+{
+	std::string name;
+	int location;
+};
 
 class Shader
 {
 public:
 	// program ID
 	unsigned int ID;
+	// active attributes, uniforms, blocks and samplers, queried once after link
+	ProgramReflection reflection;
 
 	//reads and builds the shader
 	Shader(const char* vertexPath, const char* fragmentPath);
+	// reads and builds a compute shader (needs GL 4.3)
+	explicit Shader(const char* computePath);
+
+	// builds the shader from precompiled SPIR-V (needs GL 4.6), specializing the constants at load
+	static Shader fromSpirv(const char* vertexPath, const char* fragmentPath,
+		const std::vector<SpecializationConstant>& constants = {},
+		const std::vector<UniformBinding>& uniforms = {});
 	
 	// activate the shader
 	void use();
 
-	// utility functions for uniforms
-	void setBool(const std::string& name, bool value) const;
-	void setInt(const std::string& name, int value) const;
-	void setFloat(const std::string& name, float value) const;
-	void setMat4(const std::string& name, glm::mat4 value) const;
+	// utility functions for uniforms; names are plain C strings so setting one never allocates
+	void setBool(const char* name, bool value) const;
+	void setInt(const char* name, int value) const;
+	void setUInt(const char* name, unsigned int value) const;
+	void setFloat(const char* name, float value) const;
+	void setVec2(const char* name, const glm::vec2& value) const;
+	void setVec3(const char* name, const glm::vec3& value) const;
+	void setVec4(const char* name, const glm::vec4& value) const;
+	void setMat4(const char* name, glm::mat4 value) const;
+
+	// texture unit a sampler was given at link (samplers are numbered in name order), -1 if it isn't active
+	int samplerUnit(const std::string& name) const;
+
+private:
+	// uniform locations, filled from the reflection at link. A program has few uniforms, so a
+	// linear search is as fast as hashing and compares against the C string without a copy
+	mutable std::vector<std::pair<std::string, int>> uniformLocations;
+
+	Shader();
+	int uniformLocation(const char* name) const;
+	void cacheUniformLocation(const std::string& name, int location) const;
+	void linkProgram(std::initializer_list<unsigned int> shaders);
+	void reflect(bool assignSamplerUnits);
+	static bool checkCompileErrors(unsigned int shader, const char* type);
 };
\ No newline at end of file
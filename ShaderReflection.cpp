@@ -0,0 +1,203 @@
+#include "ShaderReflection.h"
+#include <algorithm>
+
+// drops the "[0]" the driver appends to array names so lookups can use the plain name
+static std::string baseName(const char* name, GLsizei length)
+{
+    std::string result(name, length);
+    if (result.size() > 3 && result.compare(result.size() - 3, 3, "[0]") == 0)
+        result.resize(result.size() - 3);
+    return result;
+}
+
+ProgramReflection::ProgramReflection()
+{
+}
+
+ProgramReflection::ProgramReflection(GLuint program)
+{
+    GLint count = 0, maxLength = 0;
+
+    // attributes
+    glGetProgramiv(program, GL_ACTIVE_ATTRIBUTES, &count);
+    glGetProgramiv(program, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &maxLength);
+    std::vector<char> name(std::max(maxLength, 1) + 1);
+    for (GLint i = 0; i < count; i++)
+    {
+        GLsizei length = 0;
+        ShaderAttribute attribute;
+        glGetActiveAttrib(program, (GLuint)i, (GLsizei)name.size(), &length, &attribute.size, &attribute.type, name.data());
+        attribute.name = baseName(name.data(), length);
+        attribute.location = -1;
+        if (length > 0)
+            attribute.location = glGetAttribLocation(program, attribute.name.c_str());
+        else if (GLAD_GL_VERSION_4_3)
+        {
+            GLenum property = GL_LOCATION;
+            glGetProgramResourceiv(program, GL_PROGRAM_INPUT, (GLuint)i, 1, &property, 1, NULL, &attribute.location);
+        }
+        // built-ins such as gl_VertexID are reported as active but have no location
+        if (attribute.location < 0)
+            continue;
+        attributes.push_back(attribute);
+    }
+
+    // uniforms, with the block they belong to
+    glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+    name.resize(std::max(maxLength, 1) + 1);
+    std::vector<GLint> blockIndices(count);
+    if (count > 0)
+    {
+        std::vector<GLuint> indices(count);
+        for (GLint i = 0; i < count; i++)
+            indices[i] = (GLuint)i;
+        glGetActiveUniformsiv(program, count, indices.data(), GL_UNIFORM_BLOCK_INDEX, blockIndices.data());
+    }
+    for (GLint i = 0; i < count; i++)
+    {
+        GLsizei length = 0;
+        ShaderUniform uniform;
+        glGetActiveUniform(program, (GLuint)i, (GLsizei)name.size(), &length, &uniform.size, &uniform.type, name.data());
+        uniform.name = baseName(name.data(), length);
+        uniform.blockIndex = blockIndices[i];
+        uniform.location = -1;
+        if (uniform.blockIndex < 0)
+        {
+            // SPIR-V programs have no names to look locations up by, so fall back to the location query
+            if (length > 0)
+                uniform.location = glGetUniformLocation(program, name.data());
+            else if (GLAD_GL_VERSION_4_3)
+            {
+                GLenum property = GL_LOCATION;
+                glGetProgramResourceiv(program, GL_UNIFORM, (GLuint)i, 1, &property, 1, NULL, &uniform.location);
+            }
+        }
+        uniforms.push_back(uniform);
+
+        if (uniform.blockIndex < 0 && glslTypeIsSampler(uniform.type))
+        {
+            ShaderSampler sampler;
+            sampler.name = uniform.name;
+            sampler.type = uniform.type;
+            sampler.location = uniform.location;
+            sampler.unit = 0;
+            if (sampler.location >= 0)
+                glGetUniformiv(program, sampler.location, &sampler.unit);
+            samplers.push_back(sampler);
+        }
+    }
+
+    // uniform blocks
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &maxLength);
+    name.resize(std::max(maxLength, 1) + 1);
+    for (GLint i = 0; i < count; i++)
+    {
+        GLsizei length = 0;
+        ShaderBlock block;
+        block.index = (GLuint)i;
+        glGetActiveUniformBlockName(program, block.index, (GLsizei)name.size(), &length, name.data());
+        block.name = std::string(name.data(), length);
+        glGetActiveUniformBlockiv(program, block.index, GL_UNIFORM_BLOCK_DATA_SIZE, &block.dataSize);
+        glGetActiveUniformBlockiv(program, block.index, GL_UNIFORM_BLOCK_BINDING, &block.binding);
+        blocks.push_back(block);
+    }
+}
+
+const ShaderAttribute* ProgramReflection::findAttribute(const std::string& name) const
+{
+    for (const ShaderAttribute& attribute : attributes)
+        if (attribute.name == name)
+            return &attribute;
+    return nullptr;
+}
+
+const ShaderAttribute* ProgramReflection::findAttribute(GLint location) const
+{
+    for (const ShaderAttribute& attribute : attributes)
+        if (attribute.location == location)
+            return &attribute;
+    return nullptr;
+}
+
+const ShaderUniform* ProgramReflection::findUniform(const std::string& name) const
+{
+    for (const ShaderUniform& uniform : uniforms)
+        if (uniform.name == name)
+            return &uniform;
+    return nullptr;
+}
+
+const ShaderBlock* ProgramReflection::findBlock(const std::string& name) const
+{
+    for (const ShaderBlock& block : blocks)
+        if (block.name == name)
+            return &block;
+    return nullptr;
+}
+
+const ShaderSampler* ProgramReflection::findSampler(const std::string& name) const
+{
+    for (const ShaderSampler& sampler : samplers)
+        if (sampler.name == name)
+            return &sampler;
+    return nullptr;
+}
+
+GLint glslTypeComponents(GLenum type)
+{
+    switch (type)
+    {
+    case GL_FLOAT: case GL_INT: case GL_UNSIGNED_INT: case GL_BOOL: case GL_DOUBLE:
+        return 1;
+    case GL_FLOAT_VEC2: case GL_INT_VEC2: case GL_UNSIGNED_INT_VEC2: case GL_BOOL_VEC2: case GL_DOUBLE_VEC2:
+        return 2;
+    case GL_FLOAT_VEC3: case GL_INT_VEC3: case GL_UNSIGNED_INT_VEC3: case GL_BOOL_VEC3: case GL_DOUBLE_VEC3:
+        return 3;
+    case GL_FLOAT_VEC4: case GL_INT_VEC4: case GL_UNSIGNED_INT_VEC4: case GL_BOOL_VEC4: case GL_DOUBLE_VEC4:
+    case GL_FLOAT_MAT2:
+        return 4;
+    case GL_FLOAT_MAT2x3: case GL_FLOAT_MAT3x2:
+        return 6;
+    case GL_FLOAT_MAT2x4: case GL_FLOAT_MAT4x2:
+        return 8;
+    case GL_FLOAT_MAT3:
+        return 9;
+    case GL_FLOAT_MAT3x4: case GL_FLOAT_MAT4x3:
+        return 12;
+    case GL_FLOAT_MAT4:
+        return 16;
+    default:
+        return 1;
+    }
+}
+
+bool glslTypeIsInteger(GLenum type)
+{
+    switch (type)
+    {
+    case GL_INT: case GL_INT_VEC2: case GL_INT_VEC3: case GL_INT_VEC4:
+    case GL_UNSIGNED_INT: case GL_UNSIGNED_INT_VEC2: case GL_UNSIGNED_INT_VEC3: case GL_UNSIGNED_INT_VEC4:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool glslTypeIsSampler(GLenum type)
+{
+    switch (type)
+    {
+    case GL_SAMPLER_1D: case GL_SAMPLER_2D: case GL_SAMPLER_3D: case GL_SAMPLER_CUBE:
+    case GL_SAMPLER_1D_SHADOW: case GL_SAMPLER_2D_SHADOW: case GL_SAMPLER_CUBE_SHADOW:
+    case GL_SAMPLER_1D_ARRAY: case GL_SAMPLER_2D_ARRAY: case GL_SAMPLER_1D_ARRAY_SHADOW: case GL_SAMPLER_2D_ARRAY_SHADOW:
+    case GL_SAMPLER_2D_MULTISAMPLE: case GL_SAMPLER_2D_MULTISAMPLE_ARRAY: case GL_SAMPLER_BUFFER: case GL_SAMPLER_2D_RECT:
+    case GL_INT_SAMPLER_2D: case GL_INT_SAMPLER_3D: case GL_INT_SAMPLER_2D_ARRAY: case GL_INT_SAMPLER_BUFFER:
+    case GL_UNSIGNED_INT_SAMPLER_2D: case GL_UNSIGNED_INT_SAMPLER_3D: case GL_UNSIGNED_INT_SAMPLER_2D_ARRAY:
+    case GL_UNSIGNED_INT_SAMPLER_BUFFER:
+        return true;
+    default:
+        return false;
+    }
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <glad/glad.h>
+#include <string>
+#include <vector>
+
+// active vertex input of a linked program
+struct ShaderAttribute
+{
+    std::string name;
+    GLenum type;      // GL_FLOAT_VEC3, GL_INT, ...
+    GLint size;       // array size, 1 for non-arrays
+    GLint location;
+};
+
+// active uniform of a linked program, including samplers and block members
+struct ShaderUniform
+{
+    std::string name;
+    GLenum type;
+    GLint size;
+    GLint location;   // -1 for uniforms that live in a block
+    GLint blockIndex; // -1 for uniforms in the default block
+};
+
+struct ShaderBlock
+{
+    std::string name;
+    GLuint index;
+    GLint dataSize;
+    GLint binding;
+};
+
+struct ShaderSampler
+{
+    std::string name;
+    GLenum type;      // GL_SAMPLER_2D, ...
+    GLint location;
+    GLint unit;       // texture unit the sampler reads from
+};
+
+// Everything the driver reports about a program's interface after link. Names may be empty
+// for SPIR-V programs, which don't have to carry them.
+class ProgramReflection
+{
+public:
+    std::vector<ShaderAttribute> attributes;
+    std::vector<ShaderUniform> uniforms;
+    std::vector<ShaderBlock> blocks;
+    std::vector<ShaderSampler> samplers;
+
+    ProgramReflection();
+    // queries the active interface of a linked program
+    explicit ProgramReflection(GLuint program);
+
+    // lookups return nullptr when the program has no such active resource
+    const ShaderAttribute* findAttribute(const std::string& name) const;
+    const ShaderAttribute* findAttribute(GLint location) const;
+    const ShaderUniform* findUniform(const std::string& name) const;
+    const ShaderBlock* findBlock(const std::string& name) const;
+    const ShaderSampler* findSampler(const std::string& name) const;
+};
+
+// number of scalar components in a GLSL type (3 for vec3, 16 for mat4)
+GLint glslTypeComponents(GLenum type);
+// true for the int/uint scalar and vector types that need glVertexAttribIPointer
+bool glslTypeIsInteger(GLenum type);
+bool glslTypeIsSampler(GLenum type);
\ No newline at end of file
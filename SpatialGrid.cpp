@@ -0,0 +1,264 @@
+#include "SpatialGrid.h"
+#include <cmath>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+
+SpatialGrid::SpatialGrid(float cellSize) : cellSize(cellSize), inverseCellSize(1.0f / cellSize), maxRadius(0.0f), objectCount(0)
+{
+}
+
+glm::ivec3 SpatialGrid::cellCoordinate(const glm::vec3& position) const
+{
+    return glm::ivec3((int)std::floor(position.x * inverseCellSize), (int)std::floor(position.y * inverseCellSize), (int)std::floor(position.z * inverseCellSize));
+}
+
+// 21 bits per axis, so coordinates within +-1M cells of the origin don't collide
+uint64_t SpatialGrid::cellKey(const glm::ivec3& coordinate)
+{
+    const uint64_t mask = (1u << 21) - 1;
+    return ((uint64_t)(coordinate.x + (1 << 20)) & mask)
+        | (((uint64_t)(coordinate.y + (1 << 20)) & mask) << 21)
+        | (((uint64_t)(coordinate.z + (1 << 20)) & mask) << 42);
+}
+
+void SpatialGrid::addToCell(uint32_t object, uint64_t key, const glm::ivec3& coordinate)
+{
+    auto found = cellIndices.find(key);
+    uint32_t index;
+    if (found == cellIndices.end())
+    {
+        index = (uint32_t)cells.size();
+        cellIndices.emplace(key, index);
+        cells.push_back(Cell{ {}, 0.0f, coordinate, key });
+    }
+    else
+    {
+        index = found->second;
+    }
+    Cell& cell = cells[index];
+    Entry& entry = entries[object];
+    entry.cellKey = key;
+    entry.cell = index;
+    entry.slot = (uint32_t)cell.objects.size();
+    cell.objects.push_back(object);
+    cell.maxRadius = std::max(cell.maxRadius, entry.radius);
+    maxRadius = std::max(maxRadius, entry.radius);
+}
+
+// swap-remove keeps the cell's list dense; the object moved into the hole gets its slot patched.
+// Cells that empty out are swap-removed from the cell array the same way.
+void SpatialGrid::removeFromCell(uint32_t object)
+{
+    Entry& entry = entries[object];
+    std::vector<uint32_t>& list = cells[entry.cell].objects;
+    uint32_t last = list.back();
+    list[entry.slot] = last;
+    entries[last].slot = entry.slot;
+    list.pop_back();
+    entry.slot = INVALID;
+    if (!list.empty())
+        return;
+
+    uint32_t emptied = entry.cell;
+    cellIndices.erase(cells[emptied].key);
+    if (emptied != cells.size() - 1)
+    {
+        cells[emptied] = std::move(cells.back());
+        cellIndices[cells[emptied].key] = emptied;
+        for (uint32_t moved : cells[emptied].objects)
+            entries[moved].cell = emptied;
+    }
+    cells.pop_back();
+}
+
+void SpatialGrid::insert(uint32_t object, const glm::vec3& center, float radius)
+{
+    if (object >= entries.size())
+        entries.resize(object + 1, Entry{ glm::vec3(0.0f), 0.0f, 0, INVALID, INVALID });
+    if (entries[object].slot != INVALID)
+    {
+        move(object, center, radius);
+        return;
+    }
+    entries[object].center = center;
+    entries[object].radius = radius;
+    glm::ivec3 coordinate = cellCoordinate(center);
+    addToCell(object, cellKey(coordinate), coordinate);
+    objectCount++;
+}
+
+void SpatialGrid::move(uint32_t object, const glm::vec3& center, float radius)
+{
+    Entry& entry = entries[object];
+    entry.center = center;
+    entry.radius = radius;
+    glm::ivec3 coordinate = cellCoordinate(center);
+    uint64_t key = cellKey(coordinate);
+    if (key == entry.cellKey)
+    {
+        // still in the same cell: only the radius bound may need to grow
+        Cell& cell = cells[entry.cell];
+        cell.maxRadius = std::max(cell.maxRadius, radius);
+        maxRadius = std::max(maxRadius, radius);
+        return;
+    }
+    removeFromCell(object);
+    addToCell(object, key, coordinate);
+}
+
+void SpatialGrid::remove(uint32_t object)
+{
+    if (!contains(object))
+        return;
+    removeFromCell(object);
+    objectCount--;
+}
+
+bool SpatialGrid::contains(uint32_t object) const
+{
+    return object < entries.size() && entries[object].slot != INVALID;
+}
+
+void SpatialGrid::clear()
+{
+    cells.clear();
+    cellIndices.clear();
+    entries.clear();
+    maxRadius = 0.0f;
+    objectCount = 0;
+}
+
+void SpatialGrid::update(const uint32_t* movedObjects, size_t count, const SphereSoA& spheres)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        uint32_t object = movedObjects[i];
+        move(object, glm::vec3(spheres.centerX[object], spheres.centerY[object], spheres.centerZ[object]), spheres.radius[object]);
+    }
+}
+
+// cell bounds grown by what its objects can reach, against the query sphere, then each object
+void SpatialGrid::testCell(const Cell& cell, const glm::vec3& center, float radius, std::vector<uint32_t>& results) const
+{
+    glm::vec3 cellMin = glm::vec3(cell.coordinate) * cellSize - glm::vec3(cell.maxRadius);
+    glm::vec3 cellMax = glm::vec3(cell.coordinate + glm::ivec3(1)) * cellSize + glm::vec3(cell.maxRadius);
+    glm::vec3 closest = glm::clamp(center, cellMin, cellMax);
+    if (glm::dot(closest - center, closest - center) > radius * radius)
+        return;
+    for (uint32_t object : cell.objects)
+    {
+        const Entry& entry = entries[object];
+        float distance = radius + entry.radius;
+        if (glm::dot(entry.center - center, entry.center - center) <= distance * distance)
+            results.push_back(object);
+    }
+}
+
+void SpatialGrid::querySphere(const glm::vec3& center, float radius, std::vector<uint32_t>& results) const
+{
+    // objects can hang out of their cell by their radius, so the search widens by the largest one
+    glm::ivec3 low = cellCoordinate(center - glm::vec3(radius + maxRadius));
+    glm::ivec3 high = cellCoordinate(center + glm::vec3(radius + maxRadius));
+
+    // walk whichever is smaller: the cell range or the occupied cells
+    glm::ivec3 span = high - low + glm::ivec3(1);
+    if ((uint64_t)span.x * span.y * span.z > cells.size())
+    {
+        for (const Cell& cell : cells)
+            if (glm::all(glm::greaterThanEqual(cell.coordinate, low)) && glm::all(glm::lessThanEqual(cell.coordinate, high)))
+                testCell(cell, center, radius, results);
+        return;
+    }
+    for (int z = low.z; z <= high.z; z++)
+        for (int y = low.y; y <= high.y; y++)
+            for (int x = low.x; x <= high.x; x++)
+            {
+                auto it = cellIndices.find(cellKey(glm::ivec3(x, y, z)));
+                if (it != cellIndices.end())
+                    testCell(cells[it->second], center, radius, results);
+            }
+}
+
+void runSpatialGridBenchmark()
+{
+    const int FRAMES = 10;
+    std::cout << "spatial grid: one thread" << std::endl;
+    for (size_t count : { (size_t)100000, (size_t)1000000 })
+    {
+        std::mt19937 random(1);
+        std::uniform_real_distribution<float> coordinate(-100.0f, 100.0f);
+        std::uniform_real_distribution<float> size(0.1f, 1.0f);
+        std::uniform_real_distribution<float> step(-0.5f, 0.5f);
+        SphereSoA spheres;
+        spheres.resize(count);
+        for (size_t i = 0; i < count; i++)
+            spheres.set(i, glm::vec3(coordinate(random), coordinate(random), coordinate(random)), size(random));
+
+        SpatialGrid grid;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < count; i++)
+            grid.insert((uint32_t)i, glm::vec3(spheres.centerX[i], spheres.centerY[i], spheres.centerZ[i]), spheres.radius[i]);
+        double rebuild = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        std::vector<uint32_t> order(count);
+        for (size_t i = 0; i < count; i++)
+            order[i] = (uint32_t)i;
+        std::shuffle(order.begin(), order.end(), random);
+        std::cout << count << " spheres: " << grid.cellCount() << " cells, rebuilding the grid takes " << rebuild << " ms" << std::endl;
+        for (double fraction : { 0.01, 0.1, 0.5, 1.0 })
+        {
+            // a random subset moves each frame, listed in ascending order as Scene::updatedObjects is
+            std::vector<uint32_t> moved(order.begin(), order.begin() + (size_t)(fraction * count));
+            std::sort(moved.begin(), moved.end());
+            double update = 0.0;
+            for (int frame = 0; frame < FRAMES; frame++)
+            {
+                for (uint32_t object : moved)
+                {
+                    spheres.centerX[object] += step(random);
+                    spheres.centerY[object] += step(random);
+                    spheres.centerZ[object] += step(random);
+                }
+                start = std::chrono::steady_clock::now();
+                grid.update(moved.data(), moved.size(), spheres);
+                update += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            }
+            std::cout << "    " << 100.0 * fraction << "% moving: update " << update / FRAMES << " ms" << std::endl;
+        }
+
+        // neighbourhood queries are what the grid is for: a radius of 5 around random points,
+        // against a pass over every sphere with the same test
+        const int QUERIES = 100;
+        const float QUERY_RADIUS = 5.0f;
+        std::vector<uint32_t> results, expected;
+        size_t found = 0;
+        bool match = true;
+        double gridQuery = 0.0, linearQuery = 0.0;
+        for (int i = 0; i < QUERIES; i++)
+        {
+            glm::vec3 center(coordinate(random), coordinate(random), coordinate(random));
+            results.clear();
+            expected.clear();
+            start = std::chrono::steady_clock::now();
+            grid.querySphere(center, QUERY_RADIUS, results);
+            auto queried = std::chrono::steady_clock::now();
+            for (size_t object = 0; object < count; object++)
+            {
+                glm::vec3 offset = glm::vec3(spheres.centerX[object], spheres.centerY[object], spheres.centerZ[object]) - center;
+                float distance = QUERY_RADIUS + spheres.radius[object];
+                if (glm::dot(offset, offset) <= distance * distance)
+                    expected.push_back((uint32_t)object);
+            }
+            auto scanned = std::chrono::steady_clock::now();
+            gridQuery += std::chrono::duration<double, std::micro>(queried - start).count();
+            linearQuery += std::chrono::duration<double, std::micro>(scanned - queried).count();
+            found += results.size();
+            std::sort(results.begin(), results.end());
+            match = match && results == expected;
+        }
+        std::cout << "    sphere query of radius 5: " << gridQuery / QUERIES << " us against " << linearQuery / QUERIES << " us linear, "
+            << (double)found / QUERIES << " found on average" << (match ? "" : ", MISMATCH") << std::endl;
+    }
+}
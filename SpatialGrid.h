@@ -0,0 +1,76 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <vector>
+#include <unordered_map>
+#include <cstddef>
+#include <cstdint>
+#include "FrustumCulling.h"
+
+// Loose hashed uniform grid for objects that move every frame. Each object lives in the one
+// cell that holds its centre, and cells remember the largest radius they contain, so queries
+// just widen by that. Insert, move and remove are O(1) amortized, and a move that stays in
+// its cell only rewrites the sphere. It is for neighbourhood queries; frustum culling is left
+// to cullSpheres, whose linear SIMD pass over every object beat a per-cell frustum query at any
+// share of moving objects.
+class SpatialGrid
+{
+public:
+    static const uint32_t INVALID = 0xFFFFFFFFu;
+
+    // cellSize works best at a few times the typical object radius
+    explicit SpatialGrid(float cellSize = 4.0f);
+
+    // objects are identified by the caller's index (e.g. a scene slot) and can be sparse
+    void insert(uint32_t object, const glm::vec3& center, float radius);
+    void move(uint32_t object, const glm::vec3& center, float radius);
+    void remove(uint32_t object);
+    bool contains(uint32_t object) const;
+    void clear();
+
+    // Updates only the given objects from the sphere arrays, for scenes where just some move.
+    // Objects must already be in the grid.
+    void update(const uint32_t* movedObjects, size_t count, const SphereSoA& spheres);
+
+    // append the objects whose spheres overlap the query; each object is reported once
+    void querySphere(const glm::vec3& center, float radius, std::vector<uint32_t>& results) const;
+
+    size_t size() const { return objectCount; }
+    size_t cellCount() const { return cells.size(); }
+
+private:
+    struct Cell
+    {
+        std::vector<uint32_t> objects;
+        float maxRadius;
+        glm::ivec3 coordinate;
+        uint64_t key;
+    };
+    struct Entry
+    {
+        glm::vec3 center;
+        float radius;
+        uint64_t cellKey; // key of the cell holding the object
+        uint32_t cell;    // index of that cell in cells
+        uint32_t slot;    // position in that cell's object list, INVALID if not in the grid
+    };
+
+    float cellSize;
+    float inverseCellSize;
+    float maxRadius; // largest radius ever inserted, bounds how far objects reach out of their cell
+    size_t objectCount;
+    // occupied cells are kept dense so queries walk an array; the map only finds them by key
+    std::vector<Cell> cells;
+    std::unordered_map<uint64_t, uint32_t> cellIndices;
+    std::vector<Entry> entries; // indexed by object
+
+    glm::ivec3 cellCoordinate(const glm::vec3& position) const;
+    static uint64_t cellKey(const glm::ivec3& coordinate);
+    void addToCell(uint32_t object, uint64_t key, const glm::ivec3& coordinate);
+    void removeFromCell(uint32_t object);
+    void testCell(const Cell& cell, const glm::vec3& center, float radius, std::vector<uint32_t>& results) const;
+};
+
+// Times update over 100K and 1M spheres with 1% to 100% of them moving each frame, against
+// rebuilding the grid, and querySphere against a linear pass that checks its results, and
+// prints them; "--grid-benchmark" runs it without opening a window
+void runSpatialGridBenchmark();
@@ -0,0 +1,132 @@
+#pragma once
+#include <cstdint>
+
+// Number parsing for the text asset formats. Unlike strtof/stringstream these ignore the
+// locale, never allocate and work on a [cursor, end) range that isn't null terminated, which
+// is what a mapped file gives us. Each parser advances cursor past what it consumed and
+// returns false, leaving cursor alone, when there is no number there.
+
+inline bool isDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+inline bool parseInt(const char*& cursor, const char* end, int64_t& value)
+{
+    const char* p = cursor;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+    if (p == end || !isDigit(*p))
+        return false;
+    int64_t result = 0;
+    while (p < end && isDigit(*p))
+        result = result * 10 + (*p++ - '0');
+    value = negative ? -result : result;
+    cursor = p;
+    return true;
+}
+
+inline bool parseDouble(const char*& cursor, const char* end, double& value)
+{
+    // exact powers of ten; a mantissa below 2^53 scaled by one of these is correctly rounded
+    static const double powersOfTen[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    const char* p = cursor;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+
+    // up to 19 significant digits go into the mantissa, later ones only move the exponent
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    bool anyDigits = false;
+    while (p < end && isDigit(*p))
+    {
+        if (digits < 19)
+        {
+            mantissa = mantissa * 10 + (*p - '0');
+            if (mantissa != 0)
+                digits++;
+        }
+        else
+        {
+            exponent++;
+        }
+        p++;
+        anyDigits = true;
+    }
+    if (p < end && *p == '.')
+    {
+        p++;
+        while (p < end && isDigit(*p))
+        {
+            if (digits < 19)
+            {
+                mantissa = mantissa * 10 + (*p - '0');
+                if (mantissa != 0)
+                    digits++;
+                exponent--;
+            }
+            p++;
+            anyDigits = true;
+        }
+    }
+    if (!anyDigits)
+        return false;
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+        const char* exponentStart = p + 1;
+        int64_t written = 0;
+        if (parseInt(exponentStart, end, written))
+        {
+            // clamp so absurd exponents saturate to 0 or infinity instead of overflowing
+            exponent += written < -400 ? -400 : (written > 400 ? 400 : (int)written);
+            p = exponentStart;
+        }
+    }
+
+    double result = (double)mantissa;
+    while (exponent > 22)
+    {
+        result *= 1e22;
+        exponent -= 22;
+    }
+    while (exponent < -22)
+    {
+        result /= 1e22;
+        exponent += 22;
+    }
+    result = exponent >= 0 ? result * powersOfTen[exponent] : result / powersOfTen[-exponent];
+    value = negative ? -result : result;
+    cursor = p;
+    return true;
+}
+
+inline bool parseFloat(const char*& cursor, const char* end, float& value)
+{
+    double result;
+    if (!parseDouble(cursor, end, result))
+        return false;
+    value = (float)result;
+    return true;
+}
+
+// spaces and tabs only; line ends are significant in the formats that use this
+inline void skipBlanks(const char*& cursor, const char* end)
+{
+    while (cursor < end && (*cursor == ' ' || *cursor == '\t'))
+        cursor++;
+}
+
+inline void skipLine(const char*& cursor, const char* end)
+{
+    while (cursor < end && *cursor != '\n')
+        cursor++;
+    if (cursor < end)
+        cursor++;
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <vector>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+#include "BatchTransform.h"
+#include "JobSystem.h"
+
+// Parent/child transforms kept in flat arrays sorted depth first: every node is followed by
+// its whole subtree, so parents always come before their children. World transforms are then
+// one linear pass (world = parent world * local) and every subtree is a contiguous range that
+// can be handed to another thread once its root's parent is known.
+//
+// Nodes are addressed by stable ids. Creating nodes only appends; the depth first order is
+// restored in one O(n) pass at the next update (or before a destroy). Reparenting in a sorted
+// hierarchy moves the subtree's range next to its new parent, so it costs the distance moved
+// rather than a full re-sort.
+class TransformHierarchy
+{
+public:
+    static const uint32_t NONE = 0xFFFFFFFF;
+    // below this many nodes update(JobSystem&) stays on the calling thread
+    static const size_t PARALLEL_THRESHOLD = 16384;
+
+    // adds a node under parent (NONE for a root) and returns its id
+    uint32_t create(uint32_t parent = NONE, const glm::vec3& position = glm::vec3(0.0f),
+                    const glm::quat& rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f), const glm::vec3& scale = glm::vec3(1.0f));
+    // removes the node and its whole subtree
+    void destroy(uint32_t node);
+    void clear();
+    bool contains(uint32_t node) const { return node < positions.size() && positions[node] != NONE; }
+
+    // moves the node (with its subtree) under parent, NONE to make it a root. Refuses to
+    // attach a node below itself and returns false in that case.
+    bool setParent(uint32_t node, uint32_t parent);
+    uint32_t parent(uint32_t node) const { return parentIds[positions[node]]; }
+
+    void setLocal(uint32_t node, const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale);
+
+    // recomputes the world transforms of changed nodes and their descendants
+    void update();
+    // same, spreading independent subtrees over the job system's workers
+    void update(JobSystem& jobs);
+
+    size_t size() const { return nodes.size(); }
+    const AffineTransform& world(uint32_t node) const { return worlds[positions[node]]; }
+    // in depth first order; nodeOrder()[i] is the id stored at position i
+    const std::vector<AffineTransform>& worldTransforms() const { return worlds; }
+    const std::vector<uint32_t>& nodeOrder() const { return nodes; }
+
+private:
+    // indexed by id
+    std::vector<uint32_t> positions;   // position in the sorted arrays, NONE for a free id
+    std::vector<uint32_t> freeIds;
+
+    // indexed by sorted position
+    std::vector<uint32_t> nodes;        // id of the node
+    std::vector<uint32_t> parentIds;
+    std::vector<uint32_t> parentPositions; // cached positions[parentIds[i]], refreshed lazily
+    std::vector<uint32_t> subtreeSizes; // the node plus all its descendants
+    TransformSoA locals;
+    std::vector<AffineTransform> localMatrices;
+    std::vector<AffineTransform> worlds;
+    std::vector<uint8_t> localDirty;
+    std::vector<uint8_t> changed;       // scratch for update: world needs recomputing
+
+    // scratch for update(JobSystem&): subtree ranges to run as tasks, roots split off before them
+    std::vector<std::pair<size_t, size_t>> tasks;
+    std::vector<uint32_t> serialRoots;
+    std::vector<std::pair<size_t, size_t>> pendingRanges;
+
+    bool sorted = true;
+    bool parentPositionsStale = false;
+
+    void prepareUpdate();
+    void sortDepthFirst();
+    void moveRange(size_t begin, size_t middle, size_t end);
+    void updateRange(size_t begin, size_t end);
+    void updateNode(size_t i);
+};
+
+// Checks that reparenting a node under its grandparent keeps the subtree ranges intact, then
+// times updates of 1M node hierarchies shaped as 64 long chains, one root with every other
+// node under it, and 64 four-ary trees, serially and on the job system, and prints the results;
+// "--hierarchy-benchmark" runs it without opening a window
+void runHierarchyBenchmark(JobSystem& jobs);
@@ -0,0 +1,87 @@
+#include "VertexFormat.h"
+#include <cstring>
+#include <iostream>
+
+const VertexAttribute* VertexFormat::find(const char* name) const
+{
+    for (const VertexAttribute& attribute : attributes)
+        if (std::strcmp(attribute.name, name) == 0)
+            return &attribute;
+    return nullptr;
+}
+
+static bool isIntegerFormat(GLenum type)
+{
+    switch (type)
+    {
+    case GL_BYTE: case GL_UNSIGNED_BYTE: case GL_SHORT: case GL_UNSIGNED_SHORT: case GL_INT: case GL_UNSIGNED_INT:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool bindVertexStreams(const ProgramReflection& program, const std::vector<VertexStream>& streams)
+{
+    GLint previousBuffer = 0;
+    glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &previousBuffer);
+
+    bool valid = true;
+    for (const ShaderAttribute& input : program.attributes)
+    {
+        const VertexStream* stream = nullptr;
+        const VertexAttribute* attribute = nullptr;
+        GLint index = 0;
+        for (const VertexStream& candidate : streams)
+        {
+            if (!input.name.empty())
+                attribute = candidate.format->find(input.name.c_str());
+            else if (input.location >= index && input.location < index + (GLint)candidate.format->attributes.size())
+                attribute = &candidate.format->attributes[input.location - index];
+            index += (GLint)candidate.format->attributes.size();
+            if (attribute != nullptr)
+            {
+                stream = &candidate;
+                break;
+            }
+        }
+
+        if (attribute == nullptr)
+        {
+            std::cout << "ERROR::VERTEX_FORMAT::MISSING_ATTRIBUTE " << input.name << " (location " << input.location << ")" << std::endl;
+            valid = false;
+            continue;
+        }
+        // the shader may read fewer components than the buffer has, but not more
+        if (attribute->components > glslTypeComponents(input.type))
+            std::cout << "WARNING::VERTEX_FORMAT::UNUSED_COMPONENTS " << attribute->name << std::endl;
+
+        GLuint buffer = stream->buffer != 0 ? stream->buffer : (GLuint)previousBuffer;
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        const VertexFormat& format = *stream->format;
+        if (glslTypeIsInteger(input.type))
+        {
+            if (!isIntegerFormat(attribute->type) || attribute->normalized)
+            {
+                std::cout << "ERROR::VERTEX_FORMAT::TYPE_MISMATCH " << attribute->name << " is read as an integer" << std::endl;
+                valid = false;
+                continue;
+            }
+            glVertexAttribIPointer(input.location, attribute->components, attribute->type, format.stride, (void*)(size_t)attribute->offset);
+        }
+        else
+        {
+            glVertexAttribPointer(input.location, attribute->components, attribute->type, attribute->normalized, format.stride, (void*)(size_t)attribute->offset);
+        }
+        glVertexAttribDivisor(input.location, format.divisor);
+        glEnableVertexAttribArray(input.location);
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, (GLuint)previousBuffer);
+    return valid;
+}
+
+bool bindVertexFormat(const ProgramReflection& program, const VertexFormat& format)
+{
+    return bindVertexStreams(program, { { 0, &format } });
+}
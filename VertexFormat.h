@@ -0,0 +1,39 @@
+#pragma once
+#include <glad/glad.h>
+#include <vector>
+#include "ShaderReflection.h"
+
+// one interleaved vertex stream element, matched to a shader input by name
+struct VertexAttribute
+{
+    const char* name;     // shader input it feeds, e.g. "aPos"
+    GLint components;
+    GLenum type;          // GL_FLOAT, GL_UNSIGNED_BYTE, ...
+    GLboolean normalized;
+    GLsizei offset;       // bytes from the start of the vertex
+};
+
+// layout of a mesh's vertices (or of per-instance data) in a vertex buffer
+struct VertexFormat
+{
+    std::vector<VertexAttribute> attributes;
+    GLsizei stride;
+    GLuint divisor = 0; // 0 advances per vertex, 1 per instance
+
+    const VertexAttribute* find(const char* name) const;
+};
+
+// a vertex buffer and the layout of what's in it
+struct VertexStream
+{
+    GLuint buffer;
+    const VertexFormat* format;
+};
+
+// Sets up the attribute pointers of the bound VAO, placing each of the program's active inputs
+// at its reflected location and sourcing it from whichever stream provides it. Inputs without
+// names (SPIR-V) are matched by location to the attribute at that index across all streams.
+// Returns false, and prints what didn't match, when the streams can't feed the program.
+bool bindVertexStreams(const ProgramReflection& program, const std::vector<VertexStream>& streams);
+// single stream version, sourcing from the buffer bound to GL_ARRAY_BUFFER
+bool bindVertexFormat(const ProgramReflection& program, const VertexFormat& format);
@@ -0,0 +1,144 @@
+#version 430 core
+// GPU culling: one invocation per object. Objects whose bounding sphere survives the frustum
+// and Hi-Z tests append an indirect draw command for the level of detail chosen like
+// selectLod (LodSelection.cpp) does; the atomic counter becomes the draw count. When the
+// meshlet pass (meshletCullComputeShader.glsl) follows, survivors are listed for it instead.
+layout (local_size_x = 64) in;
+
+struct DrawCommand
+{
+   uint count;
+   uint instanceCount;
+   uint firstIndex;
+   int baseVertex;
+   uint baseInstance;
+};
+
+// model matrix rows, three per object (same layout as the instance buffer)
+layout (std430, binding = 0) readonly buffer Transforms { vec4 transformRows[]; };
+// object space bounding spheres: centre in xyz, radius in w
+layout (std430, binding = 1) readonly buffer Bounds { vec4 bounds[]; };
+layout (std430, binding = 2) writeonly buffer Commands { DrawCommand commands[]; };
+// levels of detail of the mesh, as ranges of the element buffer and of the meshlets
+struct Lod
+{
+   uint firstIndex;
+   uint indexCount;
+   uint firstMeshlet;
+   uint meshletCount;
+   float error;
+   float padding;
+};
+layout (std430, binding = 3) readonly buffer Lods { Lod lods[]; };
+// the level each object was drawn at last, for the hysteresis
+layout (std430, binding = 4) buffer ObjectLods { uint objectLods[]; };
+// the meshlet pass's dispatch arguments, then the objects it works on
+layout (std430, binding = 5) buffer VisibleObjects
+{
+   uint groupCountX;
+   uint groupCountY;
+   uint groupCountZ;
+   uint visibleObjects[];
+};
+layout (binding = 0, offset = 0) uniform atomic_uint drawCount;
+
+uniform uint objectCount;
+uniform uint lodCount;
+uniform vec4 cameraPosition;
+uniform float lodProjectionScale;
+uniform float lodThreshold;
+uniform float lodHysteresis;
+uniform bool listObjects;
+uniform vec4 frustumPlanes[6];
+uniform mat4 viewProjection;
+
+// farthest depth pyramid of the previous frame
+uniform sampler2D hiZ;
+uniform bool useHiZ;
+uniform vec2 hiZSize;
+uniform int hiZLevels;
+
+bool occluded(vec3 center, float radius)
+{
+   vec2 screenMin = vec2(1.0), screenMax = vec2(0.0);
+   float nearest = 1.0;
+   for (int corner = 0; corner < 8; corner++)
+   {
+      vec3 offset = vec3((corner & 1) != 0 ? radius : -radius, (corner & 2) != 0 ? radius : -radius, (corner & 4) != 0 ? radius : -radius);
+      vec4 clip = viewProjection * vec4(center + offset, 1.0);
+      // reaches behind the camera, can't be bounded on screen
+      if (clip.w <= 1e-5)
+         return false;
+      vec3 ndc = clip.xyz / clip.w;
+      vec2 uv = ndc.xy * 0.5 + 0.5;
+      screenMin = min(screenMin, uv);
+      screenMax = max(screenMax, uv);
+      nearest = min(nearest, ndc.z * 0.5 + 0.5);
+   }
+   screenMin = clamp(screenMin, vec2(0.0), vec2(1.0));
+   screenMax = clamp(screenMax, vec2(0.0), vec2(1.0));
+
+   // the level where the rectangle covers about 2x2 texels, sampled at its four corners
+   vec2 extent = (screenMax - screenMin) * hiZSize;
+   int level = clamp(int(ceil(log2(max(max(extent.x, extent.y), 1.0)))), 0, hiZLevels - 1);
+   float farthest = max(max(textureLod(hiZ, screenMin, level).r, textureLod(hiZ, vec2(screenMax.x, screenMin.y), level).r),
+                        max(textureLod(hiZ, vec2(screenMin.x, screenMax.y), level).r, textureLod(hiZ, screenMax, level).r));
+   return nearest > farthest;
+}
+
+// the coarsest level whose error stays within limit pixels
+uint coarsestWithin(float pixelsPerUnit, float limit)
+{
+   uint level = 0u;
+   while (level + 1u < lodCount && lods[level + 1u].error * pixelsPerUnit <= limit)
+      level++;
+   return level;
+}
+
+uint selectLod(uint object, float scale, float distance)
+{
+   float pixelsPerUnit = scale * lodProjectionScale / max(distance, 1e-4);
+   uint current = min(objectLods[object], lodCount - 1u);
+   uint finest = coarsestWithin(pixelsPerUnit, lodThreshold);
+   if (finest < current)
+      return finest;
+   return max(current, coarsestWithin(pixelsPerUnit, lodThreshold * (1.0 - lodHysteresis)));
+}
+
+void main()
+{
+   uint object = gl_GlobalInvocationID.x;
+   if (object >= objectCount)
+      return;
+
+   vec4 row0 = transformRows[object * 3], row1 = transformRows[object * 3 + 1], row2 = transformRows[object * 3 + 2];
+   vec4 local = vec4(bounds[object].xyz, 1.0);
+   vec3 center = vec3(dot(row0, local), dot(row1, local), dot(row2, local));
+   // the largest axis scale (the longest column of the linear part, as Scene finds it from the
+   // local scale) bounds how much the sphere can grow
+   vec3 column0 = vec3(row0.x, row1.x, row2.x), column1 = vec3(row0.y, row1.y, row2.y), column2 = vec3(row0.z, row1.z, row2.z);
+   float scale = sqrt(max(max(dot(column0, column0), dot(column1, column1)), dot(column2, column2)));
+   float radius = bounds[object].w * scale;
+
+   for (int i = 0; i < 6; i++)
+      if (dot(frustumPlanes[i].xyz, center) + frustumPlanes[i].w < -radius)
+         return;
+   if (useHiZ && occluded(center, radius))
+      return;
+
+   uint lod = selectLod(object, scale, length(center - cameraPosition.xyz) - radius);
+   objectLods[object] = lod;
+   if (listObjects)
+   {
+      visibleObjects[atomicAdd(groupCountX, 1u)] = object;
+      return;
+   }
+
+   uint slot = atomicCounterIncrement(drawCount);
+   commands[slot].count = lods[lod].indexCount;
+   commands[slot].instanceCount = 1u;
+   commands[slot].firstIndex = lods[lod].firstIndex;
+   commands[slot].baseVertex = 0;
+   // the instance attributes are fetched at baseInstance, so this picks the object's transform
+   commands[slot].baseInstance = object;
+}
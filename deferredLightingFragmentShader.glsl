@@ -0,0 +1,128 @@
+#version 330 core
+// lighting pass of the deferred path (DeferredShading.h): every pixel the geometry pass covered
+// is shaded once, by the same clustered lights, shadows and surface response as the forward
+// path (fragmentShader.glsl), from the G-buffer. The pixel's depth is written back so the
+// default framebuffer ends up with the scene's depth, as after a forward pass.
+
+out vec4 FragColor;
+
+uniform sampler2D gNormal;
+uniform sampler2D gAlbedo;
+uniform sampler2D gMaterial;
+uniform sampler2D gDepth;
+// back from window depth to view space, then to the world
+uniform mat4 inverseProjection;
+uniform mat4 inverseView;
+uniform vec2 viewportSize;
+
+// clustered lights (ClusteredLighting.h): each light is two texels, its sphere and its colour;
+// each froxel is an (offset, count) range of clusterLights, which holds indices into lightData
+uniform samplerBuffer lightData;
+uniform usamplerBuffer clusterRanges;
+uniform usamplerBuffer clusterLights;
+// froxel tiles per pixel, and the slice as log(depth) * x + y
+uniform vec2 clusterTileScale;
+uniform vec2 clusterSlicing;
+
+// the sun and its shadow cascades (CascadedShadowMaps.h); splits are the cascades' far view
+// depths and texel sizes their shadow map texels in world units
+uniform sampler2DArrayShadow shadowMap;
+uniform mat4 shadowMatrices[4];
+uniform vec4 cascadeSplits;
+uniform vec4 cascadeTexelSizes;
+// the direction the sunlight travels
+uniform vec3 sunDirection;
+uniform vec3 sunColor;
+
+uniform vec3 viewPosition;
+
+const int CLUSTER_TILES_X = 16;
+const int CLUSTER_TILES_Y = 9;
+const int CLUSTER_SLICES = 24;
+const int SHADOW_CASCADES = 4;
+const float AMBIENT = 0.25;
+
+// fraction of the sun's light reaching a point: the cascade is picked by view depth, the
+// position is pushed out along the normal by a texel or two of that cascade so a surface
+// doesn't shadow itself, and 3x3 hardware comparisons (each one a 2x2 filter) soften the edge
+float sunShadow(vec3 position, float viewDepth, vec3 normal)
+{
+   int cascade = int(dot(vec4(greaterThanEqual(vec4(viewDepth), cascadeSplits)), vec4(1.0)));
+   if (cascade >= SHADOW_CASCADES)
+      return 1.0;
+   vec3 offsetPosition = position + normal * (1.5 * cascadeTexelSizes[cascade]);
+   vec3 coord = (shadowMatrices[cascade] * vec4(offsetPosition, 1.0)).xyz * 0.5 + 0.5;
+   vec2 texel = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+   float lit = 0.0;
+   for (int y = -1; y <= 1; y++)
+      for (int x = -1; x <= 1; x++)
+         lit += texture(shadowMap, vec4(coord.xy + vec2(x, y) * texel, float(cascade), coord.z));
+   return lit / 9.0;
+}
+
+// Lambert diffuse plus a normalized Blinn-Phong highlight that widens with roughness; metals
+// have no diffuse and tint the highlight with their albedo
+vec3 surfaceResponse(vec3 albedo, float roughness, float metalness, vec3 normal, vec3 toEye, vec3 toLight)
+{
+   float facing = max(dot(normal, toLight), 0.0);
+   float alpha = max(roughness * roughness, 0.02);
+   float shininess = max(2.0 / (alpha * alpha) - 2.0, 1e-4);
+   vec3 halfway = normalize(toLight + toEye);
+   vec3 specular = mix(vec3(0.04), albedo, metalness) * ((shininess + 8.0) / 8.0) * pow(max(dot(normal, halfway), 0.0), shininess);
+   return (albedo * (1.0 - metalness) + specular) * facing;
+}
+
+// ambient, the shadowed sun and the clustered point lights reaching a point on a surface;
+// copied from fragmentShader.glsl (and fragmentShaderSpirv.glsl), so change the copies together
+vec3 shadeSurface(vec3 position, float viewDepth, vec3 normal, vec3 albedo, float ambientOcclusion, float roughness, float metalness)
+{
+   vec3 toEye = normalize(viewPosition - position);
+   vec3 color = albedo * (AMBIENT * ambientOcclusion);
+   color += sunColor * surfaceResponse(albedo, roughness, metalness, normal, toEye, -sunDirection) * sunShadow(position, viewDepth, normal);
+
+   ivec2 tile = min(ivec2(gl_FragCoord.xy * clusterTileScale), ivec2(CLUSTER_TILES_X - 1, CLUSTER_TILES_Y - 1));
+   int slice = clamp(int(floor(log(max(viewDepth, 1e-4)) * clusterSlicing.x + clusterSlicing.y)), 0, CLUSTER_SLICES - 1);
+   uvec2 range = texelFetch(clusterRanges, (slice * CLUSTER_TILES_Y + tile.y) * CLUSTER_TILES_X + tile.x).xy;
+   for (uint i = 0u; i < range.y; i++)
+   {
+      int index = int(texelFetch(clusterLights, int(range.x + i)).r);
+      vec4 sphere = texelFetch(lightData, 2 * index);
+      vec3 toLight = sphere.xyz - position;
+      float distanceSquared = dot(toLight, toLight);
+      // smooth falloff that reaches zero at the sphere's surface, where the light stops being
+      // assigned to froxels
+      float ratio = distanceSquared / (sphere.w * sphere.w);
+      float window = clamp(1.0 - ratio * ratio, 0.0, 1.0);
+      vec3 response = surfaceResponse(albedo, roughness, metalness, normal, toEye, toLight * inversesqrt(max(distanceSquared, 1e-8)));
+      color += texelFetch(lightData, 2 * index + 1).rgb * response * (window * window);
+   }
+   return color;
+}
+
+vec3 decodeOctahedral(vec2 encoded)
+{
+   vec2 folded = encoded * 2.0 - 1.0;
+   vec3 n = vec3(folded, 1.0 - abs(folded.x) - abs(folded.y));
+   float unfold = max(-n.z, 0.0);
+   n.xy += vec2(n.x >= 0.0 ? -unfold : unfold, n.y >= 0.0 ? -unfold : unfold);
+   return normalize(n);
+}
+
+void main()
+{
+   ivec2 pixel = ivec2(gl_FragCoord.xy);
+   float depth = texelFetch(gDepth, pixel, 0).r;
+   // nothing was drawn here; the clear colour shows through
+   if (depth >= 1.0)
+      discard;
+
+   vec4 viewPos = inverseProjection * vec4(vec3(gl_FragCoord.xy / viewportSize, depth) * 2.0 - 1.0, 1.0);
+   viewPos /= viewPos.w;
+   vec3 position = (inverseView * viewPos).xyz;
+   vec3 normal = decodeOctahedral(texelFetch(gNormal, pixel, 0).rg);
+   vec4 albedo = texelFetch(gAlbedo, pixel, 0);
+   vec2 material = texelFetch(gMaterial, pixel, 0).rg;
+
+   FragColor = vec4(shadeSurface(position, -viewPos.z, normal, albedo.rgb, albedo.a, material.r, material.g), 1.0);
+   gl_FragDepth = depth;
+}
@@ -0,0 +1,104 @@
+#version 450 core
+// SPIR-V build of fragmentShader.glsl; compiled offline to fragmentShader.spv.
+layout (location = 0) out vec4 FragColor;
+layout (location = 0) in vec2 TexCoord;
+layout (location = 1) in vec3 WorldPos;
+layout (location = 2) in vec3 Normal;
+layout (location = 3) in float ViewDepth;
+
+layout (location = 3, binding = 0) uniform sampler2D texture1;
+layout (location = 4, binding = 1) uniform sampler2D texture2;
+
+// clustered lights (ClusteredLighting.h), on the units ClusteredLighting binds them to
+layout (location = 5, binding = 12) uniform samplerBuffer lightData;
+layout (location = 6, binding = 13) uniform usamplerBuffer clusterRanges;
+layout (location = 7, binding = 14) uniform usamplerBuffer clusterLights;
+layout (location = 8) uniform vec2 clusterTileScale;
+layout (location = 9) uniform vec2 clusterSlicing;
+
+// the sun and its shadow cascades (CascadedShadowMaps.h)
+layout (location = 10, binding = 11) uniform sampler2DArrayShadow shadowMap;
+layout (location = 11) uniform mat4 shadowMatrices[4];
+layout (location = 15) uniform vec4 cascadeSplits;
+layout (location = 16) uniform vec4 cascadeTexelSizes;
+layout (location = 17) uniform vec3 sunDirection;
+layout (location = 18) uniform vec3 sunColor;
+
+layout (location = 19) uniform vec3 viewPosition;
+layout (location = 20) uniform float materialRoughness;
+layout (location = 21) uniform float materialMetalness;
+
+// specialized when the program is loaded
+layout (constant_id = 0) const float textureMix = 0.5;
+
+const int CLUSTER_TILES_X = 16;
+const int CLUSTER_TILES_Y = 9;
+const int CLUSTER_SLICES = 24;
+const int SHADOW_CASCADES = 4;
+const float AMBIENT = 0.25;
+
+// fraction of the sun's light reaching a point: the cascade is picked by view depth, the
+// position is pushed out along the normal by a texel or two of that cascade so a surface
+// doesn't shadow itself, and 3x3 hardware comparisons (each one a 2x2 filter) soften the edge
+float sunShadow(vec3 position, float viewDepth, vec3 normal)
+{
+   int cascade = int(dot(vec4(greaterThanEqual(vec4(viewDepth), cascadeSplits)), vec4(1.0)));
+   if (cascade >= SHADOW_CASCADES)
+      return 1.0;
+   vec3 offsetPosition = position + normal * (1.5 * cascadeTexelSizes[cascade]);
+   vec3 coord = (shadowMatrices[cascade] * vec4(offsetPosition, 1.0)).xyz * 0.5 + 0.5;
+   vec2 texel = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+   float lit = 0.0;
+   for (int y = -1; y <= 1; y++)
+      for (int x = -1; x <= 1; x++)
+         lit += texture(shadowMap, vec4(coord.xy + vec2(x, y) * texel, float(cascade), coord.z));
+   return lit / 9.0;
+}
+
+// Lambert diffuse plus a normalized Blinn-Phong highlight that widens with roughness; metals
+// have no diffuse and tint the highlight with their albedo
+vec3 surfaceResponse(vec3 albedo, float roughness, float metalness, vec3 normal, vec3 toEye, vec3 toLight)
+{
+   float facing = max(dot(normal, toLight), 0.0);
+   float alpha = max(roughness * roughness, 0.02);
+   float shininess = max(2.0 / (alpha * alpha) - 2.0, 1e-4);
+   vec3 halfway = normalize(toLight + toEye);
+   vec3 specular = mix(vec3(0.04), albedo, metalness) * ((shininess + 8.0) / 8.0) * pow(max(dot(normal, halfway), 0.0), shininess);
+   return (albedo * (1.0 - metalness) + specular) * facing;
+}
+
+// ambient, the shadowed sun and the clustered point lights reaching a point on a surface;
+// deferredLightingFragmentShader.glsl shades with a copy of this, so the two paths match
+vec3 shadeSurface(vec3 position, float viewDepth, vec3 normal, vec3 albedo, float ambientOcclusion, float roughness, float metalness)
+{
+   vec3 toEye = normalize(viewPosition - position);
+   vec3 color = albedo * (AMBIENT * ambientOcclusion);
+   color += sunColor * surfaceResponse(albedo, roughness, metalness, normal, toEye, -sunDirection) * sunShadow(position, viewDepth, normal);
+
+   ivec2 tile = min(ivec2(gl_FragCoord.xy * clusterTileScale), ivec2(CLUSTER_TILES_X - 1, CLUSTER_TILES_Y - 1));
+   int slice = clamp(int(floor(log(max(viewDepth, 1e-4)) * clusterSlicing.x + clusterSlicing.y)), 0, CLUSTER_SLICES - 1);
+   uvec2 range = texelFetch(clusterRanges, (slice * CLUSTER_TILES_Y + tile.y) * CLUSTER_TILES_X + tile.x).xy;
+   for (uint i = 0u; i < range.y; i++)
+   {
+      int index = int(texelFetch(clusterLights, int(range.x + i)).r);
+      vec4 sphere = texelFetch(lightData, 2 * index);
+      vec3 toLight = sphere.xyz - position;
+      float distanceSquared = dot(toLight, toLight);
+      // smooth falloff that reaches zero at the sphere's surface, where the light stops being
+      // assigned to froxels
+      float ratio = distanceSquared / (sphere.w * sphere.w);
+      float window = clamp(1.0 - ratio * ratio, 0.0, 1.0);
+      vec3 response = surfaceResponse(albedo, roughness, metalness, normal, toEye, toLight * inversesqrt(max(distanceSquared, 1e-8)));
+      color += texelFetch(lightData, 2 * index + 1).rgb * response * (window * window);
+   }
+   return color;
+}
+
+void main()
+{
+   vec4 albedo = mix(texture(texture1, TexCoord), texture(texture2, TexCoord), textureMix);
+   // meshes without normals are shaded as if they faced the viewer
+   float normalLength = length(Normal);
+   vec3 normal = normalLength > 0.0 ? Normal / normalLength : normalize(viewPosition - WorldPos);
+   FragColor = vec4(shadeSurface(WorldPos, ViewDepth, normal, albedo.rgb, 1.0, materialRoughness, materialMetalness), albedo.a);
+}
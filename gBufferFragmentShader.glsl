@@ -0,0 +1,39 @@
+#version 330 core
+// geometry pass of the deferred path (DeferredShading.h), fed by vertexShader.glsl. Only what
+// the lighting pass can't get elsewhere is written: the position comes back from the depth
+// buffer, so 10 bytes of colour targets per pixel hold the rest.
+layout (location = 0) out vec2 gNormal;    // RG16, octahedral
+layout (location = 1) out vec4 gAlbedo;    // RGBA8, albedo and ambient occlusion
+layout (location = 2) out vec2 gMaterial;  // RG8, roughness and metalness
+
+in vec2 TexCoord;
+in vec3 WorldPos;
+in vec3 Normal;
+
+uniform sampler2D texture1;
+uniform sampler2D texture2;
+
+uniform vec3 viewPosition;
+// the cubes have no material maps, so these are uniform
+uniform float materialRoughness;
+uniform float materialMetalness;
+
+// a unit vector folded onto the octahedron |x| + |y| + |z| = 1 and its lower half unfolded
+// over the corners of the square, mapped to [0, 1] for a unorm target
+vec2 encodeOctahedral(vec3 n)
+{
+   n /= abs(n.x) + abs(n.y) + abs(n.z);
+   vec2 folded = n.z >= 0.0 ? n.xy : (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+   return folded * 0.5 + 0.5;
+}
+
+void main()
+{
+   vec4 albedo = mix(texture(texture1, TexCoord), texture(texture2, TexCoord), 0.5f);
+   // meshes without normals are shaded as if they faced the viewer, as in the forward path
+   float normalLength = length(Normal);
+   vec3 normal = normalLength > 0.0 ? Normal / normalLength : normalize(viewPosition - WorldPos);
+   gNormal = encodeOctahedral(normal);
+   gAlbedo = vec4(albedo.rgb, 1.0);
+   gMaterial = vec2(materialRoughness, materialMetalness);
+}
@@ -0,0 +1,36 @@
+#version 430 core
+// Builds one level of the Hi-Z pyramid. Level 0 copies the depth buffer; every other level
+// keeps the farthest depth of the texels below it, including the extra row/column when the
+// level above has odd size so nothing is missed.
+layout (local_size_x = 8, local_size_y = 8) in;
+
+uniform sampler2D source;      // depth texture for level 0, the pyramid itself otherwise
+uniform int sourceLevel;       // -1 when copying the depth texture
+uniform vec2 sourceSize;
+layout (r32f, binding = 0) uniform writeonly image2D target;
+
+void main()
+{
+   ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+   ivec2 targetSize = imageSize(target);
+   if (texel.x >= targetSize.x || texel.y >= targetSize.y)
+      return;
+
+   if (sourceLevel < 0)
+   {
+      imageStore(target, texel, vec4(texelFetch(source, texel, 0).r));
+      return;
+   }
+
+   ivec2 base = texel * 2;
+   ivec2 levelSize = ivec2(sourceSize);
+   ivec2 last = levelSize - 1;
+   // odd sized levels fold their last row/column into the final texel
+   ivec2 end = base + ivec2(texel.x == targetSize.x - 1 && (levelSize.x & 1) != 0 ? 2 : 1,
+                            texel.y == targetSize.y - 1 && (levelSize.y & 1) != 0 ? 2 : 1);
+   float farthest = 0.0;
+   for (int y = base.y; y <= end.y; y++)
+      for (int x = base.x; x <= end.x; x++)
+         farthest = max(farthest, texelFetch(source, min(ivec2(x, y), last), sourceLevel).r);
+   imageStore(target, texel, vec4(farthest));
+}
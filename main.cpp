@@ -3,11 +3,43 @@
 
 #include <iostream>
 #include "Shader.h"
+#include "MappedFile.h"
+#include "VertexFormat.h"
+#include "BatchTransform.h"
+#include "FrustumCulling.h"
+#include "Bvh.h"
+#include "SpatialGrid.h"
+#include "TransformHierarchy.h"
+#include "OcclusionCulling.h"
+#include "Scene.h"
+#include "JobSystem.h"
+#include "CommandBuffer.h"
+#include "GlCommandBackend.h"
+#include "Memory.h"
+#include "AllocationTracker.h"
+#include "GpuCulling.h"
+#include "ClusteredLighting.h"
+#include "CascadedShadowMaps.h"
+#include "DeferredShading.h"
+#include "ObjLoader.h"
+#include "GltfLoader.h"
+#include "MeshFile.h"
+#include "MeshCooker.h"
+#include "MeshSimplifier.h"
+#include "MeshletBuilder.h"
+#include "LodSelection.h"
 #include "stb_image.h"
 #include "Camera.h"
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <vector>
+#include <algorithm>
+#include <cfloat>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 
 // settings
 const unsigned int SCR_WIDTH = 800;
@@ -27,6 +59,20 @@ float pitch = 0.0f;
 float lastX = 400, lastY = 300;
 const float sensitivity = 0.1f;
 
+// culling: G switches between the CPU and the compute shader path
+bool useGpuCulling = false;
+bool gpuCullingKeyDown = false;
+// M switches the compute path between drawing whole objects and drawing meshlets
+bool useMeshlets = false;
+bool meshletKeyDown = false;
+// R switches between shading in the forward pass and the deferred path
+bool useDeferred = false;
+bool deferredKeyDown = false;
+
+// once arenas, pools and caches have grown to their steady state size a frame must not touch
+// the heap; "--allocation-test <frames>" runs that many frames and fails if one after warmup did
+const unsigned int ALLOCATION_WARMUP_FRAMES = 120;
+
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void processInput(GLFWwindow* window);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
@@ -34,12 +80,109 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 
 
 
-int main() {
+int main(int argc, char* argv[]) {
+
+    unsigned int allocationTestFrames = 0;
+    // "--obj <path>" or "--mesh <path>" (a cooked .mesh) draws that model in place of the cube,
+    // "--glb <path>" adds a glTF scene
+    const char* objPath = NULL;
+    const char* meshPath = NULL;
+    const char* glbPath = NULL;
+    // "--lights <count>" scatters that many point lights through the scene
+    size_t lightCount = 1024;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--allocation-test") == 0)
+            allocationTestFrames = (i + 1 < argc) ? (unsigned int)atoi(argv[++i]) : 2 * ALLOCATION_WARMUP_FRAMES;
+        else if (strcmp(argv[i], "--obj") == 0 && i + 1 < argc)
+            objPath = argv[++i];
+        else if (strcmp(argv[i], "--mesh") == 0 && i + 1 < argc)
+            meshPath = argv[++i];
+        else if (strcmp(argv[i], "--glb") == 0 && i + 1 < argc)
+            glbPath = argv[++i];
+        else if (strcmp(argv[i], "--deferred") == 0)
+            useDeferred = true;
+        else if (strcmp(argv[i], "--lights") == 0 && i + 1 < argc)
+            lightCount = (size_t)atoi(argv[++i]);
+        else if (strcmp(argv[i], "--light-benchmark") == 0)
+        {
+            // times the light assignment at 1K, 10K and 100K lights and exits without opening a window
+            JobSystem benchmarkJobs;
+            runLightingBenchmark(benchmarkJobs);
+            return 0;
+        }
+        else if (strcmp(argv[i], "--cull-benchmark") == 0)
+        {
+            // times the SIMD frustum tests against the scalar ones and exits without opening a window
+            runCullingBenchmark();
+            return 0;
+        }
+        else if (strcmp(argv[i], "--transform-benchmark") == 0)
+        {
+            // times the batched transform composition against glm and exits without opening a window
+            runTransformBenchmark();
+            return 0;
+        }
+        else if (strcmp(argv[i], "--bvh-benchmark") == 0)
+        {
+            // times BVH builds, frustum queries and raycasts and exits without opening a window
+            JobSystem benchmarkJobs;
+            runBvhBenchmark(benchmarkJobs);
+            return 0;
+        }
+        else if (strcmp(argv[i], "--grid-benchmark") == 0)
+        {
+            // times the spatial grid with more and more objects moving and exits without opening a window
+            runSpatialGridBenchmark();
+            return 0;
+        }
+        else if (strcmp(argv[i], "--hierarchy-benchmark") == 0)
+        {
+            // times deep, wide and bushy 1M node hierarchies and exits without opening a window
+            JobSystem benchmarkJobs;
+            runHierarchyBenchmark(benchmarkJobs);
+            return 0;
+        }
+        else if (strcmp(argv[i], "--job-benchmark") == 0)
+        {
+            // times the job system from one thread up to every hardware thread and exits
+            // without opening a window
+            runJobSystemBenchmark();
+            return 0;
+        }
+        else if (strcmp(argv[i], "--sort-benchmark") == 0)
+        {
+            // times the render command sort at 100K and 1M commands and exits without opening a window
+            JobSystem benchmarkJobs;
+            runCommandSortBenchmark(benchmarkJobs);
+            return 0;
+        }
+        else if (strcmp(argv[i], "--occlusion-benchmark") == 0)
+        {
+            // times the software occlusion test behind a wall and exits without opening a window
+            JobSystem benchmarkJobs;
+            runOcclusionBenchmark(benchmarkJobs);
+            return 0;
+        }
+        else if (strcmp(argv[i], "--cook") == 0 && i + 2 < argc)
+        {
+            // "--cook <source> <destination>" converts an .obj or .glb to a .mesh and exits
+            // without opening a window
+            JobSystem cookJobs;
+            return cookMesh(argv[i + 1], argv[i + 2], cookJobs) ? 0 : 1;
+        }
+    }
+    if (allocationTestFrames > 0 && !AllocationTracker::isEnabled())
+    {
+        std::cout << "ERROR::ALLOCATION::TRACKING_DISABLED build with TRACK_ALLOCATIONS to run the allocation test" << std::endl;
+        return -1;
+    }
 
     //initialising glfw
     glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    // ask for 4.6 first (SPIR-V shaders), then 4.3 (GPU culling), then fall back to 3.3
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
     // for mac users
     #ifdef __APPLE__
@@ -49,6 +192,17 @@ int main() {
     // creating a window
     GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL", NULL, NULL);
     if (window == NULL)
+    {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL", NULL, NULL);
+    }
+    if (window == NULL)
+    {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL", NULL, NULL);
+    }
+    if (window == NULL)
     {
         std::cout << "Failed to create GLFW window" << std::endl;
         glfwTerminate();
@@ -68,8 +222,22 @@ int main() {
         return -1;
      }
 
+     // frame work (transform updates, asset decoding) is spread over every core; this thread
+     // is worker 0 and the only one that touches GL
+     JobSystem jobs;
+
      // shader 
-     Shader ourShader("vertexShader.glsl", "fragmentShader.glsl");
+     // use the precompiled SPIR-V when the context supports it and the build step produced it
+     bool useSpirv = GLAD_GL_VERSION_4_6 && MappedFile("vertexShader.spv").isOpen() && MappedFile("fragmentShader.spv").isOpen();
+     Shader ourShader = useSpirv
+         ? Shader::fromSpirv("vertexShader.spv", "fragmentShader.spv",
+             { SpecializationConstant::fromFloat(0, 0.5f) }, // textureMix
+             { { "view", 1 }, { "projection", 2 }, { "texture1", 3 }, { "texture2", 4 }, { "lightData", 5 }, { "clusterRanges", 6 },
+               { "clusterLights", 7 }, { "clusterTileScale", 8 }, { "clusterSlicing", 9 }, { "shadowMap", 10 },
+               { "shadowMatrices[0]", 11 }, { "shadowMatrices[1]", 12 }, { "shadowMatrices[2]", 13 }, { "shadowMatrices[3]", 14 },
+               { "cascadeSplits", 15 }, { "cascadeTexelSizes", 16 }, { "sunDirection", 17 }, { "sunColor", 18 },
+               { "viewPosition", 19 }, { "materialRoughness", 20 }, { "materialMetalness", 21 } })
+         : Shader("vertexShader.glsl", "fragmentShader.glsl");
      //**************************************************************
 
      float vertices[] = {
@@ -115,12 +283,75 @@ int main() {
         -0.5f,  0.5f,  0.5f,  0.0f, 0.0f,
         -0.5f,  0.5f, -0.5f,  0.0f, 1.0f
      };
-     unsigned int indices[] = {
-         0, 1, 3, // first triangle
-         1, 2, 3  // second triangle
-     };
+     // the cube becomes a mesh like any loaded model; its vertices are already a triangle list.
+     // A cooked mesh isn't copied out at all: its vertices and indices are uploaded straight
+     // from the mapping, and mesh only takes its bounds
+     Mesh mesh;
+     MeshFile meshFile;
+     if (meshPath != NULL && meshFile.open(meshPath))
+     {
+         mesh.boundsMin = glm::make_vec3(meshFile.info().boundsMin);
+         mesh.boundsMax = glm::make_vec3(meshFile.info().boundsMax);
+         mesh.boundsCenter = glm::make_vec3(meshFile.info().boundsCenter);
+         mesh.boundingRadius = meshFile.info().boundingRadius;
+     }
+     else if (objPath == NULL || !loadObj(objPath, mesh, jobs))
+     {
+         mesh.vertices.resize(36);
+         mesh.indices.resize(36);
+         for (unsigned int i = 0; i < 36; i++)
+         {
+             mesh.vertices[i].position = glm::vec3(vertices[5 * i], vertices[5 * i + 1], vertices[5 * i + 2]);
+             mesh.vertices[i].texCoord = glm::vec2(vertices[5 * i + 3], vertices[5 * i + 4]);
+             mesh.indices[i] = i;
+         }
+         // the table winds some faces clockwise; turn them so every face points out, which
+         // the normals and the meshlets' backface cones rely on
+         for (unsigned int i = 0; i < 36; i += 3)
+         {
+             const glm::vec3& a = mesh.vertices[i].position;
+             glm::vec3 normal = glm::cross(mesh.vertices[i + 1].position - a, mesh.vertices[i + 2].position - a);
+             if (glm::dot(normal, a) < 0.0f)
+                 std::swap(mesh.indices[i + 1], mesh.indices[i + 2]);
+         }
+         mesh.computeNormals();
+         mesh.computeBounds();
+     }
+     // levels of detail and meshlets: a cooked mesh brings its own, anything else gets them
+     // built here (the cube is too small to have any level past the full mesh)
+     if (meshFile.isOpen())
+     {
+         mesh.lods.assign(meshFile.lods(), meshFile.lods() + meshFile.lodCount());
+         mesh.meshlets.assign(meshFile.meshlets(), meshFile.meshlets() + meshFile.meshletCount());
+     }
+     else
+     {
+         buildLods(mesh);
+         buildMeshlets(mesh);
+     }
+     const MeshVertex* meshVertices = meshFile.isOpen() ? meshFile.vertices() : mesh.vertices.data();
+     const size_t meshVertexCount = meshFile.isOpen() ? meshFile.vertexCount() : mesh.vertices.size();
+     const uint32_t* meshIndices = meshFile.isOpen() ? meshFile.indices() : mesh.indices.data();
+     const unsigned int meshIndexCount = (unsigned int)(meshFile.isOpen() ? meshFile.indexCount() : mesh.indices.size());
+     // the LOD picks below index mesh.lods[lodCount - 1]; a mesh that came without levels is drawn
+     // whole as its only one
+     if (mesh.lods.empty())
+         mesh.lods.push_back({ 0, meshIndexCount, 0, 0, 0.0f });
+     // the CPU path rasterizes the nearest cubes' full level as occluders, so it keeps a copy of
+     // the positions and indices past the upload
+     std::vector<float> occluderPositions(3 * meshVertexCount);
+     for (size_t i = 0; i < meshVertexCount; i++)
+     {
+         occluderPositions[3 * i] = meshVertices[i].position.x;
+         occluderPositions[3 * i + 1] = meshVertices[i].position.y;
+         occluderPositions[3 * i + 2] = meshVertices[i].position.z;
+     }
+     std::vector<uint32_t> occluderIndices(meshIndices + mesh.lods[0].firstIndex, meshIndices + mesh.lods[0].firstIndex + mesh.lods[0].indexCount);
 
-     glm::vec3 cubePositions[] = {
+     // the cubes live in the scene, bounded by the mesh's sphere
+     Scene scene;
+     std::vector<SceneHandle> cubes;
+     const glm::vec3 cubePositions[] = {
         glm::vec3(0.0f,  0.0f,  0.0f),
         glm::vec3(2.0f,  5.0f, -15.0f),
         glm::vec3(-1.5f, -2.2f, -2.5f),
@@ -132,40 +363,128 @@ int main() {
         glm::vec3(1.5f,  0.2f, -1.5f),
         glm::vec3(-1.3f,  1.0f, -1.5f)
      };
+     for (const glm::vec3& position : cubePositions)
+         cubes.push_back(scene.create(position, glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(1.0f), mesh.boundingRadius, mesh.boundsCenter));
+     const unsigned int cubeCount = (unsigned int)scene.size();
 
+     // the compute path culls every cube on the GPU and reads the transforms from the instance buffer
+     GpuCulling* gpuCulling = NULL;
+     if (GpuCulling::isSupported())
+     {
+         gpuCulling = new GpuCulling(cubeCount);
+         gpuCulling->setBounds(scene.localBounds());
+         gpuCulling->setLods(mesh.lods.data(), mesh.lods.size());
+         gpuCulling->setMeshlets(mesh.meshlets.data(), mesh.meshlets.size());
+     }
 
 
-     unsigned int VBO, VAO, EBO;
+     unsigned int VBO, VAO, EBO, instanceVBO;
 
      glGenVertexArrays(1, &VAO); // create array buffer
      glGenBuffers(1, &VBO); // create the buffer
      glGenBuffers(1, &EBO);
+     glGenBuffers(1, &instanceVBO);
 
-     glBindVertexArray(VAO); // bind VAO
+     glState().bindVertexArray(VAO); // bind VAO
      
-     glBindBuffer(GL_ARRAY_BUFFER, VBO); // bind buffer (i believe any configuration will be applied to the last bound buffer)
-     glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW); // copy vertices into the buffer's memory
+     glState().bindBuffer(GL_ARRAY_BUFFER, VBO); // bind buffer (i believe any configuration will be applied to the last bound buffer)
+     glBufferData(GL_ARRAY_BUFFER, meshVertexCount * sizeof(MeshVertex), meshVertices, GL_STATIC_DRAW); // copy vertices into the buffer's memory
      
-     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-     glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
-
-     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0); // specifies data format for vertices
-     glEnableVertexAttribArray(0); // vertex attributes are disabled by default
-
-     glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float))); // texture
-     glEnableVertexAttribArray(1);
-
+     glState().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+     glBufferData(GL_ELEMENT_ARRAY_BUFFER, meshIndexCount * sizeof(uint32_t), meshIndices, GL_STATIC_DRAW);
+     // the buffers hold their own copies now
+     meshFile.close();
+
+     glState().bindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+     glBufferData(GL_ARRAY_BUFFER, cubeCount * sizeof(AffineTransform), NULL, GL_STREAM_DRAW);
+     VertexFormat instanceFormat = {
+         {
+             { "aModelRow0", 4, GL_FLOAT, GL_FALSE, 0 },
+             { "aModelRow1", 4, GL_FLOAT, GL_FALSE, 4 * sizeof(float) },
+             { "aModelRow2", 4, GL_FLOAT, GL_FALSE, 8 * sizeof(float) }
+         },
+         sizeof(AffineTransform),
+         1 // one transform per cube
+     };
+     if (!bindVertexStreams(ourShader.reflection, { { VBO, &Mesh::vertexFormat() }, { instanceVBO, &instanceFormat } }))
+         std::cout << "Cube vertices don't match the shader inputs" << std::endl;
+
+
+     glState().bindBuffer(GL_ARRAY_BUFFER, 0);
+
+     // the glTF nodes keep their parents in a hierarchy, and the ones with meshes become objects
+     // of their own scene for culling; their transforms don't change, so the instance buffer is
+     // filled once from the hierarchy. Each object is drawn with its transform as the base
+     // instance, which needs GL 4.2
+     GltfModel model;
+     TransformHierarchy modelHierarchy;
+     Scene modelScene;
+     std::vector<uint32_t> modelMeshOfObject;
+     std::vector<GLuint> modelVertexArrays;
+     unsigned int modelInstanceVBO = 0;
+     if (glbPath != NULL && !GLAD_GL_VERSION_4_2)
+         std::cout << "ERROR::GLTF::NEEDS_GL_4_2 " << glbPath << std::endl;
+     else if (glbPath != NULL && model.load(glbPath))
+     {
+         std::vector<GltfInstance> modelInstances;
+         model.instantiate(modelHierarchy, modelScene, modelInstances);
+         modelHierarchy.update(jobs);
+         modelScene.updateTransforms(jobs);
+         modelMeshOfObject.resize(modelScene.size());
+         std::vector<AffineTransform> modelTransforms(modelScene.size());
+         for (const GltfInstance& instance : modelInstances)
+         {
+             size_t object = modelScene.indexOf(instance.object);
+             modelMeshOfObject[object] = instance.mesh;
+             modelTransforms[object] = modelHierarchy.world(instance.node);
+         }
+
+         glGenBuffers(1, &modelInstanceVBO);
+         glState().bindBuffer(GL_ARRAY_BUFFER, modelInstanceVBO);
+         glBufferData(GL_ARRAY_BUFFER, modelTransforms.size() * sizeof(AffineTransform), modelTransforms.data(), GL_STATIC_DRAW);
+         glState().bindBuffer(GL_ARRAY_BUFFER, 0);
+         for (size_t i = 0; i < model.primitives().size(); i++)
+             modelVertexArrays.push_back(model.createVertexArray(i, ourShader.reflection, { { modelInstanceVBO, &instanceFormat } }));
+     }
 
-     glBindBuffer(GL_ARRAY_BUFFER, 0);
+     // sun shadows. The depth only program reads its inputs from the same locations as ourShader,
+     // so it draws from the scene's vertex arrays; the CPU path gives each cascade an instance
+     // buffer and vertex array of its own, and the compute path a culling context of its own
+     // (the Hi-Z pyramid is the camera's, so it doesn't occlude shadow casters)
+     Shader shadowShader("shadowVertexShader.glsl", "shadowFragmentShader.glsl");
+     CascadedShadowMaps* shadows = new CascadedShadowMaps();
+     const glm::vec3 sunDirection = glm::normalize(glm::vec3(-0.4f, -1.0f, -0.3f));
+     const glm::vec3 sunColor(0.8f, 0.76f, 0.68f);
+     unsigned int shadowVAOs[CascadedShadowMaps::CASCADE_COUNT], shadowInstanceVBOs[CascadedShadowMaps::CASCADE_COUNT];
+     glGenVertexArrays(CascadedShadowMaps::CASCADE_COUNT, shadowVAOs);
+     glGenBuffers(CascadedShadowMaps::CASCADE_COUNT, shadowInstanceVBOs);
+     for (uint32_t c = 0; c < CascadedShadowMaps::CASCADE_COUNT; c++)
+     {
+         glState().bindVertexArray(shadowVAOs[c]);
+         glState().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+         glState().bindBuffer(GL_ARRAY_BUFFER, shadowInstanceVBOs[c]);
+         glBufferData(GL_ARRAY_BUFFER, cubeCount * sizeof(AffineTransform), NULL, GL_STREAM_DRAW);
+         if (!bindVertexStreams(shadowShader.reflection, { { VBO, &Mesh::vertexFormat() }, { shadowInstanceVBOs[c], &instanceFormat } }))
+             std::cout << "Cube vertices don't match the shadow shader inputs" << std::endl;
+     }
+     glState().bindVertexArray(0);
+     glState().bindBuffer(GL_ARRAY_BUFFER, 0);
+     GpuCulling* shadowCulling = NULL;
+     if (gpuCulling)
+     {
+         shadowCulling = new GpuCulling(cubeCount);
+         shadowCulling->setBounds(scene.localBounds());
+         shadowCulling->setLods(mesh.lods.data(), mesh.lods.size());
+         shadowCulling->occlusionEnabled = false;
+     }
 
 
+     // sampler units are assigned by the shader at link
      ourShader.use();
-     glUniform1i(glGetUniformLocation(ourShader.ID, "texture1"), 0);
-     ourShader.setInt("texture2", 1);
      // glPolygonMode(GL_FRONT_AND_BACK, GL_LINE); // wireframe mode
 
      //depth buffer enable
-     glEnable(GL_DEPTH_TEST);
+     glState().enable(GL_DEPTH_TEST);
 
      //TEXTURES *************************************************************
 
@@ -181,8 +500,7 @@ int main() {
      glGenTextures(1, &texture1);
      glGenTextures(1, &texture2);
 
-     glActiveTexture(GL_TEXTURE0);
-     glBindTexture(GL_TEXTURE_2D, texture1);
+     glState().bindTexture(ourShader.samplerUnit("texture1"), GL_TEXTURE_2D, texture1);
 
      // set the texture wrapping/filtering options (on the currently bound texture object)
      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
@@ -190,51 +508,141 @@ int main() {
      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 
-     
-
-
-     int width, height, nrChannels;
-     stbi_set_flip_vertically_on_load(true);
-
-     unsigned char* data = stbi_load("Resources/Assets/container.jpg", &width, &height, &nrChannels, 0);
-
-     if (data)
-     {
-         glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-         glGenerateMipmap(GL_TEXTURE_2D);
-     }
-     else
-     {
-         std::cout << "Failed to load texture" << std::endl;
-     }
-     stbi_image_free(data);
-
-     glActiveTexture(GL_TEXTURE1);
-     glBindTexture(GL_TEXTURE_2D, texture2);
+     glState().bindTexture(ourShader.samplerUnit("texture2"), GL_TEXTURE_2D, texture2);
 
      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 
-     data = stbi_load("Resources/Assets/awesomeface.png", &width, &height, &nrChannels, 0);
 
-     if (data)
+     stbi_set_flip_vertically_on_load(true);
+
+     // images are decoded on the workers, straight out of the file mapping; the uploads are
+     // queued back to this thread, which owns the GL context
+     auto loadTexture = [&jobs](unsigned int texture, int unit, const char* path, GLenum format)
      {
-         glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-         glGenerateMipmap(GL_TEXTURE_2D);
-     }
-     else
+         return jobs.create([&jobs, texture, unit, path, format]()
+         {
+             MappedFile imageFile(path);
+             int width, height, nrChannels;
+             unsigned char* data = stbi_load_from_memory((const stbi_uc*)imageFile.data(), (int)imageFile.size(), &width, &height, &nrChannels, 0);
+             jobs.runOnMainThread([texture, unit, format, data, width, height]()
+             {
+                 if (data)
+                 {
+                     glState().bindTexture(unit, GL_TEXTURE_2D, texture);
+                     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+                     glGenerateMipmap(GL_TEXTURE_2D);
+                 }
+                 else
+                 {
+                     std::cout << "Failed to load texture" << std::endl;
+                 }
+                 stbi_image_free(data);
+             });
+         });
+     };
+     Job* textureJobs[] = {
+         loadTexture(texture1, ourShader.samplerUnit("texture1"), "Resources/Assets/container.jpg", GL_RGB),
+         loadTexture(texture2, ourShader.samplerUnit("texture2"), "Resources/Assets/awesomeface.png", GL_RGBA)
+     };
+     for (Job* job : textureJobs)
+         jobs.run(job);
+     for (Job* job : textureJobs)
+         jobs.wait(job);
+     jobs.executeMainThreadJobs();
+
+     // draws are recorded by the workers, one command buffer each, and executed on this thread
+     std::vector<CommandBuffer> commandBuffers(jobs.threadCount());
+     // the level of detail each cube was last drawn at
+     std::vector<uint32_t> cubeLods(cubeCount, 0);
+     // CPU occlusion culling: the software depth buffer and the boxes around the cubes' spheres
+     OcclusionBuffer occlusion;
+     AabbSoA cubeBoxes;
+     cubeBoxes.resize(cubeCount);
+     CommandQueue commandQueue;
+     GlCommandBackend commandBackend;
+     Material cubeMaterial;
+     cubeMaterial.textureCount = 2;
+     cubeMaterial.textures[0] = texture1;
+     cubeMaterial.units[0] = ourShader.samplerUnit("texture1");
+     cubeMaterial.textures[1] = texture2;
+     cubeMaterial.units[1] = ourShader.samplerUnit("texture2");
+     uint32_t cubeMaterialIndex = commandBackend.addMaterial(cubeMaterial);
+     // the shadow passes bind no textures
+     uint32_t shadowMaterialIndex = commandBackend.addMaterial(Material());
+
+     // the deferred path's geometry program samples the cube textures on the units the material
+     // binds them to, which are the forward program's
+     DeferredShading* deferred = new DeferredShading();
+     Shader* scenePrograms[2] = { &ourShader, &deferred->geometryShader() };
+     for (Shader* program : scenePrograms)
      {
-         std::cout << "Failed to load texture" << std::endl;
+         program->use();
+         program->setInt("texture1", ourShader.samplerUnit("texture1"));
+         program->setInt("texture2", ourShader.samplerUnit("texture2"));
+         program->setFloat("materialRoughness", 0.6f);
+         program->setFloat("materialMetalness", 0.0f);
      }
-     stbi_image_free(data);
+
+     // GPU time of the camera pass (the forward pass, or the geometry and lighting passes), shown
+     // in the title to compare the two paths. Two queries take turns, so the one read back is a
+     // frame old and its result is there without waiting
+     GLuint passQueries[2];
+     glGenQueries(2, passQueries);
+     bool passQueryIssued[2] = { false, false };
+     double passNanoseconds = 0.0;
+     unsigned int passSamples = 0;
+
+     // per-frame temporaries (visible lists and the like) come from here, never from the heap
+     FrameArena frameArena;
+     unsigned int frameIndex = 0;
+     unsigned int allocatingFrames = 0;
      
      
-     //matrices
-     glm::mat4 model = glm::mat4(1.0f);
-     model = glm::rotate(model, glm::radians(-55.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+     // point lights drifting through the cubes; lightOrigins keeps where each one circles
+     ClusteredLighting* lighting = new ClusteredLighting();
+     SphereSoA lights;
+     std::vector<glm::vec3> lightColors;
+     scatterLights(lightCount, glm::vec3(-8.0f, -5.0f, -20.0f), glm::vec3(8.0f, 7.0f, 2.0f), lights, lightColors);
+     SphereSoA lightOrigins = lights;
+
+     // culls the glTF scene against a frustum and draws it, one draw per primitive
+     auto recordModel = [&](const Frustum& frustum, GLuint program, uint32_t material)
+     {
+         uint32_t* visibleObjects = frameArena.allocateArray<uint32_t>(modelScene.size());
+         size_t visibleCount = cullSpheres(frustum, modelScene.worldBounds(), 0, modelScene.size(), visibleObjects);
+
+         CommandBuffer& commands = commandBuffers[0];
+         commands.reset();
+         const SphereSoA& bounds = modelScene.worldBounds();
+         for (size_t v = 0; v < visibleCount; v++)
+         {
+             uint32_t object = visibleObjects[v];
+             float distance = glm::length(glm::vec3(bounds.centerX[object], bounds.centerY[object], bounds.centerZ[object]) - camera.Position);
+             const GltfMesh& modelMesh = model.meshes()[modelMeshOfObject[object]];
+             for (uint32_t p = modelMesh.firstPrimitive; p < modelMesh.firstPrimitive + modelMesh.primitiveCount; p++)
+             {
+                 const GltfPrimitive& primitive = model.primitives()[p];
+                 DrawCommand* draw = commands.add<DrawCommand>(RenderKey::opaque(program, material, modelVertexArrays[p], distance / 100.0f));
+                 draw->indexed = primitive.indexBuffer != 0;
+                 draw->program = program;
+                 draw->vertexArray = modelVertexArrays[p];
+                 draw->material = material;
+                 draw->count = primitive.count;
+                 draw->first = primitive.firstIndex;
+                 draw->indexSize = primitive.indexSize;
+                 draw->firstInstance = object;
+             }
+         }
+         commandQueue.clear();
+         commandQueue.append(commands);
+         commandQueue.sort();
+         commandBackend.execute(commandQueue);
+     };
 
+     //matrices
      glm::mat4 view = glm::mat4(1.0f);
      view = glm::translate(view, glm::vec3(0.0f, 0.0f, -3.0f));
 
@@ -247,48 +655,393 @@ int main() {
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
 
+        // the frame that just ended should not have allocated once warmup is over
+        AllocationCounts lastFrameAllocations = AllocationTracker::beginFrame();
+        if (frameIndex > ALLOCATION_WARMUP_FRAMES && lastFrameAllocations.allocations > 0)
+        {
+            AllocationIgnoreScope reporting;
+            if (allocatingFrames++ == 0)
+            {
+                std::cout << "ERROR::ALLOCATION::STEADY_STATE_FRAME frame " << frameIndex << " made " << lastFrameAllocations.allocations
+                    << " heap allocations (" << lastFrameAllocations.bytes << " bytes)" << std::endl;
+                AllocationTracker::printLastFrameScopes();
+            }
+        }
+        frameIndex++;
+        if (allocationTestFrames > 0 && frameIndex > allocationTestFrames)
+            break;
+
         //input
-        processInput(window);
+        {
+            AllocationScope scope("input");
+            processInput(window);
+        }
+
+        frameArena.beginFrame();
+        memoryStats().beginFrame();
+
+        // once a second, show how many GL state calls the cache let through and skipped last frame
+        glState().beginFrame();
+        if (static_cast<int>(currentFrame) != static_cast<int>(currentFrame - deltaTime))
+        {
+            // GLFW copies (and on Windows converts) the title; once a second is accepted
+            AllocationIgnoreScope setTitle;
+            const GlStateCache::Counters& counters = glState().lastFrameCounters();
+            char title[160];
+            snprintf(title, sizeof(title), "LearnOpenGL - %s %.2f ms GPU - %u GL state calls issued, %u elided",
+                useDeferred ? "deferred" : "forward", passSamples > 0 ? passNanoseconds / passSamples * 1e-6 : 0.0, counters.issued, counters.elided);
+            glfwSetWindowTitle(window, title);
+            passNanoseconds = 0.0;
+            passSamples = 0;
+        }
 
         // pass projection matrix to shader (note that in this case it could change every frame)
         glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
 
         //camera stuff
         view = camera.GetViewMatrix();
-
-        //model view proj matrixes update
-        ourShader.setMat4("model", model);
-        ourShader.setMat4("view", view);
-        ourShader.setMat4("projection", projection);
+        int framebufferWidth, framebufferHeight;
+        glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+        const float projectionScale = lodProjectionScale(camera.Zoom, (float)framebufferHeight);
+
+        // the program the scene is drawn with: the forward one shades, the deferred path's fills
+        // the G-buffer. use() is free when the program is already bound
+        Shader& sceneShader = useDeferred ? deferred->geometryShader() : ourShader;
+        sceneShader.use();
+        sceneShader.setMat4("view", view);
+        sceneShader.setMat4("projection", projection);
+        sceneShader.setVec3("viewPosition", camera.Position);
+
+        // move the lights, sort them into the froxels of this view and hand them to the shader
+        {
+            AllocationScope scope("lighting");
+            const float time = static_cast<float>(glfwGetTime());
+            jobs.parallelFor(lights.size(), [&](size_t begin, size_t end)
+            {
+                for (size_t i = begin; i < end; i++)
+                {
+                    float phase = time * 0.5f + (float)i * 0.37f;
+                    lights.centerX[i] = lightOrigins.centerX[i] + std::sin(phase);
+                    lights.centerY[i] = lightOrigins.centerY[i] + 0.5f * std::sin(phase * 1.3f);
+                    lights.centerZ[i] = lightOrigins.centerZ[i] + std::cos(phase);
+                }
+            }, 4096);
+            lighting->setProjection(camera.Zoom, (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+            lighting->assign(lights, view, jobs);
+            lighting->upload(lights, lightColors.data());
+        }
 
 
         // rendering
         glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT);
 
-        ourShader.setFloat("time", glfwGetTime());
+        sceneShader.setFloat("time", glfwGetTime());
 
         //depthBuffer clear
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        //draw.
-        glBindVertexArray(VAO);
-        for (unsigned int i = 0; i < 10; i++)
+        // spin the cubes; only the objects touched here get their world transforms recomposed
+        {
+            AllocationScope scope("scene update");
+            const glm::vec3 spinAxis = glm::normalize(glm::vec3(1.0f, 0.3f, 0.5f));
+            for (unsigned int i = 0; i < cubeCount; i++)
+            {
+                float angle = 20.0f * i;
+                scene.setRotation(cubes[i], glm::angleAxis(glm::radians(angle + static_cast<float>(glfwGetTime()*10)), spinAxis));
+            }
+            scene.updateTransforms(jobs);
+        }
+        const std::vector<AffineTransform>& cubeInstances = scene.worldTransforms();
+        // the compute path reads every transform from the instance buffer, in the shadow passes too
+        if (useGpuCulling && gpuCulling)
+        {
+            glState().bindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+            glBufferSubData(GL_ARRAY_BUFFER, 0, cubeCount * sizeof(AffineTransform), cubeInstances.data());
+        }
+
+        // the sun's shadow cascades. The cubes spin, so they are dynamic casters and drawn into
+        // every cascade each frame; the glTF scene never moves, so it is a static caster and the
+        // far cascades only draw it when their cache is refreshed
+        {
+            AllocationScope scope("shadows");
+            glm::vec3 casterMin(FLT_MAX), casterMax(-FLT_MAX);
+            const SphereSoA* casterBounds[2] = { &scene.worldBounds(), &modelScene.worldBounds() };
+            for (const SphereSoA* bounds : casterBounds)
+            {
+                for (size_t i = 0; i < bounds->size(); i++)
+                {
+                    glm::vec3 center(bounds->centerX[i], bounds->centerY[i], bounds->centerZ[i]);
+                    casterMin = glm::min(casterMin, center - bounds->radius[i]);
+                    casterMax = glm::max(casterMax, center + bounds->radius[i]);
+                }
+            }
+            shadows->update(camera, (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, sunDirection, casterMin, casterMax);
+
+            const uint32_t lodCount = (uint32_t)mesh.lods.size();
+            for (size_t p = 0; p < shadows->passCount(); p++)
+            {
+                const CascadedShadowMaps::Pass& pass = shadows->pass(p);
+                shadows->beginPass(p);
+                shadowShader.use();
+                shadowShader.setMat4("lightViewProjection", pass.viewProjection);
+                Frustum frustum = Frustum::fromMatrix(pass.viewProjection);
+                if (pass.dynamicCasters && useGpuCulling && shadowCulling)
+                {
+                    shadowCulling->cull(instanceVBO, cubeCount, pass.viewProjection, camera.Position, projectionScale);
+                    shadowShader.use();
+                    glState().bindVertexArray(VAO);
+                    shadowCulling->draw();
+                }
+                else if (pass.dynamicCasters)
+                {
+                    // the cubes in the cascade go into its instance buffer as one instanced draw,
+                    // at the finest level the camera would pick for any of them
+                    uint32_t* casters = frameArena.allocateArray<uint32_t>(cubeCount);
+                    size_t casterCount = cullSpheres(frustum, scene.worldBounds(), 0, cubeCount, casters);
+                    if (casterCount > 0)
+                    {
+                        const SphereSoA& bounds = scene.worldBounds();
+                        CommandBuffer& commands = commandBuffers[0];
+                        commands.reset();
+                        AffineTransform* instances = commands.allocateArray<AffineTransform>(casterCount);
+                        uint32_t finestLod = lodCount - 1;
+                        for (size_t i = 0; i < casterCount; i++)
+                        {
+                            uint32_t cube = casters[i];
+                            instances[i] = cubeInstances[cube];
+                            glm::vec3 center(bounds.centerX[cube], bounds.centerY[cube], bounds.centerZ[cube]);
+                            float scale = mesh.boundingRadius > 0.0f ? bounds.radius[cube] / mesh.boundingRadius : 1.0f;
+                            float distance = glm::length(center - camera.Position) - bounds.radius[cube];
+                            finestLod = std::min(finestLod, selectLod(mesh.lods.data(), lodCount, scale, distance, projectionScale, cubeLods[cube]));
+                        }
+                        UploadCommand* upload = commands.add<UploadCommand>(RenderKey::upload());
+                        upload->buffer = shadowInstanceVBOs[pass.cascade];
+                        upload->offset = 0;
+                        upload->size = (uint32_t)(casterCount * sizeof(AffineTransform));
+                        upload->data = instances;
+
+                        DrawCommand* draw = commands.add<DrawCommand>(RenderKey::opaque(shadowShader.ID, shadowMaterialIndex, shadowVAOs[pass.cascade], 0.0f));
+                        draw->indexed = true;
+                        draw->program = shadowShader.ID;
+                        draw->vertexArray = shadowVAOs[pass.cascade];
+                        draw->material = shadowMaterialIndex;
+                        draw->count = mesh.lods[finestLod].indexCount;
+                        draw->first = mesh.lods[finestLod].firstIndex;
+                        draw->instanceCount = (uint32_t)casterCount;
+                        commandQueue.clear();
+                        commandQueue.append(commands);
+                        commandQueue.sort();
+                        commandBackend.execute(commandQueue);
+                    }
+                }
+                if (pass.staticCasters && modelScene.size() > 0)
+                    recordModel(frustum, shadowShader.ID, shadowMaterialIndex);
+            }
+            shadows->endPasses(framebufferWidth, framebufferHeight);
+        }
+
+        // the lights and the shadows go to whichever program shades this frame
+        Shader& shadingShader = useDeferred ? deferred->lightingShader() : ourShader;
+        shadingShader.use();
+        lighting->bind(shadingShader, framebufferWidth, framebufferHeight);
+        shadows->bind(shadingShader);
+        shadingShader.setVec3("sunColor", sunColor);
+        shadingShader.setVec3("viewPosition", camera.Position);
+
+        GLuint passQuery = passQueries[frameIndex & 1];
+        if (passQueryIssued[frameIndex & 1])
+        {
+            GLuint64 nanoseconds = 0;
+            glGetQueryObjectui64v(passQuery, GL_QUERY_RESULT, &nanoseconds);
+            passNanoseconds += (double)nanoseconds;
+            passSamples++;
+        }
+        glBeginQuery(GL_TIME_ELAPSED, passQuery);
+        passQueryIssued[frameIndex & 1] = true;
+        if (useDeferred)
+            deferred->beginGeometryPass(framebufferWidth, framebufferHeight);
+
+        if (useGpuCulling && gpuCulling)
+        {
+            AllocationScope scope("gpu culling");
+            // the compute pass writes a draw for each visible cube
+            gpuCulling->cullMeshlets = useMeshlets;
+            gpuCulling->cull(instanceVBO, cubeCount, projection * view, camera.Position, projectionScale);
+
+            sceneShader.use();
+            glState().bindVertexArray(VAO);
+            gpuCulling->draw();
+
+            // this frame's depth (the G-buffer's on the deferred path) occludes the next frame's cubes
+            gpuCulling->updateHiZ(framebufferWidth, framebufferHeight);
+            sceneShader.use();
+        }
+        else
+        {
+            AllocationScope scope("cpu culling and recording");
+            // only the cubes inside the view frustum go into the instance buffer. This is a linear
+            // pass over every cube; SpatialGrid is kept for neighbourhood queries, since walking its
+            // cells was slower than cullSpheres at any share of moving objects
+            Frustum frustum = Frustum::fromMatrix(projection * view);
+            uint32_t* visibleCubes = frameArena.allocateArray<uint32_t>(cubeCount);
+            size_t visibleCount = cullSpheres(frustum, scene.worldBounds(), 0, cubeCount, visibleCubes);
+            const SphereSoA& bounds = scene.worldBounds();
+
+            // the nearest few visible cubes are rasterized as occluders, and the cubes whose boxes
+            // lie behind them are left out (--occlusion-benchmark)
+            if (visibleCount > 1)
+            {
+                const size_t OCCLUDER_COUNT = 4;
+                auto distanceTo = [&](uint32_t cube)
+                {
+                    return glm::length(glm::vec3(bounds.centerX[cube], bounds.centerY[cube], bounds.centerZ[cube]) - camera.Position) - bounds.radius[cube];
+                };
+                size_t occluderCount = std::min(OCCLUDER_COUNT, visibleCount);
+                uint32_t* occluders = frameArena.allocateArray<uint32_t>(visibleCount);
+                std::copy(visibleCubes, visibleCubes + visibleCount, occluders);
+                std::partial_sort(occluders, occluders + occluderCount, occluders + visibleCount,
+                    [&](uint32_t a, uint32_t b) { return distanceTo(a) < distanceTo(b); });
+                occlusion.beginFrame(projection * view);
+                for (size_t k = 0; k < occluderCount; k++)
+                    occlusion.addOccluder(cubeInstances[occluders[k]].toMat4(), occluderPositions.data(), meshVertexCount, 3,
+                        occluderIndices.data(), occluderIndices.size());
+                occlusion.rasterize(jobs);
+                for (size_t i = 0; i < visibleCount; i++)
+                {
+                    uint32_t cube = visibleCubes[i];
+                    glm::vec3 center(bounds.centerX[cube], bounds.centerY[cube], bounds.centerZ[cube]);
+                    cubeBoxes.set(cube, center - bounds.radius[cube], center + bounds.radius[cube]);
+                }
+                visibleCount = occlusion.cullAabbs(cubeBoxes, visibleCubes, visibleCount, visibleCubes);
+            }
+
+            // pick each visible cube's level of detail. Without base instance (GL 4.2) every
+            // draw starts at instance 0, so all of them share the finest level picked
+            const uint32_t lodCount = (uint32_t)mesh.lods.size();
+            uint32_t finestLod = lodCount - 1;
+            for (size_t i = 0; i < visibleCount; i++)
+            {
+                uint32_t cube = visibleCubes[i];
+                glm::vec3 center(bounds.centerX[cube], bounds.centerY[cube], bounds.centerZ[cube]);
+                float scale = mesh.boundingRadius > 0.0f ? bounds.radius[cube] / mesh.boundingRadius : 1.0f;
+                float distance = glm::length(center - camera.Position) - bounds.radius[cube];
+                cubeLods[cube] = selectLod(mesh.lods.data(), lodCount, scale, distance, projectionScale, cubeLods[cube]);
+                finestLod = std::min(finestLod, cubeLods[cube]);
+            }
+            if (!GLAD_GL_VERSION_4_2)
+            {
+                for (size_t i = 0; i < visibleCount; i++)
+                    cubeLods[visibleCubes[i]] = finestLod;
+            }
+
+            // group the cubes by level (a counting sort), so a run of cubes at one level is one
+            // instanced draw
+            uint32_t* lodStarts = frameArena.allocateArray<uint32_t>(lodCount + 1);
+            std::fill(lodStarts, lodStarts + lodCount + 1, 0u);
+            for (size_t i = 0; i < visibleCount; i++)
+                lodStarts[cubeLods[visibleCubes[i]] + 1]++;
+            for (uint32_t lod = 0; lod < lodCount; lod++)
+                lodStarts[lod + 1] += lodStarts[lod];
+            uint32_t* drawnCubes = frameArena.allocateArray<uint32_t>(std::max<size_t>(visibleCount, 1));
+            for (size_t i = 0; i < visibleCount; i++)
+                drawnCubes[lodStarts[cubeLods[visibleCubes[i]]]++] = visibleCubes[i];
+
+            // each worker copies a range of the visible transforms into its command buffer and
+            // records the upload and the draws; ranges past the first need base instance (GL 4.2)
+            for (CommandBuffer& commands : commandBuffers)
+                commands.reset();
+            size_t minGrain = GLAD_GL_VERSION_4_2 ? 256 : std::max<size_t>(visibleCount, 1);
+            jobs.parallelFor(visibleCount, [&](size_t begin, size_t end)
+            {
+                AllocationScope recordScope("draw recording");
+                CommandBuffer& commands = commandBuffers[jobs.workerIndex()];
+                AffineTransform* instances = commands.allocateArray<AffineTransform>(end - begin);
+                for (size_t i = begin; i < end; i++)
+                    instances[i - begin] = cubeInstances[drawnCubes[i]];
+
+                UploadCommand* upload = commands.add<UploadCommand>(RenderKey::upload());
+                upload->buffer = instanceVBO;
+                upload->offset = (uint32_t)(begin * sizeof(AffineTransform));
+                upload->size = (uint32_t)((end - begin) * sizeof(AffineTransform));
+                upload->data = instances;
+
+                for (size_t run = begin; run < end;)
+                {
+                    uint32_t first = drawnCubes[run];
+                    const MeshLod& lod = mesh.lods[cubeLods[first]];
+                    size_t runEnd = run + 1;
+                    while (runEnd < end && cubeLods[drawnCubes[runEnd]] == cubeLods[first])
+                        runEnd++;
+
+                    float distance = glm::length(glm::vec3(bounds.centerX[first], bounds.centerY[first], bounds.centerZ[first]) - camera.Position);
+                    DrawCommand* draw = commands.add<DrawCommand>(RenderKey::opaque(sceneShader.ID, cubeMaterialIndex, VAO, distance / 100.0f));
+                    draw->indexed = true;
+                    draw->program = sceneShader.ID;
+                    draw->vertexArray = VAO;
+                    draw->material = cubeMaterialIndex;
+                    draw->count = lod.indexCount;
+                    draw->first = lod.firstIndex;
+                    draw->instanceCount = (uint32_t)(runEnd - run);
+                    draw->firstInstance = (uint32_t)run;
+                    run = runEnd;
+                }
+            }, minGrain);
+
+            // merge, sort by key and submit
+            commandQueue.clear();
+            for (const CommandBuffer& commands : commandBuffers)
+                commandQueue.append(commands);
+            commandQueue.sort(jobs);
+            commandBackend.execute(commandQueue);
+        }
+
+        // the model is culled and recorded on this thread in both paths, one draw per primitive
+        if (modelScene.size() > 0)
         {
-            glm::mat4 model = glm::mat4(1.0f);
-            model = glm::translate(model, cubePositions[i]);
-            float angle = 20.0f * i;
-            model = glm::rotate(model, glm::radians(angle + static_cast<float>(glfwGetTime()*10)), glm::vec3(1.0f, 0.3f, 0.5f));
-            ourShader.setMat4("model", model);
+            AllocationScope scope("model");
+            recordModel(Frustum::fromMatrix(projection * view), sceneShader.ID, cubeMaterialIndex);
+        }
 
-            glDrawArrays(GL_TRIANGLES, 0, 36);
+        // the deferred path shades the G-buffer into the window in one full screen pass
+        if (useDeferred)
+        {
+            AllocationScope scope("deferred lighting");
+            shadingShader.use();
+            deferred->light(view, projection);
         }
+        glEndQuery(GL_TIME_ELAPSED);
 
-        // check events and swap buffers
+        // check events and swap buffers; what the window system and the driver allocate
+        // inside these is outside the frame we control
+        AllocationIgnoreScope present;
         glfwSwapBuffers(window);
         glfwPollEvents();
     }
+    delete gpuCulling;
+    delete shadowCulling;
+    delete shadows;
+    delete deferred;
+    glDeleteQueries(2, passQueries);
+    delete lighting;
+    model.release();
     glfwTerminate();
+
+    if (allocationTestFrames > 0)
+    {
+        unsigned int checkedFrames = frameIndex > ALLOCATION_WARMUP_FRAMES + 1 ? frameIndex - 1 - ALLOCATION_WARMUP_FRAMES : 0;
+        if (checkedFrames == 0)
+        {
+            std::cout << "ERROR::ALLOCATION::TEST_FAILED no frames ran after the " << ALLOCATION_WARMUP_FRAMES << " warmup frames" << std::endl;
+            return 1;
+        }
+        if (allocatingFrames > 0)
+        {
+            std::cout << "ERROR::ALLOCATION::TEST_FAILED " << allocatingFrames << " of " << checkedFrames << " frames after warmup allocated" << std::endl;
+            return 1;
+        }
+        std::cout << "Allocation test passed: no heap allocations in " << checkedFrames << " frames after warmup" << std::endl;
+    }
 	return 0;
 }
 
@@ -310,6 +1063,30 @@ void processInput(GLFWwindow* window) {
         camera.ProcessKeyboard(LEFT, deltaTime);
     if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
         camera.ProcessKeyboard(RIGHT, deltaTime);
+
+    bool gKeyDown = glfwGetKey(window, GLFW_KEY_G) == GLFW_PRESS;
+    if (gKeyDown && !gpuCullingKeyDown)
+    {
+        useGpuCulling = !useGpuCulling;
+        std::cout << (useGpuCulling ? "GPU culling" : "CPU culling") << std::endl;
+    }
+    gpuCullingKeyDown = gKeyDown;
+
+    bool mKeyDown = glfwGetKey(window, GLFW_KEY_M) == GLFW_PRESS;
+    if (mKeyDown && !meshletKeyDown)
+    {
+        useMeshlets = !useMeshlets;
+        std::cout << (useMeshlets ? "GPU culling draws meshlets" : "GPU culling draws whole objects") << std::endl;
+    }
+    meshletKeyDown = mKeyDown;
+
+    bool rKeyDown = glfwGetKey(window, GLFW_KEY_R) == GLFW_PRESS;
+    if (rKeyDown && !deferredKeyDown)
+    {
+        useDeferred = !useDeferred;
+        std::cout << (useDeferred ? "deferred shading" : "forward shading") << std::endl;
+    }
+    deferredKeyDown = rKeyDown;
 }
 
 void mouse_callback(GLFWwindow* window, double xposIn, double yposIn)
@@ -0,0 +1,127 @@
+#version 430 core
+// Meshlet culling: one workgroup per object the object pass (cullComputeShader.glsl) listed as
+// visible, its invocations striding over the meshlets of the level that pass picked. Meshlets
+// whose normal cone faces away from the camera, whose sphere is outside the frustum or whose
+// sphere is behind the previous frame's Hi-Z pyramid are dropped; every other one appends an
+// indirect draw of its triangles.
+layout (local_size_x = 64) in;
+
+struct DrawCommand
+{
+   uint count;
+   uint instanceCount;
+   uint firstIndex;
+   int baseVertex;
+   uint baseInstance;
+};
+
+struct Lod
+{
+   uint firstIndex;
+   uint indexCount;
+   uint firstMeshlet;
+   uint meshletCount;
+   float error;
+   float padding;
+};
+
+// object space sphere (centre, radius) and normal cone (axis, cutoff) of a meshlet, and its
+// triangles as a range of the element buffer
+struct Meshlet
+{
+   vec4 sphere;
+   vec4 cone;
+   uint firstTriangle;
+   uint triangleCount;
+   uint padding0;
+   uint padding1;
+};
+
+layout (std430, binding = 0) readonly buffer Transforms { vec4 transformRows[]; };
+layout (std430, binding = 2) writeonly buffer Commands { DrawCommand commands[]; };
+layout (std430, binding = 3) readonly buffer Lods { Lod lods[]; };
+layout (std430, binding = 4) readonly buffer ObjectLods { uint objectLods[]; };
+layout (std430, binding = 5) readonly buffer VisibleObjects
+{
+   uint groupCountX;
+   uint groupCountY;
+   uint groupCountZ;
+   uint visibleObjects[];
+};
+layout (std430, binding = 6) readonly buffer Meshlets { Meshlet meshlets[]; };
+layout (binding = 0, offset = 0) uniform atomic_uint drawCount;
+
+uniform vec4 cameraPosition;
+uniform vec4 frustumPlanes[6];
+uniform mat4 viewProjection;
+
+// farthest depth pyramid of the previous frame
+uniform sampler2D hiZ;
+uniform bool useHiZ;
+uniform vec2 hiZSize;
+uniform int hiZLevels;
+
+// same test as the object pass
+bool occluded(vec3 center, float radius)
+{
+   vec2 screenMin = vec2(1.0), screenMax = vec2(0.0);
+   float nearest = 1.0;
+   for (int corner = 0; corner < 8; corner++)
+   {
+      vec3 offset = vec3((corner & 1) != 0 ? radius : -radius, (corner & 2) != 0 ? radius : -radius, (corner & 4) != 0 ? radius : -radius);
+      vec4 clip = viewProjection * vec4(center + offset, 1.0);
+      if (clip.w <= 1e-5)
+         return false;
+      vec3 ndc = clip.xyz / clip.w;
+      vec2 uv = ndc.xy * 0.5 + 0.5;
+      screenMin = min(screenMin, uv);
+      screenMax = max(screenMax, uv);
+      nearest = min(nearest, ndc.z * 0.5 + 0.5);
+   }
+   screenMin = clamp(screenMin, vec2(0.0), vec2(1.0));
+   screenMax = clamp(screenMax, vec2(0.0), vec2(1.0));
+
+   vec2 extent = (screenMax - screenMin) * hiZSize;
+   int level = clamp(int(ceil(log2(max(max(extent.x, extent.y), 1.0)))), 0, hiZLevels - 1);
+   float farthest = max(max(textureLod(hiZ, screenMin, level).r, textureLod(hiZ, vec2(screenMax.x, screenMin.y), level).r),
+                        max(textureLod(hiZ, vec2(screenMin.x, screenMax.y), level).r, textureLod(hiZ, screenMax, level).r));
+   return nearest > farthest;
+}
+
+void main()
+{
+   uint object = visibleObjects[gl_WorkGroupID.x];
+   Lod lod = lods[objectLods[object]];
+
+   vec4 row0 = transformRows[object * 3], row1 = transformRows[object * 3 + 1], row2 = transformRows[object * 3 + 2];
+   vec3 column0 = vec3(row0.x, row1.x, row2.x), column1 = vec3(row0.y, row1.y, row2.y), column2 = vec3(row0.z, row1.z, row2.z);
+   float scale = sqrt(max(max(dot(column0, column0), dot(column1, column1)), dot(column2, column2)));
+   // the cones are tested in the object's own space; an affine map keeps every point on the
+   // same side of every plane, so facing away there is facing away in the world
+   mat3 linear = transpose(mat3(row0.xyz, row1.xyz, row2.xyz));
+   vec3 camera = inverse(linear) * (cameraPosition.xyz - vec3(row0.w, row1.w, row2.w));
+
+   for (uint i = gl_LocalInvocationID.x; i < lod.meshletCount; i += gl_WorkGroupSize.x)
+   {
+      Meshlet meshlet = meshlets[lod.firstMeshlet + i];
+      vec3 toCenter = meshlet.sphere.xyz - camera;
+      if (dot(toCenter, meshlet.cone.xyz) > meshlet.cone.w * length(toCenter) + meshlet.sphere.w)
+         continue;
+
+      vec4 local = vec4(meshlet.sphere.xyz, 1.0);
+      vec3 center = vec3(dot(row0, local), dot(row1, local), dot(row2, local));
+      float radius = meshlet.sphere.w * scale;
+      bool outside = false;
+      for (int plane = 0; plane < 6; plane++)
+         outside = outside || dot(frustumPlanes[plane].xyz, center) + frustumPlanes[plane].w < -radius;
+      if (outside || (useHiZ && occluded(center, radius)))
+         continue;
+
+      uint slot = atomicCounterIncrement(drawCount);
+      commands[slot].count = meshlet.triangleCount * 3u;
+      commands[slot].instanceCount = 1u;
+      commands[slot].firstIndex = meshlet.firstTriangle * 3u;
+      commands[slot].baseVertex = 0;
+      commands[slot].baseInstance = object;
+   }
+}
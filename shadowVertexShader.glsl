@@ -0,0 +1,17 @@
+#version 330 core
+// depth only pass into a shadow cascade (CascadedShadowMaps.h). The inputs sit at the same
+// locations as in vertexShader.glsl, so the scene's vertex arrays feed this program as well.
+layout (location = 0) in vec3 aPos;
+// per-instance transform: the top three rows of the model matrix
+layout (location = 3) in vec4 aModelRow0;
+layout (location = 4) in vec4 aModelRow1;
+layout (location = 5) in vec4 aModelRow2;
+
+uniform mat4 lightViewProjection;
+
+void main()
+{
+   vec4 localPos = vec4(aPos, 1.0);
+   vec3 worldPos = vec3(dot(aModelRow0, localPos), dot(aModelRow1, localPos), dot(aModelRow2, localPos));
+   gl_Position = lightViewProjection * vec4(worldPos, 1.0);
+}
@@ -0,0 +1,31 @@
+#version 450 core
+// SPIR-V build of vertexShader.glsl; compiled offline to vertexShader.spv.
+// SPIR-V has no uniform names, so every interface needs an explicit location.
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 aTexCoord;
+layout (location = 2) in vec3 aNormal;
+// per-instance transform: the top three rows of the model matrix
+layout (location = 3) in vec4 aModelRow0;
+layout (location = 4) in vec4 aModelRow1;
+layout (location = 5) in vec4 aModelRow2;
+layout (location = 0) out vec2 TexCoord;
+layout (location = 1) out vec3 WorldPos;
+layout (location = 2) out vec3 Normal;
+// distance in front of the camera, which picks the light cluster's depth slice
+layout (location = 3) out float ViewDepth;
+
+layout (location = 1) uniform mat4 view;
+layout (location = 2) uniform mat4 projection;
+
+void main()
+{
+   vec4 localPos = vec4(aPos.x, aPos.y, aPos.z, 1.0);
+   vec3 worldPos = vec3(dot(aModelRow0, localPos), dot(aModelRow1, localPos), dot(aModelRow2, localPos));
+   vec4 viewPos = view * vec4(worldPos, 1.0);
+   gl_Position = projection * viewPos;
+   TexCoord = aTexCoord;
+   WorldPos = worldPos;
+   // the instances are only rotated and uniformly scaled, so the rows carry normals as well
+   Normal = vec3(dot(aModelRow0.xyz, aNormal), dot(aModelRow1.xyz, aNormal), dot(aModelRow2.xyz, aNormal));
+   ViewDepth = -viewPos.z;
+}